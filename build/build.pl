@@ -59,9 +59,17 @@ $::datadir  = "../data";
 $::hbfile   = "$::datadir/hbmatrices.dat";
 $::hbstem   = "$::datadir/hbmatrices_%s.dat";
 $::hmatprog = "../bin/hydrogen_matrices";
+$::cachedir = "$::datadir/structcache";
+$::storedir = "$::datadir/contribstore";
+
+# The other kinds of matrices, built in the same pass over the
+# structures: files are <base>_<version>.dat linked from <base>.dat
+%::others   = ("scmc"      => "$::datadir/hbmatricesSCMC",
+               "ndonor"    => "$::datadir/hbmatricesN",
+               "oacceptor" => "$::datadir/hbmatricesO");
 
 #*************************************************************************
-my($version, $cversion, $matfile);
+my($version, $cversion, $matfile, $kind);
 
 $version = GetCATHVersion($::cathfile);
 $cversion = GetHBVersion($::hbfile);
@@ -74,6 +82,11 @@ else
 {
     $matfile = BuildMatrixFile($::cathfile, $version, $::hbstem);
     InstallFile($matfile, $::hbfile);
+    foreach $kind (keys %::others)
+    {
+        InstallFile("$::others{$kind}_$version.dat",
+                    "$::others{$kind}.dat");
+    }
 }
 
 #*************************************************************************
@@ -88,10 +101,15 @@ sub InstallFile
 sub BuildMatrixFile
 {
     my($cathfile, $version, $hbstem) = @_;
-    my($hbfile, $log);
+    my($hbfile, $log, $kind, $extra);
 
     $hbfile = sprintf($hbstem, $version);
-    system("$::hmatprog $cathfile $hbfile");
+    $extra  = "";
+    foreach $kind (keys %::others)
+    {
+        $extra .= " -a $kind $::others{$kind}_$version.dat";
+    }
+    system("$::hmatprog -c $::cachedir -s $::storedir$extra $cathfile $hbfile");
 
     return($hbfile);
 }
@@ -59,6 +59,8 @@ $::datadir  = "../data";
 $::hbfile   = "$::datadir/hbmatricesS35_O.dat";
 $::hbstem   = "$::datadir/hbmatricesS35_O_%s.dat";
 $::hmatprog = "../bin/hydrogen_matrices_Oacceptor";
+$::cachedir = "$::datadir/structcache";
+$::storedir = "$::datadir/contribstore";
 
 #*************************************************************************
 my($version, $cversion, $matfile);
@@ -91,7 +93,7 @@ sub BuildMatrixFile
     my($hbfile, $log);
 
     $hbfile = sprintf($hbstem, $version);
-    system("$::hmatprog $cathfile $hbfile");
+    system("$::hmatprog -c $::cachedir -s $::storedir $cathfile $hbfile");
 
     return($hbfile);
 }
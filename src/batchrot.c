@@ -0,0 +1,302 @@
+/*************************************************************************
+
+   Program:    checkhbond
+   File:       batchrot.c
+
+   Version:    V1.0
+   Date:       17.10.26
+   Function:   Rotate and re-grid the occupied cells of a partner grid
+               in bulk
+
+**************************************************************************
+
+   Description:
+   ============
+   Matching a partner grid against a key grid rotates every occupied
+   partner cell by the rotation matrix, adds the CA-CA vector and
+   converts the result back to a grid cell (OrientateMatrix() and
+   COORD_2_GRID in checkhbond.c). Here the cells are held as separate
+   x, y and z arrays and processed 4 (AVX) or 2 (SSE2) at a time.
+
+   The vector code does the same multiplications and additions in the
+   same order as blMatMult3_33() followed by OrientateMatrix(), and
+   truncates in the same way as COORD_2_GRID, so the cells found are
+   identical to those of the one-at-a-time code. When built without
+   SSE2 or AVX (see SIMDOPTS in the Makefile), or if REAL is not double,
+   each cell is rotated with blMatMult3_33().
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/matrix.h"
+#include "hbondmat2.h"
+#include "sparsegrid.h"
+#include "batchrot.h"
+
+#if defined(__AVX__) || defined(__SSE2__)
+#  include <immintrin.h>
+#endif
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define BATCHBLOCK 1024    /* Growth step for the cell arrays           */
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL GrowCellBatch(CELLBATCH *batch);
+static void RotateCellsScalar(CELLBATCH *batch, int start,
+                              REAL matrix[3][3], VEC3F translation);
+#if defined(__AVX__) || defined(__SSE2__)
+static void RotateCellsVector(CELLBATCH *batch, int start, int stop,
+                              REAL matrix[3][3], VEC3F translation);
+#endif
+
+/************************************************************************/
+CELLBATCH *CreateCellBatch(void)
+{
+   CELLBATCH *batch;
+
+   if((batch = (CELLBATCH *)malloc(sizeof(CELLBATCH)))==NULL)
+      return(NULL);
+
+   batch->cells    = NULL;
+   batch->x        = batch->y  = batch->z  = NULL;
+   batch->gx       = batch->gy = batch->gz = NULL;
+   batch->ncells   = 0;
+   batch->maxcells = 0;
+
+   return(batch);
+}
+
+/************************************************************************/
+void FreeCellBatch(CELLBATCH *batch)
+{
+   if(batch == NULL)
+      return;
+
+   if(batch->cells != NULL) free(batch->cells);
+   if(batch->x     != NULL) free(batch->x);
+   if(batch->y     != NULL) free(batch->y);
+   if(batch->z     != NULL) free(batch->z);
+   if(batch->gx    != NULL) free(batch->gx);
+   if(batch->gy    != NULL) free(batch->gy);
+   if(batch->gz    != NULL) free(batch->gz);
+   free(batch);
+}
+
+/************************************************************************/
+/* Fills the batch with the cells of a grid which have a non-zero count,
+   converting their grid positions to coordinates. Returns FALSE if
+   memory runs out.
+*/
+BOOL FillCellBatch(CELLBATCH *batch, SPARSEGRID *grid)
+{
+   int      i, n = 0;
+   GRIDCELL *c;
+
+   while(batch->maxcells < grid->ncells)
+   {
+      if(!GrowCellBatch(batch))
+         return(FALSE);
+   }
+
+   for(i=0, c=grid->cells; i<grid->ncells; i++, c++)
+   {
+      if(c->count > 0)
+      {
+         batch->cells[n] = c;
+         GRID_2_COORD(c->x, batch->x[n]);
+         GRID_2_COORD(c->y, batch->y[n]);
+         GRID_2_COORD(c->z, batch->z[n]);
+         n++;
+      }
+   }
+   batch->ncells = n;
+
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Rotates the coordinates in the batch by 'matrix', adds 'translation'
+   and sets the grid cells of the results. Grid cells may lie outside
+   the grid and must be checked with VALIDGRIDCOORDS.
+*/
+void RotateCellBatch(CELLBATCH *batch, REAL matrix[3][3], VEC3F translation)
+{
+   int start = 0;
+
+#if defined(__AVX__) || defined(__SSE2__)
+   if(sizeof(REAL) == sizeof(double))
+   {
+#  ifdef __AVX__
+      start = batch->ncells - (batch->ncells % 4);
+#  else
+      start = batch->ncells - (batch->ncells % 2);
+#  endif
+      RotateCellsVector(batch, 0, start, matrix, translation);
+   }
+#endif
+
+   RotateCellsScalar(batch, start, matrix, translation);
+}
+
+/************************************************************************/
+/* One cell at a time from 'start' to the end of the batch              */
+static void RotateCellsScalar(CELLBATCH *batch, int start,
+                              REAL matrix[3][3], VEC3F translation)
+{
+   int   i;
+   VEC3F coord, rotated;
+
+   for(i=start; i<batch->ncells; i++)
+   {
+      coord.x = batch->x[i];
+      coord.y = batch->y[i];
+      coord.z = batch->z[i];
+
+      blMatMult3_33(coord, matrix, &rotated);
+
+      rotated.x += translation.x;
+      rotated.y += translation.y;
+      rotated.z += translation.z;
+
+      batch->x[i] = rotated.x;
+      batch->y[i] = rotated.y;
+      batch->z[i] = rotated.z;
+
+      COORD_2_GRID(batch->gx[i], rotated.x);
+      COORD_2_GRID(batch->gy[i], rotated.y);
+      COORD_2_GRID(batch->gz[i], rotated.z);
+   }
+}
+
+#if defined(__AVX__) || defined(__SSE2__)
+/************************************************************************/
+/* Cells from 'start' to 'stop' (a multiple of the vector width). Each
+   output coordinate is x*m[0][j] + y*m[1][j] + z*m[2][j] + t[j], added
+   left to right as in blMatMult3_33() and OrientateMatrix()
+*/
+static void RotateCellsVector(CELLBATCH *batch, int start, int stop,
+                              REAL matrix[3][3], VEC3F translation)
+{
+   double *x  = (double *)batch->x,
+          *y  = (double *)batch->y,
+          *z  = (double *)batch->z,
+          t[3];
+   int    i, j,
+          *g[3];
+
+   t[0] = translation.x;
+   t[1] = translation.y;
+   t[2] = translation.z;
+   g[0] = batch->gx;
+   g[1] = batch->gy;
+   g[2] = batch->gz;
+
+#  ifdef __AVX__
+   for(i=start; i<stop; i+=4)
+   {
+      __m256d vx  = _mm256_loadu_pd(x+i),
+              vy  = _mm256_loadu_pd(y+i),
+              vz  = _mm256_loadu_pd(z+i),
+              div = _mm256_set1_pd((double)DIV),
+              out[3];
+      __m128i off = _mm_set1_epi32(OFFSET);
+
+      for(j=0; j<3; j++)
+      {
+         out[j] = _mm256_add_pd(
+                     _mm256_add_pd(
+                        _mm256_add_pd(
+                           _mm256_mul_pd(vx, _mm256_set1_pd(matrix[0][j])),
+                           _mm256_mul_pd(vy, _mm256_set1_pd(matrix[1][j]))),
+                        _mm256_mul_pd(vz, _mm256_set1_pd(matrix[2][j]))),
+                     _mm256_set1_pd(t[j]));
+         _mm_storeu_si128((__m128i *)(g[j]+i),
+                          _mm_add_epi32(
+                             _mm256_cvttpd_epi32(_mm256_div_pd(out[j], div)),
+                             off));
+      }
+      _mm256_storeu_pd(x+i, out[0]);
+      _mm256_storeu_pd(y+i, out[1]);
+      _mm256_storeu_pd(z+i, out[2]);
+   }
+#  else
+   for(i=start; i<stop; i+=2)
+   {
+      __m128d vx  = _mm_loadu_pd(x+i),
+              vy  = _mm_loadu_pd(y+i),
+              vz  = _mm_loadu_pd(z+i),
+              div = _mm_set1_pd((double)DIV),
+              out[3];
+      int     cell[4];
+
+      for(j=0; j<3; j++)
+      {
+         out[j] = _mm_add_pd(
+                     _mm_add_pd(
+                        _mm_add_pd(
+                           _mm_mul_pd(vx, _mm_set1_pd(matrix[0][j])),
+                           _mm_mul_pd(vy, _mm_set1_pd(matrix[1][j]))),
+                        _mm_mul_pd(vz, _mm_set1_pd(matrix[2][j]))),
+                     _mm_set1_pd(t[j]));
+         _mm_storeu_si128((__m128i *)cell,
+                          _mm_cvttpd_epi32(_mm_div_pd(out[j], div)));
+         g[j][i]   = cell[0] + OFFSET;
+         g[j][i+1] = cell[1] + OFFSET;
+      }
+      _mm_storeu_pd(x+i, out[0]);
+      _mm_storeu_pd(y+i, out[1]);
+      _mm_storeu_pd(z+i, out[2]);
+   }
+#  endif
+}
+#endif
+
+/************************************************************************/
+static BOOL GrowCellBatch(CELLBATCH *batch)
+{
+   int  max = batch->maxcells + BATCHBLOCK;
+   void *p;
+
+   if((p = realloc(batch->cells, max * sizeof(GRIDCELL *)))==NULL)
+      return(FALSE);
+   batch->cells = (GRIDCELL **)p;
+
+   if((p = realloc(batch->x, max * sizeof(REAL)))==NULL)
+      return(FALSE);
+   batch->x = (REAL *)p;
+   if((p = realloc(batch->y, max * sizeof(REAL)))==NULL)
+      return(FALSE);
+   batch->y = (REAL *)p;
+   if((p = realloc(batch->z, max * sizeof(REAL)))==NULL)
+      return(FALSE);
+   batch->z = (REAL *)p;
+
+   if((p = realloc(batch->gx, max * sizeof(int)))==NULL)
+      return(FALSE);
+   batch->gx = (int *)p;
+   if((p = realloc(batch->gy, max * sizeof(int)))==NULL)
+      return(FALSE);
+   batch->gy = (int *)p;
+   if((p = realloc(batch->gz, max * sizeof(int)))==NULL)
+      return(FALSE);
+   batch->gz = (int *)p;
+
+   batch->maxcells = max;
+   return(TRUE);
+}
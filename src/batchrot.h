@@ -0,0 +1,22 @@
+#ifndef BATCHROT_H
+#define BATCHROT_H
+
+/* The occupied cells of a grid laid out as separate coordinate arrays
+   so that they can be rotated and re-gridded together (batchrot.c)
+*/
+typedef struct
+{
+   GRIDCELL **cells;          /* The grid cells in the batch           */
+   REAL     *x, *y, *z;       /* Their coordinates, rotated in place   */
+   int      *gx, *gy, *gz;    /* Grid cells of the rotated coordinates */
+   int      ncells,
+            maxcells;
+}  CELLBATCH;
+
+CELLBATCH *CreateCellBatch(void);
+void      FreeCellBatch(CELLBATCH *batch);
+BOOL      FillCellBatch(CELLBATCH *batch, SPARSEGRID *grid);
+void      RotateCellBatch(CELLBATCH *batch, REAL matrix[3][3],
+                          VEC3F translation);
+
+#endif
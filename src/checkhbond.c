@@ -3,8 +3,8 @@
    Program:    checkhbond
    File:       checkhbond.c
    
-   Version:    V2.0
-   Date:       24.01.06
+   Version:    V2.19
+   Date:       17.10.26
    Function:   Generate matrices of hydrogen bond information for use
                by checkhbond
    
@@ -73,6 +73,52 @@
    V2.1  25.03.11 Corrected usage message. Consistent error message 
                   printing. Checks returns from OrientateXXX() routines
                   to deal correctly with missing atoms.
+   V2.2  17.10.26 Matrix files may be compiled binary files (see
+                  matfile.c) which are memory-mapped rather than parsed
+   V2.3  17.10.26 Grids are held as sparse occupied-cell lists (see
+                  sparsegrid.c) so matching and culling scale with the
+                  number of occupied cells rather than the grid volume
+   V2.4  17.10.26 Grid totals are maintained as cells are set and the
+                  -log(p) terms of the pseudoenergy are tabulated per
+                  cell once per query rather than per match
+   V2.5  17.10.26 Off-grid matching probes a grid of the best key cell
+                  energy within the cutoff (built once per query)
+                  rather than scanning the neighbouring cells
+   V2.6  17.10.26 Partner cells are rotated in bulk (see batchrot.c)
+   V2.7  17.10.26 The matching code is now in hbengine.c (also built as
+                  libcheckhbond) with its state held in an HBCONTEXT
+                  and results returned in an HBRESULT; this file is
+                  the command line program
+   V2.8  17.10.26 Added batch mode (-b) which runs a list of queries
+                  with the matrices loaded once and each PDB file read
+                  once for all its queries
+   V2.9  17.10.26 Added saturation mode (-s) which tries every residue
+                  type in the matrix file at residue 2 with the pair
+                  orientated once
+   V2.10 17.10.26 Added scan mode (-a) which finds the H-bonded pairs
+                  in a structure (see hbscan.c) and tries every residue
+                  type at the partner of each
+   V2.11 17.10.26 Batch and scan modes run on a pool of threads (-t),
+                  each with its own HBCONTEXT (see threadpool.c)
+   V2.12 17.10.26 Added combined mode (-M) which runs a pair as SC/SC,
+                  SC/MC-donor and SC/MC-acceptor in one run
+   V2.13 17.10.26 Combined mode no longer copies the residues for each
+                  kind as the engine does not move them
+   V2.14 17.10.26 PDB files (and batch lists) may be gzip-compressed
+                  (gzfile.c)
+   V2.15 17.10.26 Batch mode closes its files and writes the header
+                  when there are no queries
+   V2.16 17.10.26 Corrected the version in the header and usage
+                  message
+   V2.17 17.10.26 A residue not in the PDB file is reported rather
+                  than crashing (batch mode gives an error line)
+   V2.18 17.10.26 Scan mode closes its output file and writes the
+                  header when there are no sites or the PDB file can't
+                  be read
+   V2.19 17.10.26 Scan sites come from FindScanPairs() in hbscan.c and
+                  the kind table and FormatResSpec() from hbengine, shared
+                  with checkhbond_server. Hydrogens are added in a serial
+                  section as the server does
 
 *************************************************************************/
 /* Includes
@@ -91,6 +137,13 @@
 #include "residues.h"
 #include "orientate.h"
 #include "hbondmat2.h"
+#include "matfile.h"
+#include "sparsegrid.h"
+#include "batchrot.h"
+#include "hbengine.h"
+#include "hbscan.h"
+#include "threadpool.h"
+#include "gzfile.h"
 
 /************************************************************************/
 /* Defines and macros
@@ -99,161 +152,225 @@
 #define MATRIXFILE            "/acrm/home/alison/hydrogen_bonding/matrices_05new.txt"
 #define MATRIXFILE_MCDONOR    "/acrm/home/alison/hydrogen_bonding/matrices_05new.txt"
 #define MATRIXFILE_MCACCEPTOR "/acrm/home/alison/hydrogen_bonding/matrices_05new.txt"
-/* radius of atom */
-#define RAD 25
-/* calculates distance in angstroms between atoms */
-#define DISTSQ_HATOMS(a,b) (a.x - b.x) * (a.x - b.x) + \
-                       (a.y - b.y) * (a.y - b.y) + \
-                       (a.z - b.z) * (a.z - b.z)
-/* Error codes for GetResidues() */
-#define ERR_NOMEM      0
-#define ERR_NOPREVRES1 1
-#define ERR_NOPREVRES2 2
-
-/* Matrix reading styles for ReadInMatrices */
-#define MAT_READ_DONOR1    1
-#define MAT_READ_DONOR2    2
-#define MAT_READ_ACCEPTOR1 4
-#define MAT_READ_ACCEPTOR2 8
-#define MAT_READ_BOTH      9 /* DONOR1 and ACCEPTOR2 */
-#define MAT_RES_1          1
-#define MAT_RES_2          2
-#define MAT_RES_BOTH       3
-
-/* Atom sets for CreateRotationMatrix */
-#define ATOMS_NCAC   1
-#define ATOMS_CNCA   2
-#define ATOMS_CACO   3
-#define ATOMS_NCACB  4
-
-/* Returns from CalculateHBondEnergy() */
-#define CHBE_OK      0
-#define CHBE_NOHB    1
-#define CHBE_ERROR   2
-
-/* for debugging purposes */
-
-/*
-#define DEBUG
-#define DEBUG2
-#define DEBUG3
-*/
+
+/* message when no H-bond is found and kind of pair for hbengine.c */
+#ifdef MCDONOR
+#  define NOHBONDS "No hydrogen bonds (SC/MC-donor)\n"
+#  define HBKIND   HB_MCDONOR
+#elif  MCACCEPTOR
+#  define NOHBONDS "No hydrogen bonds (SC/MC-acceptor)\n"
+#  define HBKIND   HB_MCACCEPTOR
+#else
+#  define NOHBONDS "No hydrogen bonds (SC/SC)\n"
+#  define HBKIND   HB_SCSC
+#endif
+
+/* Outcome of a batch query                                             */
+#define BATCH_ERROR    0
+#define BATCH_NOHBOND  1
+#define BATCH_VALID    2
+#define BATCH_ENERGY   3
 
 /************************************************************************/
-/* Globals
+/* Structure definitions
 */
-/* matrices that store all acceptor and donor atoms */
-int gDonate[MAXSIZE][MAXSIZE][MAXSIZE];
-int gAccept[MAXSIZE][MAXSIZE][MAXSIZE];
-/* matrix storing partner atoms to hydrogen accepting atoms */
-int gPartnertoAccept[MAXSIZE][MAXSIZE][MAXSIZE];
-int gPartnertoDonate[MAXSIZE][MAXSIZE][MAXSIZE];
-/* rotation matrix */
-REAL gRotation_matrix[3][3];
-#if defined(DEBUG1) || defined(DEBUG2)
-char gChain = 'Z';
-#endif
-   
+/* A query read in batch mode (-b) and its outcome. In combined mode
+   (-M) there is an outcome for each kind of pair
+*/
+typedef struct batchquery
+{
+   char    pdbfile[MAXBUFF],
+           locres1[16],
+           locres2[16];
+   HBQUERY query;
+   REAL    cutoff,
+           energy,
+           kindEnergy[HB_NKINDS];
+   int     index,
+           status,
+           kindStatus[HB_NKINDS];
+   struct batchquery *next;
+}  BATCHQUERY;
+
+/* A site of a scan (-a): residue 2 of a pair, with the results of
+   each residue type tried there
+*/
+typedef struct
+{
+   HBQUERY query;
+   char    locres1[16],
+           locres2[16];
+   BOOL    OK,
+           valid[HB_MAXTYPES];
+   REAL    energy[HB_MAXTYPES];
+}  SCANSITE;
+
+/* A batch run shared by its threads, and the state of each thread: its
+   grids and the last PDB file it read
+*/
+typedef struct
+{
+   MATFILE      *matrix,
+                *matrix2;
+   KINDMATRICES *kinds;      /* NULL unless in combined mode          */
+   BATCHQUERY   **order;
+   FILE         *out;
+}  BATCHRUN;
+
+typedef struct
+{
+   HBCONTEXT *ctx;
+   PDB       *pdb;
+   char      pdbfile[MAXBUFF];
+   BOOL      loaded;
+}  BATCHWORKER;
+
+/* A scan run shared by its threads                                     */
+typedef struct
+{
+   PDB      *pdb;
+   MATFILE  *matrix,
+            *matrix2;
+   SCANSITE *sites;
+   char     (*types)[8];
+   int      ntypes;
+   FILE     *out;
+}  SCANRUN;
+
 /************************************************************************/
 /* Prototypes
 */
 int main (int argc, char *argv[]);
 void Usage(void);
-BOOL ReadInMatrices(char *res1, char *res2, FILE *matrix, int type, int whichres);
-void CullArrays(PDB *pdb, PDB *res1, PDB *res2,
-                int donate_array[MAXSIZE][MAXSIZE][MAXSIZE],
-                int accept_array[MAXSIZE][MAXSIZE][MAXSIZE]);
-void CalculateCaToCaVector(PDB *res1_start, PDB *res1_stop,
-                           PDB *res2_start, PDB *res2_stop,
-                           VEC3F *CAtoCAVector);
-PDB *FindAtom(PDB *start, PDB *stop, char *atnam, VEC3F *c_alpha);
-BOOL CreateRotationMatrix(PDB *pdb, PDB *res1_start,
-                          PDB *res1_stop, PDB *res2_start,
-                          PDB *res2_stop, VEC3F CAtoCAVector, int atomset1, int atomset2, PDB *prevres1);
-BOOL CheckValidHBond(VEC3F CAtoCAVector, REAL cutoff,
-                     FILE *out,
-                     int keyarray[MAXSIZE][MAXSIZE][MAXSIZE],
-                     int partnerarray[MAXSIZE][MAXSIZE][MAXSIZE]);
-void ClearArrays();
 BOOL ParseCmdLine(int argc, char **argv, REAL *cutoff,
                   BOOL *hbplus, char *hatom1,
                   char *hatom2, char *matrix_file, char *matrix_file2, char *pdbfile,
                   char *locres1, char *locres2, char *res2,
-                  char *outputfile);
-int CalculateHBondEnergy(PDB *pdb, PDB *res1_start, PDB *res1_stop,
-                         PDB *res2_start, PDB *res2_stop, VEC3F CAtoCAVector,
-                         REAL cutoff,
-                         char *hatom1, char *hatom2, FILE *out);
-void OrientateMatrix(VEC3F CAtoCAVector,int x, int y, int z,
-                     VEC3F *rotated_coord);
-int CalculateTotalCounts(int array[MAXSIZE][MAXSIZE][MAXSIZE]);
-REAL CalcEnergy(int count1, int totalcount1, int count2, int totalcount2);
-REAL Distance_squared (int i, int j, int k, int x_coord, int y_coord,
-                       int z_coord);
-REAL DoCheckHBond(int x, int y, int z, VEC3F CAtoCAVector, VEC3F *partner_coord,
-                  int totalcount1, int totalcount2,
-                  int keyarray[MAXSIZE][MAXSIZE][MAXSIZE],
-                  int partnerarray[MAXSIZE][MAXSIZE][MAXSIZE],
-                  REAL cutoff, FILE *out);
-FILE *OpenMatrixFile(char *matrix_file, char *def_matrix_file);
+                  char *outputfile, char *batchfile, BOOL *saturate,
+                  BOOL *scan, int *nthreads, BOOL *combined,
+                  char *scmc_file, char *ndonor_file,
+                  char *oacceptor_file);
+MATFILE *OpenMatrixFile(char *matrix_file, char *def_matrix_file);
 BOOL Open_Std_Files(char *infile, char *outfile, FILE **in, FILE **out);
-BOOL PrepareHBondingPair(int resnum1, int resnum2, PDB *pdb, FILE *matrix, char *chain1, 
-                         char *chain2, char *insert1, char *insert2, BOOL *hbplus,
-                         char *hatom1, char *hatom2, REAL cutoff, char *res1, char *res2,
-                         FILE *OUT);
-PDB *GetResidues(PDB *pdb, char *chain1, int resnum1, char *insert1, 
-                 char *chain2, int resnum2, char *insert2, int *errorcode);
-void FindRes1Type(PDB *pdb, char *chain, int resnum, char *insert, char *res);
-BOOL AnalyzeMCDonorPair(int resnum1, int resnum2, PDB *pdb, FILE *matrix, FILE *matrix2,
-                        char *chain1, 
-                        char *chain2, char *insert1, char *insert2, BOOL *hbplus,
-                        char *hatom1, char *hatom2, REAL cutoff, char *res1, char *res2,
-                        FILE *OUT);
-void CalculateNToCaVector(PDB *res1_start, PDB *res1_stop,
-                          PDB *res2_start, PDB *res2_stop, VEC3F *NtoCAVector);
-BOOL AnalyzeMCAcceptorPair(int resnum1, int resnum2, PDB *pdb, FILE *matrix, FILE *matrix2,
-                           char *chain1, 
-                           char *chain2, char *insert1, char *insert2, BOOL *hbplus,
-                           char *hatom1, char *hatom2, REAL cutoff, char *res1, char *res2,
-                           FILE *OUT);
-void CalculateCToCaVector(PDB *res1_start, PDB *res1_stop,
-                          PDB *res2_start, PDB *res2_stop, VEC3F *CtoCAVector);
-PDB *SwapCarbon(PDB *pdb, PDB *prev);
+void PrintResult(FILE *out, HBRESULT *result);
+BOOL RunQuery(HBCONTEXT *ctx, PDB *pdb, MATFILE *matrix, MATFILE *matrix2,
+              HBQUERY *query, HBRESULT *result);
+BOOL RunBatch(HBCONTEXT *ctx, MATFILE *matrix, char *matrix_file2,
+              KINDMATRICES *kinds, HBQUERY *options, REAL cutoff,
+              char *batchfile, char *outputfile, int nthreads);
+void RunBatchTask(void *shared, void *worker, int item);
+void CloseBatchFiles(FILE *in, FILE *out);
+void EmitBatchResult(void *shared, int item);
+BATCHQUERY *ReadBatchQueries(FILE *in, HBQUERY *options, REAL cutoff,
+                             int *nqueries);
+PDB *ReadBatchPDB(char *pdbfile);
+void RunBatchQuery(HBCONTEXT *ctx, PDB *pdb, MATFILE *matrix,
+                   MATFILE *matrix2, KINDMATRICES *kinds, BATCHQUERY *bq);
+int BatchStatus(HBRESULT *result, BOOL found, REAL *energy);
+char *BatchStatusName(int status);
+void BatchError(BATCHQUERY *bq, char *text);
+int CompareBatchQueries(const void *a, const void *b);
+void PrintBatchResult(FILE *out, BATCHQUERY *bq, BOOL combined);
+BOOL RunSaturation(HBCONTEXT *ctx, PDB *pdb, MATFILE *matrix,
+                   MATFILE *matrix2, HBQUERY *query, char *locres1,
+                   char *locres2, FILE *out);
+BOOL RunScan(HBCONTEXT *ctx, MATFILE *matrix, char *matrix_file2,
+             char *pdbfile, char *outputfile, int nthreads);
+void RunScanTask(void *shared, void *worker, int item);
+void EmitScanSite(void *shared, int item);
+HBCONTEXT **CreateThreadContexts(HBCONTEXT *ctx, int nthreads);
+void FreeThreadContexts(HBCONTEXT **contexts, int nthreads);
+SCANSITE *FindScanSites(PDB *pdb, int *nsites);
+void RunScanSite(HBCONTEXT *ctx, PDB *pdb, MATFILE *matrix,
+                 MATFILE *matrix2, SCANSITE *site, char types[][8],
+                 int ntypes);
+void PrintScanSite(FILE *out, SCANSITE *site, char types[][8],
+                   int ntypes);
+BOOL OpenKindMatrices(MATFILE *matrix, char *scmc_file,
+                      char *ndonor_file, char *oacceptor_file,
+                      KINDMATRICES *kinds);
+BOOL RunCombined(HBCONTEXT *ctx, PDB *pdb, KINDMATRICES *kinds,
+                 HBQUERY *query, FILE *out);
+int RunKindQuery(HBCONTEXT *ctx, PDB *residues, int kind,
+                 KINDMATRICES *km, HBQUERY *query, char *label,
+                 REAL *energy);
+char *KindName(int kind);
+BOOL IsHBondCapable(char *residue);
 
 
 /************************************************************************/
 int main (int argc, char *argv[])
 {
    FILE *PDBFILE = stdin,
-      *OUT = stdout,
-      *matrix = NULL;
+      *OUT = stdout;
+   MATFILE *matrix = NULL;
+   HBCONTEXT *ctx;
+   HBQUERY query;
+   HBRESULT result;
 
-   char locres1[6], locres2[6],res1[4], res2[6],
+   char locres1[6], locres2[6],
       pdbfile[MAXBUFF], outputfile[MAXBUFF];
-   char chain1[6], insert1[6], chain2[6], insert2[6], hatom1[6], hatom2[6];
    char matrix_file[MAXBUFF];
    char matrix_file2[MAXBUFF];
+   char batchfile[MAXBUFF];
+   char scmc_file[MAXBUFF], ndonor_file[MAXBUFF],
+      oacceptor_file[MAXBUFF];
+   KINDMATRICES kinds[HB_NKINDS],
+      *kindsp = NULL;
    PDB *pdb;
-   int natoms, resnum1, resnum2, errorcode;
+   int natoms, errorcode, nthreads;
    REAL cutoff;
-   BOOL hbplus = FALSE;
-
-#if defined(MCDONOR) || defined(MCACCEPTOR)
-   FILE *matrix2 = NULL;
-#endif
+   BOOL found, saturate, scan, combined;
+   MATFILE *matrix2 = NULL;
 
    
-   /* set array elements to 0 */
-   ClearArrays();
-   
-   if(ParseCmdLine(argc, argv,  &cutoff, &hbplus,  hatom1, hatom2,
-                   matrix_file, matrix_file2, pdbfile, locres1, locres2, res2, outputfile))
+   if(ParseCmdLine(argc, argv,  &cutoff, &query.hbplus,
+                   query.hatom1, query.hatom2, matrix_file, matrix_file2,
+                   pdbfile, locres1, locres2, query.res2, outputfile,
+                   batchfile, &saturate, &scan, &nthreads, &combined,
+                   scmc_file, ndonor_file, oacceptor_file))
    {
+      /* create the grids */
+      if((ctx = CreateHBContext(cutoff))==NULL)
+      {
+         PrintError(NULL, "No memory for matrix grids\n");
+         return(1);
+      }
+
       if((matrix = OpenMatrixFile(matrix_file, MATRIXFILE)))
       {
-         if(blParseResSpec(locres1, chain1, &resnum1, insert1))
+         /* 17.10.26 Combined mode: the matrices for every kind of pair */
+         if(combined)
+         {
+            if(!OpenKindMatrices(matrix, scmc_file, ndonor_file,
+                                 oacceptor_file, kinds))
+               return(1);
+            kindsp = kinds;
+         }
+         
+         /* 17.10.26 Batch mode                                         */
+         if(batchfile[0])
+         {
+            if(!RunBatch(ctx, matrix, matrix_file2, kindsp, &query,
+                         cutoff, batchfile, outputfile, nthreads))
+               return(1);
+            return(0);
+         }
+         
+         /* 17.10.26 Scan mode                                          */
+         if(scan)
+         {
+            if(!RunScan(ctx, matrix, matrix_file2, pdbfile, outputfile,
+                        nthreads))
+               return(1);
+            return(0);
+         }
+         
+         if(blParseResSpec(locres1, query.chain1, &query.resnum1,
+                           query.insert1))
          {
-            if(blParseResSpec(locres2, chain2, &resnum2, insert2))
+            if(blParseResSpec(locres2, query.chain2, &query.resnum2,
+                              query.insert2))
             {               
                if(Open_Std_Files(pdbfile, outputfile, &PDBFILE, &OUT))
                { 
@@ -271,9 +388,10 @@ int main (int argc, char *argv[])
                      }
 
                      /* ACRM 08.09.05 Get only the residues of interest */
-                     if((pdb = GetResidues(pdb, chain1, resnum1, insert1, 
-                                           chain2, resnum2, insert2,
-                                           &errorcode))==NULL)
+                     if((pdb2 = GetResidues(pdb, query.chain1, query.resnum1,
+                                            query.insert1, query.chain2,
+                                            query.resnum2, query.insert2,
+                                            &errorcode))==NULL)
                      {
                         if(errorcode == ERR_NOMEM)
                         {
@@ -284,7 +402,8 @@ int main (int argc, char *argv[])
                         {
                            char buffer[160];
                            sprintf(buffer,"No preceeding residue for residue %c%d%c\n",
-                                   chain1[0], resnum1, insert1[0]);
+                                   query.chain1[0], query.resnum1,
+                                   query.insert1[0]);
                            PrintError(OUT,buffer);
                            return(1);
                         }
@@ -292,7 +411,23 @@ int main (int argc, char *argv[])
                         {
                            char buffer[160];
                            sprintf(buffer,"No preceeding residue for residue %c%d%c\n",
-                                   chain2[0], resnum2, insert2[0]);
+                                   query.chain2[0], query.resnum2,
+                                   query.insert2[0]);
+                           PrintError(OUT,buffer);
+                           return(1);
+                        }
+                        else if((errorcode == ERR_NORES1) ||
+                                (errorcode == ERR_NORES2))
+                        {
+                           char buffer[160];
+                           if(errorcode == ERR_NORES1)
+                              sprintf(buffer,"Residue %c%d%c not found\n",
+                                      query.chain1[0], query.resnum1,
+                                      query.insert1[0]);
+                           else
+                              sprintf(buffer,"Residue %c%d%c not found\n",
+                                      query.chain2[0], query.resnum2,
+                                      query.insert2[0]);
                            PrintError(OUT,buffer);
                            return(1);
                         }
@@ -302,45 +437,44 @@ int main (int argc, char *argv[])
                            return(1);
                         }
                      }
-                     FindRes1Type(pdb, chain1, resnum1, insert1, res1);
+                     FREELIST(pdb, PDB);
+                     pdb = pdb2;
+                     FindRes1Type(pdb, query.chain1, query.resnum1,
+                                  query.insert1, query.res1);
 
-
-#ifdef MCDONOR
-                     if((matrix2 = OpenMatrixFile(matrix_file2, MATRIXFILE_MCDONOR)))
+                     /* 17.10.26 Combined mode                          */
+                     if(combined)
                      {
-                        if(!AnalyzeMCDonorPair(resnum1, resnum2, pdb, matrix, matrix2, chain1, chain2, 
-                                               insert1, insert2, &hbplus, hatom1, hatom2,
-                                               cutoff, res1, res2, OUT))
-                        {
-                           /* ACRM 13.09.11 Corrected message - not an error state! */
-                           PrintError(OUT, "No hydrogen bonds (SC/MC-donor)\n");
-                        }
+                        if(!RunCombined(ctx, pdb, kinds, &query, OUT))
+                           return(1);
+                        return(0);
                      }
-#elif  MCACCEPTOR
-                     if((matrix2 = OpenMatrixFile(matrix_file2, MATRIXFILE_MCACCEPTOR)))
+
+#if defined(MCDONOR)
+                     if((matrix2 = OpenMatrixFile(matrix_file2, MATRIXFILE_MCDONOR))==NULL)
+                        return(0);
+#elif defined(MCACCEPTOR)
+                     if((matrix2 = OpenMatrixFile(matrix_file2, MATRIXFILE_MCACCEPTOR))==NULL)
+                        return(0);
+#endif
+                     /* 17.10.26 Saturation mode                        */
+                     if(saturate)
                      {
-                        if(!AnalyzeMCAcceptorPair(resnum1, resnum2, pdb, matrix, matrix2, chain1, chain2, 
-                                                  insert1, insert2, &hbplus, hatom1, hatom2,
-                                                  cutoff, res1, res2, OUT))
-                        {
-                           /* ACRM 13.09.11 Corrected message - not an error state! */
-                           PrintError(OUT, "No hydrogen bonds (SC/MC-acceptor)\n");
-                        }
+                        if(!RunSaturation(ctx, pdb, matrix, matrix2,
+                                          &query, locres1, locres2, OUT))
+                           return(1);
+                        return(0);
                      }
-#else
-                     if(!PrepareHBondingPair(resnum1, resnum2, pdb, matrix, chain1, chain2, 
-                                             insert1, insert2, &hbplus, hatom1, hatom2,
-                                             cutoff, res1, res2, OUT))
+                     
+                     InitHBResult(&result);
+                     found = RunQuery(ctx, pdb, matrix, matrix2, &query,
+                                      &result);
+                     PrintResult(OUT, &result);
+                     if(!found)
                      {
-                        /* ACRM 08.09.05 Swap chain, inserts and hatom as well! */
-                        if(!PrepareHBondingPair(resnum2, resnum1, pdb, matrix, chain2, chain1, 
-                                                insert2, insert1, &hbplus, hatom2, hatom1,
-                                                cutoff, res2, res1, OUT))
-                        {
-                           PrintError(OUT, "No hydrogen bonds (SC/SC)\n");
-                        }
+                        /* ACRM 13.09.11 Corrected message - not an error state! */
+                        PrintError(OUT, NOHBONDS);
                      }
-#endif
                   }
                   else
                   {
@@ -379,724 +513,552 @@ int main (int argc, char *argv[])
    return(0);
 }
 
-
 /************************************************************************/
-BOOL PrepareHBondingPair(int resnum1, int resnum2, PDB *pdb, FILE *matrix,
-                         char *chain1, char *chain2, 
-                         char *insert1, char *insert2, BOOL *hbplus,
-                         char *hatom1, char *hatom2, REAL cutoff, 
-                         char *res1, char *res2, FILE *OUT)
+/* Prints the messages and outcome of a query as the matching code used
+   to print them before it was moved to hbengine.c
+*/
+void PrintResult(FILE *out, HBRESULT *result)
 {
-   VEC3F CAtoCAVector;
+   int i;
 
-   PDB *res1_start, *res1_stop, *res2_start, *res2_stop;
-   
-   for(res1_start = pdb; res1_start !=NULL;
-       res1_start=res1_stop)
+   for(i=0; i<result->nmessages; i++)
+      PrintError((result->toOutput[i] ? out : NULL), result->message[i]);
+
+   switch(result->status)
    {
-      res1_stop = blFindNextResidue(res1_start);
-                        
-      /* if *key* residue of choice */
-      if((resnum1 == res1_start->resnum)
-         && (chain1[0]==res1_start->chain[0])
-         && (insert1[0] == res1_start->insert[0]))
-      {
-         break;
-      }
+   case HB_VALID:
+      fprintf(out, "Pseudoenergy of best quality hydrogen bond: %.2f (valid)\n", 
+              result->energy);
+      break;
+   case HB_ENERGY:
+      fprintf(out, "Pseudoenergy of best quality hydrogen bond: %.2f\n",
+              result->energy);
+      break;
+   case HB_NOHBOND:
+      fprintf(out, "No hydrogen bonds\n");
+      break;
+   default:
+      break;
    }
-   if(res1_start==NULL)
-   {
-      PrintError(OUT, "Can't find residue 1  in PDB file\n");
+}
+
+/************************************************************************/
+/* Runs a query of the kind this program was built for. A side-chain
+   pair with no H-bond is tried the other way round; the messages from
+   both attempts are kept in the result
+*/
+BOOL RunQuery(HBCONTEXT *ctx, PDB *pdb, MATFILE *matrix, MATFILE *matrix2,
+              HBQUERY *query, HBRESULT *result)
+{
+   return(RunHBQuery(ctx, pdb, HBKIND, matrix, matrix2, query, result));
+}
+
+/************************************************************************/
+/* Batch mode. Each line of batchfile (- for stdin) is a query:
+      pdbfile residue1 residue2 nameres2 [cutoff]
+   The queries are grouped by PDB file so that each file is read once,
+   and one result line per query is written to outputfile in the order
+   of the input:
+      pdbfile residue1 residue2 nameres2 cutoff result energy
+   where result is valid, energy (-p), none or error and energy is - if
+   there is none. Messages go only to stderr. 'options' gives -p and
+   its atoms; 'cutoff' is used where a line has none.
+   17.10.26 The queries are run on nthreads threads. ctx is used by the
+   first and the others have their own.
+   17.10.26 If kinds is given (-M), each query is run as each kind of
+   pair and the output line has a result and energy for each:
+      pdbfile residue1 residue2 nameres2 cutoff scsc energy ndonor
+      energy oacceptor energy
+*/
+BOOL RunBatch(HBCONTEXT *ctx, MATFILE *matrix, char *matrix_file2,
+              KINDMATRICES *kinds, HBQUERY *options, REAL cutoff,
+              char *batchfile, char *outputfile, int nthreads)
+{
+   FILE        *in  = stdin,
+               *out = stdout;
+   MATFILE     *matrix2 = NULL;
+   BATCHQUERY  *queries, *bq,
+               **order;
+   BATCHRUN    run;
+   BATCHWORKER *workers  = NULL;
+   HBCONTEXT   **contexts = NULL;
+   void        **wdata   = NULL;
+   int         *rank     = NULL;
+   int         nqueries, i;
+   BOOL        ok = FALSE;
+
+#if defined(MCDONOR)
+   if((kinds == NULL) &&
+      (matrix2 = OpenMatrixFile(matrix_file2, MATRIXFILE_MCDONOR))==NULL)
+   {
+      PrintError(NULL, "Sorry, unable to open matrix file2\n");
       return(FALSE);
    }
-   
-   /*step though each residue in list
-     is it *partner* residue? */
-   for(res2_start = pdb; res2_start !=NULL;
-       res2_start=res2_stop)
-   {
-      res2_stop = blFindNextResidue(res2_start);
-      
-      /* if *partner* residue of choice */
-      if((resnum2 == res2_start->resnum)
-         && (chain1[0]==res1_start->chain[0])
-         && (insert1[0] == res1_start->insert[0]))
-      {
-         break;
-      }
-   }
-   if(res2_start==NULL)
+#elif defined(MCACCEPTOR)
+   if((kinds == NULL) &&
+      (matrix2 = OpenMatrixFile(matrix_file2, MATRIXFILE_MCACCEPTOR))==NULL)
    {
-      PrintError(OUT, "Can't find residue 2 in PDB file\n");
+      PrintError(NULL, "Sorry, unable to open matrix file2\n");
       return(FALSE);
    }
-   
-   if(!ReadInMatrices(res1, res2, matrix, MAT_READ_BOTH, MAT_RES_BOTH))
+#endif
+
+   if(!Open_Std_Files(batchfile, outputfile, &in, &out))
    {
-      /* ACRM 08.09.05 - error message */
-/*      PrintError(OUT, "f the residues in the matrix file: %s %s\n", res1, res2); */
+      if(matrix2 != NULL)
+         CloseMatrix(matrix2);
       return(FALSE);
    }
-   
-   /* ACRM 25.03.11 Check return value */
-   if(!OrientatePDB(pdb, res2_start, res2_stop))
-      return(FALSE);
-#ifndef NOCULL
-   CullArrays(pdb, res1_start, res2_start, gPartnertoDonate,
-              gPartnertoAccept);
-#endif
 
-   /* ACRM 25.03.11 Check return value */
-   if(!OrientatePDB(pdb, res1_start, res1_stop))
-      return(FALSE);
-#ifndef NOCULL
-   CullArrays(pdb, res1_start, res2_start,
-              gDonate, gAccept);
-#endif   
+   queries = ReadBatchQueries(in, options, cutoff, &nqueries);
 
-   CalculateCaToCaVector(res1_start, res1_stop, res2_start,
-                         res2_stop, &CAtoCAVector);
-   
-   /* 19.01.06 Now fits on N,CA,CB rather than N,CA,C for consistency with
-      the frame of reference
+   /* The header is written even if there are no queries so the output
+      is always a valid (if empty) results file
    */
-   CreateRotationMatrix(pdb, res1_start, res1_stop, res2_start,
-                        res2_stop, CAtoCAVector, ATOMS_NCACB, ATOMS_NCACB, NULL);
+   if(kinds != NULL)
+      fprintf(out, "# pdbfile residue1 residue2 nameres2 cutoff scsc \
+energy ndonor energy oacceptor energy\n");
+   else
+      fprintf(out, "# pdbfile residue1 residue2 nameres2 cutoff \
+result energy\n");
 
-   if(*hbplus == TRUE)    /* ACRM 23.07.04 Dereference pointer! */
+   if(queries == NULL)
    {
-      /* ACRM 25.03.11 Check return value */
-      if(!OrientatePDB(pdb, res2_start, res2_stop))
-         return(FALSE);
+      if(nqueries == 0)
+         ok = TRUE;
+      else
+         PrintError(NULL, "No memory for batch queries\n");
 
-      if(CalculateHBondEnergy(pdb, res1_start, res1_stop,
-                               res2_start,
-                               res2_stop, CAtoCAVector, cutoff,
-                               hatom1, hatom2, OUT) == CHBE_ERROR)
-      {
-         PrintError(OUT, "Unable to calculate HBondEnergy (1)\n");
-      }
+      CloseBatchFiles(in, out);
+      if(matrix2 != NULL)
+         CloseMatrix(matrix2);
+      return(ok);
+   }
+
+   /* Sort the queries by PDB file, keeping the input order within
+      each file, so that each thread's share of them needs few files
+      reading. rank[] gives the input order for the output.
+   */
+   if(nthreads > nqueries)
+      nthreads = nqueries;
+   if(((order = (BATCHQUERY **)malloc(nqueries * sizeof(BATCHQUERY *)))
+       ==NULL) ||
+      ((rank = (int *)malloc(nqueries * sizeof(int)))==NULL) ||
+      ((workers = (BATCHWORKER *)malloc(nthreads * sizeof(BATCHWORKER)))
+       ==NULL) ||
+      ((wdata = (void **)malloc(nthreads * sizeof(void *)))==NULL) ||
+      ((contexts = CreateThreadContexts(ctx, nthreads))==NULL))
+   {
+      PrintError(NULL, "No memory for batch queries\n");
    }
    else
    {
-      if(!CheckValidHBond(CAtoCAVector, cutoff, OUT,
-                          gDonate, gPartnertoAccept))
+      for(bq=queries, i=0; bq!=NULL; NEXT(bq), i++)
+         order[i] = bq;
+      qsort(order, nqueries, sizeof(BATCHQUERY *), CompareBatchQueries);
+      for(i=0; i<nqueries; i++)
+         rank[i] = order[i]->index;
+
+      for(i=0; i<nthreads; i++)
       {
-         /* 06.02.06 ACRM - the two grids were the wrong way around! */
-         if(!CheckValidHBond(CAtoCAVector, cutoff, OUT,
-                             gPartnertoDonate, gAccept))
-         {
-            return(FALSE);
-         }
+         workers[i].ctx        = contexts[i];
+         workers[i].pdb        = NULL;
+         workers[i].pdbfile[0] = '\0';
+         workers[i].loaded     = FALSE;
+         wdata[i]              = (void *)(workers+i);
       }
-   }
-   return(TRUE);
-}
+      run.matrix  = matrix;
+      run.matrix2 = matrix2;
+      run.kinds   = kinds;
+      run.order   = order;
+      run.out     = out;
+
+      /* Results are written in input order as they become available   */
+      if(RunThreadPool(nthreads, nqueries, rank, (void *)&run, wdata,
+                       RunBatchTask, EmitBatchResult))
+         ok = TRUE;
+      else
+         PrintError(NULL, "No memory for batch threads\n");
 
-/************************************************************************/
-int CalculateHBondEnergy(PDB *pdb, PDB *res1_start, PDB *res1_stop,
-                         PDB *res2_start,PDB *res2_stop,
-                         VEC3F CAtoCAVector, REAL cutoff,
-                         char *hatom1, char *hatom2, FILE *out)
-{
-   int x_coord1, y_coord1, z_coord1,
-      totalcount1 = 0, 
-      totalcount2 = 0;
-   FILE *OUT = out;
-   VEC3F partner_coord;
-   REAL pseudoenergy = -1;
-   PDB *p;
-   BOOL OK = FALSE;
-      
-   /* calculate total number of hydrogen bonding atoms for residue 1 and 2 */
-   totalcount1 = CalculateTotalCounts(gDonate);
-   totalcount2 = CalculateTotalCounts(gPartnertoAccept);
-   
-   /* obtaining x,y,z co-ordinates for donor atom */
-   for(p = res1_start; p !=res1_stop; NEXT(p))
-   {
-      if(strstr(p->atnam, hatom1))
+      for(i=0; i<nthreads; i++)
       {
-         COORD_2_GRID(x_coord1,p->x);
-         COORD_2_GRID(y_coord1,p->y);
-         COORD_2_GRID(z_coord1,p->z);
-         
-         OK = TRUE;
-         break;
+         if(workers[i].pdb != NULL)
+            FREELIST(workers[i].pdb, PDB);
       }
    }
 
-   if(!OK)
-   {
-      char buffer[160];
-      sprintf(buffer, "Can't find %s in protein structure\n", hatom1);
-      PrintError(OUT, buffer);
-      return(CHBE_ERROR);
-   }
-      
-   pseudoenergy = DoCheckHBond(x_coord1, y_coord1, z_coord1, CAtoCAVector,&partner_coord,
-                               totalcount1, totalcount2,
-                               gDonate, gPartnertoAccept, cutoff, OUT); 
-   if((pseudoenergy !=-1)&& (pseudoenergy !=9999.9999))
-   {
-      fprintf(out, "Pseudoenergy of best quality hydrogen bond: %.2f\n", pseudoenergy);
-      return(CHBE_OK);
-   }
+   if(workers  != NULL) free(workers);
+   if(contexts != NULL) FreeThreadContexts(contexts, nthreads);
+   if(wdata    != NULL) free(wdata);
+   if(rank     != NULL) free(rank);
+   if(order    != NULL) free(order);
+   FREELIST(queries, BATCHQUERY);
+   CloseBatchFiles(in, out);
+   if(matrix2 != NULL)
+      CloseMatrix(matrix2);
 
-   fprintf(out, "No hydrogen bonds\n");
-   return(CHBE_NOHB);
+   return(ok);
 }
 
 /************************************************************************/
-int CalculateTotalCounts(int array[MAXSIZE][MAXSIZE][MAXSIZE])
+/* Closes the input and output files of batch or scan mode opened by
+   Open_Std_Files() (in may be NULL), leaving stdin and stdout open
+*/
+void CloseBatchFiles(FILE *in, FILE *out)
 {
-   int totalcount = 0, x, y, z;
-   
-   for(x=0; x <MAXSIZE; x++)
+   if((in != NULL) && (in != stdin))
+      fclose(in);
+   if(out != NULL)
    {
-      for(y=0; y <MAXSIZE; y++)
-      {
-         for(z=0; z <MAXSIZE; z++)
-         {
-            totalcount = totalcount + array[x][y][z];
-         }
-      }
+      if(out != stdout)
+         fclose(out);
+      else
+         fflush(out);
    }
-   return(totalcount);
 }
 
 /************************************************************************/
-/* function that calculates the vector from the CA of res1 to CA of res2 
+/* Runs a batch query in a thread of the pool, reading its PDB file if
+   it isn't the one the thread last read
 */
-void CalculateCaToCaVector(PDB *res1_start, PDB *res1_stop,
-                           PDB *res2_start, PDB *res2_stop, 
-                           VEC3F *CAtoCAVector)
+void RunBatchTask(void *shared, void *worker, int item)
 {
-   VEC3F res1_calpha, 
-         res2_calpha;
-   res1_calpha.x = res1_calpha.y = res1_calpha.z = 0.0;
-   res2_calpha.x = res2_calpha.y = res2_calpha.z = 0.0;
+   BATCHRUN    *run = (BATCHRUN *)shared;
+   BATCHWORKER *w   = (BATCHWORKER *)worker;
+   BATCHQUERY  *bq  = run->order[item];
 
-   /*find co-ordinates of CA atom */   
-   if(!FindAtom(res1_start, res1_stop, "CA  ", &res1_calpha))
-   {
-      PrintError(NULL, "Can't find c-alpha atoms of key residue\n");
-   }
-   
-   if(!FindAtom(res2_start, res2_stop, "CA  ", &res2_calpha))
+   if(!w->loaded || strcmp(w->pdbfile, bq->pdbfile))
    {
-      PrintError(NULL, "Can't find c-alpha atoms of partner residue\n");
+      if(w->pdb != NULL)
+         FREELIST(w->pdb, PDB);
+
+      /* The bioplib PDB reader is not thread-safe                     */
+      BeginSerialSection();
+      w->pdb = ReadBatchPDB(bq->pdbfile);
+      EndSerialSection();
+
+      strcpy(w->pdbfile, bq->pdbfile);
+      w->loaded = TRUE;
    }
-   
-   CAtoCAVector->x =  res2_calpha.x - res1_calpha.x;
-   CAtoCAVector->y =  res2_calpha.y - res1_calpha.y;
-   CAtoCAVector->z =  res2_calpha.z - res1_calpha.z;
+
+   RunBatchQuery(w->ctx, w->pdb, run->matrix, run->matrix2, run->kinds,
+                 bq);
+}
+
+/************************************************************************/
+void EmitBatchResult(void *shared, int item)
+{
+   BATCHRUN *run = (BATCHRUN *)shared;
+
+   PrintBatchResult(run->out, run->order[item], (run->kinds != NULL));
 }
 
 /************************************************************************/
-/* function that assesses whether a hydrogen-bond between the *key* 
-   residue and *partner* residue is valid. It compares the location of 
-   the *key* residue hydrogen-capable atoms  with that the *partner* 
-   hydrogen atoms (i.e. where the *partner* residue likes its partner 
-   hydrogen atoms to be).
-   Fits *partner* residue matrix on top of *key* residue matrix and 
-   calculates the difference between their respective hydrogen-capable 
-   atoms.
-   A valid hydrogen bond is said to exist if the distance between the 
-   two atoms are within a certain cutoff distance 
+/* Reads the query lines for batch mode. Blank lines and lines starting
+   with # are skipped. Lines which cannot be parsed are kept as queries
+   with an error result so that there is still one output line for
+   each. Returns NULL if there are no queries or no memory; nqueries
+   is 0 in the first case and -1 in the second.
 */
-BOOL CheckValidHBond(VEC3F CAtoCAVector, REAL cutoff, FILE *out,
-                     int keyarray[MAXSIZE][MAXSIZE][MAXSIZE],
-                     int partnerarray[MAXSIZE][MAXSIZE][MAXSIZE])
+BATCHQUERY *ReadBatchQueries(FILE *in, HBQUERY *options, REAL cutoff,
+                             int *nqueries)
 {
-   int x, y, z, totalcount1 = 0, totalcount2 = 0;
-   FILE *OUT = out;
-   REAL pseudoenergy, final_penergy  = 9999.9999;
-   VEC3F partner_coord;
+   BATCHQUERY *queries = NULL,
+              *bq      = NULL;
+   char       buffer[MAXBUFF],
+              res2[MAXBUFF],
+              first;
+   int        nfields;
 
-#if defined(DEBUG1) || defined(DEBUG2) || defined(DEBUG3)
-         gChain--;
-#endif
+   *nqueries = 0;
    
-#ifdef DEBUG3
-{
-   int x2, y2, z2;
-   int x_coord, y_coord, z_coord;
-   VEC3F rotated_coord;
+   while(fgets(buffer, MAXBUFF, in))
+   {
+      TERMINATE(buffer);
+      if((sscanf(buffer, " %c", &first) != 1) || (first == '#'))
+         continue;
 
-   fprintf(stdout, "REMARK (checkhbond): Key array chain %c\n", gChain);
+      if(queries == NULL)
+      {
+         INIT(queries, BATCHQUERY);
+         bq = queries;
+      }
+      else
+      {
+         ALLOCNEXT(bq, BATCHQUERY);
+      }
+      if(bq == NULL)
+      {
+         if(queries != NULL)
+            FREELIST(queries, BATCHQUERY);
+         *nqueries = (-1);
+         return(NULL);
+      }
 
-   for(x2=0; x2<MAXSIZE; x2++)
-   {
-      for(y2=0; y2<MAXSIZE; y2++)
+      bq->query   = *options;
+      bq->cutoff  = cutoff;
+      bq->energy  = 0.0;
+      bq->index   = (*nqueries)++;
+      bq->status  = BATCH_NOHBOND;
+      bq->pdbfile[0] = bq->locres1[0] = bq->locres2[0] = res2[0] = '\0';
+
+      nfields = sscanf(buffer, "%s %15s %15s %s %lf", bq->pdbfile,
+                       bq->locres1, bq->locres2, res2, &(bq->cutoff));
+      UPPER(bq->locres1);
+      UPPER(bq->locres2);
+      UPPER(res2);
+      strncpy(bq->query.res2, res2, 7);
+      bq->query.res2[7] = '\0';
+
+      if((nfields < 4) ||
+         !blParseResSpec(bq->locres1, bq->query.chain1,
+                         &(bq->query.resnum1), bq->query.insert1) ||
+         !blParseResSpec(bq->locres2, bq->query.chain2,
+                         &(bq->query.resnum2), bq->query.insert2))
       {
-         for(z2=0; z2<MAXSIZE; z2++)
-         {
-            OrientateMatrix(CAtoCAVector, x2, y2, z2, &rotated_coord);
-            COORD_2_GRID(x_coord,rotated_coord.x);
-            COORD_2_GRID(y_coord,rotated_coord.y);
-            COORD_2_GRID(z_coord,rotated_coord.z);
-            if(VALIDGRIDCOORDS(x_coord, y_coord, z_coord))
-            {
-               if(keyarray[x_coord][y_coord][z_coord])
-               {
-                  fprintf(stdout, "ATOM  %5d  CA  ALA %c%4d    %8.3f%8.3f%8.3f%6.2f%6.2f\n",
-                          atnum++, gChain, resnum++, rotated_coord.x, rotated_coord.y,  rotated_coord.z, 1.00, 2.00);
-               }
-            }
-         }
+         char msg[MAXBUFF+80];
+         sprintf(msg, "Unable to parse batch query: %s\n", buffer);
+         PrintError(NULL, msg);
+         bq->status = BATCH_ERROR;
       }
    }
-   fprintf(stdout, "TER   \n");
-   gChain--;
+
+   return(queries);
 }
-#endif
-         
-   /* first ... compare *key* residue hydrogen-donor atoms
-      with *partner* residue *partner-to-accept* donor atoms */ 
-   totalcount1 = CalculateTotalCounts(keyarray);
-   totalcount2 = CalculateTotalCounts(partnerarray);
-      
-#ifdef DEBUG3
-   fprintf(stdout, "REMARK (checkhbond): Partner array chain %c\n", gChain);
-#endif
-   /* go though grid for *partner* residue */
-   for(x=0; x < MAXSIZE; x++)
+
+/************************************************************************/
+/* Reads a PDB file for batch mode, stripping any hydrogens as for a
+   single query. Returns NULL (having reported it) if it can't be read
+*/
+PDB *ReadBatchPDB(char *pdbfile)
+{
+   FILE *fp;
+   PDB  *pdb, *pdb2;
+   int  natoms, natoms2;
+
+   if((fp = OpenInputFile(pdbfile))==NULL)
    {
-      for(y=0; y < MAXSIZE; y++)
-      {
-         for(z = 0; z < MAXSIZE; z++)
-         {
-            pseudoenergy = DoCheckHBond(x, y, z, CAtoCAVector, &partner_coord, totalcount1,
-                                        totalcount2, keyarray, partnerarray,
-                                        cutoff, OUT);           
-            
-            if((pseudoenergy != -1) && (final_penergy > pseudoenergy))
-            {
-               final_penergy = pseudoenergy;
-#ifdef DEBUG
-   fprintf(stdout, "ATOM  %5d  C   THR  %4d    %8.3f%8.3f%8.3f%6.2f%6.2f\n",
-           atnum++, resnum++, partner_coord.x, partner_coord.y,  partner_coord.z, 1.00, 2.00);
-#endif
-            }
-         }
-      }
+      char msg[MAXBUFF+80];
+      sprintf(msg, "Unable to open PDB file: %s\n", pdbfile);
+      PrintError(NULL, msg);
+      return(NULL);
    }
-   
-   if(final_penergy != 9999.9999)
+   pdb = blReadPDBAtoms(fp, &natoms);
+   fclose(fp);
+
+   if(pdb == NULL)
    {
-      fprintf(out, "Pseudoenergy of best quality hydrogen bond: %.2f (valid)\n", 
-              final_penergy);
-      return(TRUE);
+      char msg[MAXBUFF+80];
+      sprintf(msg, "Cannot read PDB file: %s\n", pdbfile);
+      PrintError(NULL, msg);
+      return(NULL);
+   }
+
+   /* ACRM 02.02.06 strip any hydrogens present */
+   if((pdb2 = blStripHPDBAsCopy(pdb, &natoms2)) !=NULL)
+   {
+      FREELIST(pdb, PDB);
+      pdb  = pdb2;
    }
 
-   return(FALSE);
+   return(pdb);
 }
 
 /************************************************************************/
-REAL DoCheckHBond(int x, int y, int z, VEC3F CAtoCAVector, 
-                  VEC3F *partner_coord, int totalcount1,
-                  int totalcount2,
-                  int keyarray[MAXSIZE][MAXSIZE][MAXSIZE],
-                  int partnerarray[MAXSIZE][MAXSIZE][MAXSIZE],
-                  REAL cutoff, FILE *out)
+/* Runs one batch query against its PDB file (NULL if it couldn't be
+   read). The grids are cleared first so that the result is the same
+   as running the query on its own.
+   17.10.26 In combined mode (kinds not NULL) runs it as each kind
+*/
+void RunBatchQuery(HBCONTEXT *ctx, PDB *pdb, MATFILE *matrix,
+                   MATFILE *matrix2, KINDMATRICES *kinds, BATCHQUERY *bq)
 {
-   VEC3F rotated_coord;
-   int x_coord, y_coord, z_coord,
-       count1 = 0, count2 = 0;
-   int number_of_cells = 1+(cutoff / GRIDSPACING);
-   int i, j, k;
-   REAL cutoff_squared = cutoff * cutoff,
-        pseudoenergy = -1, final_penergy = 9999.9999,
-        dist_squared;
-   int final_x,final_y,final_z;
-
-   /* call routine to rotate matrix */
-   if(partnerarray[x][y][z] > 0)
-   {  
-      count2 = partnerarray[x][y][z];
-      OrientateMatrix(CAtoCAVector, x, y, z, &rotated_coord);
-      
-      /* convert real co-ordinates back into grid locations */
-      COORD_2_GRID(x_coord,rotated_coord.x);
-      COORD_2_GRID(y_coord,rotated_coord.y);
-      COORD_2_GRID(z_coord,rotated_coord.z);
-
-      if(VALIDGRIDCOORDS(x_coord, y_coord, z_coord))
-      { 
-#ifdef DEBUG2
-   fprintf(stdout, "ATOM  %5d  C   THR %c%4d    %8.3f%8.3f%8.3f%6.2f%6.2f\n",
-           atnum++, gChain, resnum++, rotated_coord.x, rotated_coord.y,  rotated_coord.z, 1.00, 2.00);
-#endif
-         count1 = keyarray[x_coord][y_coord][z_coord];
-             
-         /* if *key* and *partner* hydrogen atoms match exactly */
-         if(count1 > 0)
-         { 
-            final_penergy = CalcEnergy(count1, totalcount1,
-                                      count2, totalcount2);
-
-            final_x = x_coord;
-            final_y = y_coord;
-            final_z = z_coord;
-
-            GRID_2_COORD(final_x, partner_coord->x);
-            GRID_2_COORD(final_y, partner_coord->y);
-            GRID_2_COORD(final_z, partner_coord->z);
-
-#ifdef DEBUG1
-   fprintf(stdout, "ATOM  %5d  C   THR %c%4d    %8.3f%8.3f%8.3f%6.2f%6.2f\n",
-           atnum++, gChain, resnum++, rotated_coord.x, rotated_coord.y,  rotated_coord.z, 1.00, 2.00);
-#endif
-         }
-         else if(cutoff > 0.0)
-         {
-            for(i=x_coord-number_of_cells; i<=x_coord+number_of_cells; i++)
-            {
-               for(j=y_coord-number_of_cells; j<=y_coord+number_of_cells; j++)
-               {
-                  for(k=z_coord-number_of_cells; k<=z_coord+number_of_cells; k++)
-                  {
-                     if(VALIDGRIDCOORDS(i, j, k))
-                     {
-                        count1 = keyarray[i][j][k];
-                     
-                        if(count1 > 0)
-                        {
-                           dist_squared = Distance_squared(i, j, k, x_coord, y_coord, z_coord);
-                           
-                           if(dist_squared <=cutoff_squared)     
-                           {
-                              /* ACRM 08.09.02 Missing this VITAL line!!!! */
-                              pseudoenergy = CalcEnergy(count1, totalcount1,
-                                                        count2, totalcount2);
-
-                              if(pseudoenergy < final_penergy)
-                              {
-                                 final_penergy = pseudoenergy;
-                                 
-                                 final_x = x_coord;
-                                 final_y = y_coord;
-                                 final_z = z_coord;
-                                 
-                                 GRID_2_COORD(final_x, partner_coord->x);
-                                 GRID_2_COORD(final_y, partner_coord->y);
-                                 GRID_2_COORD(final_z, partner_coord->z);
-                              }
-#ifdef DEBUG1
-   fprintf(stdout, "ATOM  %5d  C   THR %c%4d    %8.3f%8.3f%8.3f%6.2f%6.2f\n",
-           atnum++, gChain, resnum++, rotated_coord.x, rotated_coord.y,  rotated_coord.z, 1.00, 3.00);
-#endif
-                           }
-                        }
-                     }
-                  }
-               }
-            }
-         }
+   PDB      *residues;
+   HBRESULT result;
+   char     label[3*MAXBUFF];
+   int      errorcode, i;
+   BOOL     found;
+   
+   for(i=0; i<HB_NKINDS; i++)
+      bq->kindStatus[i] = BATCH_ERROR;
+
+   if((bq->status == BATCH_ERROR) || (pdb == NULL))
+   {
+      bq->status = BATCH_ERROR;
+      return;
+   }
+
+   if((residues = GetResidues(pdb, bq->query.chain1, bq->query.resnum1,
+                              bq->query.insert1, bq->query.chain2,
+                              bq->query.resnum2, bq->query.insert2,
+                              &errorcode))==NULL)
+   {
+      if(errorcode == ERR_NOMEM)
+         BatchError(bq, "No memory for storing residues of interest\n");
+      else if(errorcode == ERR_NOPREVRES1)
+         BatchError(bq, "No preceeding residue for residue 1\n");
+      else if(errorcode == ERR_NOPREVRES2)
+         BatchError(bq, "No preceeding residue for residue 2\n");
+      else if(errorcode == ERR_NORES1)
+         BatchError(bq, "Residue 1 not found\n");
+      else if(errorcode == ERR_NORES2)
+         BatchError(bq, "Residue 2 not found\n");
+      else
+         BatchError(bq, "Undefined error in getting residues\n");
+      bq->status = BATCH_ERROR;
+      return;
+   }
+   FindRes1Type(residues, bq->query.chain1, bq->query.resnum1,
+                bq->query.insert1, bq->query.res1);
+
+   if(kinds != NULL)
+   {
+      sprintf(label, "%s %s %s ", bq->pdbfile, bq->locres1, bq->locres2);
+      for(i=0; i<HB_NKINDS; i++)
+      {
+         ctx->cutoff = bq->cutoff;
+         bq->kindStatus[i] = RunKindQuery(ctx, residues, i, kinds+i,
+                                          &(bq->query), label,
+                                          &(bq->kindEnergy[i]));
       }
+      FREELIST(residues, PDB);
+      return;
    }
 
-   return(final_penergy);
+   ClearHBContext(ctx);
+   ctx->cutoff = bq->cutoff;
+   InitHBResult(&result);
+   found = RunQuery(ctx, residues, matrix, matrix2, &(bq->query), &result);
+   FREELIST(residues, PDB);
+
+   for(i=0; i<result.nmessages; i++)
+      BatchError(bq, result.message[i]);
+
+   bq->status = BatchStatus(&result, found, &(bq->energy));
 }
-        
+
 /************************************************************************/
-REAL CalcEnergy(int count1, int totalcount1, int count2, int totalcount2)
+/* Returns the BATCH_xxx outcome of a query, setting energy if there is
+   one
+*/
+int BatchStatus(HBRESULT *result, BOOL found, REAL *energy)
 {
-   REAL potential1, potential2, log_potential;
-   
-   potential1 = ((REAL)count1/(REAL)totalcount1);
-   potential2 = ((REAL)count2/(REAL)totalcount2);  
-   log_potential = -log(potential1)-log(potential2);
-   return(log_potential);
+   switch(result->status)
+   {
+   case HB_VALID:
+      *energy = result->energy;
+      return(BATCH_VALID);
+   case HB_ENERGY:
+      *energy = result->energy;
+      return(BATCH_ENERGY);
+   case HB_NOHBOND:
+      return(BATCH_NOHBOND);
+   default:
+      break;
+   }
+
+   /* With -p, TRUE and no result means the energy couldn't be
+      calculated
+   */
+   return(found ? BATCH_ERROR : BATCH_NOHBOND);
 }
 
 /************************************************************************/
-void OrientateMatrix(VEC3F CAtoCAVector,int x, int y, int z, 
-                     VEC3F *rotated_coord)
+char *BatchStatusName(int status)
 {
-   VEC3F partner_real_coord, partner_real_coord_rotated;
-
-   /* convert location of hydrogen atoms in *partner* residue
-      matrix to real coordinates */
-   GRID_2_COORD(x, partner_real_coord.x);
-   GRID_2_COORD(y, partner_real_coord.y);
-   GRID_2_COORD(z, partner_real_coord.z);
-
-   /* multiply vector by rotation matrix */
-   blMatMult3_33(partner_real_coord, gRotation_matrix,
-                 &partner_real_coord_rotated);
-  
-   /* add CA to CA vector */
-   partner_real_coord_rotated.x += CAtoCAVector.x;
-   partner_real_coord_rotated.y += CAtoCAVector.y;
-   partner_real_coord_rotated.z += CAtoCAVector.z;
-  
-   *rotated_coord = partner_real_coord_rotated;
+   switch(status)
+   {
+   case BATCH_VALID:
+      return("valid");
+   case BATCH_ENERGY:
+      return("energy");
+   case BATCH_NOHBOND:
+      return("none");
+   default:
+      break;
+   }
+   return("error");
 }
 
 /************************************************************************/
-/* function that calculates distance (in angstroms) between two grid 
-   points 
-*/
-REAL Distance_squared (int i, int j, int k, int x_coord,
-                       int y_coord, int z_coord)
+/* Reports a message for a batch query on stderr, naming the query      */
+void BatchError(BATCHQUERY *bq, char *text)
 {
-   REAL squared_dist;
-   VEC3F test_value, c_value;
+   char msg[3*MAXBUFF];
    
-   GRID_2_COORD(i, test_value.x);
-   GRID_2_COORD(j, test_value.y);
-   GRID_2_COORD(k, test_value.z);
+   sprintf(msg, "%s %s %s: %s", bq->pdbfile, bq->locres1, bq->locres2,
+           text);
+   PrintError(NULL, msg);
+}
 
-   GRID_2_COORD(x_coord, c_value.x);
-   GRID_2_COORD(y_coord, c_value.y);
-   GRID_2_COORD(z_coord, c_value.z);
+/************************************************************************/
+/* qsort() comparison for batch queries: by PDB file then input order  */
+int CompareBatchQueries(const void *a, const void *b)
+{
+   BATCHQUERY *qa = *(BATCHQUERY **)a,
+              *qb = *(BATCHQUERY **)b;
+   int        cmp;
 
-   squared_dist = DISTSQ_HATOMS(test_value, c_value);
-      
-   return(squared_dist);   
+   if((cmp = strcmp(qa->pdbfile, qb->pdbfile)) != 0)
+      return(cmp);
+   return(qa->index - qb->index);
 }
 
 /************************************************************************/
-/* function that finds location of an atom in a residue */
-PDB *FindAtom(PDB *res1_start, PDB *res1_next, char *atnam, VEC3F *atm)
+void PrintBatchResult(FILE *out, BATCHQUERY *bq, BOOL combined)
 {
-   PDB *p,
-      *found = NULL;
-        
-   for(p = res1_start; p !=res1_next; NEXT(p))
+   int i;
+
+   fprintf(out, "%s %s %s %s %.2f",
+           (bq->pdbfile[0] ? bq->pdbfile : "-"),
+           (bq->locres1[0] ? bq->locres1 : "-"),
+           (bq->locres2[0] ? bq->locres2 : "-"),
+           (bq->query.res2[0] ? bq->query.res2 : "-"),
+           bq->cutoff);
+
+   if(!combined)
    {
-      if(!strncmp(p->atnam, atnam, 4))
-      {
-         if(atm != NULL)
-         {
-            atm->x = p->x;
-            atm->y = p->y;
-            atm->z = p->z;
-         }
-         found = p;
-         break;
-      }
+      fprintf(out, " %s", BatchStatusName(bq->status));
+      if((bq->status == BATCH_VALID) || (bq->status == BATCH_ENERGY))
+         fprintf(out, " %.2f\n", bq->energy);
+      else
+         fprintf(out, " -\n");
+      return;
    }
 
-   return(found);
+   for(i=0; i<HB_NKINDS; i++)
+   {
+      fprintf(out, " %s", BatchStatusName(bq->kindStatus[i]));
+      if(bq->kindStatus[i] == BATCH_VALID)
+         fprintf(out, " %.2f", bq->kindEnergy[i]);
+      else
+         fprintf(out, " -");
+   }
+   fprintf(out, "\n");
 }
-   
+
 /************************************************************************/
-void CullArrays(PDB *pdb, PDB *res1, PDB *res2,
-                int donate_array[MAXSIZE][MAXSIZE][MAXSIZE],
-                int accept_array[MAXSIZE][MAXSIZE][MAXSIZE])
+/* function to open matrix file. Opens default matrix file if none 
+   specified on command line 
+   17.10.26 Returns a MATFILE which may be text or compiled
+*/
+
+MATFILE *OpenMatrixFile(char *matrix_file, char *def_matrix_file)
 {
-   PDB *p;
-   int x_coord, y_coord, z_coord, x, y, z, total;
-   
-   for(p = pdb; p!=NULL; NEXT(p))
-   {
-      COORD_2_GRID(x_coord,p->x);
-      COORD_2_GRID(y_coord,p->y);
-      COORD_2_GRID(z_coord,p->z);    
-      
-      for(x = -RAD; x <=RAD; x++)
-      {
-         for(y = -RAD; y <=RAD; y++)
-         {
-            for(z = -RAD; z <=RAD; z++) 
-            {
-               total = ((x*x) + (y*y) + (z*z));
-               if(total  < (RAD*RAD))
-               {
-                  x_coord = x + x_coord;
-                  y_coord = y + y_coord;
-                  z_coord = z + z_coord;
-
-                  if(VALIDGRIDCOORDS(x_coord, y_coord, z_coord))
-                  {
-                     if((p->resnum !=res1->resnum)
-                        && (p->chain != res1->chain)
-                        && (p->insert != res1->insert)
-                        && (p->resnum !=res2->resnum)
-                        && (p->chain != res2->chain)
-                        && (p->insert != res2->insert))
-                     {
-                        donate_array[x_coord][y_coord][z_coord] = 0; 
-                        accept_array[x_coord][y_coord][z_coord] = 0; 
-                     }
-                  }
-               }
-            }
-         }
-      }
-   }
-}
-            
-/************************************************************************/
-/* function that populates matrices from text file (created in 
-   hydrogen_matrices.c program 
-*/
-BOOL ReadInMatrices(char *res1, char *res2, FILE *matrix, 
-                    int type, int whichres)
-{
-   char buffer[MAXBUFF], junk[15], minibuffer[6];
-   int  x, y, z, count;
-   BOOL inResidue1     = FALSE,
-        inResidue2     = FALSE,
-        found_residue1 = FALSE, 
-        found_residue2 = FALSE;
-
-   rewind(matrix);
-   while(fgets(buffer, MAXBUFF, matrix))
-   {     
-      TERMINATE(buffer);
-      if(!strncmp(buffer, "residue", 7))
-      {
-         strcpy(minibuffer, buffer+8);
-        
-         if((whichres&MAT_RES_1) && !strncmp(minibuffer, res1, 3))         
-         {
-            inResidue1 = TRUE;
-         }
-         else
-         {
-            inResidue1 = FALSE;
-         }
-
-         if((whichres&MAT_RES_2) && !strncmp(minibuffer, res2, 3))
-         {
-            inResidue2 = TRUE;       
-         }
-         else
-         {
-            inResidue2 = FALSE;
-         }
-      }
-
-      if(inResidue1)
-      {
-         if(type&MAT_READ_DONOR1)
-         { 
-            if(!strncmp(buffer, "donate", 6))
-            {
-               sscanf(buffer, "%s %d %d %d %d", junk, &x, &y, &z, &count);
-               gDonate[x][y][z] = count; 
-            }
-            if(!strncmp(buffer, "partnertodonate", 15))
-            {
-               sscanf(buffer, "%s %d %d %d %d", junk, &x, &y, &z, &count);          
-               gPartnertoDonate[x][y][z] = count;
-            }
-         }
-         if(type&MAT_READ_ACCEPTOR1)
-         {
-            if(!strncmp(buffer, "accept", 6))
-            {
-               sscanf(buffer, "%s %d %d %d %d", junk, &x, &y, &z, &count);
-               gAccept[x][y][z] = count; 
-            }
-            if(!strncmp(buffer, "partnertoaccept", 15))
-            {
-               sscanf(buffer, "%s %d %d %d %d", junk, &x, &y, &z, &count);          
-               gPartnertoAccept[x][y][z] = count;
-            }
-         }
-         
-         found_residue1 = TRUE;
-      }
-      
-      if(inResidue2)
-      {
-         if(type&MAT_READ_DONOR2)
-         { 
-            if(!strncmp(buffer, "donate", 6))
-            {
-               sscanf(buffer, "%s %d %d %d %d", junk, &x, &y, &z, &count);
-               gDonate[x][y][z] = count; 
-            }
-            if(!strncmp(buffer, "partnertodonate", 15))
-            {
-               sscanf(buffer, "%s %d %d %d %d", junk, &x, &y, &z, &count);          
-               gPartnertoDonate[x][y][z] = count;
-            }
-         }
-         if(type&MAT_READ_ACCEPTOR2)
-         {
-            if(!strncmp(buffer, "accept", 6))
-            {
-               sscanf(buffer, "%s %d %d %d %d", junk, &x, &y, &z, &count);
-               gAccept[x][y][z] = count; 
-            }
-            if(!strncmp(buffer, "partnertoaccept", 15))
-            {
-               sscanf(buffer, "%s %d %d %d %d", junk, &x, &y, &z, &count);          
-               gPartnertoAccept[x][y][z] = count;
-            }
-         }
- 
-         found_residue2 = TRUE; 
-      }
-   }
-   
-   if(whichres == MAT_RES_BOTH)
-   {
-      if(found_residue1 && found_residue2)
-         return(TRUE);
-   }
-   else if(whichres == MAT_RES_1)
-   {
-      if(found_residue1)
-         return(TRUE);
-   }
-   else if(whichres == MAT_RES_2)
-   {
-      if(found_residue2)
-         return(TRUE);
-   }
-         
-   return(FALSE);
-}
-
-/************************************************************************/
-/* function that sets array elements to 0 */
-void ClearArrays(int array)
-{
-   int i, j, k;
-   
-   for(i = 0; i < MAXSIZE; i++)
-   {
-      for(j = 0; j < MAXSIZE; j++)
-      {
-         for(k = 0; k < MAXSIZE; k++)
-         {
-            gDonate[i][j][k] = 0;
-            gAccept[i][j][k] = 0;
-            gPartnertoDonate[i][j][k] = 0;
-            gPartnertoAccept[i][j][k] = 0;
-         }
-      }
-   }  
-}
-
-/************************************************************************/
-/* function to open matrix file. Opens default matrix file if none 
-   specified on command line 
-*/
-
-FILE *OpenMatrixFile(char *matrix_file, char *def_matrix_file)
-{
-   FILE *fp;
+   MATFILE *matrix;
 
    /* if filename has been specified on command line, open and return */
    if(matrix_file !=NULL && matrix_file[0])
    {      
-      fp = fopen(matrix_file, "r");
+      matrix = OpenMatrix(matrix_file);
    }
    /* if no filename specified, open default matrix file */
    else
    {
-      fp = fopen(def_matrix_file, "r");
+      matrix = OpenMatrix(def_matrix_file);
    }
 
-   return(fp);
+   return(matrix);
 }
 
 /************************************************************************/
@@ -1105,16 +1067,25 @@ BOOL ParseCmdLine(int argc, char **argv, REAL *cutoff, BOOL *hbplus,
                   char *hatom1, char *hatom2,
                   char *matrix_file, char *matrix_file2, char *pdbfile,
                   char *locres1, char *locres2, char *res2, 
-                  char *outputfile)
+                  char *outputfile, char *batchfile, BOOL *saturate,
+                  BOOL *scan, int *nthreads, BOOL *combined,
+                  char *scmc_file, char *ndonor_file,
+                  char *oacceptor_file)
 {
+   int npos;
+   
    argc--;
    argv++;
 
    *cutoff = DEFAULT_CUTOFF_VALUE;
    *hbplus = FALSE;
+   *saturate = FALSE;
+   *scan     = FALSE;
+   *nthreads = 1;
+   *combined = FALSE;
 
    matrix_file[0] = '\0';
-   pdbfile[0] = outputfile[0] = '\0';
+   pdbfile[0] = outputfile[0] = batchfile[0] = '\0';
    
    while(argc)
    {
@@ -1149,15 +1120,72 @@ BOOL ParseCmdLine(int argc, char **argv, REAL *cutoff, BOOL *hbplus,
             argv++;
             strcpy(matrix_file2, argv[0]);
             break;
+         case 'b':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            strcpy(batchfile, argv[0]);
+            break;
+         case 's':
+            *saturate = TRUE;
+            break;
+         case 'a':
+            *scan = TRUE;
+            break;
+         case 't':
+            argc--;
+            argv++;
+            if((!argc) || !sscanf(argv[0], "%d", nthreads) ||
+               (*nthreads < 0))
+               return(FALSE);
+            if(*nthreads == 0)
+               *nthreads = NumberOfProcessors();
+            break;
+         case 'M':
+            /* 17.10.26 scsc, scmc, ndonor and oacceptor matrix files  */
+            if(argc < 5)
+               return(FALSE);
+            *combined = TRUE;
+            strcpy(matrix_file,    argv[1]);
+            strcpy(scmc_file,      argv[2]);
+            strcpy(ndonor_file,    argv[3]);
+            strcpy(oacceptor_file, argv[4]);
+            argc -= 4;
+            argv += 4;
+            break;
          default:
             return(FALSE);
             break;
          }
       }
+      else if(batchfile[0])
+      {
+         /* 17.10.26 only an output file in batch mode */
+         if((argc > 1) || *saturate || *scan || (*combined && *hbplus))
+            return(FALSE);
+         strcpy(outputfile, argv[0]);
+         return(TRUE);
+      }
+      else if(*scan)
+      {
+         /* 17.10.26 a PDB file and optional output file in scan mode */
+         if((argc > 2) || *saturate || *hbplus || *combined)
+            return(FALSE);
+         strcpy(pdbfile, argv[0]);
+         if(argc > 1)
+            strcpy(outputfile, argv[1]);
+         return(TRUE);
+      }
       else
       {
-         /* check there are 5 or 6 arguments remaining */
-         if((argc > 5) || (argc < 4))
+         /* check there are 5 or 6 arguments remaining (4 or 5 without
+            nameres2 in saturation mode)
+         */
+         npos = (*saturate ? 3 : 4);
+         if((argc > npos+1) || (argc < npos) ||
+            ((*saturate || *combined) && *hbplus) ||
+            (*saturate && *combined))
             return(FALSE);
          
          strcpy(pdbfile, argv[0]);
@@ -1171,10 +1199,14 @@ BOOL ParseCmdLine(int argc, char **argv, REAL *cutoff, BOOL *hbplus,
          UPPER(locres2);
          argc--;
          argv++;
-         strcpy(res2, argv[0]);
-         UPPER(res2);
-         argc--;
-         argv++;
+         res2[0] = '\0';
+         if(!*saturate)
+         {
+            strcpy(res2, argv[0]);
+            UPPER(res2);
+            argc--;
+            argv++;
+         }
               
          if(argc)
          {
@@ -1185,28 +1217,56 @@ BOOL ParseCmdLine(int argc, char **argv, REAL *cutoff, BOOL *hbplus,
       argc--;
       argv++;
    }
-   return(FALSE);
+   return((batchfile[0] != '\0') && !*saturate &&
+          !(*combined && *hbplus));
 }
 
 /************************************************************************/
 /* function to display a usage message */
 void Usage(void)
 {
-   fprintf(stderr, "\nCheckHBond V2.1 (c) 2002-11, Alison Cuff, University of Reading\n\n");
+   fprintf(stderr, "\nCheckHBond V2.19 (c) 2002-11, Alison Cuff, University of Reading\n\n");
    fprintf(stderr, "V2.0+ changes by Andrew Martin, UCL\n\n");
    fprintf(stderr, "Usage: checkhbond [-c cutoff] [-p hatom1 hatom2][-m matrix_file]\n");
 #if defined(MCDONOR) || defined(MCACCEPTOR)
    fprintf(stderr, "   [-n matrix_file2]\n\n");
 #endif
-   fprintf(stderr, "   pdbfile residue1 residue2 nameres2 [output file]\n\n");
+   fprintf(stderr, "   pdbfile residue1 residue2 nameres2 [output file]\n");
+   fprintf(stderr, "   or: checkhbond [options] -b listfile [output file]\n");
+   fprintf(stderr, "   or: checkhbond [options] -s pdbfile residue1 residue2 [output file]\n");
+   fprintf(stderr, "   or: checkhbond [options] -a pdbfile [output file]\n");
+   fprintf(stderr, "   or: checkhbond [options] -M scsc_matrix scmc_matrix ndonor_matrix\n");
+   fprintf(stderr, "          oacceptor_matrix pdbfile residue1 residue2 nameres2 [output file]\n\n");
    fprintf(stderr, "  -c [cutoff]: cutoff distance between hydrogen-capable atoms(default: 0.5A)\n");
    fprintf(stderr, "  -p: Parse HBplus data.\n");
    fprintf(stderr, "  Hydrogen donating atom (hatom1) and hydrogen accepting atom (hatom2) required \n");
    fprintf(stderr, "  -m [matrix_file]: matrix file (if not using default file\n");
+   fprintf(stderr, "    Text matrix files and files compiled with compile_matrices are both accepted\n");
 #if defined(MCDONOR) || defined(MCACCEPTOR)
    fprintf(stderr, "  -n [matrix_file2]: matrix file2 (if not using default file\n");
    fprintf(stderr, "    This is only used for s/c-m/c HBonds and specifies the m/c matrix\n");
 #endif
+   fprintf(stderr, "  -b [listfile]: batch mode. Each line of listfile (- for stdin) is\n");
+   fprintf(stderr, "    pdbfile residue1 residue2 nameres2 [cutoff]\n");
+   fprintf(stderr, "    and gives one line of output:\n");
+   fprintf(stderr, "    pdbfile residue1 residue2 nameres2 cutoff result energy\n");
+   fprintf(stderr, "    where result is valid, energy (-p), none or error\n");
+   fprintf(stderr, "  -s: saturation mode. Tries every residue type in the matrix file\n");
+   fprintf(stderr, "    at residue2 and gives a line for each:\n");
+   fprintf(stderr, "    residue1 residue2 nameres2 result energy\n");
+   fprintf(stderr, "  -a: scan mode. Finds every H-bonded pair in the PDB file and\n");
+   fprintf(stderr, "    tries every residue type in the matrix file at the partner\n");
+   fprintf(stderr, "    (residue2) of each, giving a line for each:\n");
+   fprintf(stderr, "    residue1 residue2 native2 nameres2 result energy\n");
+   fprintf(stderr, "    Side chain pairs are tried both ways round. Hydrogens are\n");
+   fprintf(stderr, "    added to find the H-bonds using %s from $DATADIR\n", PGPFILE);
+   fprintf(stderr, "  -M: combined mode. Runs the pair as each kind of pair (as\n");
+   fprintf(stderr, "    checkhbond, checkhbond_Ndonor and checkhbond_Oacceptor) with\n");
+   fprintf(stderr, "    the PDB file read once, giving a line for each:\n");
+   fprintf(stderr, "    kind result energy\n");
+   fprintf(stderr, "    With -b each output line has a result and energy for each kind\n");
+   fprintf(stderr, "  -t [nthreads]: number of threads for -b and -a (default 1;\n");
+   fprintf(stderr, "    0 for one per processor). The output is the same.\n");
    fprintf(stderr, "  pdbfile:  pdb file of protein structure\n");
    fprintf(stderr, "  residue1: First residue (chain, residue number, insert)\n");
    fprintf(stderr, "  residue2: Second residue (chain, residue number, insert)\n");
@@ -1225,12 +1285,13 @@ void Usage(void)
 /************************************************************************/
 /* Function that opens input file for reading and output file for writing
    to and appending 
+   17.10.26 The input file may be gzip-compressed
 */
 BOOL Open_Std_Files(char *infile, char *outfile, FILE **in, FILE **out)
 {
    if(infile!=NULL && infile[0] && strcmp(infile,"-"))
    {
-      if((*in = fopen(infile,"r"))==NULL)
+      if((*in = OpenInputFile(infile))==NULL)
       {
          char buffer[160];
          sprintf(buffer,"Enable to open input file: %s\n",infile);
@@ -1254,725 +1315,470 @@ BOOL Open_Std_Files(char *infile, char *outfile, FILE **in, FILE **out)
 }
 
 /************************************************************************/
-/* Function that recognises any residues not capable of hydrogen bonding
- */
-BOOL IsHBondCapable(char *residue)
-{   
-   int i;
-   char *NotHBondRes[9];
-   BOOL flag = FALSE;
-   
-   NotHBondRes[0] = "MET";
-   NotHBondRes[1] = "CYS";
-   NotHBondRes[2] = "ILE";
-   NotHBondRes[3] = "VAL";
-   NotHBondRes[4] = "PHE";
-   NotHBondRes[5] = "GLY";
-   NotHBondRes[6] = "ALA";
-   NotHBondRes[7] = "PRO";
-   NotHBondRes[8] = "LEU";
+/* Saturation mode. Tries each residue type in the matrix file at
+   residue 2, with the pair orientated and the rotation found once
+   (see PrepareHBSite()), and prints a line for each:
+      residue1 residue2 nameres2 result energy
+   where result is valid or none and energy is - if there is none.
+   Messages go only to stderr.
+*/
+BOOL RunSaturation(HBCONTEXT *ctx, PDB *pdb, MATFILE *matrix,
+                   MATFILE *matrix2, HBQUERY *query, char *locres1,
+                   char *locres2, FILE *out)
+{
+   HBSITE   *site;
+   HBRESULT result;
+   char     types[HB_MAXTYPES][8],
+            msg[2*MAXBUFF];
+   int      ntypes, i, j;
+   BOOL     found;
 
-   for(i = 0; i < 9; i++)
+   InitHBResult(&result);
+   if((site = PrepareHBSite(ctx, pdb, HBKIND, query, &result))==NULL)
    {
-      if(!strcmp(residue, NotHBondRes[i]))
-      {
-         flag = TRUE;
-         break;
-      } 
-      else
+      PrintResult(out, &result);
+      return(FALSE);
+   }
+   for(j=0; j<result.nmessages; j++)
+      PrintError(NULL, result.message[j]);
+
+   ntypes = MatrixResidueTypes(matrix->bin, types, HB_MAXTYPES);
+
+   fprintf(out, "# residue1 residue2 nameres2 result energy\n");
+   for(i=0; i<ntypes; i++)
+   {
+      InitHBResult(&result);
+      found = ScoreHBSite(ctx, site, matrix, matrix2, types[i], &result);
+
+      for(j=0; j<result.nmessages; j++)
       {
-         flag = FALSE;
+         sprintf(msg, "%s: %s", types[i], result.message[j]);
+         PrintError(NULL, msg);
       }
+
+      fprintf(out, "%s %s %s ", locres1, locres2, types[i]);
+      if(found && (result.status == HB_VALID))
+         fprintf(out, "valid %.2f\n", result.energy);
+      else
+         fprintf(out, "none -\n");
    }
-   
-   return(flag);
+
+   FreeHBSite(site);
+   return(TRUE);
 }
 
 /************************************************************************/
-PDB *GetResidues(PDB *pdb, char *chain1, int resnum1, char *insert1, 
-                 char *chain2, int resnum2, char *insert2, int *errorcode)
+/* Scan mode. Finds the H-bonded pairs in a PDB file, with the criteria
+   used to build the matrices, and runs a saturation of residue 2 of
+   each (both ways round for side chain pairs). Prints a line per
+   residue type per site:
+      residue1 residue2 native2 nameres2 result energy
+   17.10.26 The sites are run on nthreads threads
+*/
+BOOL RunScan(HBCONTEXT *ctx, MATFILE *matrix, char *matrix_file2,
+             char *pdbfile, char *outputfile, int nthreads)
 {
-   PDB *keep=NULL,
-       *p, *q,
-       *prev1, *prev2;
-   
-   /* First find the residue preceeding res1 */
-   for(p=pdb, prev1=NULL; p!=NULL; )
-   {
-      if((p->resnum == resnum1) &&
-         (p->chain[0]  == chain1[0]) &&
-         (p->insert[0] == insert1[0]))
-         break;
-      prev1 = p;
-      p = blFindNextResidue(p);
+   FILE      *out = stdout;
+   MATFILE   *matrix2 = NULL;
+   SCANSITE  *sites = NULL;
+   SCANRUN   run;
+   HBCONTEXT **contexts = NULL;
+   PDB       *pdb;
+   char      types[HB_MAXTYPES][8];
+   int       nsites, ntypes;
+   BOOL      ok = FALSE;
+
+#if defined(MCDONOR)
+   if((matrix2 = OpenMatrixFile(matrix_file2, MATRIXFILE_MCDONOR))==NULL)
+   {
+      PrintError(NULL, "Sorry, unable to open matrix file2\n");
+      return(FALSE);
    }
-   if((prev1==NULL) || !ResiduesBonded(prev1, p))
+#elif defined(MCACCEPTOR)
+   if((matrix2 = OpenMatrixFile(matrix_file2, MATRIXFILE_MCACCEPTOR))==NULL)
    {
-      *errorcode = ERR_NOPREVRES1;
-      return(NULL);
+      PrintError(NULL, "Sorry, unable to open matrix file2\n");
+      return(FALSE);
    }
+#endif
 
-   /* First find the residue preceeding res2 */
-   for(p=pdb, prev2=NULL; p!=NULL; )
-   {
-      if((p->resnum == resnum2) &&
-         (p->chain[0]  == chain2[0]) &&
-         (p->insert[0] == insert2[0]))
-         break;
-      prev2 = p;
-      p = blFindNextResidue(p);
-   }
-   if((prev2==NULL) || !ResiduesBonded(prev2, p))
+   if(!Open_Std_Files(NULL, outputfile, NULL, &out))
    {
-      *errorcode = ERR_NOPREVRES2;
-      return(NULL);
+      if(matrix2 != NULL)
+         CloseMatrix(matrix2);
+      return(FALSE);
    }
 
+   /* The header is written even if there are no sites so the output
+      is always a valid (if empty) results file
+   */
+   fprintf(out, "# residue1 residue2 native2 nameres2 result energy\n");
 
-   for(p=pdb; p!=NULL; NEXT(p))
+   if((pdb = ReadBatchPDB(pdbfile))!=NULL)
    {
-      if(((p->resnum == resnum1) &&
-          (p->chain[0]  == chain1[0]) &&
-          (p->insert[0] == insert1[0])) ||
-         ((p->resnum == resnum2) &&
-          (p->chain[0]  == chain2[0]) &&
-          (p->insert[0] == insert2[0])) ||
-         ((p->resnum == prev1->resnum) &&
-          (p->chain[0]  == prev1->chain[0]) &&
-          (p->insert[0] == prev1->insert[0])) ||
-         ((p->resnum == prev2->resnum) &&
-          (p->chain[0]  == prev2->chain[0]) &&
-          (p->insert[0] == prev2->insert[0])))
+      if((sites = FindScanSites(pdb, &nsites))==NULL)
       {
-         if(keep == NULL)
-         {
-            INIT(keep, PDB);
-            q = keep;
-         }
+         ok = (nsites == 0);
+      }
+      else
+      {
+         ntypes = MatrixResidueTypes(matrix->bin, types, HB_MAXTYPES);
+         if(nthreads > nsites)
+            nthreads = nsites;
+
+         run.pdb     = pdb;
+         run.matrix  = matrix;
+         run.matrix2 = matrix2;
+         run.sites   = sites;
+         run.types   = types;
+         run.ntypes  = ntypes;
+         run.out     = out;
+
+         if(((contexts = CreateThreadContexts(ctx, nthreads))==NULL) ||
+            !RunThreadPool(nthreads, nsites, NULL, (void *)&run,
+                           (void **)contexts, RunScanTask, EmitScanSite))
+            PrintError(NULL, "No memory for scan threads\n");
          else
-         {
-            ALLOCNEXT(q, PDB);
-         }
-         if(q==NULL)
-         {
-            *errorcode = ERR_NOMEM;
-            return(NULL);
-         }
-         blCopyPDB(q, p);
+            ok = TRUE;
+
+         if(contexts != NULL)
+            FreeThreadContexts(contexts, nthreads);
+         free(sites);
       }
+      FREELIST(pdb, PDB);
    }
-   FREELIST(pdb, PDB);
 
-   return(keep);
-}
+   CloseBatchFiles(NULL, out);
+   if(matrix2 != NULL)
+      CloseMatrix(matrix2);
 
+   return(ok);
+}
 
 /************************************************************************/
-void FindRes1Type(PDB *pdb, char *chain, int resnum, char *insert, 
-                  char *res)
+/* Runs a scan site in a thread of the pool. The PDB list is shared and
+   is only read (GetResidues() makes a copy of the pair)
+*/
+void RunScanTask(void *shared, void *worker, int item)
 {
-   PDB *p;
-   for(p=pdb; p!=NULL; NEXT(p))
-   {
-      if((p->resnum == resnum) &&
-         (p->chain[0] == chain[0]) &&
-         (p->insert[0] == insert[0]))
-      {
-         strncpy(res, p->resnam, 3);
-         res[3] = '\0';
-         return;
-      }
-   }
+   SCANRUN *run = (SCANRUN *)shared;
+
+   RunScanSite((HBCONTEXT *)worker, run->pdb, run->matrix, run->matrix2,
+               run->sites+item, run->types, run->ntypes);
 }
 
 /************************************************************************/
-/* function that calculates the vector from the N of res1 to CA of res2 
- */
-void CalculateNToCaVector(PDB *res1_start, PDB *res1_stop,
-                          PDB *res2_start, PDB *res2_stop, 
-                          VEC3F *NtoCAVector)
+void EmitScanSite(void *shared, int item)
 {
-   VEC3F res1_n, 
-         res2_calpha;
-   res1_n.x      = res1_n.y      = res1_n.z      = 0.0;
-   res2_calpha.x = res2_calpha.y = res2_calpha.z = 0.0;
+   SCANRUN *run = (SCANRUN *)shared;
 
-   /*find co-ordinates of N  atom */   
-   if(!FindAtom(res1_start, res1_stop, "N   ", &res1_n))
-   {
-      PrintError(NULL, "Can't find N atom of key residue\n");
-   }
-   
-   /*find co-ordinates of CA atom */   
-   if(!FindAtom(res2_start, res2_stop, "CA  ", &res2_calpha))
-   {
-      PrintError(NULL, "Can't find c-alpha atom of partner residue\n");
-   }
-   
-   NtoCAVector->x =  res2_calpha.x - res1_n.x;
-   NtoCAVector->y =  res2_calpha.y - res1_n.y;
-   NtoCAVector->z =  res2_calpha.z - res1_n.z;
+   PrintScanSite(run->out, run->sites+item, run->types, run->ntypes);
 }
 
-
 /************************************************************************/
-/* function that calculates the vector from the C of res1 to CA of res2 
- */
-void CalculateCToCaVector(PDB *res1_start, PDB *res1_stop,
-                          PDB *res2_start, PDB *res2_stop, 
-                          VEC3F *CtoCAVector)
+/* Returns an HBCONTEXT for each of nthreads threads: ctx for the first
+   and new ones with the same cutoff for the others
+*/
+HBCONTEXT **CreateThreadContexts(HBCONTEXT *ctx, int nthreads)
 {
-   VEC3F res1_c, 
-         res2_calpha;
-   res1_c.x      = res1_c.y      = res1_c.z      = 0.0;
-   res2_calpha.x = res2_calpha.y = res2_calpha.z = 0.0;
+   HBCONTEXT **contexts;
+   int       i;
 
-   /*find co-ordinates of N atom */   
-   if(!FindAtom(res1_start, res1_stop, "C   ", &res1_c))
-   {
-      PrintError(NULL, "Can't find C atoms of key residue\n");
-   }
-   
-   /*find co-ordinates of CA atom */   
-   if(!FindAtom(res2_start, res2_stop, "CA  ", &res2_calpha))
+   if((contexts = (HBCONTEXT **)malloc(nthreads * sizeof(HBCONTEXT *)))
+      ==NULL)
+      return(NULL);
+
+   contexts[0] = ctx;
+   for(i=1; i<nthreads; i++)
    {
-      PrintError(NULL, "Can't find c-alpha atoms of partner residue\n");
+      if((contexts[i] = CreateHBContext(ctx->cutoff))==NULL)
+      {
+         FreeThreadContexts(contexts, i);
+         return(NULL);
+      }
    }
-   
-   CtoCAVector->x =  res2_calpha.x - res1_c.x;
-   CtoCAVector->y =  res2_calpha.y - res1_c.y;
-   CtoCAVector->z =  res2_calpha.z - res1_c.z;
+
+   return(contexts);
 }
 
+/************************************************************************/
+/* Frees the contexts made by CreateThreadContexts() (but not the first,
+   which belongs to the caller)
+*/
+void FreeThreadContexts(HBCONTEXT **contexts, int nthreads)
+{
+   int i;
+
+   for(i=1; i<nthreads; i++)
+      FreeHBContext(contexts[i]);
+   free(contexts);
+}
 
 /************************************************************************/
-/* 13.09.11 Added more error messages
- */
-BOOL AnalyzeMCDonorPair(int resnum1, int resnum2, PDB *pdb, 
-                        FILE *matrix, FILE *matrix2,
-                        char *chain1, char *chain2, 
-                        char *insert1, char *insert2, BOOL *hbplus,
-                        char *hatom1, char *hatom2, REAL cutoff, 
-                        char *res1, char *res2,
-                        FILE *OUT)
+/* Finds the sites to scan: the H-bonded pairs found with hydrogens
+   added, side chain pairs both ways round (see FindScanPairs()).
+   Returns NULL with *nsites -1 on error or 0 if there are none.
+*/
+SCANSITE *FindScanSites(PDB *pdb, int *nsites)
 {
-   VEC3F NtoCAVector;
+   HBQUERY  *pairs;
+   SCANSITE *sites;
+   char     error[MAXBUFF],
+            msg[MAXBUFF+2];
+   int      i;
 
-   PDB *res1_start, *res1_stop, *res2_start, *res2_stop, *prevres1;
-   
-   /* Find the key residue which is the mainchain donor and the previous residue */
-   for(res1_start =  pdb, prevres1 = NULL;
-       res1_start != NULL;
-       res1_start =  res1_stop)
-   {
-      res1_stop = blFindNextResidue(res1_start);
-                        
-      /* if *key* residue of choice */
-      if((resnum1 == res1_start->resnum)
-         && (chain1[0]==res1_start->chain[0])
-         && (insert1[0] == res1_start->insert[0]))
-      {
-         break;
-      }
-      prevres1 = res1_start;
-   }
-   if(res1_start==NULL)
+   if((pairs = FindScanPairs(pdb, HBKIND, nsites, error))==NULL)
    {
-      PrintError(OUT, "Can't find residue 1  in PDB file\n");
-      return(FALSE);
-   }
-   
-   /*Find the partner residue which is the sidechain acceptor */
-   for(res2_start = pdb; res2_start !=NULL;
-       res2_start=res2_stop)
-   {
-      res2_stop = blFindNextResidue(res2_start);
-      
-      /* if *partner* residue of choice */
-      if((resnum2 == res2_start->resnum)
-         && (chain1[0]==res1_start->chain[0])
-         && (insert1[0] == res1_start->insert[0]))
+      if(*nsites != 0)
       {
-         break;
+         sprintf(msg, "%s\n", error);
+         PrintError(NULL, msg);
       }
+      return(NULL);
    }
-   if(res2_start==NULL)
-   {
-      PrintError(OUT, "Can't find residue 2 in PDB file\n");
-      return(FALSE);
-   }
-   
-   if(!ReadInMatrices(res1, res2, matrix, MAT_READ_ACCEPTOR2, MAT_RES_2))
-   {
-      /* ACRM 08.09.05 - error message */
-      char buffer[160];
-      sprintf(buffer, "Unable to find residue in the sc/sc matrix file: %s\n", res2);
-      PrintError(OUT, buffer);
-      return(FALSE);
-   }
-   
-   if(!ReadInMatrices(res1, res2, matrix2, MAT_READ_DONOR1, MAT_RES_1))
-   {
-      /* ACRM 08.09.05 - error message */
-      char buffer[160];
-      sprintf(buffer, "Unable to find residue in the mc donor matrix file: %s\n", res1);
-      PrintError(OUT, buffer);
-      return(FALSE);
-   }
-   
-   /* ACRM 25.03.11 Check return value */
-   if(!OrientatePDB(pdb, res2_start, res2_stop))
+
+   if((sites = (SCANSITE *)malloc((*nsites) * sizeof(SCANSITE)))==NULL)
    {
-      PrintError(OUT, "Can't orientate PDB file\n");
-      return(FALSE);
+      PrintError(NULL, "No memory for scan sites\n");
+      free(pairs);
+      *nsites = (-1);
+      return(NULL);
    }
-   
-#ifndef NOCULL
-   CullArrays(pdb, res1_start, res2_start, gPartnertoAccept,
-              gAccept);
-#endif
 
-   /* ACRM 25.03.11 Check return value */
-   if(!OrientateN_PDB(pdb, prevres1, res1_start, res1_stop))
+   for(i=0; i<(*nsites); i++)
    {
-      PrintError(OUT, "Can't orientate PDB file about N\n");
-      return(FALSE);
+      sites[i].query = pairs[i];
+      FormatResSpec(sites[i].locres1, sites[i].query.resnum1,
+                    sites[i].query.chain1, sites[i].query.insert1);
+      FormatResSpec(sites[i].locres2, sites[i].query.resnum2,
+                    sites[i].query.chain2, sites[i].query.insert2);
+      sites[i].OK = FALSE;
    }
-   
-#ifndef NOCULL
-   CullArrays(pdb, res1_start, res2_start,
-              gDonate, gPartnertoDonate);
-#endif   
 
-   CalculateNToCaVector(res1_start, res1_stop, res2_start,
-                         res2_stop, &NtoCAVector);
-   
-   CreateRotationMatrix(pdb, res1_start, res1_stop, res2_start,
-                        res2_stop, NtoCAVector, ATOMS_CNCA, ATOMS_NCACB, prevres1);
+   free(pairs);
+   return(sites);
+}
 
-   if(*hbplus == TRUE)    /* ACRM 23.07.04 Dereference pointer! */
-   {
-      /* ACRM 25.03.11 Check return value */
-      if(!OrientatePDB(pdb, res2_start, res2_stop))
-      {
-         PrintError(OUT, "Can't orientate PDB file\n");
-         return(FALSE);
-      }
-      
-      if(CalculateHBondEnergy(pdb, res1_start, res1_stop,
-                              res2_start,
-                              res2_stop, NtoCAVector, cutoff,
-                              hatom1, hatom2, OUT) == CHBE_ERROR)
+/************************************************************************/
+/* Tries each residue type at residue 2 of a scan site                  */
+void RunScanSite(HBCONTEXT *ctx, PDB *pdb, MATFILE *matrix,
+                 MATFILE *matrix2, SCANSITE *site, char types[][8],
+                 int ntypes)
+{
+   PDB      *residues;
+   HBSITE   *hbsite;
+   HBRESULT result;
+   char     msg[2*MAXBUFF];
+   int      errorcode, i, j;
+
+   if((residues = GetResidues(pdb, site->query.chain1,
+                              site->query.resnum1, site->query.insert1,
+                              site->query.chain2, site->query.resnum2,
+                              site->query.insert2, &errorcode))==NULL)
+   {
+      sprintf(msg, "%s %s: %s", site->locres1, site->locres2,
+              ((errorcode == ERR_NOMEM) ?
+               "No memory for storing residues of interest\n" :
+               (((errorcode == ERR_NORES1) || (errorcode == ERR_NORES2)) ?
+                "Residue not found\n" : "No preceeding residue\n")));
+      PrintError(NULL, msg);
+      return;
+   }
+
+   InitHBResult(&result);
+   if((hbsite = PrepareHBSite(ctx, residues, HBKIND, &(site->query),
+                              &result))!=NULL)
+   {
+      site->OK = TRUE;
+      for(i=0; i<ntypes; i++)
       {
-         PrintError(OUT, "Unable to calculate HBondEnergy (2)\n");
+         site->valid[i] = (ScoreHBSite(ctx, hbsite, matrix, matrix2,
+                                       types[i], &result) &&
+                           (result.status == HB_VALID));
+         site->energy[i] = result.energy;
+         for(j=0; j<result.nmessages; j++)
+         {
+            sprintf(msg, "%s %s %s: %s", site->locres1, site->locres2,
+                    types[i], result.message[j]);
+            PrintError(NULL, msg);
+         }
+         InitHBResult(&result);
       }
+      FreeHBSite(hbsite);
    }
    else
    {
-      if(!CheckValidHBond(NtoCAVector, cutoff, OUT,
-                          gDonate, gPartnertoAccept))
+      for(j=0; j<result.nmessages; j++)
       {
-         /* 06.02.06 ACRM - the two grids were the wrong way around! */
-         if(!CheckValidHBond(NtoCAVector, cutoff, OUT,
-                             gPartnertoDonate, gAccept))
-         {
-            return(FALSE);
-         }
+         sprintf(msg, "%s %s: %s", site->locres1, site->locres2,
+                 result.message[j]);
+         PrintError(NULL, msg);
       }
    }
-   return(TRUE);
+
+   FREELIST(residues, PDB);
 }
 
 /************************************************************************/
-/* ACRM 13.09.11 Added more error messages */
-BOOL AnalyzeMCAcceptorPair(int resnum1, int resnum2, PDB *pdb, 
-                           FILE *matrix, FILE *matrix2,
-                           char *chain1, char *chain2, 
-                           char *insert1, char *insert2, BOOL *hbplus,
-                           char *hatom1, char *hatom2, REAL cutoff, 
-                           char *res1, char *res2,
-                           FILE *OUT)
+void PrintScanSite(FILE *out, SCANSITE *site, char types[][8],
+                   int ntypes)
 {
-   VEC3F CtoCAVector;
+   int i;
 
-   PDB *res1_start, *res1_stop, *res2_start, *res2_stop;
-   
-   /* Find the key residue which is the mainchain acceptor */
-   for(res1_start =  pdb;
-       res1_start != NULL;
-       res1_start =  res1_stop)
-   {
-      res1_stop = blFindNextResidue(res1_start);
-                        
-      /* if *key* residue of choice */
-      if((resnum1 == res1_start->resnum)
-         && (chain1[0]==res1_start->chain[0])
-         && (insert1[0] == res1_start->insert[0]))
-      {
-         break;
-      }
-   }
-   if(res1_start==NULL)
-   {
-      PrintError(OUT, "Can't find residue 1  in PDB file\n");
-      return(FALSE);
-   }
-   
-   /*Find the partner residue which is the sidechain acceptor */
-   for(res2_start = pdb; res2_start !=NULL;
-       res2_start=res2_stop)
+   if(!site->OK)
    {
-      res2_stop = blFindNextResidue(res2_start);
-      
-      /* if *partner* residue of choice */
-      if((resnum2 == res2_start->resnum)
-         && (chain1[0]==res1_start->chain[0])
-         && (insert1[0] == res1_start->insert[0]))
-      {
-         break;
-      }
-   }
-   if(res2_start==NULL)
-   {
-      PrintError(OUT, "Can't find residue 2 in PDB file\n");
-      return(FALSE);
+      fprintf(out, "%s %s %s - error -\n", site->locres1, site->locres2,
+              site->query.res2);
+      return;
    }
-   
-   if(!ReadInMatrices(res1, res2, matrix, MAT_READ_DONOR2, MAT_RES_2))
-   {
-      /* ACRM 08.09.05 - error message */
-      char buffer[160];
-      sprintf(buffer, "Unable to find residue in the sc/sc matrix file: %s\n", res2);
-      PrintError(OUT, buffer);
-      return(FALSE);
-   }
-   
-   if(!ReadInMatrices(res1, res2, matrix2, MAT_READ_ACCEPTOR1, MAT_RES_1))
-   {
-      /* ACRM 08.09.05 - error message */
-      char buffer[160];
-      sprintf(buffer, "Unable to find residue in the mc acceptor matrix file: %s\n", res1);
-      PrintError(OUT, buffer);
-      return(FALSE);
-   }
-   
-   /* ACRM 25.03.11 Check return value */
-   if(!OrientatePDB(pdb, res2_start, res2_stop))
+
+   for(i=0; i<ntypes; i++)
    {
-      PrintError(OUT, "Can't orientate the PDB file\n");
-      return(FALSE);
+      fprintf(out, "%s %s %s %s ", site->locres1, site->locres2,
+              site->query.res2, types[i]);
+      if(site->valid[i])
+         fprintf(out, "valid %.2f\n", site->energy[i]);
+      else
+         fprintf(out, "none -\n");
    }
-   
-#ifndef NOCULL
-   CullArrays(pdb, res1_start, res2_start, gDonate,
-              gPartnertoDonate);
-#endif
+}
+
+/************************************************************************/
+/* Opens the matrix files for combined mode. matrix (the SC/SC matrix)
+   is already open; the SC/MC matrix is shared by the main chain kinds
+*/
+BOOL OpenKindMatrices(MATFILE *matrix, char *scmc_file,
+                      char *ndonor_file, char *oacceptor_file,
+                      KINDMATRICES *kinds)
+{
+   MATFILE *scmc;
+   int     kind;
+
+   kinds[HB_SCSC].matrix  = matrix;
+   kinds[HB_SCSC].matrix2 = NULL;
 
-   /* ACRM 25.03.11 Check return value */
-   if(!OrientateCO_PDB(pdb, res1_start, res1_stop))
+   if(((scmc = OpenMatrixFile(scmc_file, MATRIXFILE_MCDONOR))==NULL) ||
+      ((kinds[HB_MCDONOR].matrix2 =
+        OpenMatrixFile(ndonor_file, MATRIXFILE_MCDONOR))==NULL) ||
+      ((kinds[HB_MCACCEPTOR].matrix2 =
+        OpenMatrixFile(oacceptor_file, MATRIXFILE_MCACCEPTOR))==NULL))
    {
-      PrintError(OUT, "Can't orientate the PDB file about CO\n");
+      PrintError(NULL, "Sorry, unable to open matrix file\n");
       return(FALSE);
    }
-   
-#ifndef NOCULL
-   CullArrays(pdb, res1_start, res2_start,
-              gAccept, gPartnertoAccept);
-#endif   
+   kinds[HB_MCDONOR].matrix = kinds[HB_MCACCEPTOR].matrix = scmc;
 
-   CalculateCToCaVector(res1_start, res1_stop, res2_start,
-                         res2_stop, &CtoCAVector);
-   
-   CreateRotationMatrix(pdb, res1_start, res1_stop, res2_start,
-                        res2_stop, CtoCAVector, ATOMS_CACO, ATOMS_NCACB, NULL);
+   for(kind=0; kind<HB_NKINDS; kind++)
+      kinds[kind].ntypes = MatrixResidueTypes(kinds[kind].matrix->bin,
+                                              kinds[kind].types,
+                                              HB_MAXTYPES);
 
-   if(*hbplus == TRUE)    /* ACRM 23.07.04 Dereference pointer! */
-   {
-      /* ACRM 25.03.11 Check return value */
-      if(!OrientatePDB(pdb, res2_start, res2_stop))
-      {
-         PrintError(OUT, "Can't orientate the PDB file\n");
-         return(FALSE);
-      }
-      
-      if(CalculateHBondEnergy(pdb, res1_start, res1_stop,
-                              res2_start,
-                              res2_stop, CtoCAVector, cutoff,
-                              hatom1, hatom2, OUT) == CHBE_ERROR)
-      {
-         PrintError(OUT, "Unable to calculate HBondEnergy (3)\n");
-      }
-   }
-   else
-   {
-      /* 06.02.06 ACRM - the two grids were the wrong way around! */
-      if(!CheckValidHBond(CtoCAVector, cutoff, OUT,
-                          gPartnertoAccept, gDonate))
-      {
-         if(!CheckValidHBond(CtoCAVector, cutoff, OUT,
-                             gAccept, gPartnertoDonate))
-         {
-            return(FALSE);
-         }
-      }
-   }
    return(TRUE);
 }
 
 /************************************************************************/
-/* Takes a PDB linked list of a single residue (pdb) and removes the
-   C atom. Then takes a copy of the C atom from another residue (prev)
-   and prepends it onto the first linked list
+/* Combined mode (-M). Runs the pair of residues in pdb (as returned by
+   GetResidues()) as each kind of pair and prints a line for each:
+      kind result energy
+   where kind is scsc, ndonor or oacceptor. Messages go only to stderr.
 */
-PDB *SwapCarbon(PDB *pdb, PDB *prevres)
+BOOL RunCombined(HBCONTEXT *ctx, PDB *pdb, KINDMATRICES *kinds,
+                 HBQUERY *query, FILE *out)
 {
-   PDB *p, *c, *newc, *stop, *prev;
-   
-   /* First we drop the existing carbon */
-   for(p=pdb, prev=NULL; p!=NULL; NEXT(p))
-   {
-      if(!strncmp(p->atnam, "C   ", 4))
-      {
-         if(prev==NULL)
-         {
-            pdb = p->next;
-            free(p);
-            break;
-         }
-         else
-         {
-            prev->next = p->next;
-            free(p);
-            break;
-         }
-      }
-      prev = p;
-   }
+   REAL energy;
+   int  kind, status;
 
-   stop = blFindNextResidue(prevres);
-   if((c = FindAtom(prevres, stop, "C   ", NULL))==NULL)
+   fprintf(out, "# kind result energy\n");
+   for(kind=0; kind<HB_NKINDS; kind++)
    {
-      return(NULL);
-   }
-   INIT(newc, PDB);
-   if(newc==NULL)
-   {
-      return(NULL);
+      status = RunKindQuery(ctx, pdb, kind, kinds+kind, query, "",
+                            &energy);
+      fprintf(out, "%s %s ", KindName(kind), BatchStatusName(status));
+      if(status == BATCH_VALID)
+         fprintf(out, "%.2f\n", energy);
+      else
+         fprintf(out, "-\n");
    }
-   blCopyPDB(newc,c);
-   newc->next = pdb;
-   
-   return(newc);
-}
 
+   return(TRUE);
+}
 
 /************************************************************************/
-/* function that creates a rotation matrix (global) to fit res 1
-   (*key* residue) onto res 2 (*partner* residue). A weight of 1.0
-   is added to atoms CA and N and 0.1 to atom C. 
-   Includes option to print out residues at set stages for debugging
-   purposes.
-
-   If we are ever to do backbone-backbone we will need to support
-   atomset2 being C,N,CA
+/* Runs a pair of residues (as returned by GetResidues()) as one kind
+   of pair. Messages go to stderr, preceded by label and the kind.
+   Returns the BATCH_xxx outcome.
 */
-BOOL CreateRotationMatrix(PDB *pdb, PDB *res1_start, PDB *res1_stop,
-                          PDB *res2_start, PDB *res2_stop,VEC3F Vector,
-                          int atomset1, int atomset2, PDB *prevres1)
+int RunKindQuery(HBCONTEXT *ctx, PDB *residues, int kind,
+                 KINDMATRICES *km, HBQUERY *query, char *label,
+                 REAL *energy)
 {
-   VEC3F tempv;   
-   
-   PDB  *keyres1_pdb = NULL, 
-        *partnerres2_pdb = NULL;
-   char *sel1[4], *sel2[4];
-   
-   REAL *weight = NULL;
-   int  natoms,
-        NumCo_ord1 = 0,
-        NumCo_ord2 = 0,
-        i          = 0;
-   PDB  *q         = NULL,
-        *start     = NULL;
-   COOR *keyres1_coor = NULL,
-        *partnerres2_coor = NULL;
-    
-   switch(atomset1)
-   {
-   case ATOMS_NCAC:
-      SELECT(sel1[0], "N   ");
-      SELECT(sel1[1], "CA  ");
-      SELECT(sel1[2], "C   ");
-      break;
-   case ATOMS_NCACB:
-      SELECT(sel1[0], "N   ");
-      SELECT(sel1[1], "CA  ");
-      SELECT(sel1[2], "CB  ");
-      break;
-   case ATOMS_CNCA:
-      SELECT(sel1[0], "C   ");
-      SELECT(sel1[1], "N   ");
-      SELECT(sel1[2], "CA  ");
-      break;
-   case ATOMS_CACO:
-      SELECT(sel1[0], "CA  ");
-      SELECT(sel1[1], "C   ");
-      SELECT(sel1[2], "O   ");
-      break;
-   default:
-      return(FALSE);
-   }
-   
-   switch(atomset2)
-   {
-   case ATOMS_NCAC:
-      SELECT(sel2[0], "N   ");
-      SELECT(sel2[1], "CA  ");
-      SELECT(sel2[2], "C   ");
-      break;
-   case ATOMS_NCACB:
-      SELECT(sel2[0], "N   ");
-      SELECT(sel2[1], "CA  ");
-      SELECT(sel2[2], "CB  ");
-      break;
-   case ATOMS_CNCA:
-      PrintError(NULL,"ENTERNAL ERROR - Code must be modified to support C,N,CA in second position\n");
-      exit(1);
-      SELECT(sel2[0], "C   ");
-      SELECT(sel2[1], "N   ");
-      SELECT(sel2[2], "CA  ");
-      break;
-   case ATOMS_CACO:
-      SELECT(sel2[0], "CA  ");
-      SELECT(sel2[1], "C   ");
-      SELECT(sel2[2], "O   ");
-      break;
-   default:
-      return(FALSE);
-   }
-   
-   if((sel1[0] ==NULL)||(sel2[0]==NULL))
-   {
-      return(FALSE);
-   }
-   /* create linked list containing just C, N and CA atoms of residue 1 */
-   if((keyres1_pdb = SelectAtomsResidue(res1_start, res1_stop,
-                                        3, sel1, &natoms)) == NULL)
-   {
-      return(FALSE);
-   }  
+   HBRESULT result;
+   char     msg[4*MAXBUFF];
+   int      i;
+   BOOL     found;
 
-   /* If we are doing C,N,CA, we want to swap the carbon from res1 for the
-      carbon from the previous residue
-   */
-   if(atomset1 == ATOMS_CNCA)
+   ClearHBContext(ctx);
+   InitHBResult(&result);
+   found = RunHBQuery(ctx, residues, kind, km->matrix, km->matrix2,
+                      query, &result);
+
+   for(i=0; i<result.nmessages; i++)
    {
-      if((keyres1_pdb = SwapCarbon(keyres1_pdb, prevres1))==NULL)
-      {
-         return(FALSE);
-      }
+      sprintf(msg, "%s%s: %s", label, KindName(kind), result.message[i]);
+      PrintError(NULL, msg);
    }
-   /* create linked list containing just C, N and CA atoms of residue 2 */
-   if((partnerres2_pdb = SelectAtomsResidue(res2_start, res2_stop,
-                                            3, sel2, &natoms)) == NULL)
+
+   return(BatchStatus(&result, found, energy));
+}
+
+/************************************************************************/
+/* Name of a kind of pair in combined mode output                       */
+char *KindName(int kind)
+{
+   switch(kind)
    {
-      return(FALSE);
+   case HB_MCDONOR:
+      return("ndonor");
+   case HB_MCACCEPTOR:
+      return("oacceptor");
+   default:
+      break;
    }
+   return("scsc");
+}
 
-#ifdef DEBUG
-   printf("REMARK DEBUG (checkhbond): original coordinates\n");
-   blWritePDB(stdout, keyres1_pdb);
-   blWritePDB(stdout, partnerres2_pdb);
-#endif
-   
-   /*moving partnerres2_pdb  CA atom to the origin */
-   tempv.x = -Vector.x;
-   tempv.y = -Vector.y;
-   tempv.z = -Vector.z;
+/************************************************************************/
+/* Function that recognises any residues not capable of hydrogen bonding
+ */
+BOOL IsHBondCapable(char *residue)
+{   
+   int i;
+   char *NotHBondRes[9];
+   BOOL flag = FALSE;
    
-   blTranslatePDB(partnerres2_pdb, tempv);
-    
-#ifdef DEBUG
-   printf("REMARK DEBUG (checkhbond): translated coordinates\n");
-   blWritePDB(stdout, keyres1_pdb);
-   blWritePDB(stdout, partnerres2_pdb);
-#endif
-
-   /* create coordinate arrays for res1 and res2 */
-   NumCo_ord2 = blGetPDBCoor(partnerres2_pdb, &partnerres2_coor);
-   NumCo_ord1 = blGetPDBCoor(keyres1_pdb, &keyres1_coor);
+   NotHBondRes[0] = "MET";
+   NotHBondRes[1] = "CYS";
+   NotHBondRes[2] = "ILE";
+   NotHBondRes[3] = "VAL";
+   NotHBondRes[4] = "PHE";
+   NotHBondRes[5] = "GLY";
+   NotHBondRes[6] = "ALA";
+   NotHBondRes[7] = "PRO";
+   NotHBondRes[8] = "LEU";
 
-   /* create the weight array */
-   if((weight = (REAL *)malloc(NumCo_ord1 * sizeof(REAL))) == NULL)
+   for(i = 0; i < 9; i++)
    {
-      if(partnerres2_coor)
+      if(!strcmp(residue, NotHBondRes[i]))
       {
-         free(partnerres2_coor);
-         partnerres2_coor = NULL;
-      }
-      if(keyres1_coor)
+         flag = TRUE;
+         break;
+      } 
+      else
       {
-         free(keyres1_coor);
-         keyres1_coor = NULL;
+         flag = FALSE;
       }
-      return(FALSE);
-   }
-
-   /* Set up the weight array */
-   start = partnerres2_pdb;
-   i = 0;
-   for(q = start; q!=NULL; NEXT(q))
-   {
-      if(!strncmp(q->atnam, sel2[0], 4))
-         weight[i] = (REAL)1.0;
-      if(!strncmp(q->atnam, sel2[1], 4))
-         weight[i] = (REAL)1.0;
-      if(!strncmp(q->atnam, sel2[2], 4))
-         weight[i] = (REAL)(0.1);
-      i++;
    }
    
-   /* create rotation matrix. */
-   if(!blMatfit(partnerres2_coor, keyres1_coor, gRotation_matrix,
-              NumCo_ord2, weight, FALSE))
-   {
-      PrintError(NULL,"Fitting failed!\n");
-      return(FALSE);
-   }
-
-#ifdef DEBUG   
-   blApplyMatrixPDB(keyres1_pdb, gRotation_matrix);
-   printf("REMARK DEBUG (checkhbond) rotated coordinates\n");
-   blWritePDB(stdout, keyres1_pdb);
-   blWritePDB(stdout, partnerres2_pdb);
-#endif
-   
-   FREELIST(partnerres2_pdb, PDB);
-   partnerres2_pdb = NULL;
-   
-   FREELIST(keyres1_pdb, PDB);
-   keyres1_pdb = NULL;
-   
-   free(weight);
-   weight = NULL;
-   
-   free(sel1[0]);
-   sel1[0] = NULL;
-   
-   free(sel1[1]);
-   sel1[1] = NULL;
-   
-   free(sel1[2]);
-   sel1[2] = NULL;
-   
-   free(sel2[0]);
-   sel2[0] = NULL;
-   
-   free(sel2[1]);
-   sel2[1] = NULL;
-   
-   free(sel2[2]);
-   sel2[2] = NULL;
-   
-   return(TRUE);
+   return(flag);
 }
 
@@ -0,0 +1,161 @@
+/*************************************************************************
+
+   Program:    compile_matrices
+   File:       compile_matrices.c
+
+   Version:    V1.0
+   Date:       17.10.26
+   Function:   Convert a text H-bond matrix file into the compiled
+               binary form read directly by checkhbond
+
+**************************************************************************
+
+   Description:
+   ============
+   Reads the text output of hydrogen_matrices (PrintMatrix()) and
+   writes a compiled matrix file (see matfile.h) containing the same
+   residue sections as sparse cell lists with precomputed totals.
+   checkhbond recognises compiled files automatically, so either form
+   may be given with -m or -n.
+
+**************************************************************************
+
+   Usage:
+   ======
+   compile_matrices [-v build] textmatrix binmatrix
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "bioplib/macros.h"
+#include "bioplib/pdb.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "orientate.h"
+#include "hbondmat2.h"
+#include "matfile.h"
+
+/************************************************************************/
+/* Prototypes
+*/
+int main(int argc, char *argv[]);
+BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
+                  char *build);
+void Usage(void);
+
+/************************************************************************/
+int main(int argc, char *argv[])
+{
+   char        infile[MAXBUFF], outfile[MAXBUFF], build[MAT_BUILDLEN];
+   FILE        *in, *out;
+   TEXTSECTION *sections;
+
+   if(!ParseCmdLine(argc, argv, infile, outfile, build))
+   {
+      Usage();
+      return(0);
+   }
+
+   if((in = fopen(infile, "r"))==NULL)
+   {
+      PrintError(NULL, "Unable to open text matrix file\n");
+      return(1);
+   }
+
+   if((sections = ReadTextMatrix(in))==NULL)
+   {
+      PrintError(NULL, "No residue sections read from text matrix file\n");
+      return(1);
+   }
+   fclose(in);
+
+   if((out = fopen(outfile, "wb"))==NULL)
+   {
+      PrintError(NULL, "Unable to open compiled matrix file for writing\n");
+      return(1);
+   }
+
+   if(!WriteBinaryMatrix(out, sections, (build[0] ? build : infile)))
+   {
+      PrintError(NULL, "Failed to write compiled matrix file\n");
+      fclose(out);
+      remove(outfile);
+      return(1);
+   }
+   fclose(out);
+
+   FreeTextMatrix(sections);
+   return(0);
+}
+
+/************************************************************************/
+/* function to parse the command line */
+BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
+                  char *build)
+{
+   argc--;
+   argv++;
+
+   build[0] = '\0';
+
+   while(argc)
+   {
+      if(argv[0][0] == '-')
+      {
+         switch(argv[0][1])
+         {
+         case 'v':
+            argc--;
+            argv++;
+            if(!argc)
+               return(FALSE);
+            strncpy(build, argv[0], MAT_BUILDLEN-1);
+            build[MAT_BUILDLEN-1] = '\0';
+            break;
+         default:
+            return(FALSE);
+         }
+      }
+      else
+      {
+         if(argc != 2)
+            return(FALSE);
+
+         strcpy(infile, argv[0]);
+         strcpy(outfile, argv[1]);
+         return(TRUE);
+      }
+      argc--;
+      argv++;
+   }
+   return(FALSE);
+}
+
+/************************************************************************/
+/* function to display a usage message */
+void Usage(void)
+{
+   fprintf(stderr, "\nCompile_Matrices V1.0\n\n");
+   fprintf(stderr, "Usage: compile_matrices [-v build] textmatrix \
+binmatrix\n\n");
+   fprintf(stderr, "  -v [build]: version string stored in the compiled \
+file\n");
+   fprintf(stderr, "              (default: name of the text matrix \
+file)\n");
+   fprintf(stderr, "  textmatrix: matrix file written by \
+hydrogen_matrices\n");
+   fprintf(stderr, "  binmatrix:  compiled matrix file to write\n\n");
+   fprintf(stderr, "Converts a text H-bond matrix file into the compiled \
+form which checkhbond\n");
+   fprintf(stderr, "maps into memory instead of parsing. Either form may \
+be given to checkhbond.\n\n");
+}
@@ -0,0 +1,316 @@
+/*************************************************************************
+
+   Program:    hydrogen_matrices
+   File:       contrib.c
+
+   Version:    V1.0
+   Date:       17.10.26
+   Function:   Store the contribution of each structure to the matrices
+               so that a new domain list only needs new structures run
+
+**************************************************************************
+
+   Description:
+   ============
+   The matrices are sums of counts over the structures in the CATH
+   domain list, and most structures are the same from one CATH release
+   to the next. With a store directory (hydrogen_matrices -s) the cells
+   each structure adds to are recorded as it is run and saved, one file
+   per structure. A later build adds in the saved cells of structures
+   it has seen before, and only runs the new (or changed) ones.
+
+   The matrices are always summed from the stored contributions of the
+   structures in the current list, so a domain dropped from the list
+   simply drops out of the sums, and there is no running total to go
+   wrong. Since the sums are of integer counts the matrices are exactly
+   those of a full build.
+
+   Entries are written to a temporary file which is then renamed, as
+   in strcache.c.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#define _POSIX_C_SOURCE 200809L /* For mkdir() and mkstemp()           */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bioplib/macros.h"
+#include "bioplib/pdb.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "hbondmat2.h"
+#include "strcache.h"
+#include "contrib.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define CONTRIBBLOCK 256    /* Growth step for a recorded contribution */
+
+/************************************************************************/
+/* Prototypes
+*/
+static char *ContribFileName(char *storedir, char *domain, char *variant);
+static BOOL ReadContribHeader(FILE *fp, char *variant, char *location,
+                              char chain, unsigned long pgphash,
+                              int ntypes, CONTRIBHEADER *header);
+static int  CompareContribCells(const void *a, const void *b);
+
+/************************************************************************/
+/* Records a count of one in a cell. Cells may be added more than once;
+   CompactContrib() merges them
+*/
+BOOL AddContribCell(CONTRIB *contrib, int type, int grid, int x, int y,
+                    int z)
+{
+   CONTRIBCELL *cells;
+
+   if(contrib->ncells == contrib->maxcells)
+   {
+      if((cells = (CONTRIBCELL *)realloc(contrib->cells,
+                                         (contrib->maxcells +
+                                          CONTRIBBLOCK) *
+                                         sizeof(CONTRIBCELL)))==NULL)
+         return(FALSE);
+      contrib->cells     = cells;
+      contrib->maxcells += CONTRIBBLOCK;
+   }
+
+   cells = contrib->cells + contrib->ncells;
+   cells->type  = (unsigned char)type;
+   cells->grid  = (unsigned char)grid;
+   cells->x     = (unsigned char)x;
+   cells->y     = (unsigned char)y;
+   cells->z     = (unsigned char)z;
+   cells->pad[0] = cells->pad[1] = cells->pad[2] = 0;
+   cells->count = 1;
+   (contrib->ncells)++;
+
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Sorts the cells and merges repeats of a cell into one with the total
+   count
+*/
+void CompactContrib(CONTRIB *contrib)
+{
+   CONTRIBCELL *cells = contrib->cells;
+   int         i, n;
+
+   if(contrib->ncells < 2)
+      return;
+
+   qsort(cells, contrib->ncells, sizeof(CONTRIBCELL),
+         CompareContribCells);
+   for(i=1, n=0; i<contrib->ncells; i++)
+   {
+      if(CompareContribCells(cells+i, cells+n))
+         cells[++n] = cells[i];
+      else
+         cells[n].count += cells[i].count;
+   }
+   contrib->ncells = n+1;
+}
+
+/************************************************************************/
+void ClearContrib(CONTRIB *contrib)
+{
+   if(contrib->cells != NULL)
+      free(contrib->cells);
+   contrib->cells    = NULL;
+   contrib->ncells   = 0;
+   contrib->maxcells = 0;
+}
+
+/************************************************************************/
+/* Reads the stored contribution of a domain into contrib (which should
+   be empty). Returns FALSE if there is no up-to-date entry
+*/
+BOOL ReadContrib(char *storedir, char *domain, char *variant,
+                 char *location, char chain, unsigned long pgphash,
+                 int ntypes, CONTRIB *contrib)
+{
+   CONTRIBHEADER header;
+   FILE          *fp;
+   char          *filename;
+   BOOL          ok = FALSE;
+
+   if((filename = ContribFileName(storedir, domain, variant)) == NULL)
+      return(FALSE);
+   fp = fopen(filename, "rb");
+   free(filename);
+   if(fp == NULL)
+      return(FALSE);
+
+   if(ReadContribHeader(fp, variant, location, chain, pgphash, ntypes,
+                        &header))
+   {
+      if(header.ncells == 0)
+      {
+         ok = TRUE;
+      }
+      else if((contrib->cells =
+               (CONTRIBCELL *)malloc(header.ncells *
+                                     sizeof(CONTRIBCELL))) != NULL)
+      {
+         contrib->ncells = contrib->maxcells = header.ncells;
+         ok = (fread(contrib->cells, sizeof(CONTRIBCELL), header.ncells,
+                     fp) == (size_t)header.ncells);
+         if(!ok)
+            ClearContrib(contrib);
+      }
+   }
+
+   fclose(fp);
+   return(ok);
+}
+
+/************************************************************************/
+/* Saves the contribution of a domain, which should have been through
+   CompactContrib(). Returns FALSE if it could not be written
+*/
+BOOL WriteContrib(char *storedir, char *domain, char *variant,
+                  char *location, char chain, unsigned long pgphash,
+                  int ntypes, CONTRIB *contrib)
+{
+   CONTRIBHEADER header;
+   FILE          *fp;
+   char          *filename,
+                 *tempname;
+   int           fd;
+   BOOL          ok;
+
+   memset(&header, 0, sizeof(CONTRIBHEADER));
+   if(!SourceStat(location, &header.srcsize, &header.srcmtime))
+      return(FALSE);
+   strcpy(header.magic, CONTRIB_MAGIC);
+   header.byteorder      = CONTRIB_BYTEORDER;
+   header.format         = CONTRIB_FORMAT;
+   header.maxsize        = MAXSIZE;
+   header.divPerAngstrom = DIV_PER_ANGSTROM;
+   header.ntypes         = ntypes;
+   header.ncells         = contrib->ncells;
+   header.pathlen        = strlen(location);
+   header.pgphash        = pgphash;
+   header.chain          = chain;
+   strncpy(header.variant, variant, CONTRIB_VARIANTLEN-1);
+
+   if((filename = ContribFileName(storedir, domain, variant)) == NULL)
+      return(FALSE);
+   if((tempname = (char *)malloc(strlen(filename) + 8)) == NULL)
+   {
+      free(filename);
+      return(FALSE);
+   }
+   sprintf(tempname, "%s.XXXXXX", filename);
+
+   mkdir(storedir, 0777);        /* Fails harmlessly if it exists       */
+   if(((fd = mkstemp(tempname)) == (-1)) ||
+      ((fp = fdopen(fd, "wb")) == NULL))
+   {
+      if(fd != (-1))
+      {
+         close(fd);
+         remove(tempname);
+      }
+      free(filename);
+      free(tempname);
+      return(FALSE);
+   }
+
+   ok = ((fwrite(&header, sizeof(CONTRIBHEADER), 1, fp) == 1) &&
+         (fwrite(location, 1, header.pathlen, fp) ==
+          (size_t)header.pathlen));
+   if(ok && contrib->ncells)
+      ok = (fwrite(contrib->cells, sizeof(CONTRIBCELL), contrib->ncells,
+                   fp) == (size_t)contrib->ncells);
+   if(fclose(fp) != 0)
+      ok = FALSE;
+
+   if(!ok || rename(tempname, filename))
+   {
+      remove(tempname);
+      ok = FALSE;
+   }
+
+   free(filename);
+   free(tempname);
+   return(ok);
+}
+
+/************************************************************************/
+static char *ContribFileName(char *storedir, char *domain, char *variant)
+{
+   char *filename;
+
+   if((filename = (char *)malloc(strlen(storedir) + strlen(domain) +
+                                 strlen(variant) + 8)) != NULL)
+      sprintf(filename, "%s/%s.%s.hbc", storedir, domain, variant);
+   return(filename);
+}
+
+/************************************************************************/
+/* Reads the header and source path of a store entry and checks that
+   they match the structure and build wanted
+*/
+static BOOL ReadContribHeader(FILE *fp, char *variant, char *location,
+                              char chain, unsigned long pgphash,
+                              int ntypes, CONTRIBHEADER *header)
+{
+   char *path;
+   long size, mtime;
+   BOOL ok;
+
+   if((fread(header, sizeof(CONTRIBHEADER), 1, fp) != 1)          ||
+      strncmp(header->magic, CONTRIB_MAGIC, sizeof(CONTRIB_MAGIC))  ||
+      (header->byteorder      != CONTRIB_BYTEORDER)                 ||
+      (header->format         != CONTRIB_FORMAT)                    ||
+      (header->maxsize        != MAXSIZE)                           ||
+      (header->divPerAngstrom != DIV_PER_ANGSTROM)                  ||
+      (header->ntypes         != ntypes)                            ||
+      (header->pgphash        != pgphash)                           ||
+      (header->chain          != chain)                             ||
+      (header->pathlen        != (int)strlen(location))             ||
+      (header->ncells         <  0)                                 ||
+      strncmp(header->variant, variant, CONTRIB_VARIANTLEN))
+      return(FALSE);
+
+   if(!SourceStat(location, &size, &mtime) ||
+      (header->srcsize != size) || (header->srcmtime != mtime))
+      return(FALSE);
+
+   if((path = (char *)malloc(header->pathlen + 1)) == NULL)
+      return(FALSE);
+   ok = ((fread(path, 1, header->pathlen, fp) ==
+          (size_t)header->pathlen) &&
+         !strncmp(path, location, header->pathlen));
+   free(path);
+
+   return(ok);
+}
+
+/************************************************************************/
+/* qsort() comparison: cells in order of type, grid, x, y, z            */
+static int CompareContribCells(const void *a, const void *b)
+{
+   const CONTRIBCELL *p = (const CONTRIBCELL *)a,
+                     *q = (const CONTRIBCELL *)b;
+
+   if(p->type != q->type) return((p->type < q->type) ? (-1) : 1);
+   if(p->grid != q->grid) return((p->grid < q->grid) ? (-1) : 1);
+   if(p->x    != q->x)    return((p->x    < q->x)    ? (-1) : 1);
+   if(p->y    != q->y)    return((p->y    < q->y)    ? (-1) : 1);
+   if(p->z    != q->z)    return((p->z    < q->z)    ? (-1) : 1);
+   return(0);
+}
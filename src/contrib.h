@@ -0,0 +1,78 @@
+#ifndef CONTRIB_H
+#define CONTRIB_H
+
+/* Per-structure contributions to the matrices made by hydrogen_matrices
+   (contrib.c): the grid cells each structure added to, with counts.
+
+   One file per structure and builder, in the store directory, named
+   <domain>.<variant>.hbc. Layout (native byte order, as matfile.h):
+
+      CONTRIBHEADER
+      char[pathlen]               Source file the structure came from
+      CONTRIBCELL[ncells]         In order of type, grid, x, y, z
+
+   An entry is used only if it is for the same builder, grid geometry
+   and number of hydrogen bond types, and the source path, chain, size,
+   modification time and PGP file hash all match.
+
+   The header relies on bioplib/SysDefs.h having been included.
+*/
+
+#define CONTRIB_MAGIC      "CHBCNTR"
+#define CONTRIB_BYTEORDER  0x01020304
+#define CONTRIB_FORMAT     1
+#define CONTRIB_VARIANTLEN 16
+
+/* Grid numbers, in the order PrintMatrix() writes them                 */
+#define CONTRIB_DONATE           0
+#define CONTRIB_PARTNERTODONATE  1
+#define CONTRIB_ACCEPT           2
+#define CONTRIB_PARTNERTOACCEPT  3
+
+typedef struct
+{
+   char          magic[8];
+   int           byteorder,
+                 format,
+                 maxsize,             /* Grid geometry                 */
+                 divPerAngstrom,
+                 ntypes,              /* Hydrogen bond types           */
+                 ncells,
+                 pathlen;
+   long          srcsize,
+                 srcmtime;
+   unsigned long pgphash;
+   char          variant[CONTRIB_VARIANTLEN],
+                 chain,               /* '\0' for the whole file       */
+                 pad[7];
+}  CONTRIBHEADER;
+
+typedef struct
+{
+   unsigned char type,                /* Index of hydrogen bond type   */
+                 grid,                /* CONTRIB_xxx                   */
+                 x, y, z,
+                 pad[3];
+   int           count;
+}  CONTRIBCELL;
+
+/* The contribution of one structure, as recorded or read              */
+typedef struct
+{
+   CONTRIBCELL *cells;
+   int         ncells,
+               maxcells;
+}  CONTRIB;
+
+BOOL AddContribCell(CONTRIB *contrib, int type, int grid, int x, int y,
+                    int z);
+void CompactContrib(CONTRIB *contrib);
+void ClearContrib(CONTRIB *contrib);
+BOOL ReadContrib(char *storedir, char *domain, char *variant,
+                 char *location, char chain, unsigned long pgphash,
+                 int ntypes, CONTRIB *contrib);
+BOOL WriteContrib(char *storedir, char *domain, char *variant,
+                  char *location, char chain, unsigned long pgphash,
+                  int ntypes, CONTRIB *contrib);
+
+#endif
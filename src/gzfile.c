@@ -0,0 +1,165 @@
+/*************************************************************************
+
+   Program:    checkhbond / hydrogen_matrices
+   File:       gzfile.c
+
+   Version:    V1.0
+   Date:       17.10.26
+   Function:   Open input files which may be gzip-compressed
+
+**************************************************************************
+
+   Description:
+   ============
+   PDB mirrors are usually kept compressed (pdbXXXX.ent.gz). Rather
+   than decompressing into a temporary file, or through a pipe from
+   gunzip, a compressed file is read with zlib and the stream wrapped
+   in a stdio FILE (fopencookie()), so the bioplib readers and the rest
+   of the code use it as they would a plain file.
+
+   Compression is recognised from the gzip magic number at the start
+   of the file, so a compressed file need not be named .gz and a plain
+   file named .gz is still read. Without fopencookie() (i.e. other than
+   glibc) compressed files can not be opened.
+
+   The streams may only be read sequentially, which is all blReadPDB()
+   and friends need.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#define _GNU_SOURCE             /* For fopencookie()                    */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "gzfile.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define GZIP_MAGIC1 0x1f
+#define GZIP_MAGIC2 0x8b
+#define GZBUFFER    65536       /* zlib input buffer                    */
+
+/************************************************************************/
+/* Prototypes
+*/
+static FILE *OpenGzipFile(char *filename);
+#ifdef __GLIBC__
+static ssize_t ReadGzipCookie(void *cookie, char *buffer, size_t size);
+static int     CloseGzipCookie(void *cookie);
+#endif
+
+/************************************************************************/
+/* Opens a file for reading, decompressing it as it is read if it is
+   gzip-compressed. Close it with fclose(). Returns NULL if it can't be
+   opened
+*/
+FILE *OpenInputFile(char *filename)
+{
+   FILE *fp;
+   int  c1, c2;
+
+   if((fp = fopen(filename, "r")) == NULL)
+      return(NULL);
+
+   c1 = getc(fp);
+   c2 = getc(fp);
+   if((c1 == GZIP_MAGIC1) && (c2 == GZIP_MAGIC2))
+   {
+      fclose(fp);
+      return(OpenGzipFile(filename));
+   }
+
+   rewind(fp);
+   return(fp);
+}
+
+/************************************************************************/
+/* Takes a filename (which must have been malloc()'d) and, if there is
+   no such file but there is a compressed one with .gz added, replaces
+   it with the name of that. Returns the name to use, which is the one
+   given if it was not replaced, or NULL if there was no memory (or
+   filename was NULL)
+*/
+char *FindInputFile(char *filename)
+{
+   struct stat st;
+   char        *gzname;
+
+   if((filename == NULL) || (stat(filename, &st) == 0))
+      return(filename);
+
+   if((gzname = (char *)malloc(strlen(filename) + 4)) == NULL)
+   {
+      free(filename);
+      return(NULL);
+   }
+   sprintf(gzname, "%s.gz", filename);
+
+   if(stat(gzname, &st) == 0)
+   {
+      free(filename);
+      return(gzname);
+   }
+
+   free(gzname);
+   return(filename);
+}
+
+/************************************************************************/
+#ifdef __GLIBC__
+static FILE *OpenGzipFile(char *filename)
+{
+   cookie_io_functions_t io;
+   gzFile                gz;
+   FILE                  *fp;
+
+   if((gz = gzopen(filename, "rb")) == NULL)
+      return(NULL);
+   gzbuffer(gz, GZBUFFER);
+
+   memset(&io, 0, sizeof(cookie_io_functions_t));
+   io.read  = ReadGzipCookie;
+   io.close = CloseGzipCookie;
+
+   if((fp = fopencookie((void *)gz, "r", io)) == NULL)
+      gzclose(gz);
+   return(fp);
+}
+
+/************************************************************************/
+static ssize_t ReadGzipCookie(void *cookie, char *buffer, size_t size)
+{
+   int nread;
+
+   if(size > (size_t)GZBUFFER)
+      size = GZBUFFER;
+   nread = gzread((gzFile)cookie, buffer, (unsigned)size);
+   return((nread < 0) ? (-1) : (ssize_t)nread);
+}
+
+/************************************************************************/
+static int CloseGzipCookie(void *cookie)
+{
+   return((gzclose((gzFile)cookie) == Z_OK) ? 0 : (-1));
+}
+
+#else
+/************************************************************************/
+static FILE *OpenGzipFile(char *filename)
+{
+   fprintf(stderr, "Compressed files can not be read on this system: \
+%s\n", filename);
+   return(NULL);
+}
+#endif
@@ -0,0 +1,17 @@
+#ifndef GZFILE_H
+#define GZFILE_H
+
+/* Reading of input files which may be gzip-compressed (gzfile.c).
+
+   OpenInputFile() returns an ordinary stdio stream, read and closed
+   with the usual calls whether or not the file is compressed, so the
+   bioplib readers can be given it directly. A file is taken as
+   compressed from its first two bytes, not its name.
+
+   The header relies on stdio.h having been included.
+*/
+
+FILE *OpenInputFile(char *filename);
+char *FindInputFile(char *filename);
+
+#endif
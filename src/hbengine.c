@@ -0,0 +1,2243 @@
+/*************************************************************************
+
+   Program:    checkhbond
+   File:       hbengine.c
+   
+   Version:    V1.8
+   Date:       17.10.26
+   Function:   Reentrant H-bond scoring engine for checkhbond and
+               libcheckhbond
+   
+   Copyright:  (c) University of Reading / Alison L. Cuff 2002-2006
+   Author:     Alison L. Cuff
+   Address:    School of Animal and Microbial Sciences,
+               The University of Reading,
+               Whiteknights,
+               P.O. Box 228,
+               Reading RG6 6AJ.
+               England.
+               
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If someone
+   else breaks this code, I don't want to be blamed for code that does not
+   work! 
+
+   The code may not be sold commercially or included as part of a 
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   The matching code from checkhbond.c (V2.6), with the grids and
+   rotation matrix that were globals held in an HBCONTEXT and the
+   results and messages that were printed returned in an HBRESULT.
+   See checkhbond.c for a description of the method and hbengine.h
+   for the rules on using it from several threads.
+
+   The grids are not cleared between queries. checkhbond relies on
+   this when it tries a side-chain pair the other way round, so that
+   the second query sees the same grids as it always has; other callers
+   should call ClearHBContext() before each new pair.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original, split from checkhbond.c V2.6
+   V1.1  17.10.26 GetResidues() leaves the original list alone
+   V1.2  17.10.26 Added PrepareHBSite() and ScoreHBSite() for trying
+                  many residue types at position 2 with one orientation.
+                  Culling marks a mask of cells which is then cleared
+                  in the grids
+   V1.3  17.10.26 Added RunHBQuery() so that the kind of pair can be
+                  chosen at run time
+   V1.4  17.10.26 The PDB list is no longer orientated. The orientation
+                  of each residue is found as one transform from its
+                  backbone atoms and applied only to the atoms that are
+                  read
+   V1.5  17.10.26 Culled cells are marked from a table of offsets made
+                  once per context rather than by a loop over the cube
+                  around each atom
+   V1.6  17.10.26 CreateRotationMatrix() frees everything it allocates
+                  whether or not the fit works, and a failed fit stops
+                  the query. GetResidues() and SwapCarbon() free their
+                  partial lists on failure
+   V1.7  17.10.26 GetResidues() returns ERR_NORES1/2 for a residue not
+                  in the PDB list instead of crashing
+   V1.8  17.10.26 Added FormatResSpec() from checkhbond.c so the
+                  programs share it
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bioplib/macros.h"
+#include "bioplib/pdb.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/matrix.h"
+#include "bioplib/fit.h"
+#include "residues.h"
+#include "orientate.h"
+#include "hbondmat2.h"
+#include "matfile.h"
+#include "sparsegrid.h"
+#include "batchrot.h"
+#include "hbengine.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+/* radius of atom */
+#define RAD 25
+/* calculates distance in angstroms between atoms */
+#define DISTSQ_HATOMS(a,b) (a.x - b.x) * (a.x - b.x) + \
+                       (a.y - b.y) * (a.y - b.y) + \
+                       (a.z - b.z) * (a.z - b.z)
+
+/* Matrix reading styles for ReadInMatrices */
+#define MAT_READ_DONOR1    1
+#define MAT_READ_DONOR2    2
+#define MAT_READ_ACCEPTOR1 4
+#define MAT_READ_ACCEPTOR2 8
+#define MAT_READ_BOTH      9 /* DONOR1 and ACCEPTOR2 */
+#define MAT_RES_1          1
+#define MAT_RES_2          2
+#define MAT_RES_BOTH       3
+
+/* Atom sets for CreateRotationMatrix */
+#define ATOMS_NCAC   1
+#define ATOMS_CNCA   2
+#define ATOMS_CACO   3
+#define ATOMS_NCACB  4
+
+/* Returns from CalculateHBondEnergy() */
+#define CHBE_OK      0
+#define CHBE_NOHB    1
+#define CHBE_ERROR   2
+
+/* swaps two strings of an HBQUERY */
+#define SWAPSTRING(a, b) strcpy(buffer, (a)); strcpy((a), (b)); \
+                         strcpy((b), buffer)
+
+/* for debugging purposes */
+
+/*
+#define DEBUG
+#define DEBUG2
+#define DEBUG3
+*/
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL ReadInMatrices(HBCONTEXT *ctx, char *res1, char *res2,
+                           MATFILE *matrix, int type, int whichres,
+                           HBRESULT *result);
+static BOOL CopyBinaryGrid(BINMATRIX *bin, MATSECTION *section, int grid,
+                           SPARSEGRID *array, HBRESULT *result);
+static BOOL ResiduesFound(int whichres, BOOL found_residue1,
+                          BOOL found_residue2);
+static void CullArrays(HBCONTEXT *ctx, PDB *pdb, ORIENTATION *frame,
+                       PDB *res1, PDB *res2, SPARSEGRID *donate_array,
+                       SPARSEGRID *accept_array);
+static void MarkCulledCells(HBCONTEXT *ctx, PDB *pdb, ORIENTATION *frame,
+                            PDB *res1, PDB *res2, unsigned char *mask);
+static BOOL BuildCullOffsets(HBCONTEXT *ctx);
+static int  CompareCullOffsets(const void *offset1, const void *offset2);
+static void CalculateCaToCaVector(ORIENTATION *frame,
+                                  PDB *res1_start, PDB *res1_stop,
+                                  PDB *res2_start, PDB *res2_stop,
+                                  VEC3F *CAtoCAVector, HBRESULT *result);
+static void CalculateNToCaVector(ORIENTATION *frame,
+                                 PDB *res1_start, PDB *res1_stop,
+                                 PDB *res2_start, PDB *res2_stop,
+                                 VEC3F *NtoCAVector, HBRESULT *result);
+static void CalculateCToCaVector(ORIENTATION *frame,
+                                 PDB *res1_start, PDB *res1_stop,
+                                 PDB *res2_start, PDB *res2_stop,
+                                 VEC3F *CtoCAVector, HBRESULT *result);
+static PDB *FindAtom(PDB *start, PDB *stop, char *atnam, VEC3F *c_alpha);
+static PDB *FindOrientatedAtom(PDB *start, PDB *stop, char *atnam,
+                               ORIENTATION *frame, VEC3F *atm);
+static BOOL CreateRotationMatrix(HBCONTEXT *ctx, ORIENTATION *frame,
+                                 PDB *res1_start, PDB *res1_stop,
+                                 PDB *res2_start, PDB *res2_stop,
+                                 VEC3F CAtoCAVector, int atomset1,
+                                 int atomset2, PDB *prevres1,
+                                 HBRESULT *result);
+static BOOL CheckValidHBond(HBCONTEXT *ctx, VEC3F CAtoCAVector,
+                            SPARSEGRID *keyarray, SPARSEGRID *partnerarray,
+                            HBRESULT *result);
+static int CalculateHBondEnergy(HBCONTEXT *ctx, ORIENTATION *frame,
+                                PDB *res1_start, PDB *res1_stop,
+                                VEC3F CAtoCAVector, char *hatom1,
+                                HBRESULT *result);
+static void OrientateMatrix(HBCONTEXT *ctx, VEC3F CAtoCAVector,
+                            int x, int y, int z, VEC3F *rotated_coord);
+static REAL CalcEnergy(GRIDCELL *keycell, GRIDCELL *partnercell);
+static REAL Distance_squared (int i, int j, int k, int x_coord,
+                              int y_coord, int z_coord);
+static REAL DoCheckHBond(HBCONTEXT *ctx, GRIDCELL *partnercell,
+                         VEC3F CAtoCAVector, VEC3F *partner_coord,
+                         SPARSEGRID *keyarray, SPARSEGRID *bestarray);
+static REAL MatchPartnerCell(HBCONTEXT *ctx, GRIDCELL *partnercell,
+                             VEC3F rotated_coord,
+                             int x_coord, int y_coord, int z_coord,
+                             VEC3F *partner_coord, SPARSEGRID *keyarray,
+                             SPARSEGRID *bestarray);
+static SPARSEGRID *BestKeyGrid(HBCONTEXT *ctx, SPARSEGRID *keyarray);
+static PDB *SwapCarbon(PDB *pdb, PDB *prev);
+static BOOL FindPairResidues(PDB *pdb, HBQUERY *query,
+                             PDB **res1_start, PDB **res1_stop,
+                             PDB **res2_start, PDB **res2_stop,
+                             PDB **prevres1, HBRESULT *result);
+static BOOL PrepareHBFrame(HBCONTEXT *ctx, PDB *pdb, int kind,
+                           HBQUERY *query, HBFRAME *frame,
+                           HBRESULT *result);
+static BOOL CheckHBFrame(HBCONTEXT *ctx, int kind, HBFRAME *frame,
+                         HBRESULT *result);
+
+
+/************************************************************************/
+/* Creates a context with empty grids. Returns NULL if memory runs out.
+*/
+HBCONTEXT *CreateHBContext(REAL cutoff)
+{
+   HBCONTEXT *ctx;
+
+   if((ctx = (HBCONTEXT *)malloc(sizeof(HBCONTEXT)))==NULL)
+      return(NULL);
+
+   ctx->donate          = CreateSparseGrid();
+   ctx->accept          = CreateSparseGrid();
+   ctx->partnertoDonate = CreateSparseGrid();
+   ctx->partnertoAccept = CreateSparseGrid();
+   ctx->bestKey         = CreateSparseGrid();
+   ctx->partnerBatch    = CreateCellBatch();
+   ctx->cullMask        = (unsigned char *)malloc(GRIDMASKBYTES);
+   ctx->cullOffsets     = NULL;
+   ctx->cutoff          = cutoff;
+#if defined(DEBUG1) || defined(DEBUG2)
+   ctx->debugChain      = 'Z';
+#endif
+
+   if((ctx->donate == NULL) || (ctx->accept == NULL) ||
+      (ctx->partnertoDonate == NULL) || (ctx->partnertoAccept == NULL) ||
+      (ctx->bestKey == NULL) || (ctx->partnerBatch == NULL) ||
+      (ctx->cullMask == NULL) || !BuildCullOffsets(ctx))
+   {
+      FreeHBContext(ctx);
+      return(NULL);
+   }
+
+   return(ctx);
+}
+
+/************************************************************************/
+void FreeHBContext(HBCONTEXT *ctx)
+{
+   if(ctx == NULL)
+      return;
+
+   FreeSparseGrid(ctx->donate);
+   FreeSparseGrid(ctx->accept);
+   FreeSparseGrid(ctx->partnertoDonate);
+   FreeSparseGrid(ctx->partnertoAccept);
+   FreeSparseGrid(ctx->bestKey);
+   FreeCellBatch(ctx->partnerBatch);
+   if(ctx->cullMask != NULL)
+      free(ctx->cullMask);
+   if(ctx->cullOffsets != NULL)
+      free(ctx->cullOffsets);
+   free(ctx);
+}
+
+/************************************************************************/
+/* Empties the grids of a context before a new pair of residues        */
+void ClearHBContext(HBCONTEXT *ctx)
+{
+   ClearSparseGrid(ctx->donate);
+   ClearSparseGrid(ctx->accept);
+   ClearSparseGrid(ctx->partnertoDonate);
+   ClearSparseGrid(ctx->partnertoAccept);
+}
+
+/************************************************************************/
+void InitHBResult(HBRESULT *result)
+{
+   result->status    = HB_NONE;
+   result->energy    = 0.0;
+   result->nmessages = 0;
+}
+
+/************************************************************************/
+/* Adds a message (as would have been given to PrintError()) to a
+   result. Messages beyond HB_MAXMESSAGES are dropped.
+*/
+void AddHBMessage(HBRESULT *result, char *text, BOOL toOutput)
+{
+   if(result->nmessages < HB_MAXMESSAGES)
+   {
+      strncpy(result->message[result->nmessages], text, MAXBUFF-1);
+      result->message[result->nmessages][MAXBUFF-1] = '\0';
+      result->toOutput[result->nmessages] = toOutput;
+      result->nmessages++;
+   }
+}
+
+/************************************************************************/
+/* Swaps residues 1 and 2 of a query (including the H-bonding atoms)
+   for trying a side-chain pair the other way round
+*/
+void SwapHBQuery(HBQUERY *query)
+{
+   int  resnum;
+   char buffer[8];
+
+   resnum         = query->resnum1;
+   query->resnum1 = query->resnum2;
+   query->resnum2 = resnum;
+
+   SWAPSTRING(query->chain1,  query->chain2);
+   SWAPSTRING(query->insert1, query->insert2);
+   SWAPSTRING(query->res1,    query->res2);
+   SWAPSTRING(query->hatom1,  query->hatom2);
+}
+
+/************************************************************************/
+BOOL PrepareHBondingPair(HBCONTEXT *ctx, PDB *pdb, MATFILE *matrix,
+                         HBQUERY *query, HBRESULT *result)
+{
+   VEC3F       CAtoCAVector;
+   ORIENTATION frame1, frame2;
+
+   PDB *res1_start, *res1_stop, *res2_start, *res2_stop;
+   
+   for(res1_start = pdb; res1_start !=NULL;
+       res1_start=res1_stop)
+   {
+      res1_stop = blFindNextResidue(res1_start);
+                        
+      /* if *key* residue of choice */
+      if((query->resnum1 == res1_start->resnum)
+         && (query->chain1[0]==res1_start->chain[0])
+         && (query->insert1[0] == res1_start->insert[0]))
+      {
+         break;
+      }
+   }
+   if(res1_start==NULL)
+   {
+      AddHBMessage(result, "Can't find residue 1  in PDB file\n", TRUE);
+      return(FALSE);
+   }
+   
+   /*step though each residue in list
+     is it *partner* residue? */
+   for(res2_start = pdb; res2_start !=NULL;
+       res2_start=res2_stop)
+   {
+      res2_stop = blFindNextResidue(res2_start);
+      
+      /* if *partner* residue of choice */
+      if((query->resnum2 == res2_start->resnum)
+         && (query->chain1[0]==res1_start->chain[0])
+         && (query->insert1[0] == res1_start->insert[0]))
+      {
+         break;
+      }
+   }
+   if(res2_start==NULL)
+   {
+      AddHBMessage(result, "Can't find residue 2 in PDB file\n", TRUE);
+      return(FALSE);
+   }
+   
+   if(!ReadInMatrices(ctx, query->res1, query->res2, matrix, MAT_READ_BOTH, MAT_RES_BOTH,
+                      result))
+   {
+      /* ACRM 08.09.05 - error message */
+/*      PrintError(OUT, "f the residues in the matrix file: %s %s\n", res1, res2); */
+      return(FALSE);
+   }
+   
+   /* ACRM 25.03.11 Check return value */
+   if(!FindOrientation(res2_start, res2_stop, &frame2))
+      return(FALSE);
+#ifndef NOCULL
+   CullArrays(ctx, pdb, &frame2, res1_start, res2_start,
+              ctx->partnertoDonate, ctx->partnertoAccept);
+#endif
+
+   /* ACRM 25.03.11 Check return value */
+   if(!FindOrientation(res1_start, res1_stop, &frame1))
+      return(FALSE);
+#ifndef NOCULL
+   CullArrays(ctx, pdb, &frame1, res1_start, res2_start,
+              ctx->donate, ctx->accept);
+#endif   
+
+   CalculateCaToCaVector(&frame1, res1_start, res1_stop, res2_start,
+                         res2_stop, &CAtoCAVector, result);
+   
+   /* 19.01.06 Now fits on N,CA,CB rather than N,CA,C for consistency with
+      the frame of reference
+   */
+   /* 17.10.26 Check return value */
+   if(!CreateRotationMatrix(ctx, &frame1, res1_start, res1_stop,
+                            res2_start, res2_stop, CAtoCAVector, ATOMS_NCACB,
+                            ATOMS_NCACB, NULL, result))
+   {
+      AddHBMessage(result, "Unable to fit the residues\n", TRUE);
+      return(FALSE);
+   }
+
+   if(query->hbplus)
+   {
+      /* 17.10.26 Residue 2's orientation is already known          */
+      if(CalculateHBondEnergy(ctx, &frame2, res1_start, res1_stop,
+                              CAtoCAVector, query->hatom1,
+                              result) == CHBE_ERROR)
+      {
+         AddHBMessage(result, "Unable to calculate HBondEnergy (1)\n", TRUE);
+      }
+   }
+   else
+   {
+      if(!CheckValidHBond(ctx, CAtoCAVector,
+                          ctx->donate, ctx->partnertoAccept, result))
+      {
+         /* 06.02.06 ACRM - the two grids were the wrong way around! */
+         if(!CheckValidHBond(ctx, CAtoCAVector,
+                             ctx->partnertoDonate, ctx->accept, result))
+         {
+            return(FALSE);
+         }
+      }
+   }
+   return(TRUE);
+}
+
+/************************************************************************/
+static int CalculateHBondEnergy(HBCONTEXT *ctx, ORIENTATION *frame,
+                                PDB *res1_start, PDB *res1_stop,
+                                VEC3F CAtoCAVector, char *hatom1,
+                                HBRESULT *result)
+{
+   int x_coord1, y_coord1, z_coord1;
+   GRIDCELL *partnercell = NULL;
+   SPARSEGRID *bestarray;
+   VEC3F partner_coord,
+         hatom_coord;
+   REAL pseudoenergy = -1;
+   PDB *p;
+   BOOL OK = FALSE;
+      
+   /* calculate -log(p) for hydrogen bonding atoms of residue 1 and 2 */
+   SetSparseGridEnergies(ctx->donate);
+   SetSparseGridEnergies(ctx->partnertoAccept);
+   bestarray = BestKeyGrid(ctx, ctx->donate);
+   
+   /* obtaining x,y,z co-ordinates for donor atom (in the frame of
+      residue 2)
+   */
+   for(p = res1_start; p !=res1_stop; NEXT(p))
+   {
+      if(strstr(p->atnam, hatom1))
+      {
+         hatom_coord.x = p->x;
+         hatom_coord.y = p->y;
+         hatom_coord.z = p->z;
+         OrientateVector(frame, &hatom_coord);
+         COORD_2_GRID(x_coord1,hatom_coord.x);
+         COORD_2_GRID(y_coord1,hatom_coord.y);
+         COORD_2_GRID(z_coord1,hatom_coord.z);
+         
+         OK = TRUE;
+         break;
+      }
+   }
+
+   if(!OK)
+   {
+      char buffer[160];
+      sprintf(buffer, "Can't find %s in protein structure\n", hatom1);
+      AddHBMessage(result, buffer, TRUE);
+      return(CHBE_ERROR);
+   }
+      
+   if(VALIDGRIDCOORDS(x_coord1, y_coord1, z_coord1))
+      partnercell = SparseGridCell(ctx->partnertoAccept,
+                                   x_coord1, y_coord1, z_coord1);
+
+   pseudoenergy = DoCheckHBond(ctx, partnercell, CAtoCAVector,
+                               &partner_coord, ctx->donate, bestarray); 
+   if((pseudoenergy !=-1)&& (pseudoenergy !=9999.9999))
+   {
+      result->status = HB_ENERGY;
+      result->energy = pseudoenergy;
+      return(CHBE_OK);
+   }
+
+   result->status = HB_NOHBOND;
+   return(CHBE_NOHB);
+}
+
+/************************************************************************/
+/* function that calculates the vector from the CA of res1 to CA of res2 
+   17.10.26 in the frame given
+*/
+static void CalculateCaToCaVector(ORIENTATION *frame,
+                                  PDB *res1_start, PDB *res1_stop,
+                                  PDB *res2_start, PDB *res2_stop, 
+                                  VEC3F *CAtoCAVector, HBRESULT *result)
+{
+   VEC3F res1_calpha, 
+         res2_calpha;
+   res1_calpha.x = res1_calpha.y = res1_calpha.z = 0.0;
+   res2_calpha.x = res2_calpha.y = res2_calpha.z = 0.0;
+
+   /*find co-ordinates of CA atom */   
+   if(!FindOrientatedAtom(res1_start, res1_stop, "CA  ", frame,
+                          &res1_calpha))
+   {
+      AddHBMessage(result, "Can't find c-alpha atoms of key residue\n", FALSE);
+   }
+   
+   if(!FindOrientatedAtom(res2_start, res2_stop, "CA  ", frame,
+                          &res2_calpha))
+   {
+      AddHBMessage(result, "Can't find c-alpha atoms of partner residue\n", FALSE);
+   }
+   
+   CAtoCAVector->x =  res2_calpha.x - res1_calpha.x;
+   CAtoCAVector->y =  res2_calpha.y - res1_calpha.y;
+   CAtoCAVector->z =  res2_calpha.z - res1_calpha.z;
+}
+
+/************************************************************************/
+/* function that assesses whether a hydrogen-bond between the *key* 
+   residue and *partner* residue is valid. It compares the location of 
+   the *key* residue hydrogen-capable atoms  with that the *partner* 
+   hydrogen atoms (i.e. where the *partner* residue likes its partner 
+   hydrogen atoms to be).
+   Fits *partner* residue matrix on top of *key* residue matrix and 
+   calculates the difference between their respective hydrogen-capable 
+   atoms.
+   A valid hydrogen bond is said to exist if the distance between the 
+   two atoms are within a certain cutoff distance 
+*/
+static BOOL CheckValidHBond(HBCONTEXT *ctx, VEC3F CAtoCAVector,
+                            SPARSEGRID *keyarray, SPARSEGRID *partnerarray,
+                            HBRESULT *result)
+{
+   int i;
+   SPARSEGRID *bestarray;
+   CELLBATCH *batch = ctx->partnerBatch;
+   REAL pseudoenergy, final_penergy  = 9999.9999;
+   VEC3F partner_coord, rotated_coord;
+
+#if defined(DEBUG1) || defined(DEBUG2) || defined(DEBUG3)
+         ctx->debugChain--;
+#endif
+   
+#ifdef DEBUG3
+{
+   int x2, y2, z2;
+   int x_coord, y_coord, z_coord;
+   VEC3F rotated_coord;
+
+   fprintf(stdout, "REMARK (checkhbond): Key array chain %c\n", ctx->debugChain);
+
+   for(x2=0; x2<MAXSIZE; x2++)
+   {
+      for(y2=0; y2<MAXSIZE; y2++)
+      {
+         for(z2=0; z2<MAXSIZE; z2++)
+         {
+            OrientateMatrix(ctx, CAtoCAVector, x2, y2, z2, &rotated_coord);
+            COORD_2_GRID(x_coord,rotated_coord.x);
+            COORD_2_GRID(y_coord,rotated_coord.y);
+            COORD_2_GRID(z_coord,rotated_coord.z);
+            if(VALIDGRIDCOORDS(x_coord, y_coord, z_coord))
+            {
+               if(SparseGridCount(keyarray, x_coord, y_coord, z_coord))
+               {
+                  fprintf(stdout, "ATOM  %5d  CA  ALA %c%4d    %8.3f%8.3f%8.3f%6.2f%6.2f\n",
+                          atnum++, ctx->debugChain, resnum++, rotated_coord.x, rotated_coord.y,  rotated_coord.z, 1.00, 2.00);
+               }
+            }
+         }
+      }
+   }
+   fprintf(stdout, "TER   \n");
+   ctx->debugChain--;
+}
+#endif
+         
+   /* first ... compare *key* residue hydrogen-donor atoms
+      with *partner* residue *partner-to-accept* donor atoms */ 
+   SetSparseGridEnergies(keyarray);
+   SetSparseGridEnergies(partnerarray);
+   bestarray = BestKeyGrid(ctx, keyarray);
+      
+#ifdef DEBUG3
+   fprintf(stdout, "REMARK (checkhbond): Partner array chain %c\n", ctx->debugChain);
+#endif
+   /* 17.10.26 rotate the occupied cells of grid for *partner* residue
+      together
+   */
+   if(!FillCellBatch(batch, partnerarray))
+   {
+      AddHBMessage(result, "No memory for rotating partner grid\n", TRUE);
+      return(FALSE);
+   }
+   RotateCellBatch(batch, ctx->rotation, CAtoCAVector);
+
+   /* go though occupied cells of grid for *partner* residue */
+   for(i=0; i<batch->ncells; i++)
+   {
+      rotated_coord.x = batch->x[i];
+      rotated_coord.y = batch->y[i];
+      rotated_coord.z = batch->z[i];
+      pseudoenergy = MatchPartnerCell(ctx, batch->cells[i], rotated_coord,
+                                      batch->gx[i], batch->gy[i],
+                                      batch->gz[i], &partner_coord,
+                                      keyarray, bestarray);
+      
+      if((pseudoenergy != -1) && (final_penergy > pseudoenergy))
+      {
+         final_penergy = pseudoenergy;
+#ifdef DEBUG
+   fprintf(stdout, "ATOM  %5d  C   THR  %4d    %8.3f%8.3f%8.3f%6.2f%6.2f\n",
+           atnum++, resnum++, partner_coord.x, partner_coord.y,  partner_coord.z, 1.00, 2.00);
+#endif
+      }
+   }
+   
+   if(final_penergy != 9999.9999)
+   {
+      result->status = HB_VALID;
+      result->energy = final_penergy;
+      return(TRUE);
+   }
+
+   return(FALSE);
+}
+
+/************************************************************************/
+/* Builds the grid of best key energies within the cutoff for
+   DoCheckHBond(). The key grid energies must already be set. Returns
+   NULL (so that DoCheckHBond() scans the neighbouring cells itself) if
+   there is no cutoff or no memory.
+*/
+static SPARSEGRID *BestKeyGrid(HBCONTEXT *ctx, SPARSEGRID *keyarray)
+{
+   if((ctx->cutoff <= 0.0) ||
+      !SetBestWithinCutoff(ctx->bestKey, keyarray, ctx->cutoff))
+      return(NULL);
+   return(ctx->bestKey);
+}
+
+/************************************************************************/
+/* partnercell is a cell of the *partner* grid (or NULL). bestarray is
+   from BestKeyGrid() (or NULL)
+   17.10.26 Rotates the cell and hands it to MatchPartnerCell()
+*/
+static REAL DoCheckHBond(HBCONTEXT *ctx, GRIDCELL *partnercell,
+                         VEC3F CAtoCAVector, VEC3F *partner_coord,
+                         SPARSEGRID *keyarray, SPARSEGRID *bestarray)
+{
+   VEC3F rotated_coord;
+   int x_coord, y_coord, z_coord;
+
+   /* call routine to rotate matrix */
+   if((partnercell != NULL) && (partnercell->count > 0))
+   {  
+      OrientateMatrix(ctx, CAtoCAVector, partnercell->x, partnercell->y,
+                      partnercell->z, &rotated_coord);
+      
+      /* convert real co-ordinates back into grid locations */
+      COORD_2_GRID(x_coord,rotated_coord.x);
+      COORD_2_GRID(y_coord,rotated_coord.y);
+      COORD_2_GRID(z_coord,rotated_coord.z);
+
+      return(MatchPartnerCell(ctx, partnercell, rotated_coord,
+                              x_coord, y_coord, z_coord, partner_coord,
+                              keyarray, bestarray));
+   }
+
+   return(9999.9999);
+}
+
+/************************************************************************/
+/* Matches a *partner* cell, rotated to rotated_coord in grid cell
+   x_coord,y_coord,z_coord, against the *key* grid. Returns the
+   pseudoenergy of the best match or 9999.9999 if there is none.
+*/
+static REAL MatchPartnerCell(HBCONTEXT *ctx, GRIDCELL *partnercell,
+                             VEC3F rotated_coord,
+                             int x_coord, int y_coord, int z_coord,
+                             VEC3F *partner_coord, SPARSEGRID *keyarray,
+                             SPARSEGRID *bestarray)
+{
+   REAL cutoff = ctx->cutoff;
+   GRIDCELL *keycell;
+   int number_of_cells = 1+(cutoff / GRIDSPACING);
+   int i, j, k;
+   REAL cutoff_squared = cutoff * cutoff,
+        pseudoenergy = -1, final_penergy = 9999.9999,
+        dist_squared;
+   int final_x,final_y,final_z;
+
+   if(VALIDGRIDCOORDS(x_coord, y_coord, z_coord))
+   { 
+#ifdef DEBUG2
+   fprintf(stdout, "ATOM  %5d  C   THR %c%4d    %8.3f%8.3f%8.3f%6.2f%6.2f\n",
+           atnum++, ctx->debugChain, resnum++, rotated_coord.x, rotated_coord.y,  rotated_coord.z, 1.00, 2.00);
+#endif
+      keycell = SparseGridCell(keyarray, x_coord, y_coord, z_coord);
+          
+      /* if *key* and *partner* hydrogen atoms match exactly */
+      if(keycell != NULL)
+      { 
+         final_penergy = CalcEnergy(keycell, partnercell);
+
+         final_x = x_coord;
+         final_y = y_coord;
+         final_z = z_coord;
+
+         GRID_2_COORD(final_x, partner_coord->x);
+         GRID_2_COORD(final_y, partner_coord->y);
+         GRID_2_COORD(final_z, partner_coord->z);
+
+#ifdef DEBUG1
+   fprintf(stdout, "ATOM  %5d  C   THR %c%4d    %8.3f%8.3f%8.3f%6.2f%6.2f\n",
+           atnum++, ctx->debugChain, resnum++, rotated_coord.x, rotated_coord.y,  rotated_coord.z, 1.00, 2.00);
+#endif
+      }
+      else if(bestarray != NULL)
+      {
+         /* 17.10.26 the best key cell within the cutoff has already
+            been found for this cell
+         */
+         if((keycell = SparseGridCell(bestarray, x_coord, y_coord,
+                                      z_coord)) != NULL)
+         {
+            final_penergy = CalcEnergy(keycell, partnercell);
+
+            final_x = x_coord;
+            final_y = y_coord;
+            final_z = z_coord;
+
+            GRID_2_COORD(final_x, partner_coord->x);
+            GRID_2_COORD(final_y, partner_coord->y);
+            GRID_2_COORD(final_z, partner_coord->z);
+         }
+      }
+      else if(cutoff > 0.0)
+      {
+         for(i=x_coord-number_of_cells; i<=x_coord+number_of_cells; i++)
+         {
+            for(j=y_coord-number_of_cells; j<=y_coord+number_of_cells; j++)
+            {
+               for(k=z_coord-number_of_cells; k<=z_coord+number_of_cells; k++)
+               {
+                  if(VALIDGRIDCOORDS(i, j, k))
+                  {
+                     keycell = SparseGridCell(keyarray, i, j, k);
+                  
+                     if(keycell != NULL)
+                     {
+                        dist_squared = Distance_squared(i, j, k, x_coord, y_coord, z_coord);
+                        
+                        if(dist_squared <=cutoff_squared)     
+                        {
+                           /* ACRM 08.09.02 Missing this VITAL line!!!! */
+                           pseudoenergy = CalcEnergy(keycell, partnercell);
+
+                           if(pseudoenergy < final_penergy)
+                           {
+                              final_penergy = pseudoenergy;
+                              
+                              final_x = x_coord;
+                              final_y = y_coord;
+                              final_z = z_coord;
+                              
+                              GRID_2_COORD(final_x, partner_coord->x);
+                              GRID_2_COORD(final_y, partner_coord->y);
+                              GRID_2_COORD(final_z, partner_coord->z);
+                           }
+#ifdef DEBUG1
+   fprintf(stdout, "ATOM  %5d  C   THR %c%4d    %8.3f%8.3f%8.3f%6.2f%6.2f\n",
+           atnum++, ctx->debugChain, resnum++, rotated_coord.x, rotated_coord.y,  rotated_coord.z, 1.00, 3.00);
+#endif
+                        }
+                     }
+                  }
+               }
+            }
+         }
+      }
+   }
+
+   return(final_penergy);
+}
+        
+/************************************************************************/
+/* Pseudoenergy -log(p1)-log(p2) of a matched pair of cells. The -log(p)
+   terms are set for each cell by SetSparseGridEnergies() from the grid
+   totals after culling
+*/
+static REAL CalcEnergy(GRIDCELL *keycell, GRIDCELL *partnercell)
+{
+   return(keycell->energy + partnercell->energy);
+}
+
+/************************************************************************/
+static void OrientateMatrix(HBCONTEXT *ctx, VEC3F CAtoCAVector,
+                            int x, int y, int z, VEC3F *rotated_coord)
+{
+   VEC3F partner_real_coord, partner_real_coord_rotated;
+
+   /* convert location of hydrogen atoms in *partner* residue
+      matrix to real coordinates */
+   GRID_2_COORD(x, partner_real_coord.x);
+   GRID_2_COORD(y, partner_real_coord.y);
+   GRID_2_COORD(z, partner_real_coord.z);
+
+   /* multiply vector by rotation matrix */
+   blMatMult3_33(partner_real_coord, ctx->rotation,
+                 &partner_real_coord_rotated);
+  
+   /* add CA to CA vector */
+   partner_real_coord_rotated.x += CAtoCAVector.x;
+   partner_real_coord_rotated.y += CAtoCAVector.y;
+   partner_real_coord_rotated.z += CAtoCAVector.z;
+  
+   *rotated_coord = partner_real_coord_rotated;
+}
+
+/************************************************************************/
+/* function that calculates distance (in angstroms) between two grid 
+   points 
+*/
+static REAL Distance_squared (int i, int j, int k, int x_coord,
+                              int y_coord, int z_coord)
+{
+   REAL squared_dist;
+   VEC3F test_value, c_value;
+   
+   GRID_2_COORD(i, test_value.x);
+   GRID_2_COORD(j, test_value.y);
+   GRID_2_COORD(k, test_value.z);
+
+   GRID_2_COORD(x_coord, c_value.x);
+   GRID_2_COORD(y_coord, c_value.y);
+   GRID_2_COORD(z_coord, c_value.z);
+
+   squared_dist = DISTSQ_HATOMS(test_value, c_value);
+      
+   return(squared_dist);   
+}
+
+/************************************************************************/
+/* function that finds location of an atom in a residue */
+static PDB *FindAtom(PDB *res1_start, PDB *res1_next, char *atnam,
+                     VEC3F *atm)
+{
+   PDB *p,
+      *found = NULL;
+        
+   for(p = res1_start; p !=res1_next; NEXT(p))
+   {
+      if(!strncmp(p->atnam, atnam, 4))
+      {
+         if(atm != NULL)
+         {
+            atm->x = p->x;
+            atm->y = p->y;
+            atm->z = p->z;
+         }
+         found = p;
+         break;
+      }
+   }
+
+   return(found);
+}
+
+/************************************************************************/
+/* As FindAtom() but gives the atom's position in an orientation        */
+static PDB *FindOrientatedAtom(PDB *start, PDB *stop, char *atnam,
+                               ORIENTATION *frame, VEC3F *atm)
+{
+   PDB *found;
+
+   if((found = FindAtom(start, stop, atnam, atm)) != NULL)
+      OrientateVector(frame, atm);
+
+   return(found);
+}
+   
+/************************************************************************/
+/* Clears the cells of two grids which are near atoms other than those
+   of residues 1 and 2 (see MarkCulledCells())
+   17.10.26 Cells are marked in a mask and then cleared in the sparse
+            grids rather than set to zero one at a time
+   17.10.26 Atoms are placed with the orientation 'frame'
+*/
+static void CullArrays(HBCONTEXT *ctx, PDB *pdb, ORIENTATION *frame,
+                       PDB *res1, PDB *res2, SPARSEGRID *donate_array,
+                       SPARSEGRID *accept_array)
+{
+   MarkCulledCells(ctx, pdb, frame, res1, res2, ctx->cullMask);
+   ClearSparseGridMasked(donate_array, ctx->cullMask);
+   ClearSparseGridMasked(accept_array, ctx->cullMask);
+}
+
+/************************************************************************/
+/* Sets 'mask' (GRIDMASKBYTES) to the cells culled by CullArrays() for
+   the PDB list in the orientation 'frame'
+   17.10.26 The residue test does not depend on the cell so is made 
+   once per atom. Only the atoms which pass it are orientated.
+   17.10.26 The cells are taken from the context's table of offsets
+   (see BuildCullOffsets()). It is sorted on dx, so only the part of it
+   which can reach the grid from an atom's cell is looked at.
+*/
+static void MarkCulledCells(HBCONTEXT *ctx, PDB *pdb, ORIENTATION *frame,
+                            PDB *res1, PDB *res2, unsigned char *mask)
+{
+   PDB        *p;
+   CULLOFFSET *offset,
+              *last;
+   VEC3F      pos;
+   int        x_coord, y_coord, z_coord, x, y, z, low, high, mid;
+   
+   memset(mask, 0, GRIDMASKBYTES);
+   last = ctx->cullOffsets + ctx->nCullOffsets;
+
+   for(p = pdb; p!=NULL; NEXT(p))
+   {
+      if(!((p->resnum !=res1->resnum)
+           && (p->chain != res1->chain)
+           && (p->insert != res1->insert)
+           && (p->resnum !=res2->resnum)
+           && (p->chain != res2->chain)
+           && (p->insert != res2->insert)))
+      {
+         continue;
+      }
+
+      pos.x = p->x;
+      pos.y = p->y;
+      pos.z = p->z;
+      OrientateVector(frame, &pos);
+      COORD_2_GRID(x_coord,pos.x);
+      COORD_2_GRID(y_coord,pos.y);
+      COORD_2_GRID(z_coord,pos.z);    
+
+      /* Find the first offset with x_coord + dx >= 0                   */
+      low  = 0;
+      high = ctx->nCullOffsets;
+      while(low < high)
+      {
+         mid = (low + high) / 2;
+         if(x_coord + ctx->cullOffsets[mid].dx < 0)
+            low  = mid + 1;
+         else
+            high = mid;
+      }
+      
+      for(offset = ctx->cullOffsets + low;
+          (offset < last) && (x_coord + offset->dx < MAXSIZE);
+          offset++)
+      {
+         x = x_coord + offset->dx;
+         y = y_coord + offset->dy;
+         z = z_coord + offset->dz;
+         if(VALIDGRIDCOORDS(x, y, z))
+            SETGRIDMASK(mask, x, y, z);
+      }
+   }
+}
+
+/************************************************************************/
+/* Makes the table of the offsets from an atom's cell of the cells that
+   are culled around it. The cells were found by a loop over the cube 
+   of side 2*RAD+1 around the atom, but as the loop adds each point in
+   the sphere of radius RAD to the cell it reached last, rather than to
+   the atom's cell, the offsets are the running totals of those points.
+   They do not depend on the atom so are found once here, with repeats
+   removed, and sorted on dx for MarkCulledCells().
+*/
+static BOOL BuildCullOffsets(HBCONTEXT *ctx)
+{
+   CULLOFFSET *offsets,
+              *shrunk;
+   int        x, y, z, 
+              dx       = 0, 
+              dy       = 0, 
+              dz       = 0,
+              noffsets = 0,
+              i, j;
+
+   for(x = -RAD; x <=RAD; x++)
+      for(y = -RAD; y <=RAD; y++)
+         for(z = -RAD; z <=RAD; z++)
+            if(((x*x) + (y*y) + (z*z)) < (RAD*RAD))
+               noffsets++;
+
+   if((offsets = (CULLOFFSET *)malloc(noffsets * sizeof(CULLOFFSET)))
+      ==NULL)
+      return(FALSE);
+   
+   for(x = -RAD, i = 0; x <=RAD; x++)
+   {
+      for(y = -RAD; y <=RAD; y++)
+      {
+         for(z = -RAD; z <=RAD; z++) 
+         {
+            if(((x*x) + (y*y) + (z*z)) < (RAD*RAD))
+            {
+               dx += x;
+               dy += y;
+               dz += z;
+               offsets[i].dx = dx;
+               offsets[i].dy = dy;
+               offsets[i].dz = dz;
+               i++;
+            }
+         }
+      }
+   }
+
+   qsort(offsets, noffsets, sizeof(CULLOFFSET), CompareCullOffsets);
+   for(i=1, j=0; i<noffsets; i++)
+   {
+      if(CompareCullOffsets(offsets+i, offsets+j))
+         offsets[++j] = offsets[i];
+   }
+
+   if((shrunk = (CULLOFFSET *)realloc(offsets,
+                                      (j+1) * sizeof(CULLOFFSET)))!=NULL)
+      offsets = shrunk;
+
+   ctx->cullOffsets  = offsets;
+   ctx->nCullOffsets = j+1;
+   return(TRUE);
+}
+
+/************************************************************************/
+/* qsort() comparison of CULLOFFSETs on dx, dy and then dz              */
+static int CompareCullOffsets(const void *offset1, const void *offset2)
+{
+   const CULLOFFSET *o1 = (const CULLOFFSET *)offset1,
+                    *o2 = (const CULLOFFSET *)offset2;
+
+   if(o1->dx != o2->dx)
+      return((o1->dx < o2->dx) ? -1 : 1);
+   if(o1->dy != o2->dy)
+      return((o1->dy < o2->dy) ? -1 : 1);
+   if(o1->dz != o2->dz)
+      return((o1->dz < o2->dz) ? -1 : 1);
+   return(0);
+}
+            
+/************************************************************************/
+/* Populates the grids from the residue sections of a matrix file.
+   Sections are applied in file order, so cells of a residue which
+   appears more than once are set from its last section.
+*/
+static BOOL ReadInMatrices(HBCONTEXT *ctx, char *res1, char *res2,
+                           MATFILE *matrix, int type, int whichres,
+                           HBRESULT *result)
+{
+   BINMATRIX  *bin = matrix->bin;
+   MATSECTION *section;
+   int        i;
+   BOOL       found_residue1 = FALSE, 
+              found_residue2 = FALSE;
+
+   for(i=0; i<bin->header->nsections; i++)
+   {
+      section = bin->sections + i;
+
+      if((whichres&MAT_RES_1) && !strncmp(section->resnam, res1, 3))
+      {
+         if(type&MAT_READ_DONOR1)
+         {
+            if(!CopyBinaryGrid(bin, section, MAT_DONATE, ctx->donate,
+                               result) ||
+               !CopyBinaryGrid(bin, section, MAT_PARTNERTODONATE,
+                               ctx->partnertoDonate, result))
+               return(FALSE);
+         }
+         if(type&MAT_READ_ACCEPTOR1)
+         {
+            if(!CopyBinaryGrid(bin, section, MAT_ACCEPT, ctx->accept,
+                               result) ||
+               !CopyBinaryGrid(bin, section, MAT_PARTNERTOACCEPT,
+                               ctx->partnertoAccept, result))
+               return(FALSE);
+         }
+         found_residue1 = TRUE;
+      }
+
+      if((whichres&MAT_RES_2) && !strncmp(section->resnam, res2, 3))
+      {
+         if(type&MAT_READ_DONOR2)
+         {
+            if(!CopyBinaryGrid(bin, section, MAT_DONATE, ctx->donate,
+                               result) ||
+               !CopyBinaryGrid(bin, section, MAT_PARTNERTODONATE,
+                               ctx->partnertoDonate, result))
+               return(FALSE);
+         }
+         if(type&MAT_READ_ACCEPTOR2)
+         {
+            if(!CopyBinaryGrid(bin, section, MAT_ACCEPT, ctx->accept,
+                               result) ||
+               !CopyBinaryGrid(bin, section, MAT_PARTNERTOACCEPT,
+                               ctx->partnertoAccept, result))
+               return(FALSE);
+         }
+         found_residue2 = TRUE;
+      }
+   }
+
+   return(ResiduesFound(whichres, found_residue1, found_residue2));
+}
+
+/************************************************************************/
+/* Sets the cells listed for one grid of a compiled matrix section      */
+static BOOL CopyBinaryGrid(BINMATRIX *bin, MATSECTION *section, int grid,
+                           SPARSEGRID *array, HBRESULT *result)
+{
+   MATCELL *cell;
+   int     i;
+
+   cell = BinaryMatrixCells(bin, section, grid);
+   for(i=0; i<section->ncells[grid]; i++, cell++)
+   {
+      if(!SetSparseGridCell(array, cell->x, cell->y, cell->z, cell->count))
+      {
+         AddHBMessage(result, "No memory for matrix grids\n", FALSE);
+         return(FALSE);
+      }
+   }
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Checks that the residue(s) requested from ReadInMatrices() were found
+*/
+static BOOL ResiduesFound(int whichres, BOOL found_residue1,
+                          BOOL found_residue2)
+{
+   if(whichres == MAT_RES_BOTH)
+   {
+      if(found_residue1 && found_residue2)
+         return(TRUE);
+   }
+   else if(whichres == MAT_RES_1)
+   {
+      if(found_residue1)
+         return(TRUE);
+   }
+   else if(whichres == MAT_RES_2)
+   {
+      if(found_residue2)
+         return(TRUE);
+   }
+         
+   return(FALSE);
+}
+
+/************************************************************************/
+/* Returns a copy of residues 1 and 2 and the residues preceding them.
+   17.10.26 The original list is no longer freed, so that one structure
+            can be used for many queries
+*/
+PDB *GetResidues(PDB *pdb, char *chain1, int resnum1, char *insert1, 
+                 char *chain2, int resnum2, char *insert2, int *errorcode)
+{
+   PDB *keep=NULL,
+       *p, *q,
+       *prev1, *prev2;
+   
+   /* First find the residue preceeding res1 */
+   for(p=pdb, prev1=NULL; p!=NULL; )
+   {
+      if((p->resnum == resnum1) &&
+         (p->chain[0]  == chain1[0]) &&
+         (p->insert[0] == insert1[0]))
+         break;
+      prev1 = p;
+      p = blFindNextResidue(p);
+   }
+   if(p==NULL)
+   {
+      *errorcode = ERR_NORES1;
+      return(NULL);
+   }
+   if((prev1==NULL) || !ResiduesBonded(prev1, p))
+   {
+      *errorcode = ERR_NOPREVRES1;
+      return(NULL);
+   }
+
+   /* First find the residue preceeding res2 */
+   for(p=pdb, prev2=NULL; p!=NULL; )
+   {
+      if((p->resnum == resnum2) &&
+         (p->chain[0]  == chain2[0]) &&
+         (p->insert[0] == insert2[0]))
+         break;
+      prev2 = p;
+      p = blFindNextResidue(p);
+   }
+   if(p==NULL)
+   {
+      *errorcode = ERR_NORES2;
+      return(NULL);
+   }
+   if((prev2==NULL) || !ResiduesBonded(prev2, p))
+   {
+      *errorcode = ERR_NOPREVRES2;
+      return(NULL);
+   }
+
+
+   for(p=pdb; p!=NULL; NEXT(p))
+   {
+      if(((p->resnum == resnum1) &&
+          (p->chain[0]  == chain1[0]) &&
+          (p->insert[0] == insert1[0])) ||
+         ((p->resnum == resnum2) &&
+          (p->chain[0]  == chain2[0]) &&
+          (p->insert[0] == insert2[0])) ||
+         ((p->resnum == prev1->resnum) &&
+          (p->chain[0]  == prev1->chain[0]) &&
+          (p->insert[0] == prev1->insert[0])) ||
+         ((p->resnum == prev2->resnum) &&
+          (p->chain[0]  == prev2->chain[0]) &&
+          (p->insert[0] == prev2->insert[0])))
+      {
+         if(keep == NULL)
+         {
+            INIT(keep, PDB);
+            q = keep;
+         }
+         else
+         {
+            ALLOCNEXT(q, PDB);
+         }
+         if(q==NULL)
+         {
+            /* 17.10.26 Free the residues copied so far                 */
+            if(keep != NULL) FREELIST(keep, PDB);
+            *errorcode = ERR_NOMEM;
+            return(NULL);
+         }
+         blCopyPDB(q, p);
+      }
+   }
+   return(keep);
+}
+
+
+/************************************************************************/
+void FindRes1Type(PDB *pdb, char *chain, int resnum, char *insert, 
+                  char *res)
+{
+   PDB *p;
+   for(p=pdb; p!=NULL; NEXT(p))
+   {
+      if((p->resnum == resnum) &&
+         (p->chain[0] == chain[0]) &&
+         (p->insert[0] == insert[0]))
+      {
+         strncpy(res, p->resnam, 3);
+         res[3] = '\0';
+         return;
+      }
+   }
+}
+
+/************************************************************************/
+/* Writes a residue as chain, number and insert code (e.g. L27A)        */
+void FormatResSpec(char *spec, int resnum, char *chain, char *insert)
+{
+   sprintf(spec, "%c%d", chain[0], resnum);
+   if((insert[0] != ' ') && (insert[0] != '\0'))
+      sprintf(spec+strlen(spec), "%c", insert[0]);
+}
+
+/************************************************************************/
+/* function that calculates the vector from the N of res1 to CA of res2 
+   17.10.26 in the frame given
+ */
+static void CalculateNToCaVector(ORIENTATION *frame,
+                                 PDB *res1_start, PDB *res1_stop,
+                                 PDB *res2_start, PDB *res2_stop, 
+                                 VEC3F *NtoCAVector, HBRESULT *result)
+{
+   VEC3F res1_n, 
+         res2_calpha;
+   res1_n.x      = res1_n.y      = res1_n.z      = 0.0;
+   res2_calpha.x = res2_calpha.y = res2_calpha.z = 0.0;
+
+   /*find co-ordinates of N  atom */   
+   if(!FindOrientatedAtom(res1_start, res1_stop, "N   ", frame, &res1_n))
+   {
+      AddHBMessage(result, "Can't find N atom of key residue\n", FALSE);
+   }
+   
+   /*find co-ordinates of CA atom */   
+   if(!FindOrientatedAtom(res2_start, res2_stop, "CA  ", frame,
+                          &res2_calpha))
+   {
+      AddHBMessage(result, "Can't find c-alpha atom of partner residue\n", FALSE);
+   }
+   
+   NtoCAVector->x =  res2_calpha.x - res1_n.x;
+   NtoCAVector->y =  res2_calpha.y - res1_n.y;
+   NtoCAVector->z =  res2_calpha.z - res1_n.z;
+}
+
+
+/************************************************************************/
+/* function that calculates the vector from the C of res1 to CA of res2 
+   17.10.26 in the frame given
+ */
+static void CalculateCToCaVector(ORIENTATION *frame,
+                                 PDB *res1_start, PDB *res1_stop,
+                                 PDB *res2_start, PDB *res2_stop, 
+                                 VEC3F *CtoCAVector, HBRESULT *result)
+{
+   VEC3F res1_c, 
+         res2_calpha;
+   res1_c.x      = res1_c.y      = res1_c.z      = 0.0;
+   res2_calpha.x = res2_calpha.y = res2_calpha.z = 0.0;
+
+   /*find co-ordinates of N atom */   
+   if(!FindOrientatedAtom(res1_start, res1_stop, "C   ", frame, &res1_c))
+   {
+      AddHBMessage(result, "Can't find C atoms of key residue\n", FALSE);
+   }
+   
+   /*find co-ordinates of CA atom */   
+   if(!FindOrientatedAtom(res2_start, res2_stop, "CA  ", frame,
+                          &res2_calpha))
+   {
+      AddHBMessage(result, "Can't find c-alpha atoms of partner residue\n", FALSE);
+   }
+   
+   CtoCAVector->x =  res2_calpha.x - res1_c.x;
+   CtoCAVector->y =  res2_calpha.y - res1_c.y;
+   CtoCAVector->z =  res2_calpha.z - res1_c.z;
+}
+
+
+/************************************************************************/
+/* 13.09.11 Added more error messages
+ */
+BOOL AnalyzeMCDonorPair(HBCONTEXT *ctx, PDB *pdb, 
+                        MATFILE *matrix, MATFILE *matrix2,
+                        HBQUERY *query, HBRESULT *result)
+{
+   VEC3F       NtoCAVector;
+   ORIENTATION frame1, frame2;
+
+   PDB *res1_start, *res1_stop, *res2_start, *res2_stop, *prevres1;
+   
+   /* Find the key residue which is the mainchain donor and the previous residue */
+   for(res1_start =  pdb, prevres1 = NULL;
+       res1_start != NULL;
+       res1_start =  res1_stop)
+   {
+      res1_stop = blFindNextResidue(res1_start);
+                        
+      /* if *key* residue of choice */
+      if((query->resnum1 == res1_start->resnum)
+         && (query->chain1[0]==res1_start->chain[0])
+         && (query->insert1[0] == res1_start->insert[0]))
+      {
+         break;
+      }
+      prevres1 = res1_start;
+   }
+   if(res1_start==NULL)
+   {
+      AddHBMessage(result, "Can't find residue 1  in PDB file\n", TRUE);
+      return(FALSE);
+   }
+   
+   /*Find the partner residue which is the sidechain acceptor */
+   for(res2_start = pdb; res2_start !=NULL;
+       res2_start=res2_stop)
+   {
+      res2_stop = blFindNextResidue(res2_start);
+      
+      /* if *partner* residue of choice */
+      if((query->resnum2 == res2_start->resnum)
+         && (query->chain1[0]==res1_start->chain[0])
+         && (query->insert1[0] == res1_start->insert[0]))
+      {
+         break;
+      }
+   }
+   if(res2_start==NULL)
+   {
+      AddHBMessage(result, "Can't find residue 2 in PDB file\n", TRUE);
+      return(FALSE);
+   }
+   
+   if(!ReadInMatrices(ctx, query->res1, query->res2, matrix, MAT_READ_ACCEPTOR2, MAT_RES_2,
+                      result))
+   {
+      /* ACRM 08.09.05 - error message */
+      char buffer[160];
+      sprintf(buffer, "Unable to find residue in the sc/sc matrix file: %s\n", query->res2);
+      AddHBMessage(result, buffer, TRUE);
+      return(FALSE);
+   }
+   
+   if(!ReadInMatrices(ctx, query->res1, query->res2, matrix2, MAT_READ_DONOR1, MAT_RES_1,
+                      result))
+   {
+      /* ACRM 08.09.05 - error message */
+      char buffer[160];
+      sprintf(buffer, "Unable to find residue in the mc donor matrix file: %s\n", query->res1);
+      AddHBMessage(result, buffer, TRUE);
+      return(FALSE);
+   }
+   
+   /* ACRM 25.03.11 Check return value */
+   if(!FindOrientation(res2_start, res2_stop, &frame2))
+   {
+      AddHBMessage(result, "Can't orientate PDB file\n", TRUE);
+      return(FALSE);
+   }
+   
+#ifndef NOCULL
+   CullArrays(ctx, pdb, &frame2, res1_start, res2_start,
+              ctx->partnertoAccept, ctx->accept);
+#endif
+
+   /* ACRM 25.03.11 Check return value */
+   if(!FindN_Orientation(prevres1, res1_start, res1_stop, &frame1))
+   {
+      AddHBMessage(result, "Can't orientate PDB file about N\n", TRUE);
+      return(FALSE);
+   }
+   
+#ifndef NOCULL
+   CullArrays(ctx, pdb, &frame1, res1_start, res2_start,
+              ctx->donate, ctx->partnertoDonate);
+#endif   
+
+   CalculateNToCaVector(&frame1, res1_start, res1_stop, res2_start,
+                         res2_stop, &NtoCAVector, result);
+   
+   /* 17.10.26 Check return value */
+   if(!CreateRotationMatrix(ctx, &frame1, res1_start, res1_stop,
+                            res2_start, res2_stop, NtoCAVector, ATOMS_CNCA,
+                            ATOMS_NCACB, prevres1, result))
+   {
+      AddHBMessage(result, "Unable to fit the residues\n", TRUE);
+      return(FALSE);
+   }
+
+   if(query->hbplus)
+   {
+      /* 17.10.26 Residue 2's orientation is already known          */
+      if(CalculateHBondEnergy(ctx, &frame2, res1_start, res1_stop,
+                              NtoCAVector, query->hatom1,
+                              result) == CHBE_ERROR)
+      {
+         AddHBMessage(result, "Unable to calculate HBondEnergy (2)\n", TRUE);
+      }
+   }
+   else
+   {
+      if(!CheckValidHBond(ctx, NtoCAVector,
+                          ctx->donate, ctx->partnertoAccept, result))
+      {
+         /* 06.02.06 ACRM - the two grids were the wrong way around! */
+         if(!CheckValidHBond(ctx, NtoCAVector,
+                             ctx->partnertoDonate, ctx->accept, result))
+         {
+            return(FALSE);
+         }
+      }
+   }
+   return(TRUE);
+}
+
+/************************************************************************/
+/* ACRM 13.09.11 Added more error messages */
+BOOL AnalyzeMCAcceptorPair(HBCONTEXT *ctx, PDB *pdb, 
+                           MATFILE *matrix, MATFILE *matrix2,
+                           HBQUERY *query, HBRESULT *result)
+{
+   VEC3F       CtoCAVector;
+   ORIENTATION frame1, frame2;
+
+   PDB *res1_start, *res1_stop, *res2_start, *res2_stop;
+   
+   /* Find the key residue which is the mainchain acceptor */
+   for(res1_start =  pdb;
+       res1_start != NULL;
+       res1_start =  res1_stop)
+   {
+      res1_stop = blFindNextResidue(res1_start);
+                        
+      /* if *key* residue of choice */
+      if((query->resnum1 == res1_start->resnum)
+         && (query->chain1[0]==res1_start->chain[0])
+         && (query->insert1[0] == res1_start->insert[0]))
+      {
+         break;
+      }
+   }
+   if(res1_start==NULL)
+   {
+      AddHBMessage(result, "Can't find residue 1  in PDB file\n", TRUE);
+      return(FALSE);
+   }
+   
+   /*Find the partner residue which is the sidechain acceptor */
+   for(res2_start = pdb; res2_start !=NULL;
+       res2_start=res2_stop)
+   {
+      res2_stop = blFindNextResidue(res2_start);
+      
+      /* if *partner* residue of choice */
+      if((query->resnum2 == res2_start->resnum)
+         && (query->chain1[0]==res1_start->chain[0])
+         && (query->insert1[0] == res1_start->insert[0]))
+      {
+         break;
+      }
+   }
+   if(res2_start==NULL)
+   {
+      AddHBMessage(result, "Can't find residue 2 in PDB file\n", TRUE);
+      return(FALSE);
+   }
+   
+   if(!ReadInMatrices(ctx, query->res1, query->res2, matrix, MAT_READ_DONOR2, MAT_RES_2,
+                      result))
+   {
+      /* ACRM 08.09.05 - error message */
+      char buffer[160];
+      sprintf(buffer, "Unable to find residue in the sc/sc matrix file: %s\n", query->res2);
+      AddHBMessage(result, buffer, TRUE);
+      return(FALSE);
+   }
+   
+   if(!ReadInMatrices(ctx, query->res1, query->res2, matrix2, MAT_READ_ACCEPTOR1, MAT_RES_1,
+                      result))
+   {
+      /* ACRM 08.09.05 - error message */
+      char buffer[160];
+      sprintf(buffer, "Unable to find residue in the mc acceptor matrix file: %s\n", query->res1);
+      AddHBMessage(result, buffer, TRUE);
+      return(FALSE);
+   }
+   
+   /* ACRM 25.03.11 Check return value */
+   if(!FindOrientation(res2_start, res2_stop, &frame2))
+   {
+      AddHBMessage(result, "Can't orientate the PDB file\n", TRUE);
+      return(FALSE);
+   }
+   
+#ifndef NOCULL
+   CullArrays(ctx, pdb, &frame2, res1_start, res2_start, ctx->donate,
+              ctx->partnertoDonate);
+#endif
+
+   /* ACRM 25.03.11 Check return value */
+   if(!FindCO_Orientation(res1_start, res1_stop, &frame1))
+   {
+      AddHBMessage(result, "Can't orientate the PDB file about CO\n", TRUE);
+      return(FALSE);
+   }
+   
+#ifndef NOCULL
+   CullArrays(ctx, pdb, &frame1, res1_start, res2_start,
+              ctx->accept, ctx->partnertoAccept);
+#endif   
+
+   CalculateCToCaVector(&frame1, res1_start, res1_stop, res2_start,
+                         res2_stop, &CtoCAVector, result);
+   
+   /* 17.10.26 Check return value */
+   if(!CreateRotationMatrix(ctx, &frame1, res1_start, res1_stop,
+                            res2_start, res2_stop, CtoCAVector, ATOMS_CACO,
+                            ATOMS_NCACB, NULL, result))
+   {
+      AddHBMessage(result, "Unable to fit the residues\n", TRUE);
+      return(FALSE);
+   }
+
+   if(query->hbplus)
+   {
+      /* 17.10.26 Residue 2's orientation is already known          */
+      if(CalculateHBondEnergy(ctx, &frame2, res1_start, res1_stop,
+                              CtoCAVector, query->hatom1,
+                              result) == CHBE_ERROR)
+      {
+         AddHBMessage(result, "Unable to calculate HBondEnergy (3)\n", TRUE);
+      }
+   }
+   else
+   {
+      /* 06.02.06 ACRM - the two grids were the wrong way around! */
+      if(!CheckValidHBond(ctx, CtoCAVector,
+                          ctx->partnertoAccept, ctx->donate, result))
+      {
+         if(!CheckValidHBond(ctx, CtoCAVector,
+                             ctx->accept, ctx->partnertoDonate, result))
+         {
+            return(FALSE);
+         }
+      }
+   }
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Runs a query of the given kind (HB_SCSC, HB_MCDONOR or HB_MCACCEPTOR)
+   as the checkhbond programs do. For a side-chain pair the pair is
+   tried the other way round if there is no H-bond the first way.
+   matrix2 is the main chain matrix for the HB_MC kinds.
+*/
+BOOL RunHBQuery(HBCONTEXT *ctx, PDB *pdb, int kind, MATFILE *matrix,
+                MATFILE *matrix2, HBQUERY *query, HBRESULT *result)
+{
+   BOOL found;
+
+   switch(kind)
+   {
+   case HB_MCDONOR:
+      return(AnalyzeMCDonorPair(ctx, pdb, matrix, matrix2, query,
+                                result));
+   case HB_MCACCEPTOR:
+      return(AnalyzeMCAcceptorPair(ctx, pdb, matrix, matrix2, query,
+                                   result));
+   default:
+      break;
+   }
+
+   if(PrepareHBondingPair(ctx, pdb, matrix, query, result))
+      return(TRUE);
+
+   /* ACRM 08.09.05 Swap chain, inserts and hatom as well! */
+   SwapHBQuery(query);
+   found = PrepareHBondingPair(ctx, pdb, matrix, query, result);
+   SwapHBQuery(query);
+
+   return(found);
+}
+
+/************************************************************************/
+/* Sets up a pair of residues for trying every residue type at position
+   2. The PDB list is orientated, culling masks made and the rotation
+   found just as by PrepareHBondingPair(), AnalyzeMCDonorPair() or
+   AnalyzeMCAcceptorPair() (depending on 'kind'), but once for all the
+   types. query->res1 must be set; query->res2 and hbplus are not used.
+   For HB_SCSC the pair is also set up the other way round, after the
+   first, as checkhbond does when the first way has no H-bond.
+   Returns NULL on error.
+*/
+HBSITE *PrepareHBSite(HBCONTEXT *ctx, PDB *pdb, int kind, HBQUERY *query,
+                      HBRESULT *result)
+{
+   HBSITE  *site;
+   HBQUERY swapped;
+   int     i;
+
+   if((site = (HBSITE *)malloc(sizeof(HBSITE)))==NULL)
+   {
+      AddHBMessage(result, "No memory for residue site\n", FALSE);
+      return(NULL);
+   }
+
+   site->kind    = kind;
+   site->nframes = ((kind == HB_SCSC) ? 2 : 1);
+   strcpy(site->res1, query->res1);
+   for(i=0; i<2; i++)
+      site->frame[i].cull1 = site->frame[i].cull2 = NULL;
+
+   for(i=0; i<site->nframes; i++)
+   {
+      if(((site->frame[i].cull2 =
+           (unsigned char *)malloc(GRIDMASKBYTES))==NULL) ||
+         ((site->frame[i].cull1 =
+           (unsigned char *)malloc(GRIDMASKBYTES))==NULL))
+      {
+         AddHBMessage(result, "No memory for residue site\n", FALSE);
+         FreeHBSite(site);
+         return(NULL);
+      }
+   }
+
+   if(!PrepareHBFrame(ctx, pdb, kind, query, &(site->frame[0]), result))
+   {
+      FreeHBSite(site);
+      return(NULL);
+   }
+
+   if(kind == HB_SCSC)
+   {
+      swapped = *query;
+      SwapHBQuery(&swapped);
+      if(!PrepareHBFrame(ctx, pdb, kind, &swapped, &(site->frame[1]),
+                         result))
+      {
+         FreeHBSite(site);
+         return(NULL);
+      }
+   }
+
+   return(site);
+}
+
+/************************************************************************/
+void FreeHBSite(HBSITE *site)
+{
+   int i;
+
+   if(site == NULL)
+      return;
+
+   for(i=0; i<2; i++)
+   {
+      if(site->frame[i].cull2 != NULL) free(site->frame[i].cull2);
+      if(site->frame[i].cull1 != NULL) free(site->frame[i].cull1);
+   }
+   free(site);
+}
+
+/************************************************************************/
+/* Tries residue type res2 at position 2 of a site from PrepareHBSite().
+   The grids are cleared and read for res1 and res2, culled with the
+   site's masks and matched as for a single query of the same kind.
+   Returns TRUE and sets the result if there is a valid H-bond.
+*/
+BOOL ScoreHBSite(HBCONTEXT *ctx, HBSITE *site, MATFILE *matrix,
+                 MATFILE *matrix2, char *res2, HBRESULT *result)
+{
+   char buffer[160];
+
+   ClearHBContext(ctx);
+
+   switch(site->kind)
+   {
+   case HB_MCDONOR:
+      if(!ReadInMatrices(ctx, site->res1, res2, matrix, MAT_READ_ACCEPTOR2,
+                         MAT_RES_2, result))
+      {
+         sprintf(buffer, "Unable to find residue in the sc/sc matrix file: %s\n", res2);
+         AddHBMessage(result, buffer, TRUE);
+         return(FALSE);
+      }
+      if(!ReadInMatrices(ctx, site->res1, res2, matrix2, MAT_READ_DONOR1,
+                         MAT_RES_1, result))
+      {
+         sprintf(buffer, "Unable to find residue in the mc donor matrix file: %s\n", site->res1);
+         AddHBMessage(result, buffer, TRUE);
+         return(FALSE);
+      }
+      return(CheckHBFrame(ctx, site->kind, &(site->frame[0]), result));
+   case HB_MCACCEPTOR:
+      if(!ReadInMatrices(ctx, site->res1, res2, matrix, MAT_READ_DONOR2,
+                         MAT_RES_2, result))
+      {
+         sprintf(buffer, "Unable to find residue in the sc/sc matrix file: %s\n", res2);
+         AddHBMessage(result, buffer, TRUE);
+         return(FALSE);
+      }
+      if(!ReadInMatrices(ctx, site->res1, res2, matrix2, MAT_READ_ACCEPTOR1,
+                         MAT_RES_1, result))
+      {
+         sprintf(buffer, "Unable to find residue in the mc acceptor matrix file: %s\n", site->res1);
+         AddHBMessage(result, buffer, TRUE);
+         return(FALSE);
+      }
+      return(CheckHBFrame(ctx, site->kind, &(site->frame[0]), result));
+   default:
+      if(ReadInMatrices(ctx, site->res1, res2, matrix, MAT_READ_BOTH,
+                        MAT_RES_BOTH, result) &&
+         CheckHBFrame(ctx, site->kind, &(site->frame[0]), result))
+         return(TRUE);
+
+      /* The other way round, reading on top of the grids left from the
+         first way as checkhbond does
+      */
+      if(!ReadInMatrices(ctx, res2, site->res1, matrix, MAT_READ_BOTH,
+                         MAT_RES_BOTH, result))
+         return(FALSE);
+      return(CheckHBFrame(ctx, site->kind, &(site->frame[1]), result));
+   }
+}
+
+/************************************************************************/
+/* Finds residues 1 and 2 of a query (and the residue before residue 1)
+   in the same way as PrepareHBondingPair()
+*/
+static BOOL FindPairResidues(PDB *pdb, HBQUERY *query,
+                             PDB **res1_start, PDB **res1_stop,
+                             PDB **res2_start, PDB **res2_stop,
+                             PDB **prevres1, HBRESULT *result)
+{
+   for(*res1_start = pdb, *prevres1 = NULL;
+       *res1_start != NULL;
+       *res1_start = *res1_stop)
+   {
+      *res1_stop = blFindNextResidue(*res1_start);
+      if((query->resnum1 == (*res1_start)->resnum)
+         && (query->chain1[0]==(*res1_start)->chain[0])
+         && (query->insert1[0] == (*res1_start)->insert[0]))
+      {
+         break;
+      }
+      *prevres1 = *res1_start;
+   }
+   if(*res1_start==NULL)
+   {
+      AddHBMessage(result, "Can't find residue 1  in PDB file\n", TRUE);
+      return(FALSE);
+   }
+   
+   for(*res2_start = pdb; *res2_start != NULL; *res2_start = *res2_stop)
+   {
+      *res2_stop = blFindNextResidue(*res2_start);
+      if((query->resnum2 == (*res2_start)->resnum)
+         && (query->chain1[0]==(*res1_start)->chain[0])
+         && (query->insert1[0] == (*res1_start)->insert[0]))
+      {
+         break;
+      }
+   }
+   if(*res2_start==NULL)
+   {
+      AddHBMessage(result, "Can't find residue 2 in PDB file\n", TRUE);
+      return(FALSE);
+   }
+
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Orientates the pair on residue 2 and then on residue 1 of a query
+   as for a single query of the given kind, keeping the cells that
+   would be culled and the vector and rotation in 'frame'
+*/
+static BOOL PrepareHBFrame(HBCONTEXT *ctx, PDB *pdb, int kind,
+                           HBQUERY *query, HBFRAME *frame,
+                           HBRESULT *result)
+{
+   PDB         *res1_start, *res1_stop, *res2_start, *res2_stop,
+               *prevres1;
+   ORIENTATION frame1, frame2;
+
+   if(!FindPairResidues(pdb, query, &res1_start, &res1_stop,
+                        &res2_start, &res2_stop, &prevres1, result))
+      return(FALSE);
+
+   if(!FindOrientation(res2_start, res2_stop, &frame2))
+   {
+      AddHBMessage(result, "Can't orientate PDB file\n", TRUE);
+      return(FALSE);
+   }
+   MarkCulledCells(ctx, pdb, &frame2, res1_start, res2_start, frame->cull2);
+
+   switch(kind)
+   {
+   case HB_MCDONOR:
+      if(!FindN_Orientation(prevres1, res1_start, res1_stop, &frame1))
+      {
+         AddHBMessage(result, "Can't orientate PDB file about N\n", TRUE);
+         return(FALSE);
+      }
+      MarkCulledCells(ctx, pdb, &frame1, res1_start, res2_start,
+                      frame->cull1);
+      CalculateNToCaVector(&frame1, res1_start, res1_stop, res2_start,
+                           res2_stop, &(frame->vector), result);
+      /* 17.10.26 Check return value */
+      if(!CreateRotationMatrix(ctx, &frame1, res1_start, res1_stop, res2_start,
+                               res2_stop, frame->vector, ATOMS_CNCA,
+                               ATOMS_NCACB, prevres1, result))
+      {
+         AddHBMessage(result, "Unable to fit the residues\n", TRUE);
+         return(FALSE);
+      }
+      break;
+   case HB_MCACCEPTOR:
+      if(!FindCO_Orientation(res1_start, res1_stop, &frame1))
+      {
+         AddHBMessage(result, "Can't orientate the PDB file about CO\n",
+                      TRUE);
+         return(FALSE);
+      }
+      MarkCulledCells(ctx, pdb, &frame1, res1_start, res2_start,
+                      frame->cull1);
+      CalculateCToCaVector(&frame1, res1_start, res1_stop, res2_start,
+                           res2_stop, &(frame->vector), result);
+      /* 17.10.26 Check return value */
+      if(!CreateRotationMatrix(ctx, &frame1, res1_start, res1_stop, res2_start,
+                               res2_stop, frame->vector, ATOMS_CACO,
+                               ATOMS_NCACB, NULL, result))
+      {
+         AddHBMessage(result, "Unable to fit the residues\n", TRUE);
+         return(FALSE);
+      }
+      break;
+   default:
+      if(!FindOrientation(res1_start, res1_stop, &frame1))
+      {
+         AddHBMessage(result, "Can't orientate PDB file\n", TRUE);
+         return(FALSE);
+      }
+      MarkCulledCells(ctx, pdb, &frame1, res1_start, res2_start,
+                      frame->cull1);
+      CalculateCaToCaVector(&frame1, res1_start, res1_stop, res2_start,
+                            res2_stop, &(frame->vector), result);
+      /* 17.10.26 Check return value */
+      if(!CreateRotationMatrix(ctx, &frame1, res1_start, res1_stop, res2_start,
+                               res2_stop, frame->vector, ATOMS_NCACB,
+                               ATOMS_NCACB, NULL, result))
+      {
+         AddHBMessage(result, "Unable to fit the residues\n", TRUE);
+         return(FALSE);
+      }
+      break;
+   }
+
+   memcpy(frame->rotation, ctx->rotation, sizeof(frame->rotation));
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Culls the grids read for a site with the masks of a frame and looks
+   for a valid H-bond using the frame's vector and rotation, with the
+   grids of each kind paired as in the single query functions
+*/
+static BOOL CheckHBFrame(HBCONTEXT *ctx, int kind, HBFRAME *frame,
+                         HBRESULT *result)
+{
+   SPARSEGRID *cull2a, *cull2b, *cull1a, *cull1b,
+              *key1, *partner1, *key2, *partner2;
+
+   switch(kind)
+   {
+   case HB_MCDONOR:
+      cull2a = ctx->partnertoAccept;  cull2b   = ctx->accept;
+      cull1a = ctx->donate;           cull1b   = ctx->partnertoDonate;
+      key1   = ctx->donate;           partner1 = ctx->partnertoAccept;
+      key2   = ctx->partnertoDonate;  partner2 = ctx->accept;
+      break;
+   case HB_MCACCEPTOR:
+      cull2a = ctx->donate;           cull2b   = ctx->partnertoDonate;
+      cull1a = ctx->accept;           cull1b   = ctx->partnertoAccept;
+      key1   = ctx->partnertoAccept;  partner1 = ctx->donate;
+      key2   = ctx->accept;           partner2 = ctx->partnertoDonate;
+      break;
+   default:
+      cull2a = ctx->partnertoDonate;  cull2b   = ctx->partnertoAccept;
+      cull1a = ctx->donate;           cull1b   = ctx->accept;
+      key1   = ctx->donate;           partner1 = ctx->partnertoAccept;
+      key2   = ctx->partnertoDonate;  partner2 = ctx->accept;
+      break;
+   }
+
+#ifndef NOCULL
+   ClearSparseGridMasked(cull2a, frame->cull2);
+   ClearSparseGridMasked(cull2b, frame->cull2);
+   ClearSparseGridMasked(cull1a, frame->cull1);
+   ClearSparseGridMasked(cull1b, frame->cull1);
+#endif
+
+   memcpy(ctx->rotation, frame->rotation, sizeof(ctx->rotation));
+
+   if(CheckValidHBond(ctx, frame->vector, key1, partner1, result))
+      return(TRUE);
+   return(CheckValidHBond(ctx, frame->vector, key2, partner2, result));
+}
+
+/************************************************************************/
+/* Takes a PDB linked list of a single residue (pdb) and removes the
+   C atom. Then takes a copy of the C atom from another residue (prev)
+   and prepends it onto the first linked list
+   17.10.26 Frees the list if it fails
+*/
+static PDB *SwapCarbon(PDB *pdb, PDB *prevres)
+{
+   PDB *p, *c, *newc, *stop, *prev;
+   
+   /* First we drop the existing carbon */
+   for(p=pdb, prev=NULL; p!=NULL; NEXT(p))
+   {
+      if(!strncmp(p->atnam, "C   ", 4))
+      {
+         if(prev==NULL)
+         {
+            pdb = p->next;
+            free(p);
+            break;
+         }
+         else
+         {
+            prev->next = p->next;
+            free(p);
+            break;
+         }
+      }
+      prev = p;
+   }
+
+   stop = blFindNextResidue(prevres);
+   if((c = FindAtom(prevres, stop, "C   ", NULL))==NULL)
+   {
+      if(pdb != NULL) FREELIST(pdb, PDB);
+      return(NULL);
+   }
+   INIT(newc, PDB);
+   if(newc==NULL)
+   {
+      if(pdb != NULL) FREELIST(pdb, PDB);
+      return(NULL);
+   }
+   blCopyPDB(newc,c);
+   newc->next = pdb;
+   
+   return(newc);
+}
+
+
+/************************************************************************/
+/* function that creates a rotation matrix (in ctx) to fit res 1
+   (*key* residue) onto res 2 (*partner* residue). A weight of 1.0
+   is added to atoms CA and N and 0.1 to atom C. 
+   Includes option to print out residues at set stages for debugging
+   purposes.
+
+   If we are ever to do backbone-backbone we will need to support
+   atomset2 being C,N,CA
+   17.10.26 The atoms are fitted in the orientation 'frame'
+*/
+static BOOL CreateRotationMatrix(HBCONTEXT *ctx, ORIENTATION *frame,
+                                 PDB *res1_start, PDB *res1_stop,
+                                 PDB *res2_start, PDB *res2_stop,
+                                 VEC3F Vector, int atomset1, int atomset2,
+                                 PDB *prevres1, HBRESULT *result)
+{
+   VEC3F tempv;   
+   
+   PDB  *keyres1_pdb = NULL, 
+        *partnerres2_pdb = NULL;
+   char *sel1[3], *sel2[3];
+   
+   REAL *weight = NULL;
+   int  natoms,
+        NumCo_ord1 = 0,
+        NumCo_ord2 = 0,
+        i          = 0;
+   PDB  *q         = NULL,
+        *start     = NULL;
+   COOR *keyres1_coor = NULL,
+        *partnerres2_coor = NULL;
+   BOOL ok = TRUE;
+
+   /* 17.10.26 Everything is freed at the end whether or not the fit
+      worked, as the code runs many times in one process
+   */
+   for(i=0; i<3; i++)
+      sel1[i] = sel2[i] = NULL;
+    
+   switch(atomset1)
+   {
+   case ATOMS_NCAC:
+      SELECT(sel1[0], "N   ");
+      SELECT(sel1[1], "CA  ");
+      SELECT(sel1[2], "C   ");
+      break;
+   case ATOMS_NCACB:
+      SELECT(sel1[0], "N   ");
+      SELECT(sel1[1], "CA  ");
+      SELECT(sel1[2], "CB  ");
+      break;
+   case ATOMS_CNCA:
+      SELECT(sel1[0], "C   ");
+      SELECT(sel1[1], "N   ");
+      SELECT(sel1[2], "CA  ");
+      break;
+   case ATOMS_CACO:
+      SELECT(sel1[0], "CA  ");
+      SELECT(sel1[1], "C   ");
+      SELECT(sel1[2], "O   ");
+      break;
+   default:
+      ok = FALSE;
+   }
+   
+   switch(atomset2)
+   {
+   case ATOMS_NCAC:
+      SELECT(sel2[0], "N   ");
+      SELECT(sel2[1], "CA  ");
+      SELECT(sel2[2], "C   ");
+      break;
+   case ATOMS_NCACB:
+      SELECT(sel2[0], "N   ");
+      SELECT(sel2[1], "CA  ");
+      SELECT(sel2[2], "CB  ");
+      break;
+   case ATOMS_CNCA:
+      AddHBMessage(result, "ENTERNAL ERROR - Code must be modified to support C,N,CA in second position\n", FALSE);
+      /* 17.10.26 Library code so returns rather than exiting       */
+      ok = FALSE;
+      break;
+   case ATOMS_CACO:
+      SELECT(sel2[0], "CA  ");
+      SELECT(sel2[1], "C   ");
+      SELECT(sel2[2], "O   ");
+      break;
+   default:
+      ok = FALSE;
+   }
+   
+   for(i=0; ok && (i<3); i++)
+   {
+      if((sel1[i] == NULL) || (sel2[i] == NULL))
+         ok = FALSE;
+   }
+
+   /* create linked list containing just C, N and CA atoms of residue 1 */
+   if(ok)
+      ok = ((keyres1_pdb = SelectAtomsResidue(res1_start, res1_stop,
+                                              3, sel1, &natoms)) != NULL);
+
+   /* If we are doing C,N,CA, we want to swap the carbon from res1 for the
+      carbon from the previous residue
+   */
+   if(ok && (atomset1 == ATOMS_CNCA))
+      ok = ((keyres1_pdb = SwapCarbon(keyres1_pdb, prevres1)) != NULL);
+
+   /* create linked list containing just C, N and CA atoms of residue 2 */
+   if(ok)
+      ok = ((partnerres2_pdb = SelectAtomsResidue(res2_start, res2_stop,
+                                                  3, sel2, &natoms))
+            != NULL);
+
+   if(ok)
+   {
+      /* 17.10.26 Only the selected atoms are orientated                */
+      ApplyOrientation(keyres1_pdb, NULL, frame);
+      ApplyOrientation(partnerres2_pdb, NULL, frame);
+
+#ifdef DEBUG
+      printf("REMARK DEBUG (checkhbond): original coordinates\n");
+      blWritePDB(stdout, keyres1_pdb);
+      blWritePDB(stdout, partnerres2_pdb);
+#endif
+   
+      /*moving partnerres2_pdb  CA atom to the origin */
+      tempv.x = -Vector.x;
+      tempv.y = -Vector.y;
+      tempv.z = -Vector.z;
+   
+      blTranslatePDB(partnerres2_pdb, tempv);
+    
+#ifdef DEBUG
+      printf("REMARK DEBUG (checkhbond): translated coordinates\n");
+      blWritePDB(stdout, keyres1_pdb);
+      blWritePDB(stdout, partnerres2_pdb);
+#endif
+
+      /* create coordinate arrays for res1 and res2 */
+      NumCo_ord2 = blGetPDBCoor(partnerres2_pdb, &partnerres2_coor);
+      NumCo_ord1 = blGetPDBCoor(keyres1_pdb, &keyres1_coor);
+
+      /* create the weight array. 17.10.26 Sized for residue 2, whose
+         atoms it is filled from. blMatfit() reads as many atoms of
+         residue 1, so there must be at least that many
+      */
+      ok = ((partnerres2_coor != NULL) && (keyres1_coor != NULL) &&
+            (NumCo_ord1 >= NumCo_ord2) &&
+            ((weight = (REAL *)malloc(NumCo_ord2 * sizeof(REAL)))
+             != NULL));
+   }
+
+   if(ok)
+   {
+      /* Set up the weight array */
+      start = partnerres2_pdb;
+      i = 0;
+      for(q = start; q!=NULL; NEXT(q))
+      {
+         if(!strncmp(q->atnam, sel2[0], 4))
+            weight[i] = (REAL)1.0;
+         if(!strncmp(q->atnam, sel2[1], 4))
+            weight[i] = (REAL)1.0;
+         if(!strncmp(q->atnam, sel2[2], 4))
+            weight[i] = (REAL)(0.1);
+         i++;
+      }
+   
+      /* create rotation matrix. */
+      if(!blMatfit(partnerres2_coor, keyres1_coor, ctx->rotation,
+                   NumCo_ord2, weight, FALSE))
+      {
+         AddHBMessage(result, "Fitting failed!\n", FALSE);
+         ok = FALSE;
+      }
+   }
+
+#ifdef DEBUG   
+   if(ok)
+   {
+      blApplyMatrixPDB(keyres1_pdb, ctx->rotation);
+      printf("REMARK DEBUG (checkhbond) rotated coordinates\n");
+      blWritePDB(stdout, keyres1_pdb);
+      blWritePDB(stdout, partnerres2_pdb);
+   }
+#endif
+   
+   if(partnerres2_pdb != NULL)
+      FREELIST(partnerres2_pdb, PDB);
+   if(keyres1_pdb != NULL)
+      FREELIST(keyres1_pdb, PDB);
+   if(partnerres2_coor != NULL)
+      free(partnerres2_coor);
+   if(keyres1_coor != NULL)
+      free(keyres1_coor);
+   if(weight != NULL)
+      free(weight);
+   for(i=0; i<3; i++)
+   {
+      if(sel1[i] != NULL)
+         free(sel1[i]);
+      if(sel2[i] != NULL)
+         free(sel2[i]);
+   }
+   
+   return(ok);
+}
+
@@ -0,0 +1,160 @@
+#ifndef HBENGINE_H
+#define HBENGINE_H
+
+/* The checkhbond scoring engine (hbengine.c). This is built into
+   libcheckhbond as well as the checkhbond programs.
+
+   All the working state for a query lives in an HBCONTEXT, so queries
+   may be run at the same time in different threads as long as each
+   thread has its own context. The PDB linked list is only read, so
+   may be shared as well, and so may an open MATFILE.
+
+   The header relies on bioplib/pdb.h, hbondmat2.h, matfile.h,
+   sparsegrid.h and batchrot.h having been included.
+*/
+
+/* Error codes for GetResidues() */
+#define ERR_NOMEM      0
+#define ERR_NOPREVRES1 1
+#define ERR_NOPREVRES2 2
+#define ERR_NORES1     3
+#define ERR_NORES2     4
+
+/* Outcome of a query, in HBRESULT.status                               */
+#define HB_NONE        0    /* Nothing to report (see the return value) */
+#define HB_VALID       1    /* Valid H-bond found; energy is set         */
+#define HB_ENERGY      2    /* Energy of a given H-bond (hbplus)         */
+#define HB_NOHBOND     3    /* No H-bond for the given atoms (hbplus)    */
+
+#define HB_MAXMESSAGES 16
+
+/* Kinds of pair, for PrepareHBSite()                                   */
+#define HB_SCSC        0    /* Side chain / side chain (checkhbond)      */
+#define HB_MCDONOR     1    /* Residue 1 is the main chain N donor       */
+#define HB_MCACCEPTOR  2    /* Residue 1 is the main chain O acceptor    */
+#define HB_NKINDS      3
+
+/* Most residue types tried at residue 2 of a site                      */
+#define HB_MAXTYPES    32
+
+/* The offset from an atom's cell of a cell culled around it          */
+typedef struct
+{
+   int dx,
+       dy,
+       dz;
+}  CULLOFFSET;
+
+/* The grids, rotation and cutoff used by a query                       */
+typedef struct
+{
+   SPARSEGRID *donate,
+              *accept,
+              *partnertoAccept,
+              *partnertoDonate,
+              *bestKey;         /* Best key energy within the cutoff    */
+   CELLBATCH  *partnerBatch;    /* Partner cells for rotating in bulk   */
+   unsigned char *cullMask;     /* Cells to be culled (GRIDMASKBYTES)   */
+   CULLOFFSET *cullOffsets;     /* Sorted on dx (see MarkCulledCells()) */
+   int        nCullOffsets;
+   REAL       rotation[3][3],
+              cutoff;
+#if defined(DEBUG1) || defined(DEBUG2)
+   char       debugChain;
+#endif
+}  HBCONTEXT;
+
+/* A pair of residues to test. res2 is the residue to be tested at
+   position 2; hatom1 and hatom2 are used when hbplus is set
+*/
+typedef struct
+{
+   int  resnum1,
+        resnum2;
+   char chain1[8],  chain2[8],
+        insert1[8], insert2[8],
+        res1[8],    res2[8],
+        hatom1[8],  hatom2[8];
+   BOOL hbplus;
+}  HBQUERY;
+
+/* The result of a query. Messages are kept in the order they arose;
+   toOutput is set for those the programs also write to the output
+   file rather than only to stderr
+*/
+typedef struct
+{
+   int  status;
+   REAL energy;
+   int  nmessages;
+   BOOL toOutput[HB_MAXMESSAGES];
+   char message[HB_MAXMESSAGES][MAXBUFF];
+}  HBRESULT;
+
+/* The orientation of a pair of residues in one direction: the cells
+   culled with the pair orientated on residue 2 and then on residue 1,
+   and the vector and rotation used to fit the grids together
+*/
+typedef struct
+{
+   unsigned char *cull2,        /* GRIDMASKBYTES each                   */
+                 *cull1;
+   VEC3F         vector;
+   REAL          rotation[3][3];
+}  HBFRAME;
+
+/* A pair of residues set up once by PrepareHBSite() so that any number
+   of residue types can be tried at position 2 with ScoreHBSite(). For
+   HB_SCSC the frame of the pair the other way round is kept as well
+*/
+typedef struct
+{
+   HBFRAME frame[2];
+   int     kind,
+           nframes;
+   char    res1[8];
+}  HBSITE;
+
+/* The matrix files for each kind of pair when more than one is used,
+   indexed by HB_SCSC, HB_MCDONOR and HB_MCACCEPTOR. matrix2 is the
+   main chain matrix for the HB_MC kinds; types are the residue types
+   in matrix, for trying each at residue 2
+*/
+typedef struct
+{
+   MATFILE *matrix,
+           *matrix2;
+   char    types[HB_MAXTYPES][8];
+   int     ntypes;
+}  KINDMATRICES;
+
+HBCONTEXT *CreateHBContext(REAL cutoff);
+void      FreeHBContext(HBCONTEXT *ctx);
+void      InitHBResult(HBRESULT *result);
+void      AddHBMessage(HBRESULT *result, char *text, BOOL toOutput);
+void      ClearHBContext(HBCONTEXT *ctx);
+void      SwapHBQuery(HBQUERY *query);
+BOOL      PrepareHBondingPair(HBCONTEXT *ctx, PDB *pdb, MATFILE *matrix,
+                              HBQUERY *query, HBRESULT *result);
+BOOL      AnalyzeMCDonorPair(HBCONTEXT *ctx, PDB *pdb, MATFILE *matrix,
+                             MATFILE *matrix2, HBQUERY *query,
+                             HBRESULT *result);
+BOOL      AnalyzeMCAcceptorPair(HBCONTEXT *ctx, PDB *pdb, MATFILE *matrix,
+                                MATFILE *matrix2, HBQUERY *query,
+                                HBRESULT *result);
+BOOL      RunHBQuery(HBCONTEXT *ctx, PDB *pdb, int kind, MATFILE *matrix,
+                     MATFILE *matrix2, HBQUERY *query, HBRESULT *result);
+PDB       *GetResidues(PDB *pdb, char *chain1, int resnum1,
+                       char *insert1, char *chain2, int resnum2,
+                       char *insert2, int *errorcode);
+HBSITE    *PrepareHBSite(HBCONTEXT *ctx, PDB *pdb, int kind,
+                         HBQUERY *query, HBRESULT *result);
+BOOL      ScoreHBSite(HBCONTEXT *ctx, HBSITE *site, MATFILE *matrix,
+                      MATFILE *matrix2, char *res2, HBRESULT *result);
+void      FreeHBSite(HBSITE *site);
+void      FindRes1Type(PDB *pdb, char *chain, int resnum, char *insert,
+                       char *res);
+void      FormatResSpec(char *spec, int resnum, char *chain,
+                        char *insert);
+
+#endif
@@ -0,0 +1,464 @@
+/*************************************************************************
+
+   Program:    checkhbond
+   File:       hbscan.c
+
+   Version:    V1.2
+   Date:       17.10.26
+   Function:   Find the H-bonded pairs of residues in a structure for a
+               whole-structure scan
+
+**************************************************************************
+
+   Description:
+   ============
+   Finds every pair of residues in a structure that is H-bonded by the
+   bioplib criteria used by hydrogen_matrices.c to build the matrices:
+   blIsHBonded() (side chain/side chain), blIsMCDonorHBonded() or
+   blIsMCAcceptorHBonded() (main chain N or O of residue 1 with the
+   side chain of residue 2). The structure must have hydrogens added.
+
+   Only residues whose CAs are within MAXCAHBDIST can be matched in the
+   grids, so only those pairs are tested. Residues are put in a cell
+   list on their CAs with cells MAXCAHBDIST wide, so each residue is
+   only compared with those in its own and the 26 neighbouring cells
+   rather than with every other residue.
+
+   FindScanPairs() adds the hydrogens to a copy of the structure first
+   and gives side chain pairs both ways round, as the scans of
+   checkhbond -a and checkhbond_server are run.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original
+   V1.1  17.10.26 SetQueryResidue() uses memcpy() so the build is free of
+                  warnings
+   V1.2  17.10.26 Added FindScanPairs() for the scans of checkhbond and
+                  checkhbond_server, which had their own copies
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "bioplib/macros.h"
+#include "bioplib/pdb.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "bioplib/hbond.h"
+#include "residues.h"
+#include "orientate.h"
+#include "hbondmat2.h"
+#include "matfile.h"
+#include "sparsegrid.h"
+#include "batchrot.h"
+#include "hbengine.h"
+#include "hbscan.h"
+#include "threadpool.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define CELLSIZE   ((REAL)MAXCAHBDIST)
+#define PAIRBLOCK  256      /* Growth step for the list of pairs       */
+
+#define DISTSQ_CA(a,b) (((a).x - (b).x) * ((a).x - (b).x) + \
+                        ((a).y - (b).y) * ((a).y - (b).y) + \
+                        ((a).z - (b).z) * ((a).z - (b).z))
+
+/************************************************************************/
+/* Structure definitions
+*/
+/* A residue of the structure and the cell of its CA                    */
+typedef struct
+{
+   PDB   *start,
+         *stop,
+         *prev;               /* Preceding residue in the list or NULL  */
+   VEC3F ca;
+   int   cell;
+}  SCANRES;
+
+/* A pair of residues as indexes into the SCANRES array                 */
+typedef struct
+{
+   int res1,
+       res2;
+}  SCANPAIR;
+
+/************************************************************************/
+/* Prototypes
+*/
+static SCANRES *GetScanResidues(PDB *pdb, int *nres);
+static BOOL BuildCellList(SCANRES *res, int nres, int dims[3],
+                          int **cellstart, int **order);
+static BOOL PairHBonded(SCANRES *res1, SCANRES *res2, int kind);
+static BOOL AddScanPair(SCANPAIR **pairs, int *npairs, int *maxpairs,
+                        int res1, int res2);
+static int ComparePairs(const void *a, const void *b);
+static void SetQueryResidue(PDB *res, int *resnum, char *chain,
+                            char *insert, char *resnam);
+
+/************************************************************************/
+/* Returns an array of queries, one for each H-bonded pair of residues
+   of the given kind (HB_SCSC, HB_MCDONOR or HB_MCACCEPTOR; see
+   hbengine.h), in the order of the residues in the PDB list. For
+   HB_SCSC each pair is given once, with residue 1 first in the list;
+   for the main chain kinds residue 1 is the main chain residue. res1
+   and res2 are set to the residue names. Returns NULL (with *npairs 0
+   if no pairs were found) or if memory runs out.
+*/
+HBQUERY *FindHBondedPairs(PDB *pdb, int kind, int *npairs)
+{
+   SCANRES  *res;
+   SCANPAIR *pairs    = NULL;
+   HBQUERY  *queries  = NULL;
+   int      nres, i, j, k, c,
+            dx, dy, dz, x, y, z,
+            dims[3],
+            *cellstart = NULL,
+            *order     = NULL,
+            maxpairs   = 0;
+   BOOL     OK = TRUE;
+
+   *npairs = 0;
+   if((res = GetScanResidues(pdb, &nres))==NULL)
+      return(NULL);
+
+   if(!BuildCellList(res, nres, dims, &cellstart, &order))
+   {
+      free(res);
+      return(NULL);
+   }
+
+   for(i=0; OK && (i<nres); i++)
+   {
+      x = res[i].cell / (dims[1] * dims[2]);
+      y = (res[i].cell / dims[2]) % dims[1];
+      z = res[i].cell % dims[2];
+
+      for(dx=(-1); OK && (dx<=1); dx++)
+      {
+         if((x+dx < 0) || (x+dx >= dims[0])) continue;
+         for(dy=(-1); OK && (dy<=1); dy++)
+         {
+            if((y+dy < 0) || (y+dy >= dims[1])) continue;
+            for(dz=(-1); OK && (dz<=1); dz++)
+            {
+               if((z+dz < 0) || (z+dz >= dims[2])) continue;
+               c = ((x+dx) * dims[1] + (y+dy)) * dims[2] + (z+dz);
+
+               for(k=cellstart[c]; k<cellstart[c+1]; k++)
+               {
+                  j = order[k];
+
+                  /* Side chain pairs are tested once each            */
+                  if((j == i) || ((kind == HB_SCSC) && (j < i)))
+                     continue;
+                  if(DISTSQ_CA(res[i].ca, res[j].ca) >
+                     (CELLSIZE * CELLSIZE))
+                     continue;
+
+                  if(PairHBonded(res+i, res+j, kind))
+                  {
+                     if(!AddScanPair(&pairs, npairs, &maxpairs, i, j))
+                     {
+                        OK = FALSE;
+                        break;
+                     }
+                  }
+               }
+            }
+         }
+      }
+   }
+
+   if(OK && (*npairs > 0))
+   {
+      qsort(pairs, *npairs, sizeof(SCANPAIR), ComparePairs);
+
+      if((queries = (HBQUERY *)malloc(*npairs * sizeof(HBQUERY)))!=NULL)
+      {
+         for(i=0; i<*npairs; i++)
+         {
+            SetQueryResidue(res[pairs[i].res1].start, &queries[i].resnum1,
+                            queries[i].chain1, queries[i].insert1,
+                            queries[i].res1);
+            SetQueryResidue(res[pairs[i].res2].start, &queries[i].resnum2,
+                            queries[i].chain2, queries[i].insert2,
+                            queries[i].res2);
+            queries[i].hatom1[0] = queries[i].hatom2[0] = '\0';
+            queries[i].hbplus    = FALSE;
+         }
+      }
+   }
+
+   if(queries == NULL)
+      *npairs = 0;
+
+   if(pairs != NULL)
+      free(pairs);
+   free(cellstart);
+   free(order);
+   free(res);
+
+   return(queries);
+}
+
+/************************************************************************/
+/* Finds the H-bonded pairs of the given kind in a copy of a (hydrogen
+   stripped) structure with hydrogens added from PGPFILE in $DATADIR,
+   as when the matrices were built. For HB_SCSC each pair is followed
+   by the same pair the other way round. Returns NULL with *npairs 0 if
+   there are no pairs, or with *npairs -1 and the reason in error on
+   failure
+*/
+HBQUERY *FindScanPairs(PDB *pdb, int kind, int *npairs, char *error)
+{
+   FILE    *fp;
+   PDB     *hpdb;
+   HBQUERY *pairs,
+           *both;
+   int     natoms, i;
+   BOOL    noenv,
+           added = FALSE;
+
+   *npairs = (-1);
+
+   if((hpdb = blStripHPDBAsCopy(pdb, &natoms))==NULL)
+   {
+      strcpy(error, "No memory for copy of PDB file");
+      return(NULL);
+   }
+
+   /* bioplib's hydrogen adding is not thread-safe                      */
+   BeginSerialSection();
+   if((fp = blOpenFile(PGPFILE, "DATADIR", "r", &noenv)) != NULL)
+   {
+      added = (blHAddPDB(fp, hpdb) != 0);
+      fclose(fp);
+   }
+   EndSerialSection();
+
+   if(!added)
+   {
+      strcpy(error, ((fp == NULL) ?
+                     (noenv ? "DATADIR environment variable not set" :
+                      "Can't open pgp file") :
+                     "Unable to add hydrogens"));
+      FREELIST(hpdb, PDB);
+      return(NULL);
+   }
+
+   pairs = FindHBondedPairs(hpdb, kind, npairs);
+   FREELIST(hpdb, PDB);
+   if(pairs == NULL)
+   {
+      if(*npairs != 0)
+      {
+         strcpy(error, "No memory for H-bonded pairs");
+         *npairs = (-1);
+      }
+      return(NULL);
+   }
+   if(kind != HB_SCSC)
+      return(pairs);
+
+   /* Side chain pairs are tried both ways round                        */
+   if((both = (HBQUERY *)malloc(2 * (*npairs) * sizeof(HBQUERY)))==NULL)
+   {
+      strcpy(error, "No memory for H-bonded pairs");
+      free(pairs);
+      *npairs = (-1);
+      return(NULL);
+   }
+   for(i=0; i<(*npairs); i++)
+   {
+      both[2*i] = both[2*i+1] = pairs[i];
+      SwapHBQuery(both + 2*i + 1);
+   }
+   *npairs *= 2;
+
+   free(pairs);
+   return(both);
+}
+
+/************************************************************************/
+/* Makes an array of the ATOM residues which have a CA                  */
+static SCANRES *GetScanResidues(PDB *pdb, int *nres)
+{
+   SCANRES *res;
+   PDB     *start, *stop, *prev, *p;
+   int     n = 0;
+
+   for(start=pdb; start!=NULL; start=blFindNextResidue(start))
+      n++;
+
+   *nres = 0;
+   if((n == 0) || ((res = (SCANRES *)malloc(n * sizeof(SCANRES)))==NULL))
+      return(NULL);
+
+   for(start=pdb, prev=NULL; start!=NULL; prev=start, start=stop)
+   {
+      stop = blFindNextResidue(start);
+      if(strncmp(start->record_type, "ATOM  ", 6))
+         continue;
+
+      for(p=start; p!=stop; NEXT(p))
+      {
+         if(!strncmp(p->atnam, "CA  ", 4))
+         {
+            res[*nres].start = start;
+            res[*nres].stop  = stop;
+            res[*nres].prev  = prev;
+            res[*nres].ca.x  = p->x;
+            res[*nres].ca.y  = p->y;
+            res[*nres].ca.z  = p->z;
+            (*nres)++;
+            break;
+         }
+      }
+   }
+
+   if(*nres == 0)
+   {
+      free(res);
+      return(NULL);
+   }
+   return(res);
+}
+
+/************************************************************************/
+/* Sets the cell of each residue and builds the cell list: the residues
+   in cell c are order[cellstart[c]] to order[cellstart[c+1]-1]
+*/
+static BOOL BuildCellList(SCANRES *res, int nres, int dims[3],
+                          int **cellstart, int **order)
+{
+   VEC3F min, max;
+   int   i, ncells, x, y, z;
+
+   min = max = res[0].ca;
+   for(i=1; i<nres; i++)
+   {
+      if(res[i].ca.x < min.x) min.x = res[i].ca.x;
+      if(res[i].ca.y < min.y) min.y = res[i].ca.y;
+      if(res[i].ca.z < min.z) min.z = res[i].ca.z;
+      if(res[i].ca.x > max.x) max.x = res[i].ca.x;
+      if(res[i].ca.y > max.y) max.y = res[i].ca.y;
+      if(res[i].ca.z > max.z) max.z = res[i].ca.z;
+   }
+
+   dims[0] = 1 + (int)((max.x - min.x) / CELLSIZE);
+   dims[1] = 1 + (int)((max.y - min.y) / CELLSIZE);
+   dims[2] = 1 + (int)((max.z - min.z) / CELLSIZE);
+   ncells  = dims[0] * dims[1] * dims[2];
+
+   if((*cellstart = (int *)calloc(ncells+1, sizeof(int)))==NULL)
+      return(FALSE);
+   if((*order = (int *)malloc(nres * sizeof(int)))==NULL)
+   {
+      free(*cellstart);
+      return(FALSE);
+   }
+
+   /* Count the residues in each cell, then turn the counts into the
+      start of each cell and fill in the residues
+   */
+   for(i=0; i<nres; i++)
+   {
+      x = (int)((res[i].ca.x - min.x) / CELLSIZE);
+      y = (int)((res[i].ca.y - min.y) / CELLSIZE);
+      z = (int)((res[i].ca.z - min.z) / CELLSIZE);
+      res[i].cell = (x * dims[1] + y) * dims[2] + z;
+      (*cellstart)[res[i].cell + 1]++;
+   }
+   for(i=0; i<ncells; i++)
+      (*cellstart)[i+1] += (*cellstart)[i];
+   for(i=0; i<nres; i++)
+      (*order)[(*cellstart)[res[i].cell]++] = i;
+
+   /* Filling in moved each start on to the next cell                  */
+   for(i=ncells; i>0; i--)
+      (*cellstart)[i] = (*cellstart)[i-1];
+   (*cellstart)[0] = 0;
+
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Tests a pair with the criteria used by hydrogen_matrices.c          */
+static BOOL PairHBonded(SCANRES *res1, SCANRES *res2, int kind)
+{
+   switch(kind)
+   {
+   case HB_MCDONOR:
+      /* Not proline and not the first residue                         */
+      if(!strncmp(res1->start->resnam, "PRO", 3) ||
+         (res1->prev == NULL) ||
+         !ResiduesBonded(res1->prev, res1->start))
+         return(FALSE);
+      return(blIsMCDonorHBonded(res1->start, res2->start,
+                                HBOND_SIDE2) != 0);
+   case HB_MCACCEPTOR:
+      return(blIsMCAcceptorHBonded(res1->start, res2->start,
+                                   HBOND_SIDE2) != 0);
+   default:
+      return(blIsHBonded(res1->start, res2->start, HBOND_SS) != 0);
+   }
+}
+
+/************************************************************************/
+static BOOL AddScanPair(SCANPAIR **pairs, int *npairs, int *maxpairs,
+                        int res1, int res2)
+{
+   SCANPAIR *p;
+
+   if(*npairs == *maxpairs)
+   {
+      if((p = (SCANPAIR *)realloc(*pairs, (*maxpairs + PAIRBLOCK) *
+                                  sizeof(SCANPAIR)))==NULL)
+         return(FALSE);
+      *pairs     = p;
+      *maxpairs += PAIRBLOCK;
+   }
+
+   (*pairs)[*npairs].res1 = res1;
+   (*pairs)[*npairs].res2 = res2;
+   (*npairs)++;
+   return(TRUE);
+}
+
+/************************************************************************/
+/* qsort() comparison: pairs in the order of residue 1 then residue 2  */
+static int ComparePairs(const void *a, const void *b)
+{
+   const SCANPAIR *p = (const SCANPAIR *)a,
+                  *q = (const SCANPAIR *)b;
+
+   if(p->res1 != q->res1)
+      return((p->res1 < q->res1) ? (-1) : 1);
+   if(p->res2 != q->res2)
+      return((p->res2 < q->res2) ? (-1) : 1);
+   return(0);
+}
+
+/************************************************************************/
+static void SetQueryResidue(PDB *res, int *resnum, char *chain,
+                            char *insert, char *resnam)
+{
+   *resnum = res->resnum;
+
+   /* Fixed-width fields copied whole and terminated, as strncpy()
+      warns of truncation under -O3
+   */
+   memcpy(chain, res->chain, 7);
+   chain[7] = '\0';
+   memcpy(insert, res->insert, 7);
+   insert[7] = '\0';
+   memcpy(resnam, res->resnam, 3);
+   resnam[3] = '\0';
+}
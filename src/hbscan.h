@@ -0,0 +1,10 @@
+#ifndef HBSCAN_H
+#define HBSCAN_H
+
+/* Finding the H-bonded pairs of residues in a structure (hbscan.c).
+   Relies on bioplib/pdb.h and hbengine.h having been included.
+*/
+HBQUERY *FindHBondedPairs(PDB *pdb, int kind, int *npairs);
+HBQUERY *FindScanPairs(PDB *pdb, int kind, int *npairs, char *error);
+
+#endif
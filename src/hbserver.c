@@ -0,0 +1,1426 @@
+/*************************************************************************
+
+   Program:    checkhbond_server
+   File:       hbserver.c
+
+   Version:    V1.11
+   Date:       17.10.26
+   Function:   Resident checkhbond scoring server on a Unix domain
+               socket
+
+**************************************************************************
+
+   Description:
+   ============
+   Most of the time taken by a single checkhbond run goes on starting
+   the program, opening the matrix files and reading the PDB file. The
+   server opens the matrix files for all three kinds of pair once,
+   keeps the structures it has read, and answers requests from any
+   number of clients over a Unix domain socket.
+
+   Protocol
+   --------
+   Each message, in either direction, is a 4-byte length in network
+   byte order followed by that many bytes of text. A client may send
+   any number of requests on a connection, each answered in turn:
+
+      pair     kind pdbfile residue1 residue2 nameres2 [cutoff]
+      saturate kind pdbfile residue1 residue2 [cutoff]
+      scan     kind pdbfile [cutoff]
+
+   where kind is scsc, ndonor or oacceptor (as checkhbond,
+   checkhbond_Ndonor and checkhbond_Oacceptor). The reply is OK or
+   ERROR and a reason on the first line, followed for OK by the lines
+   checkhbond would give in batch (-b), saturation (-s) or scan (-a)
+   mode:
+
+      pair:     result energy
+      saturate: residue1 residue2 nameres2 result energy
+      scan:     residue1 residue2 native2 nameres2 result energy
+
+   Messages from the matching code are given as lines starting with #.
+
+   Each connection is served by a thread of its own, which waits for
+   the client's requests. A request is run with an HBCONTEXT taken from
+   a fixed pool (-t), so clients which stay connected without sending
+   anything do not hold up others and no more than that number of
+   requests are run at once. No more than MAXCONNECTIONS clients are
+   served at once; another is sent an error and closed. Structures are read (with
+   hydrogens stripped) on first use and kept, up to MAXSTRUCTURES of
+   them; one is read again if its file has changed. A structure is
+   read without the lock on the list held, and other requests for it
+   wait until it has been read. The PDB lists are shared by the threads
+   and are only read.
+
+   With -q the program is a simple client instead, sending one request
+   given on the command line and printing the reply. The reply is
+   copied to stdout as it is read, so there is no limit on its length.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original
+   V1.1  17.10.26 PDB files may be gzip-compressed (gzfile.c)
+   V1.2  17.10.26 Structures are read without the structure lock held
+                  so one slow read does not hold up other requests
+   V1.3  17.10.26 A thread for each connection, with the HBCONTEXTs
+                  in a pool used per request, so idle clients do not
+                  stop others being served
+   V1.4  17.10.26 A reply which runs out of memory is sent as an ERROR
+                  instead of with lines missing
+   V1.5  17.10.26 File names longer than the buffers for them are
+                  rejected. Corrected version in usage message
+   V1.6  17.10.26 A residue not in the PDB file gives an error reply
+   V1.7  17.10.26 Scans use FindScanPairs() in hbscan.c and the kind
+                  table and FormatResSpec() from hbengine, shared with
+                  checkhbond
+   V1.8  17.10.26 The client copies the reply to stdout as it is read
+                  rather than into a fixed 16MB buffer, so long scan
+                  replies are not lost
+   V1.9  17.10.26 A request longer than MAXREQUEST is read and thrown
+                  away and given an error reply instead of the
+                  connection being closed with no reply
+   V1.10 17.10.26 No more than MAXCONNECTIONS connection threads;
+                  clients beyond that are sent an error and closed
+   V1.11 17.10.26 A PDB file name too long to keep is given an error
+                  reply rather than being read again on every request
+
+*************************************************************************/
+/* Includes
+*/
+#define _POSIX_C_SOURCE 200112L /* For sockets, pthreads and stat()     */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "bioplib/macros.h"
+#include "bioplib/pdb.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "orientate.h"
+#include "hbondmat2.h"
+#include "matfile.h"
+#include "sparsegrid.h"
+#include "batchrot.h"
+#include "hbengine.h"
+#include "hbscan.h"
+#include "threadpool.h"
+#include "gzfile.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define MAXREQUEST     (4*MAXBUFF) /* Longest request accepted          */
+#define MAXSTRUCTURES  64          /* Structures kept in memory         */
+#define MAXCONNECTIONS 256         /* Most clients connected at once    */
+#define MAXFIELDS      8           /* Most fields in a request          */
+#define RESPONSEBLOCK  4096        /* Response buffer growth step       */
+#define NOMEMREPLY     "ERROR No memory for reply\n"
+#define BUSYREPLY      "ERROR Too many connections\n"
+#define DEF_NTHREADS   4
+
+/************************************************************************/
+/* Structure definitions
+*/
+/* A structure kept in memory. users counts the requests using it; one
+   which is stale (its file has changed) is freed when the last
+   finishes with it. loading is set while the file is being read, with
+   the lock not held; requests wanting it wait on gStructureLoaded
+*/
+typedef struct structure
+{
+   char   pdbfile[MAXBUFF];
+   PDB    *pdb;
+   time_t mtime;
+   off_t  size;
+   long   lastUsed;
+   int    users;
+   BOOL   stale,
+          loading;
+   struct structure *next;
+}  STRUCTURE;
+
+/* A reply being built. nomem is set if any of it could not be added  */
+typedef struct
+{
+   char *text;
+   int  length,
+        maxlength;
+   BOOL OK,
+        nomem;
+}  RESPONSE;
+
+/************************************************************************/
+/* Globals
+*/
+static KINDMATRICES    gKinds[HB_NKINDS];
+static STRUCTURE       *gStructures = NULL;
+static pthread_mutex_t gStructureLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  gStructureLoaded = PTHREAD_COND_INITIALIZER;
+static long            gUseCount = 0;
+static int             gListenFd = (-1);
+static HBCONTEXT       **gContexts = NULL; /* Those not in use          */
+static int             gNContexts = 0,
+                       gNFree     = 0;
+static pthread_mutex_t gContextLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  gContextFree = PTHREAD_COND_INITIALIZER;
+static int             gNConnections = 0;
+static pthread_mutex_t gConnectionLock = PTHREAD_MUTEX_INITIALIZER;
+static REAL            gCutoff   = DEFAULT_CUTOFF_VALUE;
+
+/************************************************************************/
+/* Prototypes
+*/
+int main(int argc, char **argv);
+BOOL ParseCmdLine(int argc, char **argv, char *scscFile, char *scmcFile,
+                  char *ndonorFile, char *oacceptorFile, char *socketFile,
+                  int *nthreads, REAL *cutoff, BOOL *client,
+                  char *request);
+void Usage(void);
+BOOL OpenKindMatrices(int kind, char *matrixFile, char *matrixFile2);
+int OpenServerSocket(char *socketFile);
+int ConnectToServer(char *socketFile);
+void ServeClients(void);
+void EndConnection(int fd);
+void *ServeConnection(void *arg);
+HBCONTEXT *TakeContext(void);
+void GiveContext(HBCONTEXT *ctx);
+void HandleRequest(HBCONTEXT *ctx, char *request, RESPONSE *resp);
+void RunPairRequest(HBCONTEXT *ctx, int kind, PDB *pdb, char **fields,
+                    int nfields, RESPONSE *resp);
+void RunSaturateRequest(HBCONTEXT *ctx, int kind, PDB *pdb,
+                        char **fields, int nfields, RESPONSE *resp);
+void RunScanRequest(HBCONTEXT *ctx, int kind, PDB *pdb, RESPONSE *resp);
+BOOL ScoreSite(HBCONTEXT *ctx, int kind, PDB *pdb, HBQUERY *query,
+               char *locres1, char *locres2, BOOL native,
+               RESPONSE *resp, char *error);
+PDB *PairResidues(PDB *pdb, HBQUERY *query, char *error);
+int ParseKind(char *word);
+BOOL ParseCutoff(char **fields, int nfields, int field, REAL *cutoff);
+STRUCTURE *GetStructure(char *pdbfile);
+void ReleaseStructure(STRUCTURE *structure);
+void DropStructure(STRUCTURE *structure);
+PDB *ReadServerPDB(char *pdbfile);
+void InitResponse(RESPONSE *resp);
+BOOL AddResponse(RESPONSE *resp, char *text);
+void ResponseError(RESPONSE *resp, char *text);
+void ResponseMessages(RESPONSE *resp, HBRESULT *result, char *prefix);
+BOOL ReadMessageLength(int fd, unsigned long *length);
+BOOL CopyMessage(int fd, unsigned long length, FILE *out, BOOL *OK);
+BOOL WriteMessage(int fd, char *text, int length);
+BOOL ReadFully(int fd, char *buffer, int length);
+BOOL SkipFully(int fd, unsigned long length);
+BOOL WriteFully(int fd, char *buffer, int length);
+void StopServer(int sig);
+
+/************************************************************************/
+int main(int argc, char **argv)
+{
+   char      scscFile[MAXBUFF],
+             scmcFile[MAXBUFF],
+             ndonorFile[MAXBUFF],
+             oacceptorFile[MAXBUFF],
+             socketFile[MAXBUFF],
+             request[MAXREQUEST];
+   unsigned long length;
+   int       nthreads, fd, i;
+   BOOL      client,
+             OK;
+
+   if(!ParseCmdLine(argc, argv, scscFile, scmcFile, ndonorFile,
+                    oacceptorFile, socketFile, &nthreads, &gCutoff,
+                    &client, request))
+   {
+      Usage();
+      return(0);
+   }
+
+   /* A client gone away must not stop the server                       */
+   signal(SIGPIPE, SIG_IGN);
+
+   /* Client mode: send one request and print the reply                 */
+   if(client)
+   {
+      if((fd = ConnectToServer(socketFile)) < 0)
+         return(1);
+      if(!WriteMessage(fd, request, strlen(request)))
+      {
+         PrintError(NULL, "Unable to send request\n");
+         close(fd);
+         return(1);
+      }
+      if(!ReadMessageLength(fd, &length))
+      {
+         PrintError(NULL, "No reply from server\n");
+         close(fd);
+         return(1);
+      }
+      if(!CopyMessage(fd, length, stdout, &OK))
+      {
+         PrintError(NULL, "Reply from server cut short\n");
+         close(fd);
+         return(1);
+      }
+      close(fd);
+      return(OK ? 0 : 1);
+   }
+
+   for(i=0; i<HB_NKINDS; i++)
+      gKinds[i].matrix = gKinds[i].matrix2 = NULL;
+   if((scscFile[0] && !OpenKindMatrices(HB_SCSC, scscFile, NULL)) ||
+      (ndonorFile[0] &&
+       !OpenKindMatrices(HB_MCDONOR, scmcFile, ndonorFile)) ||
+      (oacceptorFile[0] &&
+       !OpenKindMatrices(HB_MCACCEPTOR, scmcFile, oacceptorFile)))
+      return(1);
+
+   if((gListenFd = OpenServerSocket(socketFile)) < 0)
+      return(1);
+   signal(SIGINT,  StopServer);
+   signal(SIGTERM, StopServer);
+
+   /* One context for each request which may run at once              */
+   if((gContexts = (HBCONTEXT **)malloc(nthreads*sizeof(HBCONTEXT *)))
+      ==NULL)
+   {
+      PrintError(NULL, "No memory for server threads\n");
+      return(1);
+   }
+   for(i=0; i<nthreads; i++)
+   {
+      if((gContexts[i] = CreateHBContext(gCutoff))==NULL)
+      {
+         PrintError(NULL, "No memory for matrix grids\n");
+         return(1);
+      }
+   }
+   gNContexts = gNFree = nthreads;
+
+   ServeClients();
+
+   /* Let the requests being run finish                                 */
+   pthread_mutex_lock(&gContextLock);
+   while(gNFree < gNContexts)
+      pthread_cond_wait(&gContextFree, &gContextLock);
+   pthread_mutex_unlock(&gContextLock);
+
+   unlink(socketFile);
+   return(0);
+}
+
+/************************************************************************/
+/* Closes the socket, so that the threads return from accept()          */
+void StopServer(int sig)
+{
+   if(gListenFd >= 0)
+   {
+      shutdown(gListenFd, SHUT_RDWR);
+      close(gListenFd);
+   }
+   gListenFd = (-1);
+}
+
+/************************************************************************/
+/* Returns FALSE, so that the usage message is given, if the command
+   line is wrong or a file name is too long for its MAXBUFF buffer
+*/
+BOOL ParseCmdLine(int argc, char **argv, char *scscFile, char *scmcFile,
+                  char *ndonorFile, char *oacceptorFile, char *socketFile,
+                  int *nthreads, REAL *cutoff, BOOL *client,
+                  char *request)
+{
+   argc--;
+   argv++;
+
+   scscFile[0] = scmcFile[0] = ndonorFile[0] = oacceptorFile[0] = '\0';
+   socketFile[0] = request[0] = '\0';
+   *nthreads = DEF_NTHREADS;
+   *client   = FALSE;
+
+   while(argc)
+   {
+      if(argv[0][0] == '-')
+      {
+         switch(argv[0][1])
+         {
+         case 'm':
+            argc--;
+            argv++;
+            if((!argc) || (strlen(argv[0]) >= MAXBUFF))
+               return(FALSE);
+            strcpy(scscFile, argv[0]);
+            break;
+         case 's':
+            argc--;
+            argv++;
+            if((!argc) || (strlen(argv[0]) >= MAXBUFF))
+               return(FALSE);
+            strcpy(scmcFile, argv[0]);
+            break;
+         case 'n':
+            argc--;
+            argv++;
+            if((!argc) || (strlen(argv[0]) >= MAXBUFF))
+               return(FALSE);
+            strcpy(ndonorFile, argv[0]);
+            break;
+         case 'o':
+            argc--;
+            argv++;
+            if((!argc) || (strlen(argv[0]) >= MAXBUFF))
+               return(FALSE);
+            strcpy(oacceptorFile, argv[0]);
+            break;
+         case 't':
+            argc--;
+            argv++;
+            if((!argc) || !sscanf(argv[0], "%d", nthreads) ||
+               (*nthreads < 0))
+               return(FALSE);
+            if(*nthreads == 0)
+               *nthreads = NumberOfProcessors();
+            break;
+         case 'c':
+            argc--;
+            argv++;
+            if((!argc) || !sscanf(argv[0], "%lf", cutoff))
+               return(FALSE);
+            break;
+         case 'q':
+            *client = TRUE;
+            break;
+         default:
+            return(FALSE);
+            break;
+         }
+      }
+      else
+      {
+         if(strlen(argv[0]) >= MAXBUFF)
+            return(FALSE);
+         strcpy(socketFile, argv[0]);
+         argc--;
+         argv++;
+
+         if(*client)
+         {
+            /* The rest of the command line is the request             */
+            if(!argc)
+               return(FALSE);
+            for(; argc; argc--, argv++)
+            {
+               if(strlen(request) + strlen(argv[0]) + 2 >= MAXREQUEST)
+                  return(FALSE);
+               if(request[0])
+                  strcat(request, " ");
+               strcat(request, argv[0]);
+            }
+            return(TRUE);
+         }
+
+         /* Main chain kinds need the SC/MC matrix too                  */
+         if(argc ||
+            (!scscFile[0] && !ndonorFile[0] && !oacceptorFile[0]) ||
+            ((ndonorFile[0] || oacceptorFile[0]) && !scmcFile[0]))
+            return(FALSE);
+         return(TRUE);
+      }
+      argc--;
+      argv++;
+   }
+
+   return(FALSE);
+}
+
+/************************************************************************/
+void Usage(void)
+{
+   fprintf(stderr, "\ncheckhbond_server V1.11\n\n");
+   fprintf(stderr, "Usage: checkhbond_server [-m scsc_matrix] [-s scmc_matrix]\n");
+   fprintf(stderr, "          [-n ndonor_matrix] [-o oacceptor_matrix]\n");
+   fprintf(stderr, "          [-t nthreads] [-c cutoff] socket\n");
+   fprintf(stderr, "   or: checkhbond_server -q socket request...\n\n");
+   fprintf(stderr, "  -m: SC/SC matrix file (as checkhbond -m)\n");
+   fprintf(stderr, "  -s: SC/MC matrix file (as checkhbond_Ndonor and\n");
+   fprintf(stderr, "      checkhbond_Oacceptor -m); needed with -n and -o\n");
+   fprintf(stderr, "  -n: MC N donor matrix file (as checkhbond_Ndonor -n)\n");
+   fprintf(stderr, "  -o: MC O acceptor matrix file (as checkhbond_Oacceptor -n)\n");
+   fprintf(stderr, "  -t: number of requests run at once (default %d;\n",
+           DEF_NTHREADS);
+   fprintf(stderr, "      0 for one per processor)\n");
+   fprintf(stderr, "  -c: default cutoff for off-grid matching (default %.2f)\n",
+           DEFAULT_CUTOFF_VALUE);
+   fprintf(stderr, "  -q: send one request to a running server and print the reply\n\n");
+   fprintf(stderr, "Serves checkhbond requests over a Unix domain socket with the\n");
+   fprintf(stderr, "matrix files opened once and structures kept in memory.\n");
+   fprintf(stderr, "Up to %d clients may be connected at once.\n",
+           MAXCONNECTIONS);
+   fprintf(stderr, "Requests are:\n");
+   fprintf(stderr, "   pair     kind pdbfile residue1 residue2 nameres2 [cutoff]\n");
+   fprintf(stderr, "   saturate kind pdbfile residue1 residue2 [cutoff]\n");
+   fprintf(stderr, "   scan     kind pdbfile [cutoff]\n");
+   fprintf(stderr, "where kind is scsc, ndonor or oacceptor. Each message is a\n");
+   fprintf(stderr, "4-byte length in network byte order followed by the text.\n");
+   fprintf(stderr, "Scan requests add hydrogens using %s from $DATADIR\n\n",
+           PGPFILE);
+}
+
+/************************************************************************/
+/* Opens the matrix files for a kind of pair and notes the residue types
+   in the first for saturation and scan requests
+*/
+BOOL OpenKindMatrices(int kind, char *matrixFile, char *matrixFile2)
+{
+   KINDMATRICES *km = gKinds + kind;
+   char         msg[MAXBUFF+80];
+
+   if((km->matrix = OpenMatrix(matrixFile))==NULL)
+   {
+      sprintf(msg, "Unable to open matrix file: %s\n", matrixFile);
+      PrintError(NULL, msg);
+      return(FALSE);
+   }
+   if((matrixFile2 != NULL) &&
+      ((km->matrix2 = OpenMatrix(matrixFile2))==NULL))
+   {
+      sprintf(msg, "Unable to open matrix file: %s\n", matrixFile2);
+      PrintError(NULL, msg);
+      return(FALSE);
+   }
+
+   km->ntypes = MatrixResidueTypes(km->matrix->bin, km->types, HB_MAXTYPES);
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Creates the listening socket, replacing any old socket file          */
+int OpenServerSocket(char *socketFile)
+{
+   struct sockaddr_un addr;
+   char               msg[MAXBUFF+80];
+   int                fd;
+
+   if(strlen(socketFile) >= sizeof(addr.sun_path))
+   {
+      PrintError(NULL, "Socket name is too long\n");
+      return(-1);
+   }
+
+   if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+   {
+      PrintError(NULL, "Unable to create socket\n");
+      return(-1);
+   }
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, socketFile);
+   unlink(socketFile);
+
+   if((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+      (listen(fd, SOMAXCONN) < 0))
+   {
+      sprintf(msg, "Unable to listen on socket: %s\n", socketFile);
+      PrintError(NULL, msg);
+      close(fd);
+      return(-1);
+   }
+
+   return(fd);
+}
+
+/************************************************************************/
+int ConnectToServer(char *socketFile)
+{
+   struct sockaddr_un addr;
+   char               msg[MAXBUFF+80];
+   int                fd;
+
+   if(strlen(socketFile) >= sizeof(addr.sun_path))
+   {
+      PrintError(NULL, "Socket name is too long\n");
+      return(-1);
+   }
+
+   if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+   {
+      PrintError(NULL, "Unable to create socket\n");
+      return(-1);
+   }
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, socketFile);
+
+   if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+   {
+      sprintf(msg, "Unable to connect to server: %s\n", socketFile);
+      PrintError(NULL, msg);
+      close(fd);
+      return(-1);
+   }
+
+   return(fd);
+}
+
+/************************************************************************/
+/* Accepts connections until the socket is closed, starting a thread to
+   serve each. The threads only wait for the client between requests;
+   a request is run with a context from the pool, so at most -t
+   requests run at once however many clients are connected. There are
+   no more than MAXCONNECTIONS threads; a client beyond that is sent
+   BUSYREPLY and closed, so idle clients can't use up the threads
+*/
+void ServeClients(void)
+{
+   pthread_attr_t attr;
+   pthread_t      tid;
+   int            listenFd, fd,
+                  *arg;
+   BOOL           busy;
+
+   pthread_attr_init(&attr);
+   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+   while((listenFd = gListenFd) >= 0)
+   {
+      if((fd = accept(listenFd, NULL, NULL)) < 0)
+      {
+         if(errno == EINTR)
+            continue;
+         break;
+      }
+
+      pthread_mutex_lock(&gConnectionLock);
+      if(!(busy = (gNConnections >= MAXCONNECTIONS)))
+         gNConnections++;
+      pthread_mutex_unlock(&gConnectionLock);
+      if(busy)
+      {
+         WriteMessage(fd, BUSYREPLY, strlen(BUSYREPLY));
+         close(fd);
+         continue;
+      }
+
+      if((arg = (int *)malloc(sizeof(int)))==NULL)
+      {
+         PrintError(NULL, "No memory for connection\n");
+         EndConnection(fd);
+         continue;
+      }
+      *arg = fd;
+      if(pthread_create(&tid, &attr, ServeConnection, (void *)arg) != 0)
+      {
+         PrintError(NULL, "Unable to start connection thread\n");
+         free(arg);
+         EndConnection(fd);
+      }
+   }
+
+   pthread_attr_destroy(&attr);
+}
+
+/************************************************************************/
+/* Thread body: answers requests on a connection until the client closes
+   it. arg is a malloc()'d int holding the connection
+*/
+void *ServeConnection(void *arg)
+{
+   HBCONTEXT *ctx;
+   RESPONSE  resp;
+   char      request[MAXREQUEST];
+   unsigned long length;
+   int       fd = *(int *)arg;
+
+   free(arg);
+   InitResponse(&resp);
+
+   while(ReadMessageLength(fd, &length))
+   {
+      /* ResponseError() replaces all of this with the error            */
+      resp.length = 0;
+      resp.OK     = TRUE;
+      resp.nomem  = FALSE;
+
+      /* A request too long to keep is read and thrown away so that the
+         client gets a reply and the next request can be read
+      */
+      if(length >= MAXREQUEST)
+      {
+         if(!SkipFully(fd, length))
+            break;
+         ResponseError(&resp, "Request too long");
+      }
+      else
+      {
+         if(!ReadFully(fd, request, (int)length))
+            break;
+         request[length] = '\0';
+
+         if(AddResponse(&resp, "OK\n"))
+         {
+            ctx = TakeContext();
+            HandleRequest(ctx, request, &resp);
+            GiveContext(ctx);
+         }
+      }
+
+      /* A reply which is missing lines is replaced by an error; if
+         there isn't even room for that, the error is sent as it is
+      */
+      if(resp.nomem)
+         ResponseError(&resp, "No memory for reply");
+      if(resp.nomem)
+      {
+         if(!WriteMessage(fd, NOMEMREPLY, strlen(NOMEMREPLY)))
+            break;
+      }
+      else if(!WriteMessage(fd, resp.text, resp.length))
+      {
+         break;
+      }
+   }
+
+   if(resp.text != NULL)
+      free(resp.text);
+   EndConnection(fd);
+   return(NULL);
+}
+
+/************************************************************************/
+/* Closes a connection counted by ServeClients()                        */
+void EndConnection(int fd)
+{
+   close(fd);
+   pthread_mutex_lock(&gConnectionLock);
+   gNConnections--;
+   pthread_mutex_unlock(&gConnectionLock);
+}
+
+/************************************************************************/
+/* Takes a context from the pool, waiting until one is free             */
+HBCONTEXT *TakeContext(void)
+{
+   HBCONTEXT *ctx;
+
+   pthread_mutex_lock(&gContextLock);
+   while(gNFree == 0)
+      pthread_cond_wait(&gContextFree, &gContextLock);
+   ctx = gContexts[--gNFree];
+   pthread_mutex_unlock(&gContextLock);
+
+   return(ctx);
+}
+
+/************************************************************************/
+/* Puts a context back in the pool. main() waits for all of them at the
+   end, as well as the requests waiting for one
+*/
+void GiveContext(HBCONTEXT *ctx)
+{
+   pthread_mutex_lock(&gContextLock);
+   gContexts[gNFree++] = ctx;
+   pthread_cond_broadcast(&gContextFree);
+   pthread_mutex_unlock(&gContextLock);
+}
+
+/************************************************************************/
+/* Parses and runs a request, building the reply in resp                */
+void HandleRequest(HBCONTEXT *ctx, char *request, RESPONSE *resp)
+{
+   STRUCTURE *structure;
+   char      *fields[MAXFIELDS],
+             *word,
+             *savePtr;
+   int       nfields = 0,
+             kind;
+   REAL      cutoff  = gCutoff;
+   BOOL      isPair, isSaturate, isScan;
+
+   /* strtok_r() as several threads parse requests at once             */
+   for(word=strtok_r(request, " \t\r\n", &savePtr); word!=NULL;
+       word=strtok_r(NULL, " \t\r\n", &savePtr))
+   {
+      if(nfields == MAXFIELDS)
+      {
+         ResponseError(resp, "Too many fields in request");
+         return;
+      }
+      fields[nfields++] = word;
+   }
+
+   if(nfields < 3)
+   {
+      ResponseError(resp, "Request needs a type, kind and PDB file");
+      return;
+   }
+
+   isPair     = !strcmp(fields[0], "pair");
+   isSaturate = !strcmp(fields[0], "saturate");
+   isScan     = !strcmp(fields[0], "scan");
+   if(!isPair && !isSaturate && !isScan)
+   {
+      ResponseError(resp, "Unknown request type");
+      return;
+   }
+
+   if((kind = ParseKind(fields[1])) < 0)
+   {
+      ResponseError(resp, "Unknown kind of pair");
+      return;
+   }
+   if(gKinds[kind].matrix == NULL)
+   {
+      ResponseError(resp, "No matrix files for this kind of pair");
+      return;
+   }
+
+   if((isPair     && !ParseCutoff(fields, nfields, 6, &cutoff)) ||
+      (isSaturate && !ParseCutoff(fields, nfields, 5, &cutoff)) ||
+      (isScan     && !ParseCutoff(fields, nfields, 3, &cutoff)))
+   {
+      ResponseError(resp, "Wrong number of fields or bad cutoff");
+      return;
+   }
+
+   /* A longer name could not be kept, so would never be found again  */
+   if(strlen(fields[2]) >= MAXBUFF)
+   {
+      ResponseError(resp, "PDB file name too long");
+      return;
+   }
+
+   if((structure = GetStructure(fields[2]))==NULL)
+   {
+      ResponseError(resp, "Unable to read PDB file");
+      return;
+   }
+
+   ctx->cutoff = cutoff;
+   if(isPair)
+      RunPairRequest(ctx, kind, structure->pdb, fields, nfields, resp);
+   else if(isSaturate)
+      RunSaturateRequest(ctx, kind, structure->pdb, fields, nfields,
+                         resp);
+   else
+      RunScanRequest(ctx, kind, structure->pdb, resp);
+
+   ReleaseStructure(structure);
+}
+
+/************************************************************************/
+/* pair kind pdbfile residue1 residue2 nameres2 [cutoff]                */
+void RunPairRequest(HBCONTEXT *ctx, int kind, PDB *pdb, char **fields,
+                    int nfields, RESPONSE *resp)
+{
+   HBQUERY  query;
+   HBRESULT result;
+   PDB      *residues;
+   char     line[MAXBUFF];
+   BOOL     found;
+
+   memset(&query, 0, sizeof(HBQUERY));
+   query.hbplus = FALSE;
+   UPPER(fields[3]);
+   UPPER(fields[4]);
+   UPPER(fields[5]);
+   if(!blParseResSpec(fields[3], query.chain1, &query.resnum1,
+                      query.insert1) ||
+      !blParseResSpec(fields[4], query.chain2, &query.resnum2,
+                      query.insert2))
+   {
+      ResponseError(resp, "Unable to parse residues");
+      return;
+   }
+   strncpy(query.res2, fields[5], 7);
+
+   if((residues = PairResidues(pdb, &query, line))==NULL)
+   {
+      ResponseError(resp, line);
+      return;
+   }
+
+   ClearHBContext(ctx);
+   InitHBResult(&result);
+   found = RunHBQuery(ctx, residues, kind, gKinds[kind].matrix,
+                      gKinds[kind].matrix2, &query, &result);
+   FREELIST(residues, PDB);
+
+   ResponseMessages(resp, &result, NULL);
+   if(result.status == HB_VALID)
+      sprintf(line, "valid %.2f\n", result.energy);
+   else if(found && (result.status != HB_NOHBOND))
+      sprintf(line, "error -\n");
+   else
+      sprintf(line, "none -\n");
+   AddResponse(resp, line);
+}
+
+/************************************************************************/
+/* saturate kind pdbfile residue1 residue2 [cutoff]                     */
+void RunSaturateRequest(HBCONTEXT *ctx, int kind, PDB *pdb,
+                        char **fields, int nfields, RESPONSE *resp)
+{
+   HBQUERY query;
+   char    locres1[16], locres2[16],
+           error[MAXBUFF];
+
+   memset(&query, 0, sizeof(HBQUERY));
+   query.hbplus = FALSE;
+   UPPER(fields[3]);
+   UPPER(fields[4]);
+   if(!blParseResSpec(fields[3], query.chain1, &query.resnum1,
+                      query.insert1) ||
+      !blParseResSpec(fields[4], query.chain2, &query.resnum2,
+                      query.insert2))
+   {
+      ResponseError(resp, "Unable to parse residues");
+      return;
+   }
+   FormatResSpec(locres1, query.resnum1, query.chain1, query.insert1);
+   FormatResSpec(locres2, query.resnum2, query.chain2, query.insert2);
+
+   if(!ScoreSite(ctx, kind, pdb, &query, locres1, locres2, FALSE, resp,
+                 error))
+      ResponseError(resp, error);
+}
+
+/************************************************************************/
+/* scan kind pdbfile [cutoff]. Finds the H-bonded pairs in a copy of
+   the structure with hydrogens added and tries each residue type at
+   the partner of each, side chain pairs both ways round
+*/
+void RunScanRequest(HBCONTEXT *ctx, int kind, PDB *pdb, RESPONSE *resp)
+{
+   HBQUERY *pairs;
+   char    locres1[16], locres2[16],
+           error[MAXBUFF],
+           line[2*MAXBUFF];
+   int     npairs, i;
+
+   if((pairs = FindScanPairs(pdb, kind, &npairs, error))==NULL)
+   {
+      if(npairs != 0)
+         ResponseError(resp, error);
+      return;
+   }
+
+   /* Stop once the reply can't be added to                            */
+   for(i=0; (i<npairs) && !resp->nomem; i++)
+   {
+      FormatResSpec(locres1, pairs[i].resnum1, pairs[i].chain1,
+                    pairs[i].insert1);
+      FormatResSpec(locres2, pairs[i].resnum2, pairs[i].chain2,
+                    pairs[i].insert2);
+      if(!ScoreSite(ctx, kind, pdb, pairs+i, locres1, locres2, TRUE,
+                    resp, error))
+      {
+         sprintf(line, "# %s %s: %s\n%s %s %s - error -\n", locres1,
+                 locres2, error, locres1, locres2, pairs[i].res2);
+         AddResponse(resp, line);
+      }
+   }
+
+   free(pairs);
+}
+
+/************************************************************************/
+/* Tries every residue type at residue 2 of a pair, adding a line for
+   each to the reply (with the native residue 2 if native is set).
+   Returns FALSE with the reason in error if the pair could not be
+   found or orientated
+*/
+BOOL ScoreSite(HBCONTEXT *ctx, int kind, PDB *pdb, HBQUERY *query,
+               char *locres1, char *locres2, BOOL native,
+               RESPONSE *resp, char *error)
+{
+   KINDMATRICES *km = gKinds + kind;
+   PDB          *residues;
+   HBSITE       *site;
+   HBRESULT     result;
+   char         line[MAXBUFF],
+                prefix[40];
+   int          i;
+   BOOL         found;
+
+   if((residues = PairResidues(pdb, query, error))==NULL)
+      return(FALSE);
+
+   sprintf(prefix, "%s %s", locres1, locres2);
+   ClearHBContext(ctx);
+   InitHBResult(&result);
+   if((site = PrepareHBSite(ctx, residues, kind, query, &result))==NULL)
+   {
+      /* The first message gives the reason                             */
+      strcpy(error, ((result.nmessages > 0) ? result.message[0] :
+                     "Unable to orientate the residues"));
+      TERMINATE(error);
+      FREELIST(residues, PDB);
+      return(FALSE);
+   }
+   ResponseMessages(resp, &result, prefix);
+
+   for(i=0; i<km->ntypes; i++)
+   {
+      InitHBResult(&result);
+      found = ScoreHBSite(ctx, site, km->matrix, km->matrix2,
+                          km->types[i], &result);
+      ResponseMessages(resp, &result, prefix);
+
+      if(native)
+         sprintf(line, "%s %s %s ", prefix, query->res2, km->types[i]);
+      else
+         sprintf(line, "%s %s ", prefix, km->types[i]);
+      if(found && (result.status == HB_VALID))
+         sprintf(line+strlen(line), "valid %.2f\n", result.energy);
+      else
+         strcat(line, "none -\n");
+      if(!AddResponse(resp, line))
+         break;
+   }
+
+   FreeHBSite(site);
+   FREELIST(residues, PDB);
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Copies the residues of a pair from a shared structure and sets the
+   type of residue 1. Returns NULL with the reason in error on failure
+*/
+PDB *PairResidues(PDB *pdb, HBQUERY *query, char *error)
+{
+   PDB *residues;
+   int errorcode;
+
+   if((residues = GetResidues(pdb, query->chain1, query->resnum1,
+                              query->insert1, query->chain2,
+                              query->resnum2, query->insert2,
+                              &errorcode))==NULL)
+   {
+      if(errorcode == ERR_NOMEM)
+         strcpy(error, "No memory for storing residues of interest");
+      else if(errorcode == ERR_NOPREVRES1)
+         strcpy(error, "No preceeding residue for residue 1");
+      else if(errorcode == ERR_NOPREVRES2)
+         strcpy(error, "No preceeding residue for residue 2");
+      else if(errorcode == ERR_NORES1)
+         strcpy(error, "Residue 1 not found");
+      else if(errorcode == ERR_NORES2)
+         strcpy(error, "Residue 2 not found");
+      else
+         strcpy(error, "Undefined error in getting residues");
+      return(NULL);
+   }
+   FindRes1Type(residues, query->chain1, query->resnum1, query->insert1,
+                query->res1);
+
+   return(residues);
+}
+
+/************************************************************************/
+/* Returns the HB_xxx kind for a request or -1 if it is not known       */
+int ParseKind(char *word)
+{
+   if(!strcmp(word, "scsc"))
+      return(HB_SCSC);
+   if(!strcmp(word, "ndonor"))
+      return(HB_MCDONOR);
+   if(!strcmp(word, "oacceptor"))
+      return(HB_MCACCEPTOR);
+   return(-1);
+}
+
+/************************************************************************/
+/* Checks a request has field fields (or one more, the cutoff) and reads
+   the cutoff if it is there
+*/
+BOOL ParseCutoff(char **fields, int nfields, int field, REAL *cutoff)
+{
+   if(nfields == field)
+      return(TRUE);
+   if(nfields == field+1)
+      return(sscanf(fields[field], "%lf", cutoff) == 1);
+   return(FALSE);
+}
+
+/************************************************************************/
+/* Finds a structure in memory, reading it if it is not there or if the
+   file has changed since it was read. The caller must give it back
+   with ReleaseStructure(). Returns NULL if it can't be read. The name
+   must be shorter than MAXBUFF (HandleRequest() checks this).
+
+   The file is read without the lock held, so that requests for other
+   structures are not held up; the entry is marked as loading and any
+   request for it meanwhile waits until it has been read.
+*/
+STRUCTURE *GetStructure(char *pdbfile)
+{
+   STRUCTURE   *s, *prev, *oldest, *oldestPrev;
+   struct stat st;
+   PDB         *pdb;
+   int         nkept = 0;
+
+   if(stat(pdbfile, &st) != 0)
+      return(NULL);
+
+   pthread_mutex_lock(&gStructureLock);
+
+   for(s=gStructures; s!=NULL; NEXT(s))
+   {
+      if(!s->stale && !strcmp(s->pdbfile, pdbfile))
+      {
+         if((s->mtime == st.st_mtime) && (s->size == st.st_size))
+         {
+            s->users++;
+            s->lastUsed = ++gUseCount;
+            while(s->loading)
+               pthread_cond_wait(&gStructureLoaded, &gStructureLock);
+
+            /* The request reading it failed                            */
+            if(s->pdb == NULL)
+            {
+               DropStructure(s);
+               s = NULL;
+            }
+            pthread_mutex_unlock(&gStructureLock);
+            return(s);
+         }
+         s->stale = TRUE;
+      }
+   }
+
+   /* Drop stale structures no longer in use and, if there are too many,
+      the least recently used which is not in use
+   */
+   for(;;)
+   {
+      oldest = oldestPrev = NULL;
+      nkept  = 0;
+      for(prev=NULL, s=gStructures; s!=NULL; prev=s, s=s->next)
+      {
+         if(s->users == 0)
+         {
+            if(s->stale)
+            {
+               oldest     = s;
+               oldestPrev = prev;
+               break;
+            }
+            if((oldest == NULL) || (s->lastUsed < oldest->lastUsed))
+            {
+               oldest     = s;
+               oldestPrev = prev;
+            }
+         }
+         nkept++;
+      }
+      if((oldest == NULL) ||
+         (!oldest->stale && (nkept < MAXSTRUCTURES)))
+         break;
+
+      if(oldestPrev == NULL)
+         gStructures = oldest->next;
+      else
+         oldestPrev->next = oldest->next;
+      FREELIST(oldest->pdb, PDB);
+      free(oldest);
+   }
+
+   if((s = (STRUCTURE *)malloc(sizeof(STRUCTURE)))==NULL)
+   {
+      pthread_mutex_unlock(&gStructureLock);
+      return(NULL);
+   }
+   strcpy(s->pdbfile, pdbfile);
+   s->pdb      = NULL;
+   s->mtime    = st.st_mtime;
+   s->size     = st.st_size;
+   s->users    = 1;
+   s->lastUsed = ++gUseCount;
+   s->stale    = FALSE;
+   s->loading  = TRUE;
+   s->next     = gStructures;
+   gStructures = s;
+
+   pthread_mutex_unlock(&gStructureLock);
+   pdb = ReadServerPDB(pdbfile);
+   pthread_mutex_lock(&gStructureLock);
+
+   s->pdb     = pdb;
+   s->loading = FALSE;
+   pthread_cond_broadcast(&gStructureLoaded);
+   if(pdb == NULL)
+   {
+      /* Any requests waiting for it drop it too                        */
+      s->stale = TRUE;
+      DropStructure(s);
+      s = NULL;
+   }
+
+   pthread_mutex_unlock(&gStructureLock);
+   return(s);
+}
+
+/************************************************************************/
+/* Gives back a structure from GetStructure(), freeing it if it has been
+   replaced and this was its last user
+*/
+void ReleaseStructure(STRUCTURE *structure)
+{
+   pthread_mutex_lock(&gStructureLock);
+   DropStructure(structure);
+   pthread_mutex_unlock(&gStructureLock);
+}
+
+/************************************************************************/
+/* Does the work of ReleaseStructure() with gStructureLock held         */
+void DropStructure(STRUCTURE *structure)
+{
+   STRUCTURE *s, *prev;
+
+   if((--(structure->users) == 0) && structure->stale)
+   {
+      for(prev=NULL, s=gStructures; s!=NULL; prev=s, s=s->next)
+      {
+         if(s == structure)
+         {
+            if(prev == NULL)
+               gStructures = s->next;
+            else
+               prev->next = s->next;
+            FREELIST(s->pdb, PDB);
+            free(s);
+            break;
+         }
+      }
+   }
+}
+
+/************************************************************************/
+/* Reads a PDB file stripping any hydrogens, as checkhbond does         */
+PDB *ReadServerPDB(char *pdbfile)
+{
+   FILE *fp;
+   PDB  *pdb, *pdb2;
+   int  natoms;
+
+   if((fp = OpenInputFile(pdbfile))==NULL)
+      return(NULL);
+
+   BeginSerialSection();
+   pdb = blReadPDBAtoms(fp, &natoms);
+   EndSerialSection();
+   fclose(fp);
+
+   if(pdb == NULL)
+      return(NULL);
+
+   /* ACRM 02.02.06 strip any hydrogens present */
+   if((pdb2 = blStripHPDBAsCopy(pdb, &natoms)) !=NULL)
+   {
+      FREELIST(pdb, PDB);
+      pdb  = pdb2;
+   }
+
+   return(pdb);
+}
+
+/************************************************************************/
+void InitResponse(RESPONSE *resp)
+{
+   resp->text      = NULL;
+   resp->length    = 0;
+   resp->maxlength = 0;
+   resp->OK        = TRUE;
+   resp->nomem     = FALSE;
+}
+
+/************************************************************************/
+/* Adds text to a reply. Returns FALSE, and sets nomem so that the reply
+   is sent as an error, if there is no memory
+*/
+BOOL AddResponse(RESPONSE *resp, char *text)
+{
+   int  length = strlen(text);
+   char *newText;
+
+   if(resp->length + length + 1 > resp->maxlength)
+   {
+      int maxlength = resp->maxlength +
+                      ((length/RESPONSEBLOCK) + 1) * RESPONSEBLOCK;
+
+      if((newText = (char *)realloc(resp->text, maxlength))==NULL)
+      {
+         resp->nomem = TRUE;
+         return(FALSE);
+      }
+      resp->text      = newText;
+      resp->maxlength = maxlength;
+   }
+
+   strcpy(resp->text + resp->length, text);
+   resp->length += length;
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Replaces a reply with an error. nomem is left set if even this can't
+   be added
+*/
+void ResponseError(RESPONSE *resp, char *text)
+{
+   resp->OK     = FALSE;
+   resp->nomem  = FALSE;
+   resp->length = 0;
+   if(AddResponse(resp, "ERROR "))
+   {
+      if(AddResponse(resp, text))
+         AddResponse(resp, "\n");
+   }
+}
+
+/************************************************************************/
+/* Adds the messages from the matching code to a reply as # lines       */
+void ResponseMessages(RESPONSE *resp, HBRESULT *result, char *prefix)
+{
+   char line[2*MAXBUFF];
+   int  i;
+
+   for(i=0; i<result->nmessages; i++)
+   {
+      if(prefix == NULL)
+         sprintf(line, "# %s", result->message[i]);
+      else
+         sprintf(line, "# %s: %s", prefix, result->message[i]);
+      if(line[strlen(line)-1] != '\n')
+         strcat(line, "\n");
+      if(!AddResponse(resp, line))
+         break;
+   }
+}
+
+/************************************************************************/
+/* Reads the 4-byte length which starts a message. Returns FALSE at the
+   end of the connection
+*/
+BOOL ReadMessageLength(int fd, unsigned long *length)
+{
+   unsigned char header[4];
+
+   if(!ReadFully(fd, (char *)header, 4))
+      return(FALSE);
+   *length = ((unsigned long)header[0] << 24) |
+             ((unsigned long)header[1] << 16) |
+             ((unsigned long)header[2] << 8)  |
+             (unsigned long)header[3];
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Copies the text of a message of the given length to out a block at a
+   time. OK is set if the text starts with OK. Returns FALSE if the
+   connection ends first
+*/
+BOOL CopyMessage(int fd, unsigned long length, FILE *out, BOOL *OK)
+{
+   char block[RESPONSEBLOCK];
+   int  n;
+   BOOL first = TRUE;
+
+   *OK = FALSE;
+   while(length > 0)
+   {
+      n = ((length > RESPONSEBLOCK) ? RESPONSEBLOCK : (int)length);
+      if(!ReadFully(fd, block, n))
+         return(FALSE);
+      if(first)
+         *OK = ((n >= 2) && !strncmp(block, "OK", 2));
+      fwrite(block, 1, n, out);
+      length -= n;
+      first   = FALSE;
+   }
+   return(TRUE);
+}
+
+/************************************************************************/
+BOOL WriteMessage(int fd, char *text, int length)
+{
+   unsigned char header[4];
+
+   header[0] = (unsigned char)((length >> 24) & 0xFF);
+   header[1] = (unsigned char)((length >> 16) & 0xFF);
+   header[2] = (unsigned char)((length >> 8)  & 0xFF);
+   header[3] = (unsigned char)(length & 0xFF);
+
+   return(WriteFully(fd, (char *)header, 4) &&
+          WriteFully(fd, text, length));
+}
+
+/************************************************************************/
+BOOL ReadFully(int fd, char *buffer, int length)
+{
+   ssize_t n;
+
+   while(length > 0)
+   {
+      if((n = read(fd, buffer, length)) < 0)
+      {
+         if(errno == EINTR)
+            continue;
+         return(FALSE);
+      }
+      if(n == 0)
+         return(FALSE);
+      buffer += n;
+      length -= n;
+   }
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Reads and throws away length bytes. Returns FALSE if the connection
+   ends first
+*/
+BOOL SkipFully(int fd, unsigned long length)
+{
+   char block[RESPONSEBLOCK];
+   int  n;
+
+   while(length > 0)
+   {
+      n = ((length > RESPONSEBLOCK) ? RESPONSEBLOCK : (int)length);
+      if(!ReadFully(fd, block, n))
+         return(FALSE);
+      length -= n;
+   }
+   return(TRUE);
+}
+
+/************************************************************************/
+BOOL WriteFully(int fd, char *buffer, int length)
+{
+   ssize_t n;
+
+   while(length > 0)
+   {
+      if((n = write(fd, buffer, length)) < 0)
+      {
+         if(errno == EINTR)
+            continue;
+         return(FALSE);
+      }
+      buffer += n;
+      length -= n;
+   }
+   return(TRUE);
+}
@@ -3,8 +3,8 @@
    Program:    hydrogen_matrices
    File:       hydrogen_matrices.c
    
-   Version:    V2.1
-   Date:       12.09.17
+   Version:    V2.19
+   Date:       17.10.26
    Function:   Generate matrices of hydrogen bond information for use
                by checkhbond
    
@@ -35,28 +35,28 @@
 
    Description:
    ============
-creates four matrices ....
-
-gAccept: stores all acceptor atoms of *key* residue
-gDonate: stores all donor atoms of *key* residue
-gPartnertoAccept: stores location of *partner* residue donor atoms 
-                  i.e. those atoms that hydrogen bond with 
-                  acceptor atoms in gAccept
-gPartnertoDonate: stores location of *partner* residue acceptor atoms 
-                  i.e. those atoms that hydrogen bond with 
-                  acceptor atoms in gDonate
+creates four matrices for each residue type (an HBGRIDS) ....
+
+accept: stores all acceptor atoms of *key* residue
+donate: stores all donor atoms of *key* residue
+partnertoAccept: stores location of *partner* residue donor atoms 
+                 i.e. those atoms that hydrogen bond with 
+                 acceptor atoms in accept
+partnertoDonate: stores location of *partner* residue acceptor atoms 
+                 i.e. those atoms that hydrogen bond with 
+                 acceptor atoms in donate
 Input: cath list of protein structures
 Output: text file printing matrices (see above) for hydrogen-capable
         residues in turn:
 
         for example:
         residue ASN
-        gDonate (stores location of ASN hydrogen donor atoms)
-        gAccept (stores location of ASN hydrogen acceptor atoms)
-        gPartnertoDonor (stores location of *partner* acceptor atoms
+        donate (stores location of ASN hydrogen donor atoms)
+        accept (stores location of ASN hydrogen acceptor atoms)
+        partnertoDonate (stores location of *partner* acceptor atoms
                          that hydrogen-bond with ASN donor atoms)
-        gPartnertoAccept (stores location of *partner* donor atoms 
-                          that hydrogen-bond with ASN acceptor atoms)
+        partnertoAccept (stores location of *partner* donor atoms 
+                         that hydrogen-bond with ASN acceptor atoms)
 
 output file to be used in program checkhbond.c
 
@@ -73,6 +73,49 @@ output file to be used in program checkhbond.c
    V1.1  19.08.05 Various bug fixes By: ACRM
    V2.0  24.01.05 Modified to allow mc/sc matrices to be generated
    V2.1  12.09.17 Updated for new Bioplib and some cleanup
+   V2.2  17.10.26 PrintMatrix() ends each residue with a totals line
+   V2.3  17.10.26 One pass over the structures for all the residue
+                  types, with a set of grids for each type, rather than
+                  a pass for each type
+   V2.4  17.10.26 The structures are shared out between threads (-t),
+                  each with its own grids which are added together at
+                  the end. getchain output goes to a unique temporary
+                  file
+   V2.5  17.10.26 Only residues close enough to be H-bonded to a key
+                  residue are tested against it (neighbours.c)
+   V2.6  17.10.26 The structure is no longer orientated on each key
+                  residue. The residue's frame is found and applied
+                  only to the atoms stored in the grids
+   V2.7  17.10.26 Chains are taken from the PDB file in memory rather
+                  than with getchain, and each thread keeps the last
+                  file it read so the chains of an entry share a parse
+   V2.8  17.10.26 Structures with hydrogens added may be kept in a
+                  cache directory (-c) for later builds (strcache.c)
+   V2.9  17.10.26 The counts each structure adds may be kept in a store
+                  directory (-s) so a later build only processes new
+                  or changed structures (contrib.c)
+   V2.10 17.10.26 The matrices may be built in parts (-p k/n) which
+                  merge_matrices adds together
+   V2.11 17.10.26 The SCSC, SCMC, MC donor and MC acceptor matrices may
+                  be built in one pass over the structures (-a). The
+                  kind is chosen at run time, and the program's own
+                  kind is only the default
+   V2.12 17.10.26 Structures are loaded on a thread of their own ahead
+                  of the counting threads, with a bounded queue between
+                  (RunPipeline())
+   V2.13 17.10.26 Structure files and the domain list may be
+                  gzip-compressed, and pdbXXXX.ent.gz is used where
+                  there is no pdbXXXX.ent (gzfile.c)
+   V2.14 17.10.26 The grids are sparse (sparsegrid.c), so each thread
+                  needs memory for the cells counted in rather than
+                  3.5MB per grid
+   V2.15 17.10.26 A cache directory (-c) too long for its buffer is
+                  rejected
+   V2.16 17.10.26 So is a store directory (-s)
+   V2.17 17.10.26 And a file for another kind of matrices (-a)
+   V2.18 17.10.26 Corrected the version in the usage message
+   V2.19 17.10.26 The warning for a chain with no atoms goes to stderr
+                  rather than into the matrices on stdout
 
 *************************************************************************/
 /* Includes
@@ -92,12 +135,51 @@ output file to be used in program checkhbond.c
 #include "orientate.h"
 #include "hbondmat2.h"
 #include "cavallo_userfunc.h"
+#include "threadpool.h"
+#include "neighbours.h"
+#include "strcache.h"
+#include "contrib.h"
+#include "gzfile.h"
+#include "sparsegrid.h"
 
 /************************************************************************/
 /* Defines and macros
 */
 #define NOISY
 
+/* 17.10.26 Residues with no atoms within this distance of each other
+   cannot be H-bonded: comfortably more than the longest donor-acceptor
+   distance (3.9A as in HBPlus) allowed by bioplib's H-bond tests
+*/
+#define MAXHBREACH 4.5
+
+/* 17.10.26 Structures loaded ahead, for each counting thread           */
+#define PREFETCH 2
+
+/* 17.10.26 Size of the buffers for file and directory names given on
+   the command line. Longer names are rejected
+*/
+#define MAXFILENAME 160
+
+/* 17.10.26 The kinds of matrices which may be built. The program
+   builds its own kind (-D MCDONOR etc.) and any others asked for
+*/
+#define BUILD_SCSC       0
+#define BUILD_SCMC       1
+#define BUILD_MCDONOR    2
+#define BUILD_MCACCEPTOR 3
+#define NBUILDS          4
+
+#if defined(MCDONOR)
+#  define DEFAULTBUILD BUILD_MCDONOR
+#elif defined(MCACCEPTOR)
+#  define DEFAULTBUILD BUILD_MCACCEPTOR
+#elif defined(SCMC)
+#  define DEFAULTBUILD BUILD_SCMC
+#else
+#  define DEFAULTBUILD BUILD_SCSC
+#endif
+
 struct hbond_data
 {
    char *residue;
@@ -123,42 +205,147 @@ struct pdb_names
 
 typedef struct pdb_names NAMES;
 
+/* 17.10.26 The grids for one residue type, which were globals. Sparse,
+   as each thread has a set for every type of each kind built and most
+   cells stay empty
+*/
+typedef struct
+{
+   /* matrices that store all acceptor and donor atoms */
+   SPARSEGRID *accept;
+   SPARSEGRID *donate;
+
+   /* matrix storing partner atoms to hydrogen accepting atoms */
+   SPARSEGRID *partnertoAccept;
+   /* matrix storing partner atoms to hydrogen donating heavy atoms */
+   SPARSEGRID *partnertoDonate;
+
+   /* While a structure is being added to the contribution store, the
+      cells it counts in are also recorded here
+   */
+   CONTRIB *contrib;
+   int     type;                  /* Index of the hydrogen bond type    */
+   BOOL    nomem;                 /* A count was lost for lack of memory*/
+}  HBGRIDS;
+
+/* 17.10.26 The last PDB file read, as read                           */
+typedef struct
+{
+   char *file;
+   PDB  *pdb;
+}  PDBCACHE;
+
+/* 17.10.26 Shared by the threads building the matrices                */
+typedef struct
+{
+   NAMES         **names; /* The structures, by item                */
+   HBOND         *hb;
+   FILE          *fp1;    /* PGP file, used one thread at a time       */
+   char          *cachedir; /* Prepared structures, or NULL            */
+   char          *storedir; /* Contributions of structures, or NULL    */
+   unsigned long pgphash; /* Hash of the PGP file for the cache        */
+   int           ntypes;
+   BOOL          builds[NBUILDS]; /* Kinds of matrices being built     */
+   PDBCACHE      cache;   /* Last PDB file read, by the loading thread */
+}  HMRUN;
+
+/* 17.10.26 The counts made by one thread, for each kind of matrices
+   built and each hydrogen bond type
+*/
+typedef struct
+{
+   HBGRIDS  **grids[NBUILDS];     /* NULL for kinds not built           */
+}  HMWORKER;
+
+/* 17.10.26 A structure as loaded for the counting threads: the counts
+   saved for it for each kind of matrices, and the structure itself if
+   any kind has to be built from it
+*/
+typedef struct
+{
+   CONTRIB stored[NBUILDS];
+   PDB     *pdb;
+   char    *location,
+           chain;
+   BOOL    builds[NBUILDS];       /* Kinds to build from pdb            */
+}  HMLOAD;
+
 /************************************************************************/
 /* Globals
 */
-/* matrices that store all acceptor and donor atoms */
-static int gAccept[MAXSIZE][MAXSIZE][MAXSIZE];
-static int gDonate[MAXSIZE][MAXSIZE][MAXSIZE];
-
-/* matrix storing partner atoms to hydrogen accepting atoms */
-static int gPartnertoAccept[MAXSIZE][MAXSIZE][MAXSIZE];
-/* matrix storing partner atoms to hydrogen donating heavy atoms */
-static int gPartnertoDonate[MAXSIZE][MAXSIZE][MAXSIZE];
+/* 17.10.26 By BUILD_xxx: names in the contribution store and on the
+   command line
+*/
+static char *gBuildNames[NBUILDS] = {"SCSC", "SCMC", "MCDONOR",
+                                     "MCACCEPTOR"};
+static char *gBuildKinds[NBUILDS] = {"scsc", "scmc", "ndonor",
+                                     "oacceptor"};
 
 /************************************************************************/
 /* Prototypes
 */
 int main (int argc, char *argv[]);
 HBOND *InitializeHbondTypes(void);
-BOOL ParseCmdLine(int argc, char **argv, char *inputfile, char *outputfile);
+BOOL ParseCmdLine(int argc, char **argv, char *inputfile, char *outputfile,
+                  int *nthreads, char *cachedir, char *storedir,
+                  int *part, int *nparts, char extrafiles[NBUILDS][MAXFILENAME]);
+int  BuildKind(char *kind);
+BOOL OpenExtraFiles(char extrafiles[NBUILDS][MAXFILENAME], FILE *out,
+                    FILE **outs);
 void Usage(void);
 NAMES *InitializeDomainList(FILE *fp);
-char *FindStructureLocation(NAMES *names, BOOL *tempflag);
-BOOL CalcAndStoreHBondData(HBOND *hb, NAMES *names, FILE *out);
+NAMES *SelectPart(NAMES *names, int part, int nparts);
+char *FindStructureLocation(NAMES *names, char *chain);
+BOOL CalcAndStoreHBondData(HBOND *hb, NAMES *names, FILE **outs,
+                           int nthreads, char *cachedir, char *storedir);
+BOOL TypeSelected(HBOND *h, int build);
+HBGRIDS **CreateGrids(HBOND *hb, int ntypes, int build);
+void FreeGrids(HBGRIDS **grids, int ntypes);
+BOOL AddGrids(HBGRIDS *sum, HBGRIDS *grids);
+void *LoadStructureTask(void *shared, int item);
+PDB *LoadStructure(HMRUN *run, char *location, char chain);
+void StoreStructureTask(void *shared, void *worker, int item,
+                        void *loaded);
+void StoreStructure(HMRUN *run, HMWORKER *thread, BOOL *builds,
+                    char *domain, char *location, char chain, PDB *pdb);
+void AddContribution(HBGRIDS **grids, int ntypes, CONTRIB *contrib);
+void RecordContribution(HBGRIDS **grids, int ntypes, CONTRIB *contrib);
+void SaveContribution(HMRUN *run, int build, char *domain,
+                      char *location, char chain, CONTRIB *contrib);
+PDB *ReadStructure(FILE *fp1, char *location, char chain,
+                   PDBCACHE *cache);
+PDB *ReadCachedPDB(char *location, PDBCACHE *cache);
+PDB *ExtractChain(PDB *pdb, char chain);
+void StoreResidueType(PDB *pdb, NEIGHBOURS *nb, char *location, HBOND *h,
+                      HBOND *hb, int build, HBGRIDS *grids);
+PDB **IndexResidues(PDB *pdb, int nres);
 BOOL isDonor(PDB *d, HBOND *hb, char *h_name1, char *h_name2, char *h_name3);
 BOOL isAcceptor(PDB *a, HBOND *hb, char *p_name);
 PDB *FindAtomInRange(PDB *start, PDB *stop, char *name);
-void FindHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb);
-void ClearArrays(void);
-void StoreHBondingPosition(PDB *start, PDB *next, HBOND *hb);
-void PrintMatrix(HBOND *h, FILE *out);
-void StorePartnertoDonatePosition(PDB *a);
-void StorePartnertoAcceptPosition(PDB *d);
-void FindMCDonorHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb);
-void StoreHBondingNPosition(PDB *start, PDB *stop, HBOND *hb);
-void FindMCAcceptorAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb);
-void StoreHBondingCOPosition(PDB *start, PDB *stop, HBOND *hb);
-void FindHAtomsSCMC(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb);
+void FindHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb,
+                ORIENTATION *orient, HBGRIDS *grids);
+void StoreHBondingPosition(PDB *start, PDB *next, HBOND *hb,
+                           ORIENTATION *orient, HBGRIDS *grids);
+void PrintMatrix(HBOND *h, HBGRIDS *grids, FILE *out);
+void StorePartnertoDonatePosition(PDB *a, ORIENTATION *orient,
+                                  HBGRIDS *grids);
+void StorePartnertoAcceptPosition(PDB *d, ORIENTATION *orient,
+                                  HBGRIDS *grids);
+void StoreGridPosition(HBGRIDS *grids, int which, PDB *p,
+                       ORIENTATION *orient);
+void CountGridCell(HBGRIDS *grids, int which, int x, int y, int z,
+                   int count);
+SPARSEGRID *WhichGrid(HBGRIDS *grids, int which);
+void FindMCDonorHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB,
+                       HBOND *hb, ORIENTATION *orient, HBGRIDS *grids);
+void StoreHBondingNPosition(PDB *start, PDB *stop, HBOND *hb,
+                            ORIENTATION *orient, HBGRIDS *grids);
+void FindMCAcceptorAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB,
+                         HBOND *hb, ORIENTATION *orient, HBGRIDS *grids);
+void StoreHBondingCOPosition(PDB *start, PDB *stop, HBOND *hb,
+                             ORIENTATION *orient, HBGRIDS *grids);
+void FindHAtomsSCMC(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB,
+                    HBOND *hb, ORIENTATION *orient, HBGRIDS *grids);
 
 
 
@@ -167,22 +354,34 @@ void FindHAtomsSCMC(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb);
 /************************************************************************/
 int main (int argc, char *argv[])
 {
-   FILE *in = stdin, *out = stdout;
+   FILE *in = stdin, *out = stdout, *outs[NBUILDS];
    HBOND *hb;
-   char inputfile[160], outputfile[160];
+   char inputfile[MAXFILENAME], outputfile[MAXFILENAME],
+        cachedir[MAXFILENAME], storedir[MAXFILENAME],
+        extrafiles[NBUILDS][MAXFILENAME];
    NAMES *names;
+   int nthreads, part, nparts;
    
    inputfile[0] = outputfile[0] = '\0';
    
-   if(ParseCmdLine(argc, argv, inputfile, outputfile))
+   if(ParseCmdLine(argc, argv, inputfile, outputfile, &nthreads,
+                   cachedir, storedir, &part, &nparts, extrafiles))
    {
-      if(blOpenStdFiles(inputfile, outputfile, &in, &out))
+      /* 17.10.26 The domain list may be compressed                   */
+      if(((inputfile[0] == '\0') ||
+          ((in = OpenInputFile(inputfile)) != NULL)) &&
+         blOpenStdFiles(NULL, outputfile, &in, &out) &&
+         OpenExtraFiles(extrafiles, out, outs))
       {
          if((hb = InitializeHbondTypes()) !=NULL)
          {
             if((names = InitializeDomainList(in)) !=NULL)
             {
-               if(!CalcAndStoreHBondData(hb, names, out))
+               if(nparts > 1)
+                  names = SelectPart(names, part, nparts);
+               if(!CalcAndStoreHBondData(hb, names, outs, nthreads,
+                                         (cachedir[0] ? cachedir : NULL),
+                                         (storedir[0] ? storedir : NULL)))
                {
                   return(1);
                }
@@ -216,16 +415,41 @@ int main (int argc, char *argv[])
    
                
 /************************************************************************/
-BOOL CalcAndStoreHBondData(HBOND *hb, NAMES *names, FILE *out)
+/* 17.10.26 Each structure is read, stripped and has hydrogens added
+   once, and the residues of every selected type in it are added to
+   that type's grids. The matrices are printed at the end, in the order
+   of the hydrogen bond types, as when there was a pass over the
+   structures for each type.
+
+   The matrices of each kind (BUILD_xxx) with a file in outs are built
+   in the same pass, each kind with its own grids.
+
+   The structures are shared out between nthreads threads, each adding
+   to its own set of grids. The grids only hold counts, so adding them
+   together at the end gives exactly the grids of a run on one thread.
+   Another thread loads the structures, in the order of the list, a
+   few ahead of the counting threads so they need not wait for the
+   disk (PREFETCH for each counting thread are held at most).
+
+   If cachedir is given, structures are taken from there when they have
+   been prepared before, and saved there when they have not.
+
+   If storedir is given, the counts a structure adds are taken from
+   there when it has been processed before, so only structures which
+   are new (or have changed) are processed; those are saved there.
+*/
+BOOL CalcAndStoreHBondData(HBOND *hb, NAMES *names, FILE **outs,
+                           int nthreads, char *cachedir, char *storedir)
 {
-   NAMES *n;
-   HBOND *h;
-   int natoms, natoms2, nHatoms;
-   PDB *pdb, *pdb2, *start, *next, *nextres, *stop, *prev;
-   FILE *fp1 = NULL,
-        *fp2 = NULL;
-   char *location;
-   BOOL noenv, tempflag;
+   NAMES    *n;
+   HBOND    *h;
+   HMRUN    run;
+   HMWORKER *workers = NULL;
+   void     **wdata  = NULL;
+   FILE     *fp1     = NULL;
+   BOOL     noenv, 
+            ok       = TRUE;
+   int      nnames, ntypes, i, j, b;
  
    if((fp1 = blOpenFile(PGPFILE, "DATADIR", "r", &noenv)) == NULL)
    {
@@ -237,231 +461,792 @@ BOOL CalcAndStoreHBondData(HBOND *hb, NAMES *names, FILE *out)
       
       return(FALSE);
    }
-   
-   for(h = hb; h!=NULL; NEXT(h))
+
+   for(n=names, nnames=0; n!=NULL; NEXT(n))
+      nnames++;
+   for(h=hb, ntypes=0; h!=NULL; NEXT(h))
+      ntypes++;
+   if(nthreads > nnames)
+      nthreads = nnames;
+   if(nthreads < 1)
+      nthreads = 1;
+
+   run.hb       = hb;
+   run.fp1      = fp1;
+   run.cachedir = cachedir;
+   run.storedir = storedir;
+   run.ntypes   = ntypes;
+   run.cache.file = NULL;
+   run.cache.pdb  = NULL;
+   for(b=0; b<NBUILDS; b++)
+      run.builds[b] = (outs[b] != NULL);
+   run.pgphash  = ((cachedir != NULL) || (storedir != NULL)) ?
+                  HashPGPFile(fp1) : 0;
+   if(((run.names = (NAMES **)malloc((nnames ? nnames : 1) *
+                                     sizeof(NAMES *)))==NULL) ||
+      ((workers = (HMWORKER *)calloc(nthreads, sizeof(HMWORKER)))==NULL) ||
+      ((wdata = (void **)malloc(nthreads * sizeof(void *)))==NULL))
    {
-#if defined(MCDONOR) || defined(MCACCEPTOR)
-      if(h->select)
-#else
-      if(h->select && (h->accept || h->donate))
-#endif
+      fprintf(stderr, "ERROR: No memory for list of structures\n");
+      ok = FALSE;
+   }
+   else
+   {
+      for(n=names, i=0; n!=NULL; NEXT(n), i++)
+         run.names[i] = n;
+
+      for(h=hb; h!=NULL; NEXT(h))
       {
-         fprintf(stderr,"INFO: Processing residue type %s\n",h->residue);
+         for(b=0; b<NBUILDS; b++)
+         {
+            if(run.builds[b] && TypeSelected(h, b))
+            {
+               fprintf(stderr,"INFO: Processing residue type %s\n",
+                       h->residue);
+               break;
+            }
+         }
+      }
 
-         ClearArrays();
-         
-         for(n=names; n !=NULL; NEXT(n))
+      /* Grids for each selected hydrogen bond type of each kind built
+         in each thread
+      */
+      for(i=0; ok && (i<nthreads); i++)
+      {
+         for(b=0; b<NBUILDS; b++)
          {
-            if((location = FindStructureLocation(n, &tempflag)) == NULL)
+            if(run.builds[b] &&
+               ((workers[i].grids[b] = CreateGrids(hb, ntypes, b))
+                == NULL))
             {
-               /* 19.08.05 ACRM: Corrected from 'location' to 'n->filename' 
-                  Also, FindStructureLocation() will generate a warning, so
-                  this is a continuation.
-                */
-               fprintf(stderr,"         File not processed for: %s\n", n->filename);
+               fprintf(stderr, "ERROR: No memory for matrices \
+(try fewer threads)\n");
+               ok = FALSE;
+               break;
             }
-            else
+         }
+         wdata[i] = (void *)&(workers[i]);
+      }
+   }
+
+   if(ok && !RunPipeline(nthreads, nnames, PREFETCH * nthreads,
+                         (void *)&run, wdata, LoadStructureTask,
+                         StoreStructureTask))
+   {
+      fprintf(stderr, "ERROR: No memory to start threads\n");
+      ok = FALSE;
+   }
+
+   if(ok)
+   {
+      /* Add the counts of the other threads to those of the first, in
+         thread order
+      */
+      for(b=0; b<NBUILDS; b++)
+      {
+         if(!run.builds[b])
+            continue;
+
+         for(i=1; ok && (i<nthreads); i++)
+         {
+            for(j=0; ok && (j<ntypes); j++)
             {
+               if((workers[0].grids[b][j] != NULL) &&
+                  !AddGrids(workers[0].grids[b][j],
+                            workers[i].grids[b][j]))
+                  ok = FALSE;
+            }
+         }
+         for(j=0; ok && (j<ntypes); j++)
+         {
+            if((workers[0].grids[b][j] != NULL) &&
+               workers[0].grids[b][j]->nomem)
+               ok = FALSE;
+         }
+         if(!ok)
+         {
+            fprintf(stderr, "ERROR: No memory for matrices\n");
+            break;
+         }
+
+         for(h=hb, j=0; h!=NULL; NEXT(h), j++)
+         {
+            if(workers[0].grids[b][j] != NULL)
+               PrintMatrix(h, workers[0].grids[b][j], outs[b]);
+         }
+      }
+   }
+
+   if(workers != NULL)
+   {
+      for(i=0; i<nthreads; i++)
+      {
+         for(b=0; b<NBUILDS; b++)
+         {
+            if(workers[i].grids[b] != NULL)
+               FreeGrids(workers[i].grids[b], ntypes);
+         }
+      }
+      free(workers);
+   }
+   if(run.cache.file != NULL) free(run.cache.file);
+   if(run.cache.pdb != NULL)  FREELIST(run.cache.pdb, PDB);
+   if(wdata != NULL)     free(wdata);
+   if(run.names != NULL) free(run.names);
+   fclose(fp1);
+   return(ok);
+}
+
+/************************************************************************/
+/* Returns TRUE if matrices of a kind (BUILD_xxx) are made for a
+   hydrogen bond type
+*/
+BOOL TypeSelected(HBOND *h, int build)
+{
+   if((build == BUILD_MCDONOR) || (build == BUILD_MCACCEPTOR))
+      return(h->select);
+   return(h->select && (h->accept || h->donate));
+}
+
+/************************************************************************/
+/* Allocates an array of grids indexed as the hydrogen bond types hb,
+   with empty grids for the types selected for a kind of matrices and
+   NULL for the others
+*/
+HBGRIDS **CreateGrids(HBOND *hb, int ntypes, int build)
+{
+   HBGRIDS **grids;
+   HBOND   *h;
+   int     i;
+
+   if((grids = (HBGRIDS **)calloc(ntypes, sizeof(HBGRIDS *))) == NULL)
+      return(NULL);
+
+   for(h=hb, i=0; h!=NULL; NEXT(h), i++)
+   {
+      if(TypeSelected(h, build))
+      {
+         if(((grids[i] = (HBGRIDS *)calloc(1, sizeof(HBGRIDS))) == NULL) ||
+            ((grids[i]->accept          = CreateSparseGrid()) == NULL) ||
+            ((grids[i]->donate          = CreateSparseGrid()) == NULL) ||
+            ((grids[i]->partnertoAccept = CreateSparseGrid()) == NULL) ||
+            ((grids[i]->partnertoDonate = CreateSparseGrid()) == NULL))
+         {
+            FreeGrids(grids, ntypes);
+            return(NULL);
+         }
+         grids[i]->contrib = NULL;
+         grids[i]->type    = i;
+         grids[i]->nomem   = FALSE;
+      }
+   }
+   return(grids);
+}
+
+/************************************************************************/
+void FreeGrids(HBGRIDS **grids, int ntypes)
+{
+   int i;
+
+   for(i=0; i<ntypes; i++)
+   {
+      if(grids[i] != NULL)
+      {
+         FreeSparseGrid(grids[i]->accept);
+         FreeSparseGrid(grids[i]->donate);
+         FreeSparseGrid(grids[i]->partnertoAccept);
+         FreeSparseGrid(grids[i]->partnertoDonate);
+         free(grids[i]);
+      }
+   }
+   free(grids);
+}
+
+/************************************************************************/
+/* Adds the counts in one set of grids to another, going through only
+   the occupied cells. Returns FALSE if either lost counts for lack of
+   memory
+*/
+BOOL AddGrids(HBGRIDS *sum, HBGRIDS *grids)
+{
+   GRIDCELL *c;
+   int      which, i;
+
+   if(sum->nomem || grids->nomem)
+      return(FALSE);
+
+   for(which=0; which<4; which++)
+   {
+      SPARSEGRID *grid = WhichGrid(grids, which);
+
+      for(i=0, c=grid->cells; i<grid->ncells; i++, c++)
+         CountGridCell(sum, which, c->x, c->y, c->z, c->count);
+   }
+   return(!sum->nomem);
+}
+
+/************************************************************************/
+/* 17.10.26 Run on the loading thread for each structure in turn: finds
+   the file and reads the counts saved for it in the store directory,
+   and the structure itself if any kind of matrices has to be built
+   from it. Returns an HMLOAD for StoreStructureTask(), or NULL if the
+   structure can't be found
+*/
+void *LoadStructureTask(void *shared, int item)
+{
+   HMRUN  *run    = (HMRUN *)shared;
+   NAMES  *n      = run->names[item];
+   HMLOAD *load;
+   BOOL   process = FALSE;
+   int    b;
+
+   if((load = (HMLOAD *)calloc(1, sizeof(HMLOAD))) == NULL)
+   {
+      fprintf(stderr,"WARNING: No memory to load structure for: %s\n",
+              n->filename);
+      return(NULL);
+   }
+
+   if((load->location = FindStructureLocation(n, &(load->chain))) == NULL)
+   {
+      /* 19.08.05 ACRM: Corrected from 'location' to 'n->filename' 
+         Also, FindStructureLocation() will generate a warning, so
+         this is a continuation.
+      */
+      fprintf(stderr,"         File not processed for: %s\n", n->filename);
+      free(load);
+      return(NULL);
+   }
+
 #ifdef NOISY
-               fprintf(stderr,"INFO: Processing file %s\n", location);
+   if(load->chain)
+      fprintf(stderr,"INFO: Processing file %s chain %c\n", 
+              load->location, load->chain);
+   else
+      fprintf(stderr,"INFO: Processing file %s\n", load->location);
 #endif
-               /* open protein domain file */
-               if((fp2 = fopen(location, "r")) !=NULL)
-               { 
-                  /* create linked list of pdb file */  
-                  if((pdb = blReadPDBAtoms(fp2, &natoms)) !=NULL)
-                  {   
-                     /* strip any hydrogens present in protein domain file */
-                     if((pdb2 = blStripHPDBAsCopy(pdb, &natoms2)) !=NULL)
-                     {
-                        FREELIST(pdb, PDB);
-                        pdb  = pdb2;
-                        prev = NULL;
-                        
-                        if((nHatoms = blHAddPDB(fp1, pdb)) !=0)                    
-                        {
-                           for(start=pdb; start!=NULL; prev=start, start=next)
-                           {
-                              next = blFindNextResidue(start);
 
-#if defined(MCDONOR)
-                              /* If not proline and not first residue */
-                              if(!strncmp(start->record_type, "ATOM  ", 6) &&
-                                 !strncmp(start->resnam, h->residue, 3) &&
-                                 strncmp(start->resnam, "PRO", 3) && 
-                                 (prev != NULL) &&
-                                 ResiduesBonded(prev, start))
-                              {
-                                 /* return true if backbone atoms cannot be found
-                                    .. stops program
-                                    progressing to next stage 
-
-                                    This key residue is the one NOT being mutated.
-                                    So if we are doing sc/mc HBonds, this is always
-                                    the m/c residue
-                                 */
-                                 if((OrientateN_PDB(pdb, prev, start, next) != FALSE))
-                                 {
-                                    StoreHBondingNPosition(start, next, hb);
-                                    
-                                    for(nextres=pdb; nextres!=NULL; nextres=stop)
-                                    {
-                                       stop = blFindNextResidue(nextres);
-                                       
-                                       if((nextres !=start))
-                                       {
-                                          /*
-                                            printf("%s %s\n", start->resnam, 
-                                            nextres->resnam);
-                                          */
-                                          
-                                          if((blIsMCDonorHBonded(start,nextres,HBOND_SIDE2))
-                                             !=0)
-                                          {
-                                             FindMCDonorHAtoms(start, next, nextres, 
-                                                               stop, hb);
-                                          }
-                                       }
-                                    }
-                                 }
-                                 else /* If we couldn't orientate the residue */
-                                 {
-                                    printf("WARNING: backbone atoms can't be found for %c%d%c\
- (PDB file: %s)\n",
-                                           start->chain[0], start->resnum, start->insert[0],
-                                           location);
-                                 }
-                              }  /* If the residue type matches */
-#elif defined(MCACCEPTOR)
-                              if(!strncmp(start->record_type, "ATOM  ", 6) &&
-                                 !strncmp(start->resnam, h->residue, 3))
-                              {
-                                 /* return true if backbone atoms cannot be found
-                                    .. stops program
-                                    progressing to next stage 
-                                 */
-                                 if((OrientateCO_PDB(pdb, start, next) != FALSE))
-                                 {
-                                    StoreHBondingCOPosition(start, next, hb);
-                                    
-                                    for(nextres=pdb; nextres!=NULL; nextres=stop)
-                                    {
-                                       stop = blFindNextResidue(nextres);
-                                       
-                                       if((nextres !=start))
-                                       {
-                                          /*
-                                            printf("%s %s\n", start->resnam, 
-                                            nextres->resnam);
-                                          */
-                                          
-                                          if((blIsMCAcceptorHBonded(start,nextres,HBOND_SIDE2))
-                                             !=0)
-                                          {
-                                             FindMCAcceptorAtoms(start, next, nextres, 
-                                                                 stop, hb);
-                                          }
-                                       }
-                                    }
-                                 }
-                                 else /* If we couldn't orientate the residue */
-                                 {
-                                    printf("WARNING: backbone atoms can't be found for %c%d%c\
- (PDB file: %s)\n",
-                                           start->chain[0], start->resnum, start->insert[0],
-                                           location);
-                                 }
-                              }
-#else /* SCSC */
-                              if((!strncmp(start->resnam, h->residue, 3)))
-                              {
-                                 /* return true if backbone atoms cannot be found
-                                    .. stops program
-                                    progressing to next stage 
-                                 */
-                                 if((OrientatePDB(pdb, start, next) != FALSE))
-                                 {
-                                    StoreHBondingPosition(start, next, hb);
-                                    
-                                    for(nextres=pdb; nextres!=NULL; nextres=stop)
-                                    {
-                                       stop = blFindNextResidue(nextres);
-                                       
-                                       if((nextres !=start))
-                                       {
-                                          /*
-                                            printf("%s %s\n", start->resnam, 
-                                            nextres->resnam);
-                                          */
-                                          
-#ifdef SCMC
-                                          if((blIsHBonded(start,nextres,HBOND_SIDECHAIN))
-                                             !=0)
-                                          {
-                                             FindHAtomsSCMC(start, next, nextres, 
-                                                            stop, hb);
-                                          }
-#else
-                                          if((blIsHBonded(start,nextres,HBOND_SS))
-                                             !=0)
-                                          {
-                                             FindHAtoms(start, next, nextres, 
-                                                        stop, hb);
-                                          }
-#endif
-                                       }
-                                    }
-                                 }
-                                 else /* If we couldn't orientate the residue */
-                                 {
-                                    printf("WARNING: backbone atoms can't be found for %c%d%c\
- (PDB file: %s)\n",
-                                           start->chain[0], start->resnum, start->insert[0],
-                                           location);
-                                 }
-                              }  /* If the residue type matches */
-#endif
-                           }  /* For each residue in the PDB */
-                        }  /* If we added the hydrogens */
-                     }  /* If we stripped the hydrogens */
+   /* Kinds without counts saved for the structure are built from it    */
+   for(b=0; b<NBUILDS; b++)
+   {
+      load->builds[b] = run->builds[b] &&
+                        ((run->storedir == NULL) ||
+                         !ReadContrib(run->storedir, n->filename,
+                                      gBuildNames[b], load->location,
+                                      load->chain, run->pgphash,
+                                      run->ntypes, &(load->stored[b])));
+      if(load->builds[b])
+         process = TRUE;
+   }
+
+   if(process)
+      load->pdb = LoadStructure(run, load->location, load->chain);
+
+   return((void *)load);
+}
+
+/************************************************************************/
+/* 17.10.26 Returns a structure with hydrogens added: from the cache
+   directory if it is there, otherwise read by ReadStructure() and
+   saved in the cache. Split from StoreStructure()
+*/
+PDB *LoadStructure(HMRUN *run, char *location, char chain)
+{
+   PDB *pdb = NULL;
+
+   if(run->cachedir != NULL)
+      pdb = ReadCachedStructure(run->cachedir, location, chain,
+                                run->pgphash);
+
+   if(pdb == NULL)
+   {
+      /* bioplib's reader and the shared PGP file are not thread-safe  */
+      BeginSerialSection();
+      pdb = ReadStructure(run->fp1, location, chain, &(run->cache));
+      EndSerialSection();
+
+      if((pdb != NULL) && (run->cachedir != NULL) &&
+         !WriteCachedStructure(run->cachedir, location, chain,
+                               run->pgphash, pdb))
+      {
+         fprintf(stderr, "WARNING: Unable to save PDB file %s in \
+cache %s\n", location, run->cachedir);
+      }
+   }
+
+   return(pdb);
+}
+
+/************************************************************************/
+/* Run on a counting thread for each structure loaded by
+   LoadStructureTask(): adds the saved counts and the structure to the
+   thread's own grids and frees them
+*/
+void StoreStructureTask(void *shared, void *worker, int item,
+                        void *loaded)
+{
+   HMRUN    *run    = (HMRUN *)shared;
+   HMWORKER *thread = (HMWORKER *)worker;
+   HMLOAD   *load   = (HMLOAD *)loaded;
+   int      b;
+
+   if(load == NULL)
+      return;
+
+   for(b=0; b<NBUILDS; b++)
+   {
+      if(run->builds[b] && !load->builds[b])
+         AddContribution(thread->grids[b], run->ntypes,
+                         &(load->stored[b]));
+      ClearContrib(&(load->stored[b]));
+   }
+
+   if(load->pdb != NULL)
+   {
+      StoreStructure(run, thread, load->builds, run->names[item]->filename,
+                     load->location, load->chain, load->pdb);
+      FREELIST(load->pdb, PDB);
+   }
+
+   free(load->location);
+   free(load);
+}
+
+/************************************************************************/
+/* Adds the residues of a structure with hydrogens to the grids
+   (indexed as the hydrogen bond types hb) of each selected type. The
+   structure itself is not changed, so it is shared by all the types,
+   as is the neighbour list. With a store directory the counts added
+   are recorded and saved there for domain
+   17.10.26 Builds each kind of matrices set in builds
+   17.10.26 The structure is loaded by LoadStructure()
+*/
+void StoreStructure(HMRUN *run, HMWORKER *thread, BOOL *builds,
+                    char *domain, char *location, char chain, PDB *pdb)
+{
+   HBOND      *h;
+   NEIGHBOURS *nb;
+   CONTRIB    contrib;
+   int        i, b;
+
+   if((nb = BuildNeighbours(pdb, (REAL)MAXHBREACH)) == NULL)
+   {
+      fprintf(stderr, "WARNING: No memory for neighbour list for PDB \
+file %s\n", location);
+      return;
+   }
+
+   for(b=0; b<NBUILDS; b++)
+   {
+      if(!builds[b])
+         continue;
+
+      contrib.cells    = NULL;
+      contrib.ncells   = contrib.maxcells = 0;
+      if(run->storedir != NULL)
+         RecordContribution(thread->grids[b], run->ntypes, &contrib);
+
+      for(h=run->hb, i=0; h!=NULL; NEXT(h), i++)
+      {
+         if(thread->grids[b][i] != NULL)
+            StoreResidueType(pdb, nb, location, h, run->hb, b,
+                             thread->grids[b][i]);
+      }
+
+      if(run->storedir != NULL)
+      {
+         RecordContribution(thread->grids[b], run->ntypes, NULL);
+         SaveContribution(run, b, domain, location, chain, &contrib);
+      }
+   }
+
+   FreeNeighbours(nb);
+}
+
+/************************************************************************/
+/* 17.10.26 Saves the counts recorded for a domain for one kind of
+   matrices in the store directory and frees them. Split from
+   StoreStructure()
+*/
+void SaveContribution(HMRUN *run, int build, char *domain,
+                      char *location, char chain, CONTRIB *contrib)
+{
+   if(contrib->ncells < 0)
+   {
+      fprintf(stderr, "WARNING: No memory to record counts for PDB \
+file %s\n", location);
+   }
+   else
+   {
+      CompactContrib(contrib);
+      if(!WriteContrib(run->storedir, domain, gBuildNames[build],
+                       location, chain, run->pgphash, run->ntypes,
+                       contrib))
+      {
+         fprintf(stderr, "WARNING: Unable to save counts for PDB \
+file %s in store %s\n", location, run->storedir);
+      }
+   }
+   ClearContrib(contrib);
+}
+
+/************************************************************************/
+/* 17.10.26 Adds the counts saved for a domain in the store directory
+   to a set of grids
+*/
+void AddContribution(HBGRIDS **grids, int ntypes, CONTRIB *contrib)
+{
+   CONTRIBCELL *c;
+   int         i;
+
+   for(i=0, c=contrib->cells; i<contrib->ncells; i++, c++)
+   {
+      if((c->type < ntypes) && (grids[c->type] != NULL))
+         CountGridCell(grids[c->type], c->grid, c->x, c->y, c->z,
+                       c->count);
+   }
+}
+
+/************************************************************************/
+/* 17.10.26 Starts (or with NULL, stops) recording the cells counted in
+   a set of grids in contrib
+*/
+void RecordContribution(HBGRIDS **grids, int ntypes, CONTRIB *contrib)
+{
+   int i;
+
+   for(i=0; i<ntypes; i++)
+   {
+      if(grids[i] != NULL)
+         grids[i]->contrib = contrib;
+   }
+}
+
+/************************************************************************/
+/* Reads a protein domain file, strips any hydrogens and adds them 
+   back. Returns NULL if any of these fails. Split from StoreStructure()
+   17.10.26 If chain is set only that chain is kept (as getchain was
+   used for). The file as read is kept in the cache and is not read
+   again if the next structure comes from the same file.
+*/
+PDB *ReadStructure(FILE *fp1, char *location, char chain,
+                   PDBCACHE *cache)
+{
+   PDB  *whole, *pdb, *pdb2;
+   int  natoms2;
+
+   if((whole = ReadCachedPDB(location, cache)) == NULL)
+      return(NULL);
+
+   if(chain)
+   {
+      if((pdb = ExtractChain(whole, chain)) == NULL)
+      {
+         fprintf(stderr, "WARNING: No atoms for chain %c in PDB file %s\n",
+                 chain, location);
+         return(NULL);
+      }
+   }
+   else
+   {
+      pdb = whole;
+   }
+   
+   /* strip any hydrogens present in protein domain file */
+   pdb2 = blStripHPDBAsCopy(pdb, &natoms2);
+   if(pdb != whole)
+      FREELIST(pdb, PDB);
+
+   if(pdb2 != NULL)
+   {
+      if(blHAddPDB(fp1, pdb2) !=0)                    
+         return(pdb2);
+      FREELIST(pdb2, PDB);
+   }
+   return(NULL);
+}
+
+/************************************************************************/
+/* Returns the PDB list for a file, read only if it is not the one in
+   the cache. The list belongs to the cache.
+*/
+PDB *ReadCachedPDB(char *location, PDBCACHE *cache)
+{
+   FILE *fp2;
+   PDB  *pdb;
+   int  natoms;
+
+   if((cache->file != NULL) && !strcmp(cache->file, location))
+      return(cache->pdb);
+
+   if(cache->file != NULL)
+   {
+      free(cache->file);
+      cache->file = NULL;
+   }
+   if(cache->pdb != NULL)
+   {
+      FREELIST(cache->pdb, PDB);
+      cache->pdb = NULL;
+   }
+
+   /* open protein domain file */
+   if((fp2 = OpenInputFile(location)) == NULL)
+      return(NULL);
+   
+   /* create linked list of pdb file */  
+   if((pdb = blReadPDBAtoms(fp2, &natoms)) == NULL)
+   {
+      printf("WARNING: Can't read atom list from PDB file %s\n",
+             location);
+   }
+   else if((cache->file = (char *)malloc(strlen(location)+1)) != NULL)
+   {
+      strcpy(cache->file, location);
+      cache->pdb = pdb;
+   }
+   fclose(fp2);
+
+   return(pdb);
+}
+
+/************************************************************************/
+/* Returns a copy of the atoms of one chain of a PDB list, or NULL if
+   there are none (or no memory)
+*/
+PDB *ExtractChain(PDB *pdb, char chain)
+{
+   PDB *p, 
+       *out = NULL, 
+       *q   = NULL;
+
+   for(p=pdb; p!=NULL; NEXT(p))
+   {
+      if(p->chain[0] != chain)
+         continue;
+
+      if(out == NULL)
+      {
+         INIT(out, PDB);
+         q = out;
+      }
+      else
+      {
+         ALLOCNEXT(q, PDB);
+      }
+      if(q == NULL)
+      {
+         if(out != NULL) FREELIST(out, PDB);
+         return(NULL);
+      }
+      blCopyPDB(q, p);
+   }
+   return(out);
+}
+
+/************************************************************************/
+/* Adds each residue of type h in the PDB list to the grids of that
+   type. This was the body of the loop over structures in 
+   CalcAndStoreHBondData()
+   17.10.26 Only the residues listed in nb (built for this structure)
+   as close enough are tested for H-bonds to each
+   17.10.26 The frame of each residue is found and applied to the atoms
+   as they are stored, rather than orientating the whole PDB list
+   17.10.26 The kind of matrices (BUILD_xxx) is given by build rather
+   than chosen when compiling
+*/
+void StoreResidueType(PDB *pdb, NEIGHBOURS *nb, char *location, HBOND *h,
+                      HBOND *hb, int build, HBGRIDS *grids)
+{
+   PDB *start, *next, *nextres, *stop, *prev = NULL,
+       **residues;
+   int *list = NULL,
+       ires, nlist, k;
+   ORIENTATION orient;
+
+   if(((residues = IndexResidues(pdb, nb->nres)) == NULL) ||
+      ((list = (int *)malloc(nb->nres * sizeof(int))) == NULL))
+   {
+      fprintf(stderr, "WARNING: No memory for residue list for PDB \
+file %s\n", location);
+      if(residues != NULL) free(residues);
+      return;
+   }
+
+   for(start=pdb, ires=0; start!=NULL; prev=start, start=next, ires++)
+   {
+      next = blFindNextResidue(start);
+
+      /* If not proline and not first residue */
+      if((build == BUILD_MCDONOR) &&
+         !strncmp(start->record_type, "ATOM  ", 6) &&
+         !strncmp(start->resnam, h->residue, 3) &&
+         strncmp(start->resnam, "PRO", 3) && 
+         (prev != NULL) &&
+         ResiduesBonded(prev, start))
+      {
+         /* return true if backbone atoms cannot be found
+            .. stops program
+            progressing to next stage 
+
+            This key residue is the one NOT being mutated.
+            So if we are doing sc/mc HBonds, this is always
+            the m/c residue
+         */
+         if(FindN_Orientation(prev, start, next, &orient))
+         {
+            StoreHBondingNPosition(start, next, hb, &orient, grids);
+            
+            nlist = FindNeighbours(nb, ires, list);
+            for(k=0; k<nlist; k++)
+            {
+               nextres = residues[list[k]];
+               stop    = residues[list[k]+1];
+               
+               if((nextres !=start))
+               {
+                  /*
+                    printf("%s %s\n", start->resnam, 
+                    nextres->resnam);
+                  */
+                  
+                  if((blIsMCDonorHBonded(start,nextres,HBOND_SIDE2))
+                     !=0)
+                  {
+                     FindMCDonorHAtoms(start, next, nextres, 
+                                       stop, hb, &orient, grids);
                   }
-                  else /* if we didn't read the PDB file */
+               }
+            }
+         }
+         else /* If we couldn't orientate the residue */
+         {
+            printf("WARNING: backbone atoms can't be found for %c%d%c\
+ (PDB file: %s)\n",
+                   start->chain[0], start->resnum, start->insert[0],
+                   location);
+         }
+      }  /* If the residue type matches */
+      else if((build == BUILD_MCACCEPTOR) &&
+              !strncmp(start->record_type, "ATOM  ", 6) &&
+              !strncmp(start->resnam, h->residue, 3))
+      {
+         /* return true if backbone atoms cannot be found
+            .. stops program
+            progressing to next stage 
+         */
+         if(FindCO_Orientation(start, next, &orient))
+         {
+            StoreHBondingCOPosition(start, next, hb, &orient, grids);
+            
+            nlist = FindNeighbours(nb, ires, list);
+            for(k=0; k<nlist; k++)
+            {
+               nextres = residues[list[k]];
+               stop    = residues[list[k]+1];
+               
+               if((nextres !=start))
+               {
+                  /*
+                    printf("%s %s\n", start->resnam, 
+                    nextres->resnam);
+                  */
+                  
+                  if((blIsMCAcceptorHBonded(start,nextres,HBOND_SIDE2))
+                     !=0)
                   {
-                     printf("WARNING: Can't read atom list from PDB file %s\n",
-                            location);
+                     FindMCAcceptorAtoms(start, next, nextres, 
+                                         stop, hb, &orient, grids);
                   }
-                  if(pdb != NULL) FREELIST(pdb, PDB); 
                }
             }
-            if(fp2 !=NULL) fclose(fp2);
-            /* ACRM 19.08.05 - Moved this in here. Previously only one
-               temporary file was created and re-used each time. After
-               Antonio's changes, a new filename was created for each
-               temp file being processed, so they weren't getting
-               deleted. Similarly, the location variable needs to
-               be freed on each cycle.
-            */
-            /* remove protein domain files created by getchain */
-            if(tempflag)
+         }
+         else /* If we couldn't orientate the residue */
+         {
+            printf("WARNING: backbone atoms can't be found for %c%d%c\
+ (PDB file: %s)\n",
+                   start->chain[0], start->resnum, start->insert[0],
+                   location);
+         }
+      }
+      else if(((build == BUILD_SCSC) || (build == BUILD_SCMC)) &&
+              (!strncmp(start->resnam, h->residue, 3)))
+      {
+         /* return true if backbone atoms cannot be found
+            .. stops program
+            progressing to next stage 
+         */
+         if(FindOrientation(start, next, &orient))
+         {
+            StoreHBondingPosition(start, next, hb, &orient, grids);
+            
+            nlist = FindNeighbours(nb, ires, list);
+            for(k=0; k<nlist; k++)
             {
-               if(remove(location))
+               nextres = residues[list[k]];
+               stop    = residues[list[k]+1];
+               
+               if((nextres !=start))
                {
-                  fprintf(stderr, "WARNING: Unable to remove temporary protein \
-domain file %s\n", location);
-               } 
+                  /*
+                    printf("%s %s\n", start->resnam, 
+                    nextres->resnam);
+                  */
+                  
+                  if(build == BUILD_SCMC)
+                  {
+                     if((blIsHBonded(start,nextres,HBOND_SIDECHAIN))
+                        !=0)
+                     {
+                        FindHAtomsSCMC(start, next, nextres, 
+                                       stop, hb, &orient, grids);
+                     }
+                  }
+                  else if((blIsHBonded(start,nextres,HBOND_SS))
+                          !=0)
+                  {
+                     FindHAtoms(start, next, nextres, 
+                                stop, hb, &orient, grids);
+                  }
+               }
             }
-            free(location);
-         }  /* foreach name, n */
-         PrintMatrix(h, out);
-      }  /* if(h->select) */
-   }  /* For each hydrogen bond type, h */
-   
-   fclose(fp1);
-   return(TRUE);
+         }
+         else /* If we couldn't orientate the residue */
+         {
+            printf("WARNING: backbone atoms can't be found for %c%d%c\
+ (PDB file: %s)\n",
+                   start->chain[0], start->resnum, start->insert[0],
+                   location);
+         }
+      }  /* If the residue type matches */
+   }  /* For each residue in the PDB */
+
+   free(list);
+   free(residues);
 }
 
 /************************************************************************/
-void FindHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb)
+/* Returns an array of the start of each of the nres residues in a PDB
+   list, followed by NULL, so residue i runs from [i] to [i+1]
+*/
+PDB **IndexResidues(PDB *pdb, int nres)
+{
+   PDB **residues, *p;
+   int i;
+
+   if((residues = (PDB **)malloc((nres+1) * sizeof(PDB *))) == NULL)
+      return(NULL);
+
+   for(p=pdb, i=0; (p!=NULL) && (i<nres); p=blFindNextResidue(p), i++)
+      residues[i] = p;
+   residues[i] = NULL;
+
+   return(residues);
+}
+
+/************************************************************************/
+void FindHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb,
+                ORIENTATION *orient, HBGRIDS *grids)
 {
    PDB *d, *a, *h1, *h2, *h3, *p;
    
@@ -493,7 +1278,7 @@ void FindHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb)
                           a->resnam, a->resnum,  a->atnam, 
                           ((h1==NULL?"???":h1->atnam)), p->atnam); 
 #endif
-                  StorePartnertoDonatePosition(a);
+                  StorePartnertoDonatePosition(a, orient, grids);
                }
                else if(h2!=NULL)
                {
@@ -505,7 +1290,7 @@ void FindHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb)
                             a->resnam, a->resnum, a->atnam, 
                             h2->atnam, p->atnam);
 #endif
-                     StorePartnertoDonatePosition(a);
+                     StorePartnertoDonatePosition(a, orient, grids);
                   }
                }
                else if(h3!=NULL)
@@ -518,7 +1303,7 @@ void FindHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb)
                             a->resnam, a->resnum, a->atnam, 
                             h3->atnam, p->atnam);
 #endif
-                     StorePartnertoDonatePosition(a);
+                     StorePartnertoDonatePosition(a, orient, grids);
                   }
                }
             }
@@ -554,7 +1339,7 @@ void FindHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb)
                           a->resnam, a->resnum, a->atnam, 
                           ((h1==NULL?"???":h1->atnam)), p->atnam);
 #endif
-                  StorePartnertoAcceptPosition(d);
+                  StorePartnertoAcceptPosition(d, orient, grids);
                }
                else if(h2!=NULL)
                {
@@ -566,7 +1351,7 @@ void FindHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb)
                              a->resnam, a->resnum, a->atnam, 
                              h2->atnam, p->atnam);
 #endif
-                     StorePartnertoAcceptPosition(d);
+                     StorePartnertoAcceptPosition(d, orient, grids);
                   }
                }
                else if(h3!=NULL)
@@ -579,7 +1364,7 @@ void FindHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb)
                             a->resnam, a->resnum, a->atnam, 
                             h3->atnam, p->atnam);
 #endif
-                     StorePartnertoAcceptPosition(d);
+                     StorePartnertoAcceptPosition(d, orient, grids);
                   }
                }
             }
@@ -659,7 +1444,8 @@ PDB *FindAtomInRange(PDB *start, PDB *stop, char *name)
 }
 
 /************************************************************************/
-void StoreHBondingPosition(PDB *start, PDB *stop, HBOND *hb)
+void StoreHBondingPosition(PDB *start, PDB *stop, HBOND *hb,
+                           ORIENTATION *orient, HBGRIDS *grids)
 {
    PDB *p;
    
@@ -680,18 +1466,14 @@ void StoreHBondingPosition(PDB *start, PDB *stop, HBOND *hb)
                if(h->donate)
                {
                   /* store location */
-                  gDonate[(int)(p->x/DIV) + OFFSET] 
-                     [(int)(p->y/DIV) + OFFSET]
-                     [(int)(p->z/DIV) + OFFSET]++;
+                  StoreGridPosition(grids, CONTRIB_DONATE, p, orient);
                }
 
                /* or acceptor */
                if(h->accept)
                {
                   /* store location */
-                  gAccept[(int)(p->x/DIV) + OFFSET]  
-                     [(int)(p->y/DIV) + OFFSET]
-                     [(int)(p->z/DIV) + OFFSET]++;
+                  StoreGridPosition(grids, CONTRIB_ACCEPT, p, orient);
                }
                break;
             }
@@ -706,25 +1488,98 @@ void StoreHBondingPosition(PDB *start, PDB *stop, HBOND *hb)
 }
 
 /************************************************************************/
-void StorePartnertoAcceptPosition(PDB *d)
+void StorePartnertoAcceptPosition(PDB *d, ORIENTATION *orient,
+                                  HBGRIDS *grids)
 {
-   gPartnertoAccept[(int)(d->x/DIV) + OFFSET]
-      [(int)(d->y/DIV) + OFFSET]
-      [(int)(d->z/DIV) + OFFSET]++;   
+   StoreGridPosition(grids, CONTRIB_PARTNERTOACCEPT, d, orient);
 }
 
 /************************************************************************/
-void StorePartnertoDonatePosition(PDB *a)
+void StorePartnertoDonatePosition(PDB *a, ORIENTATION *orient,
+                                  HBGRIDS *grids)
 {
-   gPartnertoDonate[(int)(a->x/DIV) + OFFSET]
-      [(int)(a->y/DIV) + OFFSET]
-      [(int)(a->z/DIV) + OFFSET]++;   
+   StoreGridPosition(grids, CONTRIB_PARTNERTODONATE, a, orient);
 }
 
 /************************************************************************/
-void PrintMatrix(HBOND *h, FILE *out)
+/* 17.10.26 Counts an atom in the grid cell of its position in the frame
+   of the key residue, in the grid which (CONTRIB_xxx). Atoms outside
+   the grid are not counted.
+*/
+void StoreGridPosition(HBGRIDS *grids, int which, PDB *p,
+                       ORIENTATION *orient)
 {
-   int x, y, z;
+   VEC3F pos;
+   int   x, y, z;
+
+   pos.x = p->x;
+   pos.y = p->y;
+   pos.z = p->z;
+   OrientateVector(orient, &pos);
+
+   x = (int)(pos.x/DIV) + OFFSET;
+   y = (int)(pos.y/DIV) + OFFSET;
+   z = (int)(pos.z/DIV) + OFFSET;
+   if(VALIDGRIDCOORDS(x, y, z))
+   {
+      CountGridCell(grids, which, x, y, z, 1);
+
+      /* A failed recording is marked with a negative count            */
+      if((grids->contrib != NULL) && (grids->contrib->ncells >= 0) &&
+         !AddContribCell(grids->contrib, grids->type, which, x, y, z))
+      {
+         ClearContrib(grids->contrib);
+         grids->contrib->ncells = (-1);
+      }
+   }
+}
+
+/************************************************************************/
+/* 17.10.26 Adds count to a cell of the grid which (CONTRIB_xxx).
+   Cells outside the grids are ignored. A count lost for lack of memory
+   is noted in the grids and fails the build
+*/
+void CountGridCell(HBGRIDS *grids, int which, int x, int y, int z,
+                   int count)
+{
+   SPARSEGRID *grid;
+
+   if(VALIDGRIDCOORDS(x, y, z) &&
+      ((grid = WhichGrid(grids, which)) != NULL) &&
+      !AddSparseGridCell(grid, x, y, z, count))
+      grids->nomem = TRUE;
+}
+
+/************************************************************************/
+/* 17.10.26 Returns the grid which (CONTRIB_xxx), or NULL if there is no
+   such grid
+*/
+SPARSEGRID *WhichGrid(HBGRIDS *grids, int which)
+{
+   switch(which)
+   {
+   case CONTRIB_DONATE:
+      return(grids->donate);
+   case CONTRIB_PARTNERTODONATE:
+      return(grids->partnertoDonate);
+   case CONTRIB_ACCEPT:
+      return(grids->accept);
+   case CONTRIB_PARTNERTOACCEPT:
+      return(grids->partnertoAccept);
+   }
+   return(NULL);
+}
+
+/************************************************************************/
+/* 17.10.26 Ends the residue with a line giving the total counts for
+   the donate, partnertodonate, accept and partnertoaccept grids.
+   Readers which only look for the four grid keywords ignore it.
+*/
+void PrintMatrix(HBOND *h, HBGRIDS *grids, FILE *out)
+{
+   int x, y, z, count,
+       totdonate = 0, totpartnertodonate = 0,
+       totaccept = 0, totpartnertoaccept = 0;
 
    if(h->select)
    {
@@ -737,10 +1592,11 @@ void PrintMatrix(HBOND *h, FILE *out)
       {
          for(z = 0; z < MAXSIZE; z++)
          {
-            if(gDonate[x][y][z] > 0)
+            if((count = SparseGridCount(grids->donate, x, y, z)) > 0)
             {
                fprintf(out, "donate\t%8d\t%8d\t%8d\t%6d\n",  x, y, z,  
-                       gDonate[x][y][z]);
+                       count);
+               totdonate += count;
 
                /*
                  GRID_2_COORD(x, grid.x);
@@ -763,10 +1619,11 @@ void PrintMatrix(HBOND *h, FILE *out)
       {
          for(z = 0; z < MAXSIZE; z++)
          {
-            if(gPartnertoDonate[x][y][z] > 0)
+            if((count = SparseGridCount(grids->partnertoDonate, x, y, z)) > 0)
             {
                fprintf(out, "partnertodonate\t%8d\t%8d\t%8d\t%6d\n", 
-                       x, y, z,  gPartnertoDonate[x][y][z]);
+                       x, y, z,  count);
+               totpartnertodonate += count;
 
                /* 
                   GRID_2_COORD(x, grid.x);
@@ -787,10 +1644,11 @@ void PrintMatrix(HBOND *h, FILE *out)
       {
          for(z = 0; z < MAXSIZE; z++)
          {
-            if(gAccept[x][y][z] > 0)
+            if((count = SparseGridCount(grids->accept, x, y, z)) > 0)
             {
                fprintf(out, "accept\t%8d\t%8d\t%8d\t%6d\n",   
-                       x, y, z,  gAccept[x][y][z]);
+                       x, y, z,  count);
+               totaccept += count;
 
                /*GRID_2_COORD(x, grid.x);
                GRID_2_COORD(y, grid.y);
@@ -813,10 +1671,11 @@ void PrintMatrix(HBOND *h, FILE *out)
       {
          for(z = 0; z < MAXSIZE; z++)
          {
-            if(gPartnertoAccept[x][y][z] > 0)
+            if((count = SparseGridCount(grids->partnertoAccept, x, y, z)) > 0)
             {
               fprintf(out, "partnertoaccept\t%8d\t%8d\t%8d\t%6d\n", 
-                      x, y, z,  gPartnertoAccept[x][y][z]);
+                      x, y, z,  count);
+               totpartnertoaccept += count;
 
                /*GRID_2_COORD(x, grid.x);
                GRID_2_COORD(y, grid.y);
@@ -828,26 +1687,9 @@ void PrintMatrix(HBOND *h, FILE *out)
          }
       }
    }
-}
 
-/************************************************************************/
-void ClearArrays()
-{
-   int i, j, k;
-   
-   for(i = 0; i < MAXSIZE; i++)
-   {
-      for(j = 0; j < MAXSIZE; j++)
-      {
-         for(k = 0; k < MAXSIZE; k++)
-         {
-            gDonate[i][j][k] = 0;
-            gAccept[i][j][k] = 0;
-            gPartnertoDonate[i][j][k] = 0;
-            gPartnertoAccept[i][j][k] = 0;
-         }
-      }
-   }
+   fprintf(out, "totals\t%8d\t%8d\t%8d\t%8d\n", totdonate,
+           totpartnertodonate, totaccept, totpartnertoaccept);
 }
 
 /************************************************************************/
@@ -910,11 +1752,50 @@ NAMES *InitializeDomainList(FILE *fp)
 }
 
 /************************************************************************/
-char *FindStructureLocation (NAMES *names, BOOL *tempflag)
+/* 17.10.26 Keeps every nparts'th domain of the list, starting with
+   number part (counting from 1), for a run which builds one part of
+   the matrices. Domains are dealt out in turn rather than in blocks so
+   that each part gets a similar mix of structures. Returns the list of
+   those kept, which is NULL if there are fewer domains than parts.
+*/
+NAMES *SelectPart(NAMES *names, int part, int nparts)
+{
+   NAMES *n, *next,
+         *kept = NULL,
+         *last = NULL;
+   int   i;
+
+   for(n=names, i=0; n!=NULL; n=next, i++)
+   {
+      next = n->next;
+      if((i % nparts) == (part - 1))
+      {
+         if(kept == NULL)
+            kept = n;
+         else
+            last->next = n;
+         last    = n;
+         n->next = NULL;
+      }
+      else
+      {
+         free(n);
+      }
+   }
+
+   return(kept);
+}
+
+/************************************************************************/
+/* 17.10.26 For a chain, returns the whole PDB file and sets *chain
+   (otherwise '\0') rather than running getchain into a temporary file
+   17.10.26 Returns the .gz file if there is only a compressed one
+*/
+char *FindStructureLocation (NAMES *names, char *chain)
 {
    char *filename=(char *)malloc((size_t)(sizeof(char)*(6+1)));
-   char *result,*tbuffer,*tbuffer1,chainlabel;
-   *tempflag = 0;
+   char *result;
+   *chain = '\0';
    
    if(!filename)
    {
@@ -937,24 +1818,18 @@ structure file\n");
       /*dompdb */
       result=multiappend("%s%s",DOMAINLOC,filename);		  
       free(filename);
-      return(result);
+      return(FindInputFile(result));
    }
    else
    {
       if(filename[4]!='0')
       {
-         /* getchain */
-         chainlabel=filename[4];
+         /* chain of pdb */
+         *chain=filename[4];
          filename[4]='\0';
-         tbuffer=multiappend("getchain %c %s%s%s",
-                             chainlabel,PDBLOC,filename,PDBEXT);
-         tbuffer1=multiappend("%s/%s",
-                              tmpdir(),filename);
-         doIt(tbuffer,tbuffer1);
-         free(tbuffer);
+         result=multiappend("%s%s%s",PDBLOC,filename,PDBEXT);
          free(filename);
-         *tempflag = 1;
-         return(tbuffer1);
+         return(FindInputFile(result));
       }
       else
       {
@@ -962,7 +1837,7 @@ structure file\n");
          filename[4]='\0';
          result=multiappend("%s%s%s",PDBLOC,filename,PDBEXT);		  
          free(filename);
-         return(result);
+         return(FindInputFile(result));
       }
    }	  
 
@@ -1059,10 +1934,26 @@ HBOND *InitializeHbondTypes()
 /* function to display a usage message */
 void Usage(void)
 {
-   fprintf(stderr, "\nHydrogen Matrices V2.0 (c) 2002-6, Alison Cuff, University of Reading\n");
+   fprintf(stderr, "\nHydrogen Matrices V2.19 (c) 2002-6, Alison Cuff, University of Reading\n");
    fprintf(stderr, "V1.1/2.0 modifications, Andrew C.R. Martin, University College London\n\n");
    
-   fprintf(stderr, "Usage: hydrogen_matrices [cath domain file] [output file]\n\n");
+   fprintf(stderr, "Usage: hydrogen_matrices [-t nthreads] [-c cachedir] [-s storedir]\n");
+   fprintf(stderr, "                         [-p k/n] [-a kind file ...] [cath domain file]\n");
+   fprintf(stderr, "                         [output file]\n\n");
+   fprintf(stderr, "  -t [nthreads] number of counting threads (default 1; 0 for one\n");
+   fprintf(stderr, "                per processor); another reads the structures.\n");
+   fprintf(stderr, "                The matrices are the same. Each thread keeps its\n");
+   fprintf(stderr, "                own counts of the cells counted in (a few MB)\n");
+   fprintf(stderr, "  -c [cachedir] keep structures with hydrogens added in cachedir\n");
+   fprintf(stderr, "                and use them in later runs\n");
+   fprintf(stderr, "  -s [storedir] keep the counts from each structure in storedir\n");
+   fprintf(stderr, "                so later runs only process new structures\n");
+   fprintf(stderr, "  -p [k/n]      build part k of n of the matrices, from every n'th\n");
+   fprintf(stderr, "                domain; merge_matrices adds the parts together\n");
+   fprintf(stderr, "  -a kind file  also build matrices of another kind (scsc, scmc,\n");
+   fprintf(stderr, "                ndonor or oacceptor) in the same pass over the\n");
+   fprintf(stderr, "                structures, writing them to file. May be repeated.\n");
+   fprintf(stderr, "                Each kind adds its own counts to every thread\n");
    fprintf(stderr, "  [cath domain file] non-redundant (e.g Sreps) cath domain list file\n");
    fprintf(stderr, "  [output file] name of file to print out matrices\n");
    fprintf(stderr, "                I/O is though stdout if file not specified\n\n");   
@@ -1079,11 +1970,76 @@ void Usage(void)
 }
       
 /************************************************************************/
-/* function to parse the command line */
-BOOL ParseCmdLine(int argc, char **argv, char *inputfile, char *outputfile)
+/* function to parse the command line 
+   17.10.26 Added -t, -c, -s, -p and -a
+*/
+BOOL ParseCmdLine(int argc, char **argv, char *inputfile, char *outputfile,
+                  int *nthreads, char *cachedir, char *storedir,
+                  int *part, int *nparts, char extrafiles[NBUILDS][MAXFILENAME])
 {
+   int b;
+
+
    argc--;
    argv++;
+
+   *nthreads   = 1;
+   cachedir[0] = '\0';
+   storedir[0] = '\0';
+   *part       = *nparts = 1;
+   for(b=0; b<NBUILDS; b++)
+      extrafiles[b][0] = '\0';
+
+   while((argc > 0) && (argv[0][0] == '-'))
+   {
+      switch(argv[0][1])
+      {
+      case 't':
+         argc--;
+         argv++;
+         if((!argc) || !sscanf(argv[0], "%d", nthreads) ||
+            (*nthreads < 0))
+            return(FALSE);
+         if(*nthreads == 0)
+            *nthreads = NumberOfProcessors();
+         break;
+      case 'c':
+         argc--;
+         argv++;
+         if((!argc) || (strlen(argv[0]) >= MAXFILENAME))
+            return(FALSE);
+         strcpy(cachedir, argv[0]);
+         break;
+      case 's':
+         argc--;
+         argv++;
+         if((!argc) || (strlen(argv[0]) >= MAXFILENAME))
+            return(FALSE);
+         strcpy(storedir, argv[0]);
+         break;
+      case 'p':
+         argc--;
+         argv++;
+         if((!argc) ||
+            (sscanf(argv[0], "%d/%d", part, nparts) != 2) ||
+            (*part < 1) || (*part > *nparts))
+            return(FALSE);
+         break;
+      case 'a':
+         if((argc < 3) || ((b = BuildKind(argv[1])) < 0) ||
+            (b == DEFAULTBUILD) || extrafiles[b][0] ||
+            (strlen(argv[2]) >= MAXFILENAME))
+            return(FALSE);
+         strcpy(extrafiles[b], argv[2]);
+         argc -= 2;
+         argv += 2;
+         break;
+      default:
+         return(FALSE);
+      }
+      argc--;
+      argv++;
+   }
         
    if(argc > 2 || argc < 1)
    {
@@ -1098,15 +2054,49 @@ BOOL ParseCmdLine(int argc, char **argv, char *inputfile, char *outputfile)
       strcpy(outputfile, argv[0]);
    }
    return(TRUE);
-   
-   argc--;
-   argv++;
-      
+}
+
+/************************************************************************/
+/* 17.10.26 Returns the BUILD_xxx for a kind of matrices named on the
+   command line, or -1 if it is not known
+*/
+int BuildKind(char *kind)
+{
+   int b;
+
+   for(b=0; b<NBUILDS; b++)
+   {
+      if(!strcmp(kind, gBuildKinds[b]))
+         return(b);
+   }
+   return(-1);
+}
+
+/************************************************************************/
+/* 17.10.26 Fills in the output file for each kind of matrices: out for
+   the program's own kind, the files named with -a and NULL for kinds
+   not built. Returns FALSE if one of the files can't be opened
+*/
+BOOL OpenExtraFiles(char extrafiles[NBUILDS][MAXFILENAME], FILE *out,
+                    FILE **outs)
+{
+   int b;
+
+   for(b=0; b<NBUILDS; b++)
+   {
+      outs[b] = NULL;
+      if(b == DEFAULTBUILD)
+         outs[b] = out;
+      else if(extrafiles[b][0] &&
+              ((outs[b] = fopen(extrafiles[b], "w")) == NULL))
+         return(FALSE);
+   }
    return(TRUE);
 }
 
 /************************************************************************/
-void StoreHBondingCOPosition(PDB *start, PDB *stop, HBOND *hb)
+void StoreHBondingCOPosition(PDB *start, PDB *stop, HBOND *hb,
+                             ORIENTATION *orient, HBGRIDS *grids)
 {
    PDB *p;
    
@@ -1118,16 +2108,15 @@ void StoreHBondingCOPosition(PDB *start, PDB *stop, HBOND *hb)
       if(!strncmp(p->atnam, "O  ", 3))
       {
          /* store location */
-         gAccept[(int)(p->x/DIV) + OFFSET]  
-            [(int)(p->y/DIV) + OFFSET]
-            [(int)(p->z/DIV) + OFFSET]++;
+         StoreGridPosition(grids, CONTRIB_ACCEPT, p, orient);
          break;
       }
    }
 }
 
 /************************************************************************/
-void FindMCAcceptorAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb)
+void FindMCAcceptorAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB,
+                         HBOND *hb, ORIENTATION *orient, HBGRIDS *grids)
 {
    PDB *d, *a, *h1, *h2, *h3, *p;
    
@@ -1158,7 +2147,7 @@ void FindMCAcceptorAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb
                     a->resnam, a->resnum, a->atnam, 
                     ((h1==NULL?"???":h1->atnam)), p->atnam);
 #endif
-            StorePartnertoAcceptPosition(d);
+            StorePartnertoAcceptPosition(d, orient, grids);
          }
          else if(h2!=NULL)
          {
@@ -1170,7 +2159,7 @@ void FindMCAcceptorAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb
                        a->resnam, a->resnum, a->atnam, 
                        h2->atnam, p->atnam);
 #endif
-               StorePartnertoAcceptPosition(d);
+               StorePartnertoAcceptPosition(d, orient, grids);
             }
          }
          else if(h3!=NULL)
@@ -1183,7 +2172,7 @@ void FindMCAcceptorAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb
                        a->resnam, a->resnum, a->atnam, 
                        h3->atnam, p->atnam);
 #endif
-               StorePartnertoAcceptPosition(d);
+               StorePartnertoAcceptPosition(d, orient, grids);
             }
          }
       }
@@ -1191,7 +2180,8 @@ void FindMCAcceptorAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb
 }
 
 /************************************************************************/
-void StoreHBondingNPosition(PDB *start, PDB *stop, HBOND *hb)
+void StoreHBondingNPosition(PDB *start, PDB *stop, HBOND *hb,
+                            ORIENTATION *orient, HBGRIDS *grids)
 {
    PDB *p;
    
@@ -1204,9 +2194,7 @@ void StoreHBondingNPosition(PDB *start, PDB *stop, HBOND *hb)
          if(!strncmp(p->atnam, "N  ", 3))
          {
             /* store location */
-            gDonate[(int)(p->x/DIV) + OFFSET] 
-                   [(int)(p->y/DIV) + OFFSET]
-                   [(int)(p->z/DIV) + OFFSET]++;
+            StoreGridPosition(grids, CONTRIB_DONATE, p, orient);
          }
       }
    }
@@ -1214,7 +2202,8 @@ void StoreHBondingNPosition(PDB *start, PDB *stop, HBOND *hb)
 
 
 /************************************************************************/
-void FindMCDonorHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb)
+void FindMCDonorHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB,
+                       HBOND *hb, ORIENTATION *orient, HBGRIDS *grids)
 {
    PDB *d, *a, *h1, *p;
    
@@ -1242,7 +2231,7 @@ void FindMCDonorHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb)
                           a->resnam, a->resnum,  a->atnam, 
                           ((h1==NULL?"???":h1->atnam)), p->atnam); 
 #endif
-                  StorePartnertoDonatePosition(a);
+                  StorePartnertoDonatePosition(a, orient, grids);
                }
             }
          }
@@ -1252,7 +2241,7 @@ void FindMCDonorHAtoms(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, HBOND *hb)
 
 /************************************************************************/
 void FindHAtomsSCMC(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB, 
-                    HBOND *hb)
+                    HBOND *hb, ORIENTATION *orient, HBGRIDS *grids)
 {
    PDB *d, *a, *h1, *h2, *h3, *p;
    
@@ -1281,7 +2270,7 @@ void FindHAtomsSCMC(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB,
                     a->resnam, a->resnum,  a->atnam, 
                     ((h1==NULL?"???":h1->atnam)), p->atnam); 
 #endif
-            StorePartnertoDonatePosition(a);
+            StorePartnertoDonatePosition(a, orient, grids);
          }
          else if(h2!=NULL)
          {
@@ -1293,7 +2282,7 @@ void FindHAtomsSCMC(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB,
                        a->resnam, a->resnum, a->atnam, 
                        h2->atnam, p->atnam);
 #endif
-               StorePartnertoDonatePosition(a);
+               StorePartnertoDonatePosition(a, orient, grids);
             }
          }
          else if(h3!=NULL)
@@ -1306,7 +2295,7 @@ void FindHAtomsSCMC(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB,
                        a->resnam, a->resnum, a->atnam, 
                        h3->atnam, p->atnam);
 #endif
-               StorePartnertoDonatePosition(a);
+               StorePartnertoDonatePosition(a, orient, grids);
             }
          }
       }
@@ -1333,7 +2322,7 @@ void FindHAtomsSCMC(PDB *resA, PDB *stopA, PDB *resB, PDB *stopB,
                     a->resnam, a->resnum, a->atnam, 
                     ((h1==NULL?"???":h1->atnam)), p->atnam);
 #endif
-            StorePartnertoAcceptPosition(d);
+            StorePartnertoAcceptPosition(d, orient, grids);
          }
       }
    }
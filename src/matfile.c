@@ -0,0 +1,593 @@
+/*************************************************************************
+
+   Program:    checkhbond
+   File:       matfile.c
+
+   Version:    V1.0
+   Date:       17.10.26
+   Function:   Read text H-bond matrix files and read/write compiled
+               (binary) matrix files
+
+**************************************************************************
+
+   Description:
+   ============
+   The text matrix files written by hydrogen_matrices (PrintMatrix())
+   contain one "residue" block per residue type with one line per
+   non-zero grid cell. Parsing these every time checkhbond runs is
+   most of the run time for a single query, so they may be compiled
+   (see compile_matrices.c) into a binary file which is memory-mapped
+   and used directly. The layout is described in matfile.h
+
+   A text file given to OpenMatrix() is read once and built into the
+   same layout in memory, so the rest of the code only sees the
+   compiled form.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original
+   V1.1  17.10.26 Checks the totals line written by PrintMatrix()
+   V1.2  17.10.26 Text files are built into the compiled layout in
+                  memory when opened (BuildBinaryMatrix())
+   V1.3  17.10.26 Added MatrixResidueTypes()
+   V1.4  17.10.26 Added AddTextMatrix() and WriteTextMatrix() for
+                  merge_matrices
+
+*************************************************************************/
+/* Includes
+*/
+#define _POSIX_C_SOURCE 200112L /* For fileno() and mmap()             */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "bioplib/macros.h"
+#include "bioplib/pdb.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "orientate.h"
+#include "hbondmat2.h"
+#include "matfile.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define CELLBLOCK 1024   /* Cell list growth step when reading text     */
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL AddTextCell(TEXTSECTION *section, int grid, int x, int y,
+                        int z, int count);
+static void CompactTextCells(TEXTSECTION *section, int grid);
+static int  CompareMatCells(const void *a, const void *b);
+
+/************************************************************************/
+/* Opens a matrix file, compiled or text. Compiled files are recognised
+   by their magic number and are memory-mapped; anything else is
+   treated as a text file, read and built into the compiled layout
+*/
+MATFILE *OpenMatrix(char *filename)
+{
+   MATFILE     *matrix;
+   FILE        *fp;
+   TEXTSECTION *sections;
+   char        magic[sizeof(MAT_MAGIC)];
+
+   if((matrix = (MATFILE *)malloc(sizeof(MATFILE)))==NULL)
+      return(NULL);
+   matrix->bin = NULL;
+
+   if((fp = fopen(filename, "r"))==NULL)
+   {
+      free(matrix);
+      return(NULL);
+   }
+
+   if((fread(magic, 1, sizeof(MAT_MAGIC), fp)==sizeof(MAT_MAGIC))
+      && !strncmp(magic, MAT_MAGIC, sizeof(MAT_MAGIC)))
+   {
+      matrix->bin = MapBinaryMatrix(fp);
+   }
+   else
+   {
+      rewind(fp);
+      if((sections = ReadTextMatrix(fp)) != NULL)
+      {
+         matrix->bin = BuildBinaryMatrix(sections, filename);
+         FreeTextMatrix(sections);
+      }
+   }
+   fclose(fp);
+
+   if(matrix->bin == NULL)
+   {
+      free(matrix);
+      return(NULL);
+   }
+
+   return(matrix);
+}
+
+/************************************************************************/
+void CloseMatrix(MATFILE *matrix)
+{
+   if(matrix == NULL)
+      return;
+   if(matrix->bin != NULL)
+      UnmapBinaryMatrix(matrix->bin);
+   free(matrix);
+}
+
+/************************************************************************/
+/* Maps a compiled matrix file and checks that it was built for this
+   architecture and grid geometry. The mapping stays valid after the
+   file is closed.
+*/
+BINMATRIX *MapBinaryMatrix(FILE *fp)
+{
+   BINMATRIX   *bin;
+   struct stat st;
+   MATHEADER   *h;
+   void        *base;
+   int         i, j;
+
+   if(fstat(fileno(fp), &st) || (st.st_size < (off_t)sizeof(MATHEADER)))
+   {
+      PrintError(NULL, "Compiled matrix file is truncated\n");
+      return(NULL);
+   }
+
+   base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED,
+               fileno(fp), 0);
+   if(base == MAP_FAILED)
+   {
+      PrintError(NULL, "Unable to map compiled matrix file\n");
+      return(NULL);
+   }
+
+   if((bin = (BINMATRIX *)malloc(sizeof(BINMATRIX)))==NULL)
+   {
+      munmap(base, (size_t)st.st_size);
+      return(NULL);
+   }
+   bin->base     = (char *)base;
+   bin->mapped   = TRUE;
+   bin->length   = (size_t)st.st_size;
+   bin->header   = h = (MATHEADER *)base;
+   bin->sections = (MATSECTION *)(bin->base + sizeof(MATHEADER));
+
+   if(h->byteorder != MAT_BYTEORDER)
+   {
+      PrintError(NULL, "Compiled matrix file was built on a machine \
+with a different byte order\n");
+      UnmapBinaryMatrix(bin);
+      return(NULL);
+   }
+   if(h->format != MAT_FORMAT)
+   {
+      PrintError(NULL, "Compiled matrix file format version not \
+supported\n");
+      UnmapBinaryMatrix(bin);
+      return(NULL);
+   }
+   if((h->maxsize != MAXSIZE) || (h->divPerAngstrom != DIV_PER_ANGSTROM) ||
+      (h->offset != OFFSET))
+   {
+      PrintError(NULL, "Compiled matrix file uses a different grid \
+geometry\n");
+      UnmapBinaryMatrix(bin);
+      return(NULL);
+   }
+
+   /* Check all the cell lists lie within the file                     */
+   if((h->nsections < 0) ||
+      (sizeof(MATHEADER) + h->nsections * sizeof(MATSECTION) > bin->length))
+   {
+      PrintError(NULL, "Compiled matrix file is truncated\n");
+      UnmapBinaryMatrix(bin);
+      return(NULL);
+   }
+   for(i=0; i<h->nsections; i++)
+   {
+      for(j=0; j<MAT_NGRIDS; j++)
+      {
+         if((bin->sections[i].ncells[j] < 0) ||
+            (bin->sections[i].start[j] < 0) ||
+            ((size_t)bin->sections[i].start[j] +
+             bin->sections[i].ncells[j] * sizeof(MATCELL) > bin->length))
+         {
+            PrintError(NULL, "Compiled matrix file is truncated\n");
+            UnmapBinaryMatrix(bin);
+            return(NULL);
+         }
+      }
+   }
+
+   return(bin);
+}
+
+/************************************************************************/
+void UnmapBinaryMatrix(BINMATRIX *bin)
+{
+   if(bin->mapped)
+      munmap((void *)bin->base, bin->length);
+   else
+      free(bin->base);
+   free(bin);
+}
+
+/************************************************************************/
+MATCELL *BinaryMatrixCells(BINMATRIX *bin, MATSECTION *section, int grid)
+{
+   return((MATCELL *)(bin->base + section->start[grid]));
+}
+
+/************************************************************************/
+/* Fills 'types' with the residue names of the sections of a matrix,
+   in file order and with repeated names given once. Returns the number
+   of names (at most maxtypes).
+*/
+int MatrixResidueTypes(BINMATRIX *bin, char types[][8], int maxtypes)
+{
+   int i, j, ntypes = 0;
+
+   for(i=0; (i<bin->header->nsections) && (ntypes<maxtypes); i++)
+   {
+      for(j=0; j<ntypes; j++)
+      {
+         if(!strncmp(types[j], bin->sections[i].resnam, 8))
+            break;
+      }
+      if(j==ntypes)
+      {
+         strncpy(types[ntypes], bin->sections[i].resnam, 8);
+         types[ntypes][7] = '\0';
+         ntypes++;
+      }
+   }
+   return(ntypes);
+}
+
+/************************************************************************/
+/* Returns the grid number for a keyword from a text matrix file or -1
+   if the keyword is not a grid name
+*/
+int MatrixGridType(char *keyword)
+{
+   if(!strcmp(keyword, "donate"))
+      return(MAT_DONATE);
+   if(!strcmp(keyword, "partnertodonate"))
+      return(MAT_PARTNERTODONATE);
+   if(!strcmp(keyword, "accept"))
+      return(MAT_ACCEPT);
+   if(!strcmp(keyword, "partnertoaccept"))
+      return(MAT_PARTNERTOACCEPT);
+   return(-1);
+}
+
+/************************************************************************/
+/* Reads all the residue sections from a text matrix file as written by
+   PrintMatrix() in hydrogen_matrices.c. Sections are kept in file
+   order, including any repeated residue names. Where a section ends
+   with a totals line (files from hydrogen_matrices V2.2 onwards) the
+   totals are checked against the cells read.
+*/
+TEXTSECTION *ReadTextMatrix(FILE *fp)
+{
+   TEXTSECTION *sections = NULL,
+               *s        = NULL;
+   char        buffer[MAXBUFF], keyword[MAXBUFF];
+   int         x, y, z, count, grid,
+               totals[MAT_NGRIDS];
+
+   while(fgets(buffer, MAXBUFF, fp))
+   {
+      TERMINATE(buffer);
+      if(!strncmp(buffer, "residue", 7))
+      {
+         if(sections == NULL)
+         {
+            INIT(sections, TEXTSECTION);
+            s = sections;
+         }
+         else
+         {
+            ALLOCNEXT(s, TEXTSECTION);
+         }
+         if(s == NULL)
+         {
+            FreeTextMatrix(sections);
+            return(NULL);
+         }
+
+         for(grid=0; grid<MAT_NGRIDS; grid++)
+         {
+            s->cells[grid]    = NULL;
+            s->ncells[grid]   = 0;
+            s->maxcells[grid] = 0;
+            s->total[grid]    = 0;
+         }
+         strncpy(s->resnam, buffer+8, 3);
+         s->resnam[3] = '\0';
+      }
+      else if((s != NULL) && !strncmp(buffer, "totals", 6))
+      {
+         if((sscanf(buffer, "%s %d %d %d %d", keyword,
+                    &totals[MAT_DONATE], &totals[MAT_PARTNERTODONATE],
+                    &totals[MAT_ACCEPT], &totals[MAT_PARTNERTOACCEPT])
+             != 5) ||
+            memcmp(totals, s->total, sizeof(totals)))
+         {
+            char msg[MAXBUFF+80];
+            sprintf(msg, "Totals do not match cells for residue %s\n",
+                    s->resnam);
+            PrintError(NULL, msg);
+         }
+      }
+      else if((s != NULL) &&
+              (sscanf(buffer, "%s %d %d %d %d",
+                      keyword, &x, &y, &z, &count) == 5) &&
+              ((grid = MatrixGridType(keyword)) >= 0))
+      {
+         if(!VALIDGRIDCOORDS(x, y, z))
+         {
+            char msg[MAXBUFF+80];
+            sprintf(msg, "Matrix cell out of range: %s\n", buffer);
+            PrintError(NULL, msg);
+            continue;
+         }
+
+         if(!AddTextCell(s, grid, x, y, z, count))
+         {
+            FreeTextMatrix(sections);
+            return(NULL);
+         }
+      }
+   }
+
+   return(sections);
+}
+
+/************************************************************************/
+static BOOL AddTextCell(TEXTSECTION *section, int grid, int x, int y,
+                        int z, int count)
+{
+   MATCELL *cell;
+
+   if(section->ncells[grid] == section->maxcells[grid])
+   {
+      MATCELL *cells;
+
+      section->maxcells[grid] += CELLBLOCK;
+      if((cells = (MATCELL *)realloc(section->cells[grid],
+                                     section->maxcells[grid] *
+                                     sizeof(MATCELL)))==NULL)
+      {
+         return(FALSE);
+      }
+      section->cells[grid] = cells;
+   }
+
+   cell = section->cells[grid] + section->ncells[grid]++;
+   cell->x     = (unsigned char)x;
+   cell->y     = (unsigned char)y;
+   cell->z     = (unsigned char)z;
+   cell->pad   = 0;
+   cell->count = count;
+
+   section->total[grid] += count;
+
+   return(TRUE);
+}
+
+/************************************************************************/
+void FreeTextMatrix(TEXTSECTION *sections)
+{
+   TEXTSECTION *s;
+   int         grid;
+
+   for(s=sections; s!=NULL; NEXT(s))
+   {
+      for(grid=0; grid<MAT_NGRIDS; grid++)
+      {
+         if(s->cells[grid] != NULL)
+            free(s->cells[grid]);
+      }
+   }
+   FREELIST(sections, TEXTSECTION);
+}
+
+/************************************************************************/
+/* Builds the compiled form of the sections read by ReadTextMatrix() in
+   memory. 'build' is stored in the header to identify the matrices.
+*/
+BINMATRIX *BuildBinaryMatrix(TEXTSECTION *sections, char *build)
+{
+   BINMATRIX   *bin;
+   MATHEADER   *header;
+   MATSECTION  *section;
+   TEXTSECTION *s;
+   int         nsections = 0,
+               ncells    = 0,
+               start, grid;
+
+   for(s=sections; s!=NULL; NEXT(s))
+   {
+      nsections++;
+      for(grid=0; grid<MAT_NGRIDS; grid++)
+         ncells += s->ncells[grid];
+   }
+
+   if((bin = (BINMATRIX *)malloc(sizeof(BINMATRIX)))==NULL)
+      return(NULL);
+   bin->mapped = FALSE;
+   bin->length = sizeof(MATHEADER) + nsections * sizeof(MATSECTION) +
+                 ncells * sizeof(MATCELL);
+   if((bin->base = (char *)calloc(1, bin->length))==NULL)
+   {
+      free(bin);
+      return(NULL);
+   }
+   bin->header   = header = (MATHEADER *)bin->base;
+   bin->sections = (MATSECTION *)(bin->base + sizeof(MATHEADER));
+
+   strcpy(header->magic, MAT_MAGIC);
+   header->byteorder      = MAT_BYTEORDER;
+   header->format         = MAT_FORMAT;
+   header->maxsize        = MAXSIZE;
+   header->divPerAngstrom = DIV_PER_ANGSTROM;
+   header->offset         = OFFSET;
+   header->nsections      = nsections;
+   strncpy(header->build, build, MAT_BUILDLEN-1);
+
+   /* Section table; the cell lists follow in the same order           */
+   start = sizeof(MATHEADER) + nsections * sizeof(MATSECTION);
+   for(s=sections, section=bin->sections; s!=NULL; NEXT(s), section++)
+   {
+      strcpy(section->resnam, s->resnam);
+      for(grid=0; grid<MAT_NGRIDS; grid++)
+      {
+         section->ncells[grid] = s->ncells[grid];
+         section->total[grid]  = s->total[grid];
+         section->start[grid]  = start;
+         if(s->ncells[grid])
+         {
+            memcpy(bin->base + start, s->cells[grid],
+                   s->ncells[grid] * sizeof(MATCELL));
+         }
+         start += s->ncells[grid] * sizeof(MATCELL);
+      }
+   }
+
+   return(bin);
+}
+
+/************************************************************************/
+/* Writes the sections read by ReadTextMatrix() as a compiled matrix
+   file. 'build' is stored in the header to identify the matrices.
+*/
+BOOL WriteBinaryMatrix(FILE *fp, TEXTSECTION *sections, char *build)
+{
+   BINMATRIX *bin;
+   BOOL      ok;
+
+   if((bin = BuildBinaryMatrix(sections, build))==NULL)
+      return(FALSE);
+
+   ok = (fwrite(bin->base, 1, bin->length, fp) == bin->length);
+   UnmapBinaryMatrix(bin);
+
+   return(ok);
+}
+
+/************************************************************************/
+/* Adds the counts of one text matrix to another, as read by
+   ReadTextMatrix(). Both must have the same residue sections in the
+   same order (as do all the files from one hydrogen_matrices program).
+   Returns FALSE if they do not, or if memory runs out.
+*/
+BOOL AddTextMatrix(TEXTSECTION *sum, TEXTSECTION *sections)
+{
+   TEXTSECTION *s, *t;
+   MATCELL     *cell;
+   int         grid, i;
+
+   for(s=sum, t=sections; (s!=NULL) && (t!=NULL); NEXT(s), NEXT(t))
+   {
+      if(strcmp(s->resnam, t->resnam))
+         return(FALSE);
+   }
+   if((s != NULL) || (t != NULL))
+      return(FALSE);
+
+   for(s=sum, t=sections; s!=NULL; NEXT(s), NEXT(t))
+   {
+      for(grid=0; grid<MAT_NGRIDS; grid++)
+      {
+         if(t->ncells[grid] == 0)
+            continue;
+
+         for(i=0, cell=t->cells[grid]; i<t->ncells[grid]; i++, cell++)
+         {
+            if(!AddTextCell(s, grid, cell->x, cell->y, cell->z,
+                            cell->count))
+               return(FALSE);
+         }
+         CompactTextCells(s, grid);
+      }
+   }
+
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Writes text matrix sections in the form written by PrintMatrix() in
+   hydrogen_matrices.c, with each grid in order of x, y, z
+*/
+void WriteTextMatrix(FILE *fp, TEXTSECTION *sections)
+{
+   static char *keywords[MAT_NGRIDS] = {"donate", "partnertodonate",
+                                        "accept", "partnertoaccept"};
+   TEXTSECTION *s;
+   MATCELL     *cell;
+   int         grid, i;
+
+   for(s=sections; s!=NULL; NEXT(s))
+   {
+      fprintf(fp, "residue %s\n", s->resnam);
+      for(grid=0; grid<MAT_NGRIDS; grid++)
+      {
+         for(i=0, cell=s->cells[grid]; i<s->ncells[grid]; i++, cell++)
+         {
+            if(cell->count > 0)
+               fprintf(fp, "%s\t%8d\t%8d\t%8d\t%6d\n", keywords[grid],
+                       cell->x, cell->y, cell->z, cell->count);
+         }
+      }
+      fprintf(fp, "totals\t%8d\t%8d\t%8d\t%8d\n",
+              s->total[MAT_DONATE], s->total[MAT_PARTNERTODONATE],
+              s->total[MAT_ACCEPT], s->total[MAT_PARTNERTOACCEPT]);
+   }
+}
+
+/************************************************************************/
+/* Sorts the cells of a grid and merges repeats of a cell into one with
+   the total count. The grid total is not changed.
+*/
+static void CompactTextCells(TEXTSECTION *section, int grid)
+{
+   MATCELL *cells = section->cells[grid];
+   int     i, n;
+
+   if(section->ncells[grid] < 2)
+      return;
+
+   qsort(cells, section->ncells[grid], sizeof(MATCELL), CompareMatCells);
+   for(i=1, n=0; i<section->ncells[grid]; i++)
+   {
+      if(CompareMatCells(cells+i, cells+n))
+         cells[++n] = cells[i];
+      else
+         cells[n].count += cells[i].count;
+   }
+   section->ncells[grid] = n+1;
+}
+
+/************************************************************************/
+/* qsort() comparison: cells in order of x, y, z                        */
+static int CompareMatCells(const void *a, const void *b)
+{
+   const MATCELL *p = (const MATCELL *)a,
+                 *q = (const MATCELL *)b;
+
+   if(p->x != q->x) return((p->x < q->x) ? (-1) : 1);
+   if(p->y != q->y) return((p->y < q->y) ? (-1) : 1);
+   if(p->z != q->z) return((p->z < q->z) ? (-1) : 1);
+   return(0);
+}
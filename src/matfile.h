@@ -0,0 +1,104 @@
+#ifndef MATFILE_H
+#define MATFILE_H
+
+/* Compiled (binary) H-bond matrix files.
+
+   Layout (all values in native byte order; the byte order marker in
+   the header lets a reader reject files from another architecture):
+
+      MATHEADER
+      MATSECTION[nsections]       One per "residue" block of the text
+      MATCELL[...]                Cell lists, referenced from sections
+
+   Each section holds four sparse cell lists, indexed by the MAT_xxx
+   grid numbers below, together with the total count for each grid.
+*/
+
+#define MAT_MAGIC        "CHBMATX"
+#define MAT_BYTEORDER    0x01020304
+#define MAT_FORMAT       1
+#define MAT_BUILDLEN     64
+
+/* Grid numbers within a section                                        */
+#define MAT_DONATE           0
+#define MAT_PARTNERTODONATE  1
+#define MAT_ACCEPT           2
+#define MAT_PARTNERTOACCEPT  3
+#define MAT_NGRIDS           4
+
+typedef struct
+{
+   char magic[8];
+   int  byteorder,
+        format,
+        maxsize,              /* Grid geometry the file was built for  */
+        divPerAngstrom,
+        offset,
+        nsections;
+   char build[MAT_BUILDLEN];  /* Build version string                  */
+}  MATHEADER;
+
+typedef struct
+{
+   char resnam[8];
+   int  ncells[MAT_NGRIDS],
+        total[MAT_NGRIDS],    /* Sum of counts over each grid          */
+        start[MAT_NGRIDS];    /* Byte offset of each cell list         */
+}  MATSECTION;
+
+typedef struct
+{
+   unsigned char x, y, z, pad;
+   int           count;
+}  MATCELL;
+
+/* A compiled matrix file, memory-mapped or built in memory from a text
+   file by BuildBinaryMatrix()
+*/
+typedef struct
+{
+   char       *base;
+   size_t     length;
+   MATHEADER  *header;
+   MATSECTION *sections;
+   BOOL       mapped;         /* base is mapped rather than allocated  */
+}  BINMATRIX;
+
+/* Text sections as read from a PrintMatrix() file, before compiling    */
+typedef struct textsection
+{
+   char    resnam[8];
+   MATCELL *cells[MAT_NGRIDS];
+   int     ncells[MAT_NGRIDS],
+           maxcells[MAT_NGRIDS],
+           total[MAT_NGRIDS];
+   struct textsection *next;
+}  TEXTSECTION;
+
+/* An open matrix file of either kind. Text files are read completely
+   when they are opened, so a MATFILE is not changed by reading from it
+   and may be shared between threads.
+*/
+typedef struct
+{
+   BINMATRIX *bin;
+}  MATFILE;
+
+MATFILE     *OpenMatrix(char *filename);
+void        CloseMatrix(MATFILE *matrix);
+BINMATRIX   *MapBinaryMatrix(FILE *fp);
+void        UnmapBinaryMatrix(BINMATRIX *bin);
+MATCELL     *BinaryMatrixCells(BINMATRIX *bin, MATSECTION *section,
+                               int grid);
+int         MatrixResidueTypes(BINMATRIX *bin, char types[][8],
+                               int maxtypes);
+int         MatrixGridType(char *keyword);
+TEXTSECTION *ReadTextMatrix(FILE *fp);
+void        FreeTextMatrix(TEXTSECTION *sections);
+BINMATRIX   *BuildBinaryMatrix(TEXTSECTION *sections, char *build);
+BOOL        WriteBinaryMatrix(FILE *fp, TEXTSECTION *sections,
+                              char *build);
+BOOL        AddTextMatrix(TEXTSECTION *sum, TEXTSECTION *sections);
+void        WriteTextMatrix(FILE *fp, TEXTSECTION *sections);
+
+#endif
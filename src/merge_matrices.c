@@ -0,0 +1,185 @@
+/*************************************************************************
+
+   Program:    merge_matrices
+   File:       merge_matrices.c
+
+   Version:    V1.1
+   Date:       17.10.26
+   Function:   Sum the partial H-bond matrix files from a sharded
+               hydrogen_matrices build into the full matrix file
+
+**************************************************************************
+
+   Description:
+   ============
+   hydrogen_matrices -p k/n builds the matrices from part k of n of the
+   domain list, so a build may be spread over separate processes or
+   machines. Each part is an ordinary text matrix file of the counts
+   from its domains. The matrices only hold counts, so adding the
+   parts cell by cell gives the matrix file which one run over the
+   whole list would have written.
+
+   All the parts must come from the same hydrogen_matrices program.
+
+**************************************************************************
+
+   Usage:
+   ======
+   merge_matrices [-o merged] part [part ...]
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original
+   V1.1  17.10.26 An output file name too long for its buffer is
+                  rejected. Errors are printed directly with the
+                  program's own name rather than through a fixed-size
+                  buffer
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "bioplib/macros.h"
+#include "bioplib/pdb.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "orientate.h"
+#include "hbondmat2.h"
+#include "matfile.h"
+
+/************************************************************************/
+/* Prototypes
+*/
+int main(int argc, char *argv[]);
+BOOL ParseCmdLine(int argc, char **argv, char *outfile, int *firstpart);
+void Usage(void);
+TEXTSECTION *ReadPart(char *filename);
+
+/************************************************************************/
+int main(int argc, char *argv[])
+{
+   char        outfile[MAXBUFF];
+   FILE        *out = stdout;
+   TEXTSECTION *sum, *sections;
+   int         i;
+
+   if(!ParseCmdLine(argc, argv, outfile, &i))
+   {
+      Usage();
+      return(0);
+   }
+
+   if((sum = ReadPart(argv[i])) == NULL)
+      return(1);
+
+   for(i++; i<argc; i++)
+   {
+      if((sections = ReadPart(argv[i])) == NULL)
+         return(1);
+      if(!AddTextMatrix(sum, sections))
+      {
+         fprintf(stderr, "Error (merge_matrices): Unable to add %s: not \
+from the same program as\n         the first part (or no memory)\n",
+                 argv[i]);
+         return(1);
+      }
+      FreeTextMatrix(sections);
+   }
+
+   if(outfile[0] && ((out = fopen(outfile, "w"))==NULL))
+   {
+      fprintf(stderr, "Error (merge_matrices): Unable to open merged \
+matrix file for writing\n");
+      return(1);
+   }
+   WriteTextMatrix(out, sum);
+   if(out != stdout)
+      fclose(out);
+
+   FreeTextMatrix(sum);
+   return(0);
+}
+
+/************************************************************************/
+/* Reads one partial matrix file. Returns NULL after printing an error
+   if it can't be read
+*/
+TEXTSECTION *ReadPart(char *filename)
+{
+   FILE        *in;
+   TEXTSECTION *sections;
+
+   if((in = fopen(filename, "r"))==NULL)
+   {
+      fprintf(stderr, "Error (merge_matrices): Unable to open partial \
+matrix file %s\n", filename);
+      return(NULL);
+   }
+
+   if((sections = ReadTextMatrix(in))==NULL)
+   {
+      fprintf(stderr, "Error (merge_matrices): No residue sections read \
+from partial matrix\n         file %s\n", filename);
+   }
+   fclose(in);
+
+   return(sections);
+}
+
+/************************************************************************/
+/* function to parse the command line. firstpart is set to the index in
+   argv of the first partial matrix file. Returns FALSE, so that the
+   usage message is given, if the output file name is too long for its
+   buffer
+*/
+BOOL ParseCmdLine(int argc, char **argv, char *outfile, int *firstpart)
+{
+   int i;
+
+   outfile[0] = '\0';
+
+   for(i=1; i<argc; i++)
+   {
+      if(argv[i][0] == '-')
+      {
+         switch(argv[i][1])
+         {
+         case 'o':
+            if((++i >= argc) || (strlen(argv[i]) >= MAXBUFF))
+               return(FALSE);
+            strcpy(outfile, argv[i]);
+            break;
+         default:
+            return(FALSE);
+         }
+      }
+      else
+      {
+         *firstpart = i;
+         return(TRUE);
+      }
+   }
+   return(FALSE);
+}
+
+/************************************************************************/
+/* function to display a usage message */
+void Usage(void)
+{
+   fprintf(stderr, "\nMerge_Matrices V1.1\n\n");
+   fprintf(stderr, "Usage: merge_matrices [-o merged] part [part ...]\n\n");
+   fprintf(stderr, "  -o [merged]: matrix file to write (default: \
+stdout)\n");
+   fprintf(stderr, "  part:        partial matrix file written by \
+hydrogen_matrices -p\n\n");
+   fprintf(stderr, "Adds together the partial matrix files from a build \
+split into parts with\n");
+   fprintf(stderr, "hydrogen_matrices -p, giving the matrix file of a \
+build over the whole\n");
+   fprintf(stderr, "domain list. The parts must all come from the same \
+hydrogen_matrices program.\n\n");
+}
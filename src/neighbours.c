@@ -0,0 +1,257 @@
+/*************************************************************************
+
+   Program:    hydrogen_matrices
+   File:       neighbours.c
+
+   Version:    V1.0
+   Date:       17.10.26
+   Function:   Find the residues of a structure close enough to a given
+               residue to be H-bonded to it
+
+**************************************************************************
+
+   Description:
+   ============
+   hydrogen_matrices.c tests each residue of a type against every other
+   residue in the structure with blIsHBonded() and friends, which is
+   slow for large structures. Two residues can only be H-bonded if some
+   atom of one is within H-bonding distance of some atom of the other.
+   Each residue is given a centre (the mean of its atoms) and a radius
+   (the furthest of its atoms from the centre), so residues i and j can
+   only be H-bonded if their centres are within
+
+      radius[i] + radius[j] + reach
+
+   where reach is at least the longest H-bond allowed. The residues are
+   put in a cell list on their centres, with cells at least as wide as
+   the largest such distance, so only those in the 27 cells around a
+   residue need to be compared.
+
+   The test uses all the atoms of each residue, so no pair which could
+   be H-bonded is missed; distances do not change when the structure is
+   orientated, so the list may be built before then. Residues are
+   numbered in the order of blFindNextResidue() over the PDB list.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bioplib/macros.h"
+#include "bioplib/pdb.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "neighbours.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define DISTSQ_V(a,b) (((a).x - (b).x) * ((a).x - (b).x) + \
+                       ((a).y - (b).y) * ((a).y - (b).y) + \
+                       ((a).z - (b).z) * ((a).z - (b).z))
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL SetResidueSpheres(PDB *pdb, NEIGHBOURS *nb);
+static BOOL BuildCells(NEIGHBOURS *nb);
+static int  CompareInts(const void *a, const void *b);
+
+/************************************************************************/
+/* Builds the cell list for the residues of a PDB list. reach is the
+   longest distance between two atoms that may be H-bonded. Returns
+   NULL if memory runs out or there are no residues.
+*/
+NEIGHBOURS *BuildNeighbours(PDB *pdb, REAL reach)
+{
+   NEIGHBOURS *nb;
+
+   if((nb = (NEIGHBOURS *)calloc(1, sizeof(NEIGHBOURS)))==NULL)
+      return(NULL);
+   nb->reach = reach;
+
+   if(!SetResidueSpheres(pdb, nb) || !BuildCells(nb))
+   {
+      FreeNeighbours(nb);
+      return(NULL);
+   }
+   return(nb);
+}
+
+/************************************************************************/
+void FreeNeighbours(NEIGHBOURS *nb)
+{
+   if(nb == NULL)
+      return;
+   if(nb->res != NULL)       free(nb->res);
+   if(nb->cellstart != NULL) free(nb->cellstart);
+   if(nb->order != NULL)     free(nb->order);
+   free(nb);
+}
+
+/************************************************************************/
+/* Fills in list[] (which must have room for nb->nres entries) with the
+   residues other than residue i which may be H-bonded to it, in order,
+   and returns how many there are
+*/
+int FindNeighbours(NEIGHBOURS *nb, int i, int *list)
+{
+   NBRES *res = nb->res;
+   REAL  maxdist;
+   int   n = 0,
+         j, k, c,
+         dx, dy, dz, x, y, z,
+         *dims = nb->dims;
+
+   x = res[i].cell / (dims[1] * dims[2]);
+   y = (res[i].cell / dims[2]) % dims[1];
+   z = res[i].cell % dims[2];
+
+   for(dx=(-1); dx<=1; dx++)
+   {
+      if((x+dx < 0) || (x+dx >= dims[0])) continue;
+      for(dy=(-1); dy<=1; dy++)
+      {
+         if((y+dy < 0) || (y+dy >= dims[1])) continue;
+         for(dz=(-1); dz<=1; dz++)
+         {
+            if((z+dz < 0) || (z+dz >= dims[2])) continue;
+            c = ((x+dx) * dims[1] + (y+dy)) * dims[2] + (z+dz);
+
+            for(k=nb->cellstart[c]; k<nb->cellstart[c+1]; k++)
+            {
+               j = nb->order[k];
+               if(j == i)
+                  continue;
+
+               maxdist = res[i].radius + res[j].radius + nb->reach;
+               if(DISTSQ_V(res[i].centre, res[j].centre) <=
+                  (maxdist * maxdist))
+                  list[n++] = j;
+            }
+         }
+      }
+   }
+
+   /* The cells are visited out of order                                */
+   qsort(list, n, sizeof(int), CompareInts);
+   return(n);
+}
+
+/************************************************************************/
+/* Sets the centre and radius of each residue                           */
+static BOOL SetResidueSpheres(PDB *pdb, NEIGHBOURS *nb)
+{
+   PDB  *start, *stop, *p;
+   REAL dsq, maxdsq;
+   int  i, natoms;
+
+   for(start=pdb; start!=NULL; start=blFindNextResidue(start))
+      nb->nres++;
+   if((nb->nres == 0) ||
+      ((nb->res = (NBRES *)malloc(nb->nres * sizeof(NBRES)))==NULL))
+      return(FALSE);
+
+   for(start=pdb, i=0; start!=NULL; start=stop, i++)
+   {
+      stop = blFindNextResidue(start);
+
+      nb->res[i].centre.x = nb->res[i].centre.y = nb->res[i].centre.z = 0.0;
+      for(p=start, natoms=0; p!=stop; NEXT(p), natoms++)
+      {
+         nb->res[i].centre.x += p->x;
+         nb->res[i].centre.y += p->y;
+         nb->res[i].centre.z += p->z;
+      }
+      nb->res[i].centre.x /= natoms;
+      nb->res[i].centre.y /= natoms;
+      nb->res[i].centre.z /= natoms;
+
+      maxdsq = 0.0;
+      for(p=start; p!=stop; NEXT(p))
+      {
+         dsq = DISTSQ_V(nb->res[i].centre, *p);
+         if(dsq > maxdsq)
+            maxdsq = dsq;
+      }
+      nb->res[i].radius = (REAL)sqrt((double)maxdsq);
+   }
+
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Sets the cell of each residue and builds the cell list: the residues
+   in cell c are order[cellstart[c]] to order[cellstart[c+1]-1]. The
+   cells are as wide as the furthest apart two residues may be and
+   still be H-bonded.
+*/
+static BOOL BuildCells(NEIGHBOURS *nb)
+{
+   NBRES *res = nb->res;
+   VEC3F min, max;
+   REAL  maxradius = 0.0;
+   int   i, ncells, x, y, z;
+
+   min = max = res[0].centre;
+   for(i=0; i<nb->nres; i++)
+   {
+      if(res[i].centre.x < min.x) min.x = res[i].centre.x;
+      if(res[i].centre.y < min.y) min.y = res[i].centre.y;
+      if(res[i].centre.z < min.z) min.z = res[i].centre.z;
+      if(res[i].centre.x > max.x) max.x = res[i].centre.x;
+      if(res[i].centre.y > max.y) max.y = res[i].centre.y;
+      if(res[i].centre.z > max.z) max.z = res[i].centre.z;
+      if(res[i].radius > maxradius) maxradius = res[i].radius;
+   }
+
+   nb->cellsize = 2.0 * maxradius + nb->reach;
+   nb->dims[0]  = 1 + (int)((max.x - min.x) / nb->cellsize);
+   nb->dims[1]  = 1 + (int)((max.y - min.y) / nb->cellsize);
+   nb->dims[2]  = 1 + (int)((max.z - min.z) / nb->cellsize);
+   ncells       = nb->dims[0] * nb->dims[1] * nb->dims[2];
+
+   if(((nb->cellstart = (int *)calloc(ncells+1, sizeof(int)))==NULL) ||
+      ((nb->order = (int *)malloc(nb->nres * sizeof(int)))==NULL))
+      return(FALSE);
+
+   /* Count the residues in each cell, then turn the counts into the
+      start of each cell and fill in the residues
+   */
+   for(i=0; i<nb->nres; i++)
+   {
+      x = (int)((res[i].centre.x - min.x) / nb->cellsize);
+      y = (int)((res[i].centre.y - min.y) / nb->cellsize);
+      z = (int)((res[i].centre.z - min.z) / nb->cellsize);
+      res[i].cell = (x * nb->dims[1] + y) * nb->dims[2] + z;
+      nb->cellstart[res[i].cell + 1]++;
+   }
+   for(i=0; i<ncells; i++)
+      nb->cellstart[i+1] += nb->cellstart[i];
+   for(i=0; i<nb->nres; i++)
+      nb->order[nb->cellstart[res[i].cell]++] = i;
+
+   /* Filling in moved each start on to the next cell                  */
+   for(i=ncells; i>0; i--)
+      nb->cellstart[i] = nb->cellstart[i-1];
+   nb->cellstart[0] = 0;
+
+   return(TRUE);
+}
+
+/************************************************************************/
+/* qsort() comparison for ints in ascending order                       */
+static int CompareInts(const void *a, const void *b)
+{
+   int p = *(const int *)a,
+       q = *(const int *)b;
+
+   return((p < q) ? (-1) : ((p > q) ? 1 : 0));
+}
@@ -0,0 +1,32 @@
+#ifndef NEIGHBOURS_H
+#define NEIGHBOURS_H
+
+/* A cell list of the residues of a structure for finding those close
+   enough to a residue to be H-bonded to it (neighbours.c). Residues
+   are numbered in the order of blFindNextResidue().
+
+   The header relies on bioplib/pdb.h having been included.
+*/
+typedef struct
+{
+   VEC3F centre;              /* Mean of the atoms                      */
+   REAL  radius;              /* Furthest atom from the centre          */
+   int   cell;
+}  NBRES;
+
+typedef struct
+{
+   NBRES *res;
+   REAL  reach,               /* Longest H-bond between two atoms       */
+         cellsize;
+   int   nres,
+         dims[3],
+         *cellstart,          /* Residues in cell c are order[cellstart */
+         *order;              /* [c]] to order[cellstart[c+1]-1]        */
+}  NEIGHBOURS;
+
+NEIGHBOURS *BuildNeighbours(PDB *pdb, REAL reach);
+void FreeNeighbours(NEIGHBOURS *nb);
+int  FindNeighbours(NEIGHBOURS *nb, int i, int *list);
+
+#endif
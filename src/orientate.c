@@ -13,62 +13,60 @@
 #include "orientate.h"
 
 /************************************************************************/
+/* Orientates the PDB list so that the CA of the residue from start to
+   next is at the origin, its N on the x axis and its CB in the xy plane
+   17.10.26 The orientation is found from the residue's own atoms and
+            applied to the list in one pass (see FindOrientation())
+*/
 BOOL OrientatePDB(PDB *pdb, PDB *start, PDB *next)
 {
-   VEC3F c_alpha,
-         c_beta,
-         n,
-         TempVec;
-   c_alpha.x = c_alpha.y = c_alpha.z = (REAL)0.0;
+   ORIENTATION orient;
 
-   /* find co-ordinates of *key* residue */
-   if(!FindNCACBAtoms(start, next, &c_alpha, &c_beta, &n))
-   {
-      PrintError(NULL, "Error (checkhbond): 1. Unable to find backbone atoms\n");
+   if(!FindOrientation(start, next, &orient))
       return(FALSE);
-   }
-   
-   /* move protein structure file so that c_alpha is at the origin */
-   TempVec.x = -c_alpha.x;
-   TempVec.y = -c_alpha.y;
-   TempVec.z = -c_alpha.z;
+   ApplyOrientation(pdb, NULL, &orient);
 
-   blTranslatePDB(pdb, TempVec);
-   
-   /* find co-ordinates of *key* residue after the translation */
-  
-   if(!FindNCACBAtoms(start, next, &c_alpha, &c_beta, &n))
-   {
-      PrintError(NULL,"2. Unable to find backbone atoms\n");
+   return(TRUE); 
+}
+
+/************************************************************************/
+/* Orientates the PDB list so that the N of the residue from start to
+   next is at the origin, the C of the previous residue on the x axis
+   and its CA in the xy plane
+   17.10.26 Uses FindN_Orientation()
+*/
+BOOL OrientateN_PDB(PDB *pdb, PDB *prev, PDB *start, PDB *next)
+{
+   ORIENTATION orient;
+
+   if(!FindN_Orientation(prev, start, next, &orient))
       return(FALSE);
-   }
+   ApplyOrientation(pdb, NULL, &orient);
 
-   /* rotate n so that it is on the xz plane */
-            
-   RotateToXZ(pdb, &n);
-   
-   /* rotate n onto the x axis */
+   return(TRUE); 
+}
 
-   RotateToX(pdb, &n);
+/************************************************************************/
+/* Finds the orientation used by OrientatePDB() without moving any atoms.
+   The three rotations are found from the N, CA and CB alone, exactly as
+   when the whole list was translated and rotated three times, and are
+   combined into one matrix.
+*/
+BOOL FindOrientation(PDB *start, PDB *next, ORIENTATION *orient)
+{
+   VEC3F c_alpha,
+         c_beta,
+         n;
 
-   /** ACRM c_beta has moved now!!! because of the rotations in the 2 previous steps
-       c-beta has to be refound!
-       Add this line!
-   **/
-   
+   /* find co-ordinates of *key* residue */
    if(!FindNCACBAtoms(start, next, &c_alpha, &c_beta, &n))
    {
-      PrintError(NULL,"3. Unable to find backbone atoms\n");
+      PrintError(NULL, "Error (checkhbond): 1. Unable to find backbone atoms\n");
       return(FALSE);
    }
-   	 
-    RotateToXY(pdb, &c_beta);
 
-   if(!FindNCACBAtoms(start, next, &c_alpha, &c_beta, &n))
-   {
-      PrintError(NULL,"4. Unable to find backbone atoms\n");
-      return(FALSE);
-   }
+   /* CA to the origin, N on the x axis and CB in the xy plane */
+   BuildOrientation(c_alpha, n, c_beta, orient);
 
 #ifdef DEBUG
    printf("DEBUG: residue %s %d\n",start->resnam, start->resnum);
@@ -76,18 +74,20 @@ BOOL OrientatePDB(PDB *pdb, PDB *start, PDB *next)
    printf("DEBUG: c_beta atoms %f %f %f\n", c_beta.x, c_beta.y, c_beta.z);
    printf("DEBUG: n atoms %f %f %f\n", n.x, n.y, n.z);
 #endif
-  
-   return(TRUE); 
 
+   return(TRUE);
 }
 
 /************************************************************************/
-BOOL OrientateN_PDB(PDB *pdb, PDB *prev, PDB *start, PDB *next)
+/* Finds the orientation used by OrientateN_PDB() without moving any 
+   atoms
+*/
+BOOL FindN_Orientation(PDB *prev, PDB *start, PDB *next,
+                       ORIENTATION *orient)
 {
    VEC3F c_alpha,
-      c,
-      n,
-      TempVec;
+         c,
+         n;
 
    /* find co-ordinates of *key* residue */
    if(!FindCNCAAtoms(prev, start, next, &c, &n, &c_alpha))
@@ -95,48 +95,9 @@ BOOL OrientateN_PDB(PDB *pdb, PDB *prev, PDB *start, PDB *next)
       PrintError(NULL,"5. Unable to find backbone atoms\n");
       return(FALSE);
    }
-   
-   /* move protein structure file so that N is at the origin */
-   TempVec.x = -n.x;
-   TempVec.y = -n.y;
-   TempVec.z = -n.z;
 
-   blTranslatePDB(pdb, TempVec);
-   
-   /* find co-ordinates of *key* residue after the translation */
-  
-   if(!FindCNCAAtoms(prev, start, next, &c, &n, &c_alpha))
-   {
-      PrintError(NULL,"6. Unable to find backbone atoms\n");
-      return(FALSE);
-   }
-
-   /* rotate c so that it is on the xz plane */
-            
-   RotateToXZ(pdb, &c);
-   
-   /* rotate c onto the x axis */
-
-   RotateToX(pdb, &c);
-
-   /** ACRM c_beta has moved now!!! because of the rotations in the 2 previous steps
-       c-beta has to be refound!
-       Add this line!
-   **/
-   
-   if(!FindCNCAAtoms(prev, start, next, &c, &n, &c_alpha))
-   {
-      PrintError(NULL,"7. Unable to find backbone atoms\n");
-      return(FALSE);
-   }
-   	 
-    RotateToXY(pdb, &c_alpha);
-
-   if(!FindCNCAAtoms(prev, start, next, &c, &n, &c_alpha))
-   {
-      PrintError(NULL,"8. Unable to find backbone atoms\n");
-      return(FALSE);
-   }
+   /* N to the origin, C on the x axis and CA in the xy plane */
+   BuildOrientation(n, c, c_alpha, orient);
 
 #ifdef DEBUG
    printf("DEBUG: residue %s %d\n",start->resnam, start->resnum);
@@ -144,9 +105,86 @@ BOOL OrientateN_PDB(PDB *pdb, PDB *prev, PDB *start, PDB *next)
    printf("DEBUG: n atoms %f %f %f\n", n.x, n.y, n.z);
    printf("DEBUG: c_alpha atoms %f %f %f\n", c_alpha.x, c_alpha.y, c_alpha.z);
 #endif
-  
-   return(TRUE); 
 
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Finds the orientation which moves 'origin' to the origin, 'axis' onto
+   the x axis and 'plane' into the xy plane. This is the translation
+   followed by RotateToXZ() and RotateToX() on 'axis' and RotateToXY()
+   on 'plane' that the OrientateXXX() routines used to make, with the
+   angles calculated in the same way
+*/
+void BuildOrientation(VEC3F origin, VEC3F axis, VEC3F plane,
+                      ORIENTATION *orient)
+{
+   REAL  rotz[3][3],
+         roty[3][3],
+         rotx[3][3],
+         rotzy[3][3];
+   VEC3F temp;
+
+   axis.x  -= origin.x;
+   axis.y  -= origin.y;
+   axis.z  -= origin.z;
+   plane.x -= origin.x;
+   plane.y -= origin.y;
+   plane.z -= origin.z;
+
+   /* rotate axis so that it is on the xz plane                         */
+   blCreateRotMat('z', -TheAngle(axis.y, axis.x), rotz);
+   blMatMult3_33(axis, rotz, &temp);
+
+   /* rotate axis onto the x axis                                       */
+   blCreateRotMat('y', TheAngle(temp.z, temp.x), roty);
+
+   /* rotate plane (having made the same two rotations) onto the xy 
+      plane
+   */
+   blMatMult3_33(plane, rotz, &temp);
+   blMatMult3_33(temp, roty, &plane);
+   blCreateRotMat('x', -TheAngle(plane.z, plane.y), rotx);
+
+   /* Coordinates are row vectors (see blMatMult3_33()) so the rotations
+      combine left to right
+   */
+   blMatMult33_33(rotz, roty, rotzy);
+   blMatMult33_33(rotzy, rotx, orient->matrix);
+   orient->origin = origin;
+}
+
+/************************************************************************/
+/* Applies an orientation to a point                                    */
+void OrientateVector(ORIENTATION *orient, VEC3F *vec)
+{
+   VEC3F temp;
+
+   temp.x = vec->x - orient->origin.x;
+   temp.y = vec->y - orient->origin.y;
+   temp.z = vec->z - orient->origin.z;
+   blMatMult3_33(temp, orient->matrix, vec);
+}
+
+/************************************************************************/
+/* Applies an orientation to the atoms from start up to (not including)
+   stop, which may be NULL for the rest of the list
+*/
+void ApplyOrientation(PDB *start, PDB *stop, ORIENTATION *orient)
+{
+   PDB   *p;
+   VEC3F vec;
+
+   for(p=start; p!=stop; NEXT(p))
+   {
+      vec.x = p->x;
+      vec.y = p->y;
+      vec.z = p->z;
+      OrientateVector(orient, &vec);
+      p->x = vec.x;
+      p->y = vec.y;
+      p->z = vec.z;
+   }
 }
 
 /**************************************************************/
@@ -329,56 +367,40 @@ BOOL FindCNCAAtoms(PDB *res0_start, PDB *res1_start, PDB *stop, VEC3F *c, VEC3F
 
 
 /************************************************************************/
+/* Orientates the PDB list so that the C of the residue from start to
+   next is at the origin, its CA on the x axis and its O in the xy plane
+   17.10.26 Uses FindCO_Orientation()
+*/
 BOOL OrientateCO_PDB(PDB *pdb, PDB *start, PDB *next)
 {
-   VEC3F c_alpha,
-      c,
-      o,
-      TempVec;
+   ORIENTATION orient;
 
-   /* find co-ordinates of *key* residue */
-   if(!FindCACOAtoms(start, next, &c_alpha, &c, &o))
-   {
-      PrintError(NULL,"9. Unable to find backbone atoms\n");
+   if(!FindCO_Orientation(start, next, &orient))
       return(FALSE);
-   }
-   
-   /* move protein structure file so that c is at the origin */
-   TempVec.x = -c.x;
-   TempVec.y = -c.y;
-   TempVec.z = -c.z;
+   ApplyOrientation(pdb, NULL, &orient);
 
-   blTranslatePDB(pdb, TempVec);
-   
-   /* find co-ordinates of *key* residue after the translation */
-  
-   if(!FindCACOAtoms(start, next, &c_alpha, &c, &o))
-   {
-      PrintError(NULL,"10. Unable to find backbone atoms\n");
-      return(FALSE);
-   }
+   return(TRUE); 
+}
 
-   /* rotate ca so that it is on the xz plane */
-            
-   RotateToXZ(pdb, &c_alpha);
-   
-   /* rotate ca onto the x axis */
+/************************************************************************/
+/* Finds the orientation used by OrientateCO_PDB() without moving any
+   atoms
+*/
+BOOL FindCO_Orientation(PDB *start, PDB *next, ORIENTATION *orient)
+{
+   VEC3F c_alpha,
+         c,
+         o;
 
-   RotateToX(pdb, &c_alpha);
-   
+   /* find co-ordinates of *key* residue */
    if(!FindCACOAtoms(start, next, &c_alpha, &c, &o))
    {
-      PrintError(NULL,"11. Unable to find backbone atoms\n");
+      PrintError(NULL,"9. Unable to find backbone atoms\n");
       return(FALSE);
    }
-   	 
-    RotateToXY(pdb, &o);
 
-   if(!FindCACOAtoms(start, next, &c_alpha, &c, &o))
-   {
-      PrintError(NULL,"12. Unable to find backbone atoms\n");
-      return(FALSE);
-   }
+   /* C to the origin, CA on the x axis and O in the xy plane */
+   BuildOrientation(c, c_alpha, o, orient);
 
 #ifdef DEBUG
    printf("DEBUG: residue %s %d\n",start->resnam, start->resnum);
@@ -386,9 +408,8 @@ BOOL OrientateCO_PDB(PDB *pdb, PDB *start, PDB *next)
    printf("DEBUG: c atoms %f %f %f\n", c.x, c.y, c.z);
    printf("DEBUG: o atoms %f %f %f\n", o.x, o.y, o.z);
 #endif
-  
-   return(TRUE); 
 
+   return(TRUE);
 }
 
 
@@ -1,9 +1,26 @@
 #ifndef ORIENTATE_H
 #define ORIENTATE_H
 
+/* A rigid transform to the frame of a residue: coordinates have origin
+   subtracted and are then multiplied by matrix (see blMatMult3_33())
+*/
+typedef struct
+{
+   VEC3F origin;
+   REAL  matrix[3][3];
+}  ORIENTATION;
+
 BOOL OrientatePDB(PDB *pdb, PDB *res1_start, PDB *res1_next);
 BOOL OrientateN_PDB(PDB *pdb, PDB *prev, PDB *start, PDB *next);
 BOOL OrientateCO_PDB(PDB *pdb, PDB *start, PDB *next);
+BOOL FindOrientation(PDB *start, PDB *next, ORIENTATION *orient);
+BOOL FindN_Orientation(PDB *prev, PDB *start, PDB *next,
+                       ORIENTATION *orient);
+BOOL FindCO_Orientation(PDB *start, PDB *next, ORIENTATION *orient);
+void BuildOrientation(VEC3F origin, VEC3F axis, VEC3F plane,
+                      ORIENTATION *orient);
+void OrientateVector(ORIENTATION *orient, VEC3F *vec);
+void ApplyOrientation(PDB *start, PDB *stop, ORIENTATION *orient);
 void RotateToXZ(PDB *pdb, VEC3F *n);
 void RotateToX(PDB *pdb, VEC3F *n);
 void RotateToXY(PDB *pdb, VEC3F *c_beta);
@@ -0,0 +1,395 @@
+/*************************************************************************
+
+   Program:    checkhbond
+   File:       sparsegrid.c
+
+   Version:    V1.4
+   Date:       17.10.26
+   Function:   Sparse storage for the H-bond matrix grids
+
+**************************************************************************
+
+   Description:
+   ============
+   A residue section of a matrix file has only a few thousand non-zero
+   cells out of the MAXSIZE^3 (216,000) in a grid. A SPARSEGRID keeps
+   just the occupied cells in a list, so that walking a grid costs
+   time proportional to its occupancy, together with a hash table on
+   the cell position so that individual cells can still be probed in
+   constant time.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original
+   V1.1  17.10.26 Keeps the grid total and per-cell -log(p) energies
+   V1.2  17.10.26 Added SetBestWithinCutoff()
+   V1.3  17.10.26 Added ClearSparseGridMasked()
+   V1.4  17.10.26 Added AddSparseGridCell() for hydrogen_matrices, which
+                  counts into sparse grids
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bioplib/macros.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "hbondmat2.h"
+#include "sparsegrid.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define INITIALCELLS 1024      /* Must be a power of 2                  */
+
+/* Position of a cell in the full grid and its slot in the hash table   */
+#define CELLKEY(x,y,z) ((((x) * MAXSIZE) + (y)) * MAXSIZE + (z))
+#define CELLHASH(key, size) \
+   ((int)(((unsigned long)(key) * 2654435761UL) & ((size) - 1)))
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL GrowSparseGrid(SPARSEGRID *grid);
+
+/************************************************************************/
+SPARSEGRID *CreateSparseGrid(void)
+{
+   SPARSEGRID *grid;
+   int        i;
+
+   if((grid = (SPARSEGRID *)malloc(sizeof(SPARSEGRID)))==NULL)
+      return(NULL);
+
+   grid->ncells   = 0;
+   grid->total    = 0;
+   grid->maxcells = INITIALCELLS;
+   grid->hashsize = 2 * INITIALCELLS;
+   grid->cells    = (GRIDCELL *)malloc(grid->maxcells * sizeof(GRIDCELL));
+   grid->hash     = (int *)malloc(grid->hashsize * sizeof(int));
+
+   if((grid->cells == NULL) || (grid->hash == NULL))
+   {
+      FreeSparseGrid(grid);
+      return(NULL);
+   }
+
+   for(i=0; i<grid->hashsize; i++)
+      grid->hash[i] = (-1);
+
+   return(grid);
+}
+
+/************************************************************************/
+void FreeSparseGrid(SPARSEGRID *grid)
+{
+   if(grid == NULL)
+      return;
+   if(grid->cells != NULL)
+      free(grid->cells);
+   if(grid->hash != NULL)
+      free(grid->hash);
+   free(grid);
+}
+
+/************************************************************************/
+/* Empties a grid. Only the hash slots in use are reset, so this costs
+   time proportional to the occupancy rather than the table size
+*/
+void ClearSparseGrid(SPARSEGRID *grid)
+{
+   int      i, slot;
+   GRIDCELL *c;
+
+   for(i=0, c=grid->cells; i<grid->ncells; i++, c++)
+   {
+      slot = CELLHASH(CELLKEY(c->x, c->y, c->z), grid->hashsize);
+      while(grid->hash[slot] != (-1))
+      {
+         grid->hash[slot] = (-1);
+         slot = (slot + 1) & (grid->hashsize - 1);
+      }
+   }
+   grid->ncells = 0;
+   grid->total  = 0;
+}
+
+/************************************************************************/
+/* Returns the index in grid->cells[] of cell x,y,z or -1 if it is not
+   occupied. The coordinates must be valid grid coordinates.
+*/
+int SparseGridLookup(SPARSEGRID *grid, int x, int y, int z)
+{
+   int      key  = CELLKEY(x, y, z),
+            slot = CELLHASH(key, grid->hashsize),
+            i;
+   GRIDCELL *c;
+
+   while((i = grid->hash[slot]) != (-1))
+   {
+      c = grid->cells + i;
+      if(CELLKEY(c->x, c->y, c->z) == key)
+         return(i);
+      slot = (slot + 1) & (grid->hashsize - 1);
+   }
+   return(-1);
+}
+
+/************************************************************************/
+/* Returns the count in cell x,y,z (0 if unoccupied)                    */
+int SparseGridCount(SPARSEGRID *grid, int x, int y, int z)
+{
+   int i;
+
+   if((i = SparseGridLookup(grid, x, y, z)) == (-1))
+      return(0);
+   return(grid->cells[i].count);
+}
+
+/************************************************************************/
+/* Returns cell x,y,z if it is occupied with a non-zero count, otherwise
+   NULL
+*/
+GRIDCELL *SparseGridCell(SPARSEGRID *grid, int x, int y, int z)
+{
+   int i;
+
+   if(((i = SparseGridLookup(grid, x, y, z)) == (-1)) ||
+      (grid->cells[i].count <= 0))
+      return(NULL);
+   return(grid->cells + i);
+}
+
+/************************************************************************/
+/* Sets the count in cell x,y,z to zero if it is occupied. The cell stays
+   in the list.
+*/
+void ClearSparseGridCell(SPARSEGRID *grid, int x, int y, int z)
+{
+   int i;
+
+   if((i = SparseGridLookup(grid, x, y, z)) != (-1))
+   {
+      grid->total         -= grid->cells[i].count;
+      grid->cells[i].count = 0;
+   }
+}
+
+/************************************************************************/
+/* Sets the count to zero in each occupied cell marked in 'mask' (see
+   SETGRIDMASK). This is the same as calling ClearSparseGridCell() for
+   every marked cell, but costs time proportional to the occupancy.
+*/
+void ClearSparseGridMasked(SPARSEGRID *grid, unsigned char *mask)
+{
+   int      i;
+   GRIDCELL *c;
+
+   for(i=0, c=grid->cells; i<grid->ncells; i++, c++)
+   {
+      if(GRIDMASKSET(mask, c->x, c->y, c->z))
+      {
+         grid->total -= c->count;
+         c->count     = 0;
+      }
+   }
+}
+
+/************************************************************************/
+/* Sets the count in cell x,y,z, adding the cell if it is not already
+   occupied. Returns FALSE if memory runs out.
+*/
+BOOL SetSparseGridCell(SPARSEGRID *grid, int x, int y, int z, int count)
+{
+   int      i, slot;
+   GRIDCELL *c;
+
+   if((i = SparseGridLookup(grid, x, y, z)) != (-1))
+   {
+      grid->total         += count - grid->cells[i].count;
+      grid->cells[i].count = count;
+      return(TRUE);
+   }
+
+   /* Keep the hash table at most half full                            */
+   if(grid->ncells == grid->maxcells)
+   {
+      if(!GrowSparseGrid(grid))
+         return(FALSE);
+   }
+
+   c = grid->cells + grid->ncells;
+   c->x     = (unsigned char)x;
+   c->y     = (unsigned char)y;
+   c->z     = (unsigned char)z;
+   c->pad    = 0;
+   c->count  = count;
+   c->energy = 0.0;
+   grid->total += count;
+
+   slot = CELLHASH(CELLKEY(x, y, z), grid->hashsize);
+   while(grid->hash[slot] != (-1))
+      slot = (slot + 1) & (grid->hashsize - 1);
+   grid->hash[slot] = grid->ncells++;
+
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Adds count to the count in cell x,y,z, adding the cell if it is not
+   already occupied. Returns FALSE if memory runs out.
+*/
+BOOL AddSparseGridCell(SPARSEGRID *grid, int x, int y, int z, int count)
+{
+   int i;
+
+   if((i = SparseGridLookup(grid, x, y, z)) != (-1))
+   {
+      grid->cells[i].count += count;
+      grid->total          += count;
+      return(TRUE);
+   }
+   return(SetSparseGridCell(grid, x, y, z, count));
+}
+
+/************************************************************************/
+/* Sum of the counts over the grid                                      */
+int SparseGridTotal(SPARSEGRID *grid)
+{
+   return(grid->total);
+}
+
+/************************************************************************/
+/* Sets the energy of each occupied cell to -log(count/total). This is
+   one of the two terms of the pseudoenergy of a matched pair of cells
+   (see DoCheckHBond() in checkhbond.c), so matching only has to add the
+   energies of the two cells. Must be called again if cells are changed.
+*/
+void SetSparseGridEnergies(SPARSEGRID *grid)
+{
+   int      i;
+   GRIDCELL *c;
+
+   for(i=0, c=grid->cells; i<grid->ncells; i++, c++)
+   {
+      if(c->count > 0)
+         c->energy = -log((REAL)c->count/(REAL)grid->total);
+   }
+}
+
+/************************************************************************/
+/* Fills 'best' with, for each cell within 'cutoff' of an occupied cell
+   of 'grid', the lowest energy of the occupied cells within the cutoff
+   (as set by SetSparseGridEnergies()). This is what the neighbour scan
+   in DoCheckHBond() finds when a rotated partner cell misses, so one
+   probe of 'best' replaces the scan. Returns FALSE if memory runs out.
+*/
+BOOL SetBestWithinCutoff(SPARSEGRID *best, SPARSEGRID *grid, REAL cutoff)
+{
+   int      number_of_cells = 1+(cutoff / GRIDSPACING),
+            width           = 2*number_of_cells + 1,
+            *offsets,
+            noffsets = 0,
+            i, j, k, n, b, x, y, z;
+   REAL     cutoff_squared  = cutoff * cutoff,
+            dx, dy, dz;
+   GRIDCELL *c;
+
+   ClearSparseGrid(best);
+
+   /* Offsets of the cells within the cutoff, using the same distances
+      as Distance_squared() in checkhbond.c
+   */
+   if((offsets = (int *)malloc(3 * width * width * width * sizeof(int)))
+      ==NULL)
+      return(FALSE);
+   for(i=(-number_of_cells); i<=number_of_cells; i++)
+   {
+      for(j=(-number_of_cells); j<=number_of_cells; j++)
+      {
+         for(k=(-number_of_cells); k<=number_of_cells; k++)
+         {
+            dx = (REAL)i * DIV;
+            dy = (REAL)j * DIV;
+            dz = (REAL)k * DIV;
+            if((dx*dx + dy*dy + dz*dz) <= cutoff_squared)
+            {
+               offsets[noffsets++] = i;
+               offsets[noffsets++] = j;
+               offsets[noffsets++] = k;
+            }
+         }
+      }
+   }
+
+   for(n=0, c=grid->cells; n<grid->ncells; n++, c++)
+   {
+      if(c->count <= 0)
+         continue;
+
+      for(i=0; i<noffsets; i+=3)
+      {
+         x = c->x + offsets[i];
+         y = c->y + offsets[i+1];
+         z = c->z + offsets[i+2];
+         if(!VALIDGRIDCOORDS(x, y, z))
+            continue;
+
+         if((b = SparseGridLookup(best, x, y, z)) == (-1))
+         {
+            if(!SetSparseGridCell(best, x, y, z, 1))
+            {
+               free(offsets);
+               return(FALSE);
+            }
+            best->cells[best->ncells-1].energy = c->energy;
+         }
+         else if(c->energy < best->cells[b].energy)
+         {
+            best->cells[b].energy = c->energy;
+         }
+      }
+   }
+
+   free(offsets);
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Doubles the cell list and hash table, re-inserting the cells         */
+static BOOL GrowSparseGrid(SPARSEGRID *grid)
+{
+   GRIDCELL *cells;
+   int      *hash,
+            i, slot;
+
+   if((cells = (GRIDCELL *)realloc(grid->cells, 2 * grid->maxcells *
+                                   sizeof(GRIDCELL)))==NULL)
+      return(FALSE);
+   grid->cells = cells;
+
+   if((hash = (int *)malloc(2 * grid->hashsize * sizeof(int)))==NULL)
+      return(FALSE);
+   free(grid->hash);
+   grid->hash      = hash;
+   grid->maxcells *= 2;
+   grid->hashsize *= 2;
+
+   for(i=0; i<grid->hashsize; i++)
+      grid->hash[i] = (-1);
+   for(i=0; i<grid->ncells; i++)
+   {
+      slot = CELLHASH(CELLKEY(cells[i].x, cells[i].y, cells[i].z),
+                      grid->hashsize);
+      while(grid->hash[slot] != (-1))
+         slot = (slot + 1) & (grid->hashsize - 1);
+      grid->hash[slot] = i;
+   }
+
+   return(TRUE);
+}
@@ -0,0 +1,56 @@
+#ifndef SPARSEGRID_H
+#define SPARSEGRID_H
+
+/* A MAXSIZE^3 grid of counts stored as a list of occupied cells, for
+   iteration, and an open-addressed hash of cell positions, for probing.
+   Cells whose count has been set to zero stay in the list and are
+   skipped by the callers, just as zero cells of a full grid are.
+   The total count over the grid is kept up to date as cells are set,
+   and SetSparseGridEnergies() fills in -log(count/total) for each cell.
+*/
+typedef struct
+{
+   REAL          energy;      /* -log(p) from SetSparseGridEnergies()  */
+   int           count;
+   unsigned char x, y, z, pad;
+}  GRIDCELL;
+
+typedef struct
+{
+   GRIDCELL *cells;           /* Occupied cells in order of insertion  */
+   int      *hash;            /* Index into cells[] or -1 if empty     */
+   int      ncells,
+            maxcells,
+            hashsize,         /* Always a power of 2                   */
+            total;            /* Sum of counts over the grid           */
+}  SPARSEGRID;
+
+/* A bit for each cell of a MAXSIZE^3 grid, marking cells to be cleared
+   with ClearSparseGridMasked()
+*/
+#define GRIDMASKBYTES ((MAXSIZE*MAXSIZE*MAXSIZE + 7) / 8)
+#define GRIDMASKINDEX(x,y,z) ((((x) * MAXSIZE) + (y)) * MAXSIZE + (z))
+#define SETGRIDMASK(mask,x,y,z) \
+   ((mask)[GRIDMASKINDEX(x,y,z) >> 3] |= \
+    (unsigned char)(1 << (GRIDMASKINDEX(x,y,z) & 7)))
+#define GRIDMASKSET(mask,x,y,z) \
+   ((mask)[GRIDMASKINDEX(x,y,z) >> 3] & (1 << (GRIDMASKINDEX(x,y,z) & 7)))
+
+SPARSEGRID *CreateSparseGrid(void);
+void       FreeSparseGrid(SPARSEGRID *grid);
+void       ClearSparseGrid(SPARSEGRID *grid);
+BOOL       SetSparseGridCell(SPARSEGRID *grid, int x, int y, int z,
+                             int count);
+BOOL       AddSparseGridCell(SPARSEGRID *grid, int x, int y, int z,
+                             int count);
+int        SparseGridLookup(SPARSEGRID *grid, int x, int y, int z);
+int        SparseGridCount(SPARSEGRID *grid, int x, int y, int z);
+GRIDCELL   *SparseGridCell(SPARSEGRID *grid, int x, int y, int z);
+void       ClearSparseGridCell(SPARSEGRID *grid, int x, int y, int z);
+void       ClearSparseGridMasked(SPARSEGRID *grid, unsigned char *mask);
+int        SparseGridTotal(SPARSEGRID *grid);
+void       SetSparseGridEnergies(SPARSEGRID *grid);
+BOOL       SetBestWithinCutoff(SPARSEGRID *best, SPARSEGRID *grid,
+                               REAL cutoff);
+
+#endif
@@ -0,0 +1,344 @@
+/*************************************************************************
+
+   Program:    hydrogen_matrices
+   File:       strcache.c
+
+   Version:    V1.2
+   Date:       17.10.26
+   Function:   On-disk cache of structures with hydrogens added
+
+**************************************************************************
+
+   Description:
+   ============
+   Each hydrogen_matrices build (SCSC, SCMC, Ndonor, Oacceptor) reads
+   every structure in the CATH list, strips the hydrogens and adds them
+   back with the PGP file, and does so again each time the matrices
+   are rebuilt. With a cache directory (hydrogen_matrices -c) each
+   structure is saved as prepared, and later builds load it directly.
+
+   Entries are checked against the size and modification time of the
+   source file and a hash of the PGP file, so a changed structure or
+   hydrogen placement is prepared again. The fields of the atoms which
+   the builder uses are stored exactly as they were in memory, so a
+   build from the cache gives the same matrices. Pointers are not
+   stored: the records read back are cleared first, so every pointer
+   in them (whatever the bioplib version has) is NULL.
+
+   Entries are written to a temporary file which is then renamed, so a
+   reader (or another build running at the same time) never sees a
+   partly written entry.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original
+   V1.1  17.10.26 SourceStat() is no longer static, for contrib.c
+   V1.2  17.10.26 Atoms are stored as STRATOMs, with the fields used
+                  and no pointers, rather than as whole PDB records
+
+*************************************************************************/
+/* Includes
+*/
+#define _POSIX_C_SOURCE 200809L /* For stat(), mkdir() and mkstemp()   */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bioplib/macros.h"
+#include "bioplib/pdb.h"
+#include "bioplib/MathType.h"
+#include "bioplib/SysDefs.h"
+#include "strcache.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define FNV_BASIS  2166136261UL
+#define FNV_PRIME  16777619UL
+#define FNV_STEP(h, c) (h) = ((((h) ^ (unsigned char)(c)) * FNV_PRIME) \
+                              & 0xffffffffUL)
+
+/************************************************************************/
+/* Prototypes
+*/
+static char *CacheFileName(char *cachedir, char *location, char chain);
+static BOOL ReadCacheHeader(FILE *fp, char *location, char chain,
+                            unsigned long pgphash, STRHEADER *header);
+static void PackAtom(STRATOM *atom, PDB *p);
+static void UnpackAtom(PDB *p, STRATOM *atom);
+static void CopyName(char *out, int outsize, char *in);
+
+/************************************************************************/
+/* Returns a hash of the contents of the PGP file, which is rewound     */
+unsigned long HashPGPFile(FILE *fp)
+{
+   unsigned long hash = FNV_BASIS;
+   int           c;
+
+   rewind(fp);
+   while((c = getc(fp)) != EOF)
+      FNV_STEP(hash, c);
+   rewind(fp);
+
+   return(hash);
+}
+
+/************************************************************************/
+/* Returns the prepared structure for a source file and chain from the
+   cache, or NULL if there is no up-to-date entry
+*/
+PDB *ReadCachedStructure(char *cachedir, char *location, char chain,
+                         unsigned long pgphash)
+{
+   STRHEADER header;
+   STRATOM   atom;
+   FILE      *fp;
+   PDB       *pdb = NULL,
+             *p   = NULL;
+   char      *filename;
+   int       i;
+
+   if((filename = CacheFileName(cachedir, location, chain)) == NULL)
+      return(NULL);
+   fp = fopen(filename, "rb");
+   free(filename);
+   if(fp == NULL)
+      return(NULL);
+
+   if(ReadCacheHeader(fp, location, chain, pgphash, &header))
+   {
+      for(i=0; i<header.natoms; i++)
+      {
+         if(pdb == NULL)
+         {
+            INIT(pdb, PDB);
+            p = pdb;
+         }
+         else
+         {
+            ALLOCNEXT(p, PDB);
+         }
+         if((p == NULL) || (fread(&atom, sizeof(STRATOM), 1, fp) != 1))
+         {
+            if(pdb != NULL) FREELIST(pdb, PDB);
+            break;
+         }
+         UnpackAtom(p, &atom);
+      }
+   }
+
+   fclose(fp);
+   return(pdb);
+}
+
+/************************************************************************/
+/* Saves a prepared structure in the cache. Returns FALSE if it could
+   not be written (the build goes on without it)
+*/
+BOOL WriteCachedStructure(char *cachedir, char *location, char chain,
+                          unsigned long pgphash, PDB *pdb)
+{
+   STRHEADER header;
+   STRATOM   atom;
+   FILE      *fp;
+   PDB       *p;
+   char      *filename,
+             *tempname;
+   int       fd;
+   BOOL      ok;
+
+   memset(&header, 0, sizeof(STRHEADER));
+   if(!SourceStat(location, &header.srcsize, &header.srcmtime))
+      return(FALSE);
+   strcpy(header.magic, STR_MAGIC);
+   header.byteorder = STR_BYTEORDER;
+   header.format    = STR_FORMAT;
+   header.atomsize  = sizeof(STRATOM);
+   header.pathlen   = strlen(location);
+   header.pgphash   = pgphash;
+   header.chain     = chain;
+   for(p=pdb; p!=NULL; NEXT(p))
+      header.natoms++;
+
+   if((filename = CacheFileName(cachedir, location, chain)) == NULL)
+      return(FALSE);
+   if((tempname = (char *)malloc(strlen(filename) + 8)) == NULL)
+   {
+      free(filename);
+      return(FALSE);
+   }
+   sprintf(tempname, "%s.XXXXXX", filename);
+
+   mkdir(cachedir, 0777);        /* Fails harmlessly if it exists       */
+   if(((fd = mkstemp(tempname)) == (-1)) ||
+      ((fp = fdopen(fd, "wb")) == NULL))
+   {
+      if(fd != (-1))
+      {
+         close(fd);
+         remove(tempname);
+      }
+      free(filename);
+      free(tempname);
+      return(FALSE);
+   }
+
+   ok = ((fwrite(&header, sizeof(STRHEADER), 1, fp) == 1) &&
+         (fwrite(location, 1, header.pathlen, fp) ==
+          (size_t)header.pathlen));
+   for(p=pdb; ok && (p!=NULL); NEXT(p))
+   {
+      PackAtom(&atom, p);
+      ok = (fwrite(&atom, sizeof(STRATOM), 1, fp) == 1);
+   }
+   if(fclose(fp) != 0)
+      ok = FALSE;
+
+   if(!ok || rename(tempname, filename))
+   {
+      remove(tempname);
+      ok = FALSE;
+   }
+
+   free(filename);
+   free(tempname);
+   return(ok);
+}
+
+/************************************************************************/
+/* The cache file for a source file and chain: an FNV-1a hash of the
+   two. Entries which share a name replace each other, which only
+   costs preparing the structure again.
+*/
+static char *CacheFileName(char *cachedir, char *location, char chain)
+{
+   unsigned long hash = FNV_BASIS;
+   char          *filename,
+                 *c;
+
+   for(c=location; *c; c++)
+      FNV_STEP(hash, *c);
+   FNV_STEP(hash, chain);
+
+   if((filename = (char *)malloc(strlen(cachedir) + 16)) != NULL)
+      sprintf(filename, "%s/%08lx.hbs", cachedir, hash);
+   return(filename);
+}
+
+/************************************************************************/
+/* Gets the size and modification time of a source file. Also used to
+   check the entries of the contribution store (contrib.c)
+*/
+BOOL SourceStat(char *location, long *size, long *mtime)
+{
+   struct stat st;
+
+   if(stat(location, &st))
+      return(FALSE);
+   *size  = (long)st.st_size;
+   *mtime = (long)st.st_mtime;
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Reads the header and source path of a cache entry and checks that
+   they match the structure wanted
+*/
+static BOOL ReadCacheHeader(FILE *fp, char *location, char chain,
+                            unsigned long pgphash, STRHEADER *header)
+{
+   char *path;
+   long size, mtime;
+   BOOL ok;
+
+   if((fread(header, sizeof(STRHEADER), 1, fp) != 1)     ||
+      strncmp(header->magic, STR_MAGIC, sizeof(STR_MAGIC)) ||
+      (header->byteorder != STR_BYTEORDER)                 ||
+      (header->format    != STR_FORMAT)                    ||
+      (header->atomsize  != (int)sizeof(STRATOM))          ||
+      (header->pgphash   != pgphash)                       ||
+      (header->chain     != chain)                         ||
+      (header->pathlen   != (int)strlen(location))         ||
+      (header->natoms    <= 0))
+      return(FALSE);
+
+   if(!SourceStat(location, &size, &mtime) ||
+      (header->srcsize != size) || (header->srcmtime != mtime))
+      return(FALSE);
+
+   if((path = (char *)malloc(header->pathlen + 1)) == NULL)
+      return(FALSE);
+   ok = ((fread(path, 1, header->pathlen, fp) ==
+          (size_t)header->pathlen) &&
+         !strncmp(path, location, header->pathlen));
+   free(path);
+
+   return(ok);
+}
+
+/************************************************************************/
+/* Copies the fields of a PDB record which are stored into an STRATOM.
+   The STRATOM is cleared first so that the padding written is always
+   the same
+*/
+static void PackAtom(STRATOM *atom, PDB *p)
+{
+   memset(atom, 0, sizeof(STRATOM));
+   atom->x      = p->x;
+   atom->y      = p->y;
+   atom->z      = p->z;
+   atom->occ    = p->occ;
+   atom->bval   = p->bval;
+   atom->atnum  = p->atnum;
+   atom->resnum = p->resnum;
+   atom->altpos = p->altpos;
+   CopyName(atom->record_type, STR_NAMELEN, p->record_type);
+   CopyName(atom->atnam,       STR_NAMELEN, p->atnam);
+   CopyName(atom->atnam_raw,   STR_NAMELEN, p->atnam_raw);
+   CopyName(atom->resnam,      STR_NAMELEN, p->resnam);
+   CopyName(atom->insert,      STR_NAMELEN, p->insert);
+   CopyName(atom->chain,       STR_NAMELEN, p->chain);
+   CopyName(atom->element,     STR_NAMELEN, p->element);
+}
+
+/************************************************************************/
+/* Fills a PDB record from an STRATOM. The record is cleared first, so
+   every pointer in it is NULL and every count of them 0
+*/
+static void UnpackAtom(PDB *p, STRATOM *atom)
+{
+   memset(p, 0, sizeof(PDB));
+   p->x      = atom->x;
+   p->y      = atom->y;
+   p->z      = atom->z;
+   p->occ    = atom->occ;
+   p->bval   = atom->bval;
+   p->atnum  = atom->atnum;
+   p->resnum = atom->resnum;
+   p->altpos = atom->altpos;
+   CopyName(p->record_type, sizeof(p->record_type), atom->record_type);
+   CopyName(p->atnam,       sizeof(p->atnam),       atom->atnam);
+   CopyName(p->atnam_raw,   sizeof(p->atnam_raw),   atom->atnam_raw);
+   CopyName(p->resnam,      sizeof(p->resnam),      atom->resnam);
+   CopyName(p->insert,      sizeof(p->insert),      atom->insert);
+   CopyName(p->chain,       sizeof(p->chain),       atom->chain);
+   CopyName(p->element,     sizeof(p->element),     atom->element);
+}
+
+/************************************************************************/
+/* Copies a string into a buffer of outsize characters, cutting it
+   short if need be
+*/
+static void CopyName(char *out, int outsize, char *in)
+{
+   int len = strlen(in);
+
+   if(len > outsize-1)
+      len = outsize-1;
+   memcpy(out, in, len);
+   out[len] = '\0';
+}
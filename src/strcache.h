@@ -0,0 +1,69 @@
+#ifndef STRCACHE_H
+#define STRCACHE_H
+
+/* On-disk cache of structures prepared for hydrogen_matrices (read,
+   chain taken, hydrogens stripped and added again) (strcache.c).
+
+   One file per source file and chain, in the cache directory, named
+   from a hash of the two. Layout (native byte order, as matfile.h):
+
+      STRHEADER
+      char[pathlen]               Source file the structure came from
+      STRATOM[natoms]             The atoms
+
+   An entry is used only if the source path, chain, size and
+   modification time and the hash of the PGP file all match, and the
+   file was written by a program with the same STRATOM structure.
+
+   Only the fields of the PDB records which the builder uses are
+   stored, never the pointers in them (next, extras, and in bioplib
+   versions which have them the CONECT pointers), which would mean
+   nothing to the process reading the entry.
+
+   The header relies on bioplib/pdb.h having been included.
+*/
+
+#define STR_MAGIC      "CHBSTRC"
+#define STR_BYTEORDER  0x01020304
+#define STR_FORMAT     2
+#define STR_NAMELEN    8
+
+/* An atom as stored in a cache entry                                   */
+typedef struct
+{
+   REAL x, y, z, occ, bval;
+   int  atnum, resnum;
+   char record_type[STR_NAMELEN],
+        atnam[STR_NAMELEN],
+        atnam_raw[STR_NAMELEN],
+        resnam[STR_NAMELEN],
+        insert[STR_NAMELEN],
+        chain[STR_NAMELEN],
+        element[STR_NAMELEN],
+        altpos,
+        pad[7];
+}  STRATOM;
+
+typedef struct
+{
+   char          magic[8];
+   int           byteorder,
+                 format,
+                 atomsize,            /* sizeof(STRATOM) of the writer */
+                 natoms,
+                 pathlen;
+   long          srcsize,
+                 srcmtime;
+   unsigned long pgphash;
+   char          chain,               /* '\0' for the whole file       */
+                 pad[7];
+}  STRHEADER;
+
+unsigned long HashPGPFile(FILE *fp);
+BOOL SourceStat(char *location, long *size, long *mtime);
+PDB  *ReadCachedStructure(char *cachedir, char *location, char chain,
+                          unsigned long pgphash);
+BOOL WriteCachedStructure(char *cachedir, char *location, char chain,
+                          unsigned long pgphash, PDB *pdb);
+
+#endif
@@ -0,0 +1,48 @@
+# Batch mode (-b) should give the same results as running each query on
+# its own. Prints OK or FAILED
+EXE=../../bin/checkhbond
+SCMAT=../../data/hbmatricesS35.dat
+TMP=/tmp/testbatch.$$
+
+cat > $TMP.lst << LIST
+1tsrB.pdb B126 B131 ASN
+1tsrB.pdb B127 B282 ARG
+1tsrB.pdb B127 B286 GLU
+1tsrB.pdb B132 B271 GLU
+1tsrB.pdb B140 B198 GLU
+1tsrB.pdb B155 B259 ASP
+1tsrB.pdb B183 B175 ARG
+1tsrB.pdb B236 B253 THR
+1tsrB.pdb B131 B126 TYR
+1tsrB.pdb B282 B127 SER
+1tsrB.pdb B207 B214 HIS
+1tsrB.pdb B126 B131 GLY
+1tsrB.pdb B126 B131 PHE
+1tsrB.pdb B280 B281 ASP
+1tsrB.pdb B280 B999 ASP
+LIST
+
+$EXE -c 0.5 -m $SCMAT -b $TMP.lst $TMP.batch 2>/dev/null
+
+# The same queries one at a time, written as batch output lines
+echo "# pdbfile residue1 residue2 nameres2 cutoff result energy" > $TMP.single
+while read pdb res1 res2 nameres2
+do
+   if $EXE -c 0.5 -m $SCMAT $pdb $res1 $res2 $nameres2 > $TMP.out 2>/dev/null
+   then
+      result=`awk '/\(valid\)/ {print "valid", $(NF-1); found=1}
+                   END {if(!found) print "none -"}' $TMP.out`
+   else
+      result="error -"
+   fi
+   echo "$pdb $res1 $res2 $nameres2 0.50 $result" >> $TMP.single
+done < $TMP.lst
+
+if diff $TMP.single $TMP.batch
+then
+   echo "Batch mode: OK"
+else
+   echo "Batch mode: FAILED"
+fi
+
+rm -f $TMP.lst $TMP.batch $TMP.single $TMP.out
@@ -0,0 +1,17 @@
+# Builds SC/SC matrices from chain B of 1tsr (1tsr.cath). The chain is
+# taken from the PDB file in memory, and the matrices should be those
+# in testchains.mat, which were built by running getchain. Needs
+# DATADIR set as for hydrogen_matrices. Prints OK or FAILED
+EXE=../../bin/hydrogen_matrices
+TMP=/tmp/testchains.$$
+
+$EXE 1tsr.cath $TMP.mat > /dev/null 2>&1
+
+if diff testchains.mat $TMP.mat > /dev/null
+then
+   echo "Chain extraction: OK"
+else
+   echo "Chain extraction: FAILED"
+fi
+
+rm -f $TMP.mat
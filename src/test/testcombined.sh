@@ -0,0 +1,47 @@
+# Combined mode (-M) should give the same results as checkhbond,
+# checkhbond_Ndonor and checkhbond_Oacceptor run separately. Prints OK
+# or FAILED
+BIN=../../bin
+SCMAT=../../data/hbmatricesS35.dat
+SCMCMAT=../../data/hbmatricesS35_SCMC.dat
+NMAT=../../data/hbmatricesS35_N.dat
+OMAT=../../data/hbmatricesS35_O.dat
+TMP=/tmp/testcombined.$$
+
+: > $TMP.combined
+: > $TMP.single
+for query in "B126 B131 ASN" "B183 B175 ARG" "B202 B200 ASN" \
+             "B263 B261 SER" "B184 B183 SER" "B280 B284 THR" \
+             "B118 B283 ARG" "B221 B230 THR" "B126 B131 GLY"
+do
+   $BIN/checkhbond -c 0.5 -M $SCMAT $SCMCMAT $NMAT $OMAT 1tsrB.pdb \
+      $query 2>/dev/null | grep -v '^#' | sed "s/^/$query /" \
+      >> $TMP.combined
+
+   for kind in scsc ndonor oacceptor
+   do
+      case $kind in
+      scsc)      EXE="$BIN/checkhbond -m $SCMAT" ;;
+      ndonor)    EXE="$BIN/checkhbond_Ndonor -m $SCMCMAT -n $NMAT" ;;
+      oacceptor) EXE="$BIN/checkhbond_Oacceptor -m $SCMCMAT -n $OMAT" ;;
+      esac
+
+      if $EXE -c 0.5 1tsrB.pdb $query > $TMP.out 2>/dev/null
+      then
+         result=`awk '/\(valid\)/ {print "valid", $(NF-1); found=1}
+                      END {if(!found) print "none -"}' $TMP.out`
+      else
+         result="error -"
+      fi
+      echo "$query $kind $result" >> $TMP.single
+   done
+done
+
+if [ -s $TMP.combined ] && diff $TMP.single $TMP.combined
+then
+   echo "Combined mode: OK"
+else
+   echo "Combined mode: FAILED"
+fi
+
+rm -f $TMP.combined $TMP.single $TMP.out
@@ -0,0 +1,63 @@
+# Runs the pairs from testscsc.sh, testmcdonor.sh and testmcacceptor.sh
+# with the text matrices and with the same matrices compiled by
+# compile_matrices. Both should give the results in testculling.out,
+# which were recorded before culled cells were marked from a table of
+# offsets. Prints OK or FAILED
+BIN=../../bin
+DATA=../../data
+TMP=/tmp/testculling.$$
+
+for kind in scsc ndonor oacceptor
+do
+   case $kind in
+   scsc)      script=testscsc.sh ;;
+   ndonor)    script=testmcdonor.sh ;;
+   oacceptor) script=testmcacceptor.sh ;;
+   esac
+   grep '^\$EXE' $script | awk -v k=$kind '{print k, $(NF-2), $(NF-1), $NF}'
+done > $TMP.lst
+
+for matrix in hbmatricesS35 hbmatricesS35_SCMC hbmatricesS35_N \
+              hbmatricesS35_O
+do
+   $BIN/compile_matrices $DATA/$matrix.dat $TMP.$matrix.bin
+done
+
+for form in text compiled
+do
+   if [ $form = text ]
+   then
+      SCMAT=$DATA/hbmatricesS35.dat
+      SCMCMAT=$DATA/hbmatricesS35_SCMC.dat
+      NMAT=$DATA/hbmatricesS35_N.dat
+      OMAT=$DATA/hbmatricesS35_O.dat
+   else
+      SCMAT=$TMP.hbmatricesS35.bin
+      SCMCMAT=$TMP.hbmatricesS35_SCMC.bin
+      NMAT=$TMP.hbmatricesS35_N.bin
+      OMAT=$TMP.hbmatricesS35_O.bin
+   fi
+
+   while read kind res1 res2 nameres2
+   do
+      case $kind in
+      scsc)      EXE="$BIN/checkhbond -m $SCMAT" ;;
+      ndonor)    EXE="$BIN/checkhbond_Ndonor -m $SCMCMAT -n $NMAT" ;;
+      oacceptor) EXE="$BIN/checkhbond_Oacceptor -m $SCMCMAT -n $OMAT" ;;
+      esac
+      for cutoff in 0.25 0.5
+      do
+         echo "$kind $res1 $res2 $nameres2 $cutoff"
+         $EXE -c $cutoff 1tsrB.pdb $res1 $res2 $nameres2 2>/dev/null
+      done
+   done < $TMP.lst > $TMP.$form
+
+   if diff testculling.out $TMP.$form
+   then
+      echo "Culling with $form matrices: OK"
+   else
+      echo "Culling with $form matrices: FAILED"
+   fi
+done
+
+rm -f $TMP.lst $TMP.text $TMP.compiled $TMP.*.bin
@@ -0,0 +1,58 @@
+# A gzip-compressed PDB file (and batch list) should give the same
+# results as the plain file, for single queries, batch mode (-b) and
+# scan mode (-a). Scan mode needs DATADIR set as for checkhbond -a.
+# Prints OK or FAILED
+EXE=../../bin/checkhbond
+SCMAT=../../data/hbmatricesS35.dat
+TMP=/tmp/testgzip.$$
+
+cp 1tsrB.pdb $TMP.pdb
+gzip -c 1tsrB.pdb > $TMP.pdb.gz
+
+for pdb in $TMP.pdb $TMP.pdb.gz
+do
+   for query in "B126 B131 ASN" "B127 B282 ARG" "B183 B175 ARG" \
+                "B236 B253 THR" "B126 B131 GLY"
+   do
+      $EXE -c 0.5 -m $SCMAT $pdb $query 2>&1
+   done > $pdb.single
+done
+if diff $TMP.pdb.single $TMP.pdb.gz.single
+then
+   echo "Compressed PDB file, single queries: OK"
+else
+   echo "Compressed PDB file, single queries: FAILED"
+fi
+
+# The compressed batch list names the compressed PDB file
+for pdb in $TMP.pdb $TMP.pdb.gz
+do
+   for query in "B126 B131 ASN" "B127 B282 ARG" "B183 B175 ARG"
+   do
+      echo "$pdb $query"
+   done > $pdb.lst
+done
+gzip $TMP.pdb.gz.lst
+$EXE -c 0.5 -m $SCMAT -b $TMP.pdb.lst 2>/dev/null | sed 's/\.gz / /' \
+   > $TMP.pdb.batch
+$EXE -c 0.5 -m $SCMAT -b $TMP.pdb.gz.lst.gz 2>/dev/null | \
+   sed 's/\.gz / /' > $TMP.pdb.gz.batch
+if diff $TMP.pdb.batch $TMP.pdb.gz.batch
+then
+   echo "Compressed PDB file and list, batch mode: OK"
+else
+   echo "Compressed PDB file and list, batch mode: FAILED"
+fi
+
+$EXE -c 0.5 -m $SCMAT -a $TMP.pdb $TMP.pdb.scan 2>/dev/null
+$EXE -c 0.5 -m $SCMAT -a $TMP.pdb.gz $TMP.pdb.gz.scan 2>/dev/null
+if [ -s $TMP.pdb.scan ] && diff $TMP.pdb.scan $TMP.pdb.gz.scan
+then
+   echo "Compressed PDB file, scan mode: OK"
+else
+   echo "Compressed PDB file, scan mode: FAILED"
+fi
+
+rm -f $TMP.pdb $TMP.pdb.gz $TMP.pdb.single $TMP.pdb.gz.single \
+      $TMP.pdb.lst $TMP.pdb.gz.lst.gz $TMP.pdb.batch $TMP.pdb.gz.batch \
+      $TMP.pdb.scan $TMP.pdb.gz.scan
@@ -0,0 +1,34 @@
+# Builds the matrices in three parts (-p) and merges them with
+# merge_matrices; the result should be the matrices built over the
+# whole domain list. Needs DATADIR set as for hydrogen_matrices.
+# Prints OK or FAILED
+BIN=../../bin
+TMP=/tmp/testmerge.$$
+
+cat > $TMP.cath << LIST
+1tsrB0     2    60    40   720     2     1     2   196 0.90
+3pga20     3    40    50    40     1     4     1   114 2.00
+3pga30     3    40    50    40     1     4     1   114 2.00
+3pga41     3    40    50  1170     1     2     2   214 2.00
+1tsr00     3    40    50  1170     1     2     2   214 2.00
+LIST
+
+for program in hydrogen_matrices hydrogen_matrices_SCMC \
+               hydrogen_matrices_Ndonor hydrogen_matrices_Oacceptor
+do
+   $BIN/$program $TMP.cath $TMP.whole > /dev/null 2>&1
+   for part in 1 2 3
+   do
+      $BIN/$program -p $part/3 $TMP.cath $TMP.part$part > /dev/null 2>&1
+   done
+   $BIN/merge_matrices -o $TMP.merged $TMP.part1 $TMP.part2 $TMP.part3
+
+   if [ -s $TMP.whole ] && diff $TMP.whole $TMP.merged > /dev/null
+   then
+      echo "Merged $program: OK"
+   else
+      echo "Merged $program: FAILED"
+   fi
+done
+
+rm -f $TMP.cath $TMP.whole $TMP.part1 $TMP.part2 $TMP.part3 $TMP.merged
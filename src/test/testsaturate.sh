@@ -0,0 +1,32 @@
+# Saturation mode (-s) should give the same results as a run for each
+# residue type at residue 2. Prints OK or FAILED
+EXE=../../bin/checkhbond
+SCMAT=../../data/hbmatricesS35.dat
+TMP=/tmp/testsaturate.$$
+
+: > $TMP.sat
+: > $TMP.single
+for pair in "B126 B131" "B127 B282" "B132 B271" "B183 B175" "B236 B253"
+do
+   set -- $pair
+   $EXE -c 0.5 -m $SCMAT -s 1tsrB.pdb $1 $2 2>/dev/null | grep -v '^#' \
+      >> $TMP.sat
+
+   # The residue types tried are those given by -s
+   for type in `awk -v r="$1 $2" '$1" "$2 == r {print $3}' $TMP.sat`
+   do
+      result=`$EXE -c 0.5 -m $SCMAT 1tsrB.pdb $1 $2 $type 2>/dev/null | \
+              awk '/\(valid\)/ {print "valid", $(NF-1); found=1}
+                   END {if(!found) print "none -"}'`
+      echo "$1 $2 $type $result" >> $TMP.single
+   done
+done
+
+if [ -s $TMP.sat ] && diff $TMP.single $TMP.sat
+then
+   echo "Saturation mode: OK"
+else
+   echo "Saturation mode: FAILED"
+fi
+
+rm -f $TMP.sat $TMP.single
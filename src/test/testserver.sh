@@ -0,0 +1,73 @@
+# pair requests to checkhbond_server should give the same results as
+# checkhbond, checkhbond_Ndonor and checkhbond_Oacceptor. Prints OK or
+# FAILED
+BIN=../../bin
+SERVER=$BIN/checkhbond_server
+SCMAT=../../data/hbmatricesS35.dat
+SCMCMAT=../../data/hbmatricesS35_SCMC.dat
+NMAT=../../data/hbmatricesS35_N.dat
+OMAT=../../data/hbmatricesS35_O.dat
+TMP=/tmp/testserver.$$
+SOCKET=$TMP.sock
+
+$SERVER -m $SCMAT -s $SCMCMAT -n $NMAT -o $OMAT -t 2 $SOCKET &
+SERVERPID=$!
+tries=0
+while [ ! -S $SOCKET ] && [ $tries -lt 50 ]
+do
+   sleep 0.1
+   tries=`expr $tries + 1`
+done
+
+cat > $TMP.lst << LIST
+scsc B126 B131 ASN
+scsc B127 B282 ARG
+scsc B132 B271 GLU
+scsc B183 B175 ARG
+scsc B126 B131 GLY
+scsc B280 B999 ASP
+ndonor B202 B200 ASN
+ndonor B263 B261 SER
+ndonor B184 B183 SER
+ndonor B260 B259 ASP
+oacceptor B280 B284 THR
+oacceptor B118 B283 ARG
+oacceptor B184 B183 SER
+oacceptor B221 B230 THR
+LIST
+
+: > $TMP.server
+: > $TMP.single
+while read kind res1 res2 nameres2
+do
+   case $kind in
+   scsc)      EXE="$BIN/checkhbond -m $SCMAT" ;;
+   ndonor)    EXE="$BIN/checkhbond_Ndonor -m $SCMCMAT -n $NMAT" ;;
+   oacceptor) EXE="$BIN/checkhbond_Oacceptor -m $SCMCMAT -n $OMAT" ;;
+   esac
+
+   # The server's reply without the OK line and any messages
+   $SERVER -q $SOCKET pair $kind 1tsrB.pdb $res1 $res2 $nameres2 0.5 | \
+      awk 'NR==1 && !/^OK/ {print "error -"} NR>1 && !/^#/' | \
+      sed "s/^/$kind $res1 $res2 $nameres2 /" >> $TMP.server
+
+   if $EXE -c 0.5 1tsrB.pdb $res1 $res2 $nameres2 > $TMP.out 2>/dev/null
+   then
+      result=`awk '/\(valid\)/ {print "valid", $(NF-1); found=1}
+                   END {if(!found) print "none -"}' $TMP.out`
+   else
+      result="error -"
+   fi
+   echo "$kind $res1 $res2 $nameres2 $result" >> $TMP.single
+done < $TMP.lst
+
+kill $SERVERPID
+
+if diff $TMP.single $TMP.server
+then
+   echo "Server pair requests: OK"
+else
+   echo "Server pair requests: FAILED"
+fi
+
+rm -f $TMP.lst $TMP.server $TMP.single $TMP.out $SOCKET
@@ -0,0 +1,38 @@
+# Batch (-b) and scan (-a) modes should give the same output on one
+# thread as on eight. Scan mode needs DATADIR set as for checkhbond -a.
+# Prints OK or FAILED
+EXE=../../bin/checkhbond
+SCMAT=../../data/hbmatricesS35.dat
+TMP=/tmp/testthreads.$$
+
+for pdb in 1tsrB.pdb mytest.pdb
+do
+   for pair in "B126 B131" "B127 B282" "B132 B271" "B183 B175" \
+               "B236 B253" "B280 B281" "B140 B198" "B146 B144"
+   do
+      for type in SER THR ASN GLN TYR HIS
+      do
+         echo "$pdb $pair $type"
+      done
+   done
+done > $TMP.lst
+
+$EXE -c 0.5 -m $SCMAT -t 1 -b $TMP.lst $TMP.b1 2>/dev/null
+$EXE -c 0.5 -m $SCMAT -t 8 -b $TMP.lst $TMP.b8 2>/dev/null
+if diff $TMP.b1 $TMP.b8
+then
+   echo "Batch mode threads: OK"
+else
+   echo "Batch mode threads: FAILED"
+fi
+
+$EXE -c 0.5 -m $SCMAT -t 1 -a 1tsrB.pdb $TMP.a1 2>/dev/null
+$EXE -c 0.5 -m $SCMAT -t 8 -a 1tsrB.pdb $TMP.a8 2>/dev/null
+if [ -s $TMP.a1 ] && diff $TMP.a1 $TMP.a8
+then
+   echo "Scan mode threads: OK"
+else
+   echo "Scan mode threads: FAILED"
+fi
+
+rm -f $TMP.lst $TMP.b1 $TMP.b8 $TMP.a1 $TMP.a8
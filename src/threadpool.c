@@ -0,0 +1,502 @@
+/*************************************************************************
+
+   Program:    checkhbond
+   File:       threadpool.c
+
+   Version:    V1.1
+   Date:       17.10.26
+   Function:   Run independent queries on a pool of threads
+
+**************************************************************************
+
+   Description:
+   ============
+   Batch (-b) and scan (-a) runs are made up of many queries which
+   share nothing but the (read-only) matrix files, so they are run on
+   a pool of threads, each with its own HBCONTEXT.
+
+   The items are shared out as a contiguous block per thread, so that
+   the queries a thread runs tend to be on the same PDB file. Queries
+   take very different times (an orientation failure returns at once,
+   a large side chain fills many cells), so a thread that runs out
+   takes the second half of the block of another thread that has
+   some left. Items are never added once the pool is running, so a
+   thread that finds every block empty has nothing more to do and
+   stops.
+
+   Results are emitted as soon as they and all those before them in
+   the output order are finished, so output streams in the same order
+   as a run on a single thread.
+
+   bioplib is not thread-safe in general (the PDB reader keeps some
+   global state), so calls into it other than those made by the
+   matching code are made between BeginSerialSection() and
+   EndSerialSection().
+
+   RunPipeline() is for work where each item must first be loaded
+   (e.g. a structure read from disk). One thread loads the items in
+   order while the pool threads work on those already loaded, so the
+   disk and the processors are kept busy at the same time. No more
+   than a fixed number of loaded items wait to be used, so the loader
+   cannot run far ahead and fill memory.
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0  17.10.26 Original
+   V1.1  17.10.26 Added RunPipeline()
+
+*************************************************************************/
+/* Includes
+*/
+#define _POSIX_C_SOURCE 200112L /* For pthreads and sysconf()          */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "bioplib/SysDefs.h"
+#include "threadpool.h"
+
+/************************************************************************/
+/* Structure definitions
+*/
+/* The items still to be run by one thread: next to end-1. The owner
+   takes from the front and other threads steal from the back
+*/
+typedef struct
+{
+   pthread_mutex_t lock;
+   int             next,
+                   end;
+}  TPQUEUE;
+
+typedef struct
+{
+   TPQUEUE         *queues;
+   pthread_mutex_t emitLock;
+   TPTASK          task;
+   TPEMIT          emit;
+   void            *shared,
+                   **workers;
+   int             *rank,
+                   *itemAt;     /* Item at each output position        */
+   char            *done;       /* Finished, by output position        */
+   int             nthreads,
+                   nitems,
+                   nextEmit;
+}  THREADPOOL;
+
+typedef struct
+{
+   THREADPOOL *pool;
+   int        id;
+}  TPTHREAD;
+
+/* Loaded items waiting to be used: a ring of depth slots holding count
+   items from head
+*/
+typedef struct
+{
+   pthread_mutex_t lock;
+   pthread_cond_t  notEmpty,
+                   notFull;
+   TPLOAD          load;
+   TPUSE           use;
+   void            *shared,
+                   **workers,
+                   **loaded;
+   int             *items,
+                   depth,
+                   head,
+                   count,
+                   nitems;
+   BOOL            finished;    /* All items have been loaded          */
+}  TPPIPELINE;
+
+typedef struct
+{
+   TPPIPELINE *pipe;
+   int        id;
+}  TPSTAGE;
+
+/************************************************************************/
+/* Globals
+*/
+static pthread_mutex_t gSerialLock = PTHREAD_MUTEX_INITIALIZER;
+
+/************************************************************************/
+/* Prototypes
+*/
+static void *RunPoolThread(void *arg);
+static int  TakeItem(THREADPOOL *pool, int id);
+static int  StealItems(THREADPOOL *pool, int id);
+static void FinishItem(THREADPOOL *pool, int item);
+static void *RunLoader(void *arg);
+static void *RunUser(void *arg);
+
+/************************************************************************/
+/* Runs task() on items 0..nitems-1 using up to nthreads threads, the
+   calling thread being one of them. workers[] has per-thread data for
+   each of the nthreads threads and is passed to task() with shared.
+   If threads cannot be started the items are run by those that were.
+   Returns FALSE if there was no memory to set up the pool.
+*/
+BOOL RunThreadPool(int nthreads, int nitems, int *rank, void *shared,
+                   void **workers, TPTASK task, TPEMIT emit)
+{
+   THREADPOOL pool;
+   TPTHREAD   *threads;
+   pthread_t  *tids;
+   BOOL       *started;
+   int        i;
+
+   if(nitems <= 0)
+      return(TRUE);
+   if(nthreads > nitems)
+      nthreads = nitems;
+   if(nthreads < 1)
+      nthreads = 1;
+
+   pool.task     = task;
+   pool.emit     = emit;
+   pool.shared   = shared;
+   pool.workers  = workers;
+   pool.rank     = rank;
+   pool.nthreads = nthreads;
+   pool.nitems   = nitems;
+   pool.nextEmit = 0;
+
+   pool.queues  = (TPQUEUE *)malloc(nthreads * sizeof(TPQUEUE));
+   pool.itemAt  = (int *)malloc(nitems * sizeof(int));
+   pool.done    = (char *)calloc(nitems, sizeof(char));
+   threads      = (TPTHREAD *)malloc(nthreads * sizeof(TPTHREAD));
+   tids         = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+   started      = (BOOL *)calloc(nthreads, sizeof(BOOL));
+   if((pool.queues == NULL) || (pool.itemAt == NULL) ||
+      (pool.done == NULL) || (threads == NULL) || (tids == NULL) ||
+      (started == NULL))
+   {
+      if(pool.queues != NULL) free(pool.queues);
+      if(pool.itemAt != NULL) free(pool.itemAt);
+      if(pool.done   != NULL) free(pool.done);
+      if(threads     != NULL) free(threads);
+      if(tids        != NULL) free(tids);
+      if(started     != NULL) free(started);
+      return(FALSE);
+   }
+
+   for(i=0; i<nitems; i++)
+      pool.itemAt[(rank == NULL) ? i : rank[i]] = i;
+
+   /* Share the items out in contiguous blocks                          */
+   for(i=0; i<nthreads; i++)
+   {
+      pthread_mutex_init(&(pool.queues[i].lock), NULL);
+      pool.queues[i].next = (int)(((long)nitems * i) / nthreads);
+      pool.queues[i].end  = (int)(((long)nitems * (i+1)) / nthreads);
+      threads[i].pool     = &pool;
+      threads[i].id       = i;
+   }
+   pthread_mutex_init(&(pool.emitLock), NULL);
+
+   for(i=1; i<nthreads; i++)
+      started[i] = (pthread_create(&(tids[i]), NULL, RunPoolThread,
+                                   (void *)&(threads[i])) == 0);
+   RunPoolThread((void *)&(threads[0]));
+   for(i=1; i<nthreads; i++)
+   {
+      if(started[i])
+         pthread_join(tids[i], NULL);
+   }
+
+   for(i=0; i<nthreads; i++)
+      pthread_mutex_destroy(&(pool.queues[i].lock));
+   pthread_mutex_destroy(&(pool.emitLock));
+
+   free(pool.queues);
+   free(pool.itemAt);
+   free(pool.done);
+   free(threads);
+   free(tids);
+   free(started);
+
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Runs items from the thread's own block, then from the others, until
+   there are none left
+*/
+static void *RunPoolThread(void *arg)
+{
+   TPTHREAD   *thread = (TPTHREAD *)arg;
+   THREADPOOL *pool   = thread->pool;
+   int        item;
+
+   for(;;)
+   {
+      if(((item = TakeItem(pool, thread->id)) < 0) &&
+         ((item = StealItems(pool, thread->id)) < 0))
+         break;
+
+      (*pool->task)(pool->shared, pool->workers[thread->id], item);
+      FinishItem(pool, item);
+   }
+
+   return(NULL);
+}
+
+/************************************************************************/
+/* Takes the next item from the front of a thread's own block, or
+   returns -1 if it is empty
+*/
+static int TakeItem(THREADPOOL *pool, int id)
+{
+   TPQUEUE *queue = pool->queues + id;
+   int     item   = (-1);
+
+   pthread_mutex_lock(&(queue->lock));
+   if(queue->next < queue->end)
+      item = (queue->next)++;
+   pthread_mutex_unlock(&(queue->lock));
+
+   return(item);
+}
+
+/************************************************************************/
+/* Moves the back half of the first other block with items left into
+   the (empty) block of thread id and takes the first of them. Returns
+   -1 if every other block is empty.
+*/
+static int StealItems(THREADPOOL *pool, int id)
+{
+   TPQUEUE *victim,
+           *queue = pool->queues + id;
+   int     i, n, start, end;
+
+   for(i=1; i<pool->nthreads; i++)
+   {
+      victim = pool->queues + ((id + i) % pool->nthreads);
+
+      pthread_mutex_lock(&(victim->lock));
+      if((n = victim->end - victim->next) > 0)
+      {
+         end          = victim->end;
+         start        = end - (n+1)/2;
+         victim->end  = start;
+         pthread_mutex_unlock(&(victim->lock));
+
+         pthread_mutex_lock(&(queue->lock));
+         queue->next  = start + 1;
+         queue->end   = end;
+         pthread_mutex_unlock(&(queue->lock));
+         return(start);
+      }
+      pthread_mutex_unlock(&(victim->lock));
+   }
+
+   return(-1);
+}
+
+/************************************************************************/
+/* Marks an item finished and emits those which are now next in the
+   output order
+*/
+static void FinishItem(THREADPOOL *pool, int item)
+{
+   pthread_mutex_lock(&(pool->emitLock));
+   pool->done[(pool->rank == NULL) ? item : pool->rank[item]] = 1;
+   while((pool->nextEmit < pool->nitems) && pool->done[pool->nextEmit])
+   {
+      if(pool->emit != NULL)
+         (*pool->emit)(pool->shared, pool->itemAt[pool->nextEmit]);
+      (pool->nextEmit)++;
+   }
+   pthread_mutex_unlock(&(pool->emitLock));
+}
+
+/************************************************************************/
+/* Runs load() on items 0..nitems-1 in order on a thread of its own,
+   and use() on each loaded item using up to nthreads more threads,
+   the calling thread being one of them. use() is given what load()
+   returned for the item (which may be NULL) and must free it.
+   workers[] is as for RunThreadPool(). At most depth loaded items
+   wait to be used. If the loading thread cannot be started the items
+   are loaded and used in turn by the calling thread. Returns FALSE if
+   there was no memory to set up the pipeline.
+*/
+BOOL RunPipeline(int nthreads, int nitems, int depth, void *shared,
+                 void **workers, TPLOAD load, TPUSE use)
+{
+   TPPIPELINE pipe;
+   TPSTAGE    *stages;
+   pthread_t  loader,
+              *tids;
+   BOOL       *started;
+   int        i;
+
+   if(nitems <= 0)
+      return(TRUE);
+   if(nthreads > nitems)
+      nthreads = nitems;
+   if(nthreads < 1)
+      nthreads = 1;
+   if(depth < 1)
+      depth = 1;
+
+   pipe.load     = load;
+   pipe.use      = use;
+   pipe.shared   = shared;
+   pipe.workers  = workers;
+   pipe.depth    = depth;
+   pipe.head     = 0;
+   pipe.count    = 0;
+   pipe.nitems   = nitems;
+   pipe.finished = FALSE;
+
+   pipe.loaded = (void **)malloc(depth * sizeof(void *));
+   pipe.items  = (int *)malloc(depth * sizeof(int));
+   stages      = (TPSTAGE *)malloc(nthreads * sizeof(TPSTAGE));
+   tids        = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+   started     = (BOOL *)calloc(nthreads, sizeof(BOOL));
+   if((pipe.loaded == NULL) || (pipe.items == NULL) ||
+      (stages == NULL) || (tids == NULL) || (started == NULL))
+   {
+      if(pipe.loaded != NULL) free(pipe.loaded);
+      if(pipe.items  != NULL) free(pipe.items);
+      if(stages      != NULL) free(stages);
+      if(tids        != NULL) free(tids);
+      if(started     != NULL) free(started);
+      return(FALSE);
+   }
+
+   pthread_mutex_init(&(pipe.lock), NULL);
+   pthread_cond_init(&(pipe.notEmpty), NULL);
+   pthread_cond_init(&(pipe.notFull), NULL);
+
+   if(pthread_create(&loader, NULL, RunLoader, (void *)&pipe) == 0)
+   {
+      for(i=0; i<nthreads; i++)
+      {
+         stages[i].pipe = &pipe;
+         stages[i].id   = i;
+      }
+      for(i=1; i<nthreads; i++)
+         started[i] = (pthread_create(&(tids[i]), NULL, RunUser,
+                                      (void *)&(stages[i])) == 0);
+      RunUser((void *)&(stages[0]));
+      for(i=1; i<nthreads; i++)
+      {
+         if(started[i])
+            pthread_join(tids[i], NULL);
+      }
+      pthread_join(loader, NULL);
+   }
+   else
+   {
+      for(i=0; i<nitems; i++)
+         (*use)(shared, workers[0], i, (*load)(shared, i));
+   }
+
+   pthread_mutex_destroy(&(pipe.lock));
+   pthread_cond_destroy(&(pipe.notEmpty));
+   pthread_cond_destroy(&(pipe.notFull));
+
+   free(pipe.loaded);
+   free(pipe.items);
+   free(stages);
+   free(tids);
+   free(started);
+
+   return(TRUE);
+}
+
+/************************************************************************/
+/* Loads each item in turn and queues it, waiting while the queue is
+   full
+*/
+static void *RunLoader(void *arg)
+{
+   TPPIPELINE *pipe = (TPPIPELINE *)arg;
+   void       *loaded;
+   int        item, slot;
+
+   for(item=0; item<pipe->nitems; item++)
+   {
+      loaded = (*pipe->load)(pipe->shared, item);
+
+      pthread_mutex_lock(&(pipe->lock));
+      while(pipe->count == pipe->depth)
+         pthread_cond_wait(&(pipe->notFull), &(pipe->lock));
+      slot = (pipe->head + pipe->count) % pipe->depth;
+      pipe->loaded[slot] = loaded;
+      pipe->items[slot]  = item;
+      (pipe->count)++;
+      pthread_cond_signal(&(pipe->notEmpty));
+      pthread_mutex_unlock(&(pipe->lock));
+   }
+
+   pthread_mutex_lock(&(pipe->lock));
+   pipe->finished = TRUE;
+   pthread_cond_broadcast(&(pipe->notEmpty));
+   pthread_mutex_unlock(&(pipe->lock));
+
+   return(NULL);
+}
+
+/************************************************************************/
+/* Takes loaded items from the queue and uses them until the loader
+   has finished and the queue is empty
+*/
+static void *RunUser(void *arg)
+{
+   TPSTAGE    *stage = (TPSTAGE *)arg;
+   TPPIPELINE *pipe  = stage->pipe;
+   void       *loaded;
+   int        item;
+
+   for(;;)
+   {
+      pthread_mutex_lock(&(pipe->lock));
+      while((pipe->count == 0) && !pipe->finished)
+         pthread_cond_wait(&(pipe->notEmpty), &(pipe->lock));
+      if(pipe->count == 0)
+      {
+         pthread_mutex_unlock(&(pipe->lock));
+         break;
+      }
+      loaded     = pipe->loaded[pipe->head];
+      item       = pipe->items[pipe->head];
+      pipe->head = (pipe->head + 1) % pipe->depth;
+      (pipe->count)--;
+      pthread_cond_signal(&(pipe->notFull));
+      pthread_mutex_unlock(&(pipe->lock));
+
+      (*pipe->use)(pipe->shared, pipe->workers[stage->id], item, loaded);
+   }
+
+   return(NULL);
+}
+
+/************************************************************************/
+/* Returns the number of processors online, for -t 0                    */
+int NumberOfProcessors(void)
+{
+   long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+   return((n < 1) ? 1 : (int)n);
+}
+
+/************************************************************************/
+/* Brackets calls that must not be made by two threads at once          */
+void BeginSerialSection(void)
+{
+   pthread_mutex_lock(&gSerialLock);
+}
+
+/************************************************************************/
+void EndSerialSection(void)
+{
+   pthread_mutex_unlock(&gSerialLock);
+}
@@ -0,0 +1,32 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/* A pool of threads running a fixed number of independent items of
+   work (threadpool.c). Each thread starts with its own block of
+   items and steals half of what another thread has left when its
+   own run out. task() is called in the threads; emit() is called
+   for each finished item in the order given by rank[] (or in item
+   order if rank is NULL), one at a time, as soon as all the items
+   before it have finished.
+
+   RunPipeline() runs load() on each item in order on a thread of its
+   own and passes what it returns to use() on the pool threads,
+   holding no more than depth loaded items between the two.
+
+   The header relies on bioplib/SysDefs.h having been included.
+*/
+typedef void (*TPTASK)(void *shared, void *worker, int item);
+typedef void (*TPEMIT)(void *shared, int item);
+typedef void *(*TPLOAD)(void *shared, int item);
+typedef void (*TPUSE)(void *shared, void *worker, int item,
+                      void *loaded);
+
+BOOL RunThreadPool(int nthreads, int nitems, int *rank, void *shared,
+                   void **workers, TPTASK task, TPEMIT emit);
+BOOL RunPipeline(int nthreads, int nitems, int depth, void *shared,
+                 void **workers, TPLOAD load, TPUSE use);
+int  NumberOfProcessors(void);
+void BeginSerialSection(void);
+void EndSerialSection(void);
+
+#endif